@@ -19,6 +19,8 @@
 #ifndef DETOURCOMMON_H
 #define DETOURCOMMON_H
 
+#include "DetourSimd.h"
+
 
 /**
 
@@ -379,6 +381,45 @@ inline bool dtOverlapQuantBounds(const unsigned short amin[3], const unsigned sh
 	return overlap;
 }
 
+/// Determines which of four axis-aligned bounding boxes overlap a box.
+///  @param[in]		amin	Minimum bounds of box A. [(x, y, z)]
+///  @param[in]		amax	Maximum bounds of box A. [(x, y, z)]
+///  @param[in]		bmin	Minimum bounds of the four boxes, stored by axis. [(x, y, z)][box]
+///  @param[in]		bmax	Maximum bounds of the four boxes, stored by axis. [(x, y, z)][box]
+/// @return A mask whose bit i is set if box A overlaps the box i.
+/// @see dtOverlapQuantBounds
+inline unsigned int dtOverlapQuantBounds4(const unsigned short amin[3], const unsigned short amax[3],
+										  const unsigned short bmin[3][4], const unsigned short bmax[3][4])
+{
+#ifdef DT_SIMD_SSE2
+	// SSE2 only compares signed integers, the bounds are shifted to keep their order
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	__m128i outside = _mm_setzero_si128();
+	for (int i = 0; i < 3; ++i)
+	{
+		const __m128i nmin = _mm_xor_si128(_mm_loadl_epi64((const __m128i*)bmin[i]), bias);
+		const __m128i nmax = _mm_xor_si128(_mm_loadl_epi64((const __m128i*)bmax[i]), bias);
+		const __m128i qmin = _mm_set1_epi16((short)(amin[i] ^ 0x8000));
+		const __m128i qmax = _mm_set1_epi16((short)(amax[i] ^ 0x8000));
+		outside = _mm_or_si128(outside, _mm_or_si128(_mm_cmpgt_epi16(qmin, nmax), _mm_cmpgt_epi16(nmin, qmax)));
+	}
+	// One bit per box once packed to bytes
+	return ~(unsigned int)_mm_movemask_epi8(_mm_packs_epi16(outside, outside)) & 0xf;
+#else
+	unsigned int mask = 0;
+	for (int j = 0; j < 4; ++j)
+	{
+		bool overlap = true;
+		overlap = (amin[0] > bmax[0][j] || amax[0] < bmin[0][j]) ? false : overlap;
+		overlap = (amin[1] > bmax[1][j] || amax[1] < bmin[1][j]) ? false : overlap;
+		overlap = (amin[2] > bmax[2][j] || amax[2] < bmin[2][j]) ? false : overlap;
+		if (overlap)
+			mask |= 1u << j;
+	}
+	return mask;
+#endif
+}
+
 /// Determines if two axis-aligned bounding boxes overlap.
 ///  @param[in]		amin	Minimum bounds of box A. [(x, y, z)]
 ///  @param[in]		amax	Maximum bounds of box A. [(x, y, z)]
@@ -49,6 +49,10 @@ static const int DT_NAVMESH_MAGIC = 'D'<<24 | 'N'<<16 | 'A'<<8 | 'V';
 /// A version number used to detect compatibility of navigation tile data.
 static const int DT_NAVMESH_VERSION = 7;
 
+/// The version number of the navigation tile data storing a 4-wide bounding volume tree (#dtBVNode4).
+/// The rest of the data is the same as in #DT_NAVMESH_VERSION.
+static const int DT_NAVMESH_VERSION_WIDE_BVH = 8;
+
 /// A magic number used to detect the compatibility of navigation tile states.
 static const int DT_NAVMESH_STATE_MAGIC = 'D'<<24 | 'N'<<16 | 'M'<<8 | 'S';
 
@@ -173,6 +177,27 @@ struct dtBVNode
 	int i;							///< The node's index. (Negative for escape sequence.)
 };
 
+/// The number of children of a node of a wide bounding volume tree.
+static const int DT_BVH_WIDTH = 4;
+
+/// The size of the stack used to traverse a wide bounding volume tree.
+/// It is enough for any tree built for the 2^16 polygons a tile can have.
+static const int DT_BVH_STACK_SIZE = 64;
+
+/// Wide bounding volume node.
+/// The bounds of the children are stored by axis, so they can be tested against a box at once.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile, #DT_NAVMESH_VERSION_WIDE_BVH
+struct dtBVNode4
+{
+	unsigned short bmin[3][DT_BVH_WIDTH];	///< Minimum bounds of the children's AABBs. [(x, y, z)][child]
+	unsigned short bmax[3][DT_BVH_WIDTH];	///< Maximum bounds of the children's AABBs. [(x, y, z)][child]
+	
+	/// The children. A positive value is the index of a node, a negative one the complement (~) of the index 
+	/// of a polygon, and 0 an empty child.
+	int children[DT_BVH_WIDTH];
+};
+
 /// Defines an navigation mesh off-mesh connection within a dtMeshTile object.
 /// An off-mesh connection is a user defined traversable connection made up to two vertices.
 struct dtOffMeshConnection
@@ -217,7 +242,7 @@ struct dtMeshHeader
 	int detailVertCount;
 	
 	int detailTriCount;			///< The number of triangles in the detail mesh.
-	int bvNodeCount;			///< The number of bounding volume nodes. (Zero if bounding volumes are disabled.)
+	int bvNodeCount;			///< The number of bounding volume nodes, binary or wide depending on the version. (Zero if bounding volumes are disabled.)
 	int offMeshConCount;		///< The number of off-mesh connections.
 	int offMeshBase;			///< The index of the first polygon which is an off-mesh connection.
 	float walkableHeight;		///< The height of the agents using the tile.
@@ -250,9 +275,13 @@ struct dtMeshTile
 	unsigned char* detailTris;	
 
 	/// The tile bounding volume nodes. [Size: dtMeshHeader::bvNodeCount]
-	/// (Will be null if bounding volumes are disabled.)
+	/// (Will be null if bounding volumes are disabled or wide.)
 	dtBVNode* bvTree;
 
+	/// The tile wide bounding volume nodes, the root being the first one. [Size: dtMeshHeader::bvNodeCount]
+	/// (Will be null unless the tile data is #DT_NAVMESH_VERSION_WIDE_BVH.)
+	dtBVNode4* bvTree4;
+
 	dtOffMeshConnection* offMeshCons;		///< The tile off-mesh connections. [Size: dtMeshHeader::offMeshConCount]
 		
 	unsigned char* data;					///< The tile data. (Not directly accessed under normal situations.)
@@ -365,6 +394,12 @@ public:
 	/// The maximum number of tiles supported by the navigation mesh.
 	/// @return The maximum number of tiles supported by the navigation mesh.
 	int getMaxTiles() const;
+
+	/// Gets the revision of the navigation mesh.
+	/// The revision changes every time a tile is added or removed, or the state of a polygon changes, 
+	/// so data derived from the navigation mesh can be cached until it does.
+	/// @return The revision of the navigation mesh.
+	unsigned int getRevision() const { return m_revision; }
 	
 	/// Gets the tile at the specified index.
 	///  @param[in]	i		The tile index. [Limit: 0 >= index < #getMaxTiles()]
@@ -579,6 +614,8 @@ private:
 	unsigned int m_saltBits;			///< Number of salt bits in the tile ID.
 	unsigned int m_tileBits;			///< Number of tile bits in the tile ID.
 	unsigned int m_polyBits;			///< Number of poly bits in the tile ID.
+
+	unsigned int m_revision;			///< Incremented every time the tiles or the state of the polygons change.
 };
 
 /// Allocates a navigation mesh object using the Detour allocator.
@@ -101,6 +101,10 @@ struct dtNavMeshCreateParams
 	/// @note The BVTree is not normally needed for layered navigation meshes.
 	bool buildBvTree;
 
+	/// True if the bounding volume tree should have four children per node (#dtBVNode4),
+	/// which is faster to query for tiles with many polygons. The tile data is then #DT_NAVMESH_VERSION_WIDE_BVH.
+	bool buildWideBvTree;
+
 	/// @}
 };
 
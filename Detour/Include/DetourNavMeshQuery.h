@@ -130,6 +130,12 @@ public:
 	/// @returns The status flags for the query.
 	dtStatus init(const dtNavMesh* nav, const int maxNodes);
 	
+	/// Makes the path searches sort their open nodes in buckets of total cost instead of a heap.
+	///  @param[in]		bucketWidth	The range of total costs of a bucket, 0 to use the heap. [Limit: >= 0]
+	///  @param[in]		nbBuckets	The number of buckets, rounded up to a power of two. [Limit: > 0]
+	/// @returns The status flags for the query.
+	dtStatus setOpenListBuckets(const float bucketWidth, const int nbBuckets);
+	
 	/// @name Standard Pathfinding Functions
 	// /@{
 
@@ -264,6 +270,31 @@ public:
 	dtStatus findNearestPoly(const float* center, const float* extents,
 							 const dtQueryFilter* filter,
 							 dtPolyRef* nearestRef, float* nearestPt) const;
+
+	/// Finds the polygon containing a point, starting from a polygon close to it.
+	///  @param[in]		hintRef		The reference id of a polygon close to the point, usually the previous location. [opt]
+	///  @param[in]		pos			The point to locate. [(x, y, z)]
+	///  @param[in]		extents		The search distance along each axis, used if the point is not reached from the hint. [(x, y, z)]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[out]	ref			The reference id of the polygon found.
+	///  @param[out]	nearest		The nearest point on the polygon. [opt] [(x, y, z)]
+	///  @param[out]	fromHint	True if the polygon was reached from the hint, false if the BV trees were queried. [opt]
+	/// @returns The status flags for the query.
+	dtStatus locatePoint(dtPolyRef hintRef, const float* pos, const float* extents,
+						 const dtQueryFilter* filter,
+						 dtPolyRef* ref, float* nearest, bool* fromHint = 0) const;
+
+	/// Finds the polygons nearest to several center points.
+	///  @param[in]		centers		The centers of the search boxes. [(x, y, z) * nbQueries]
+	///  @param[in]		nbQueries	The number of center points.
+	///  @param[in]		extents		The search distance along each axis, shared by every query. [(x, y, z)]
+	///  @param[in]		filter		The polygon filter to apply to the queries.
+	///  @param[out]	nearestRefs	The reference ids of the nearest polygons. [Size: nbQueries]
+	///  @param[out]	nearestPts	The nearest points on the polygons. [opt] [(x, y, z) * nbQueries]
+	/// @returns The status flags for the query.
+	dtStatus findNearestPolyBatch(const float* centers, const int nbQueries, const float* extents,
+								  const dtQueryFilter* filter,
+								  dtPolyRef* nearestRefs, float* nearestPts) const;
 	
 	/// Finds polygons that overlap the search box.
 	///  @param[in]		center		The center of the search box. [(x, y, z)]
@@ -433,6 +464,11 @@ private:
 	/// Find nearest polygon within a tile.
 	dtPolyRef findNearestPolyInTile(const dtMeshTile* tile, const float* center, const float* extents,
 									const dtQueryFilter* filter, float* nearestPt) const;
+	/// Updates the nearest polygons of up to 8 queries with the polygons of a tile,
+	/// traversing its BV tree once for all of them.
+	void findNearestPolyInTilePacket(const dtMeshTile* tile, const float* centers, const int* queries, const int nbQueries,
+									 const float* extents, const dtQueryFilter* filter,
+									 dtPolyRef* nearestRefs, float* nearestPts, float* nearestDistSqr) const;
 	/// Returns closest point on polygon.
 	void closestPointOnPolyInTile(const dtMeshTile* tile, const dtPoly* poly, const float* pos, float* closest) const;
 	
@@ -38,12 +38,20 @@ struct dtNode
 	unsigned int pidx : 30;		///< Index to parent node.
 	unsigned int flags : 2;		///< Node flags 0/open/closed.
 	dtPolyRef id;				///< Polygon ref the node corresponds to.
+	int qidx;					///< Position of the node in the open list, only valid while it is open.
 };
 
 
+/// Pool of the nodes of a search, indexed by polygon.
+///
+/// The nodes are found through an open addressing hash table whose slots are stamped with the generation
+/// of the pool. Clearing the pool only starts a new generation, the slots of the previous ones being seen as empty,
+/// so it does not depend on the size of the pool.
 class dtNodePool
 {
 public:
+	/// @param[in]	maxNodes	The maximum number of nodes of the pool. [Limit: > 0, < 65535]
+	/// @param[in]	hashSize	The number of slots of the hash table, a power of two. [Limit: > maxNodes]
 	dtNodePool(int maxNodes, int hashSize);
 	~dtNodePool();
 	inline void operator=(const dtNodePool&) {}
@@ -73,26 +81,51 @@ public:
 	{
 		return sizeof(*this) +
 			sizeof(dtNode)*m_maxNodes +
-			sizeof(dtNodeIndex)*m_maxNodes +
-			sizeof(dtNodeIndex)*m_hashSize;
+			sizeof(Slot)*m_hashSize;
 	}
 	
 	inline int getMaxNodes() const { return m_maxNodes; }
 	
+	/// Returns false if the nodes could not be allocated.
+	inline bool isValid() const { return m_nodes && m_slots; }
+	
 	inline int getHashSize() const { return m_hashSize; }
-	inline dtNodeIndex getFirst(int bucket) const { return m_first[bucket]; }
-	inline dtNodeIndex getNext(int i) const { return m_next[i]; }
+
+	/// Gets the number of nodes used since the last clear. Their indices are [1, getNodeCount()].
+	inline int getNodeCount() const { return m_nodeCount; }
 	
 private:
+	/// A slot of the hash table
+	struct Slot
+	{
+		dtPolyRef id;				///< The polygon of the node
+		dtNodeIndex idx;			///< The index of the node
+		unsigned short generation;	///< The generation of the pool when the slot was used
+	};
+
+	/// Finds the slot of the given polygon, or the empty slot where it would be stored.
+	inline Slot* findSlot(dtPolyRef id);
 	
 	dtNode* m_nodes;
-	dtNodeIndex* m_first;
-	dtNodeIndex* m_next;
+	Slot* m_slots;
 	const int m_maxNodes;
 	const int m_hashSize;
 	int m_nodeCount;
+	unsigned short m_generation;	///< The generation of the slots used since the last clear, never 0
 };
 
+/// The number of children of a node of the heap of a dtNodeQueue.
+static const int DT_NODE_QUEUE_ARITY = 4;
+
+/// Open list of a search, giving the open node of least total cost.
+///
+/// By default, the nodes are kept in a 4-ary heap. The position of a node in the heap is stored in the node, 
+/// so modify() does not search it.
+///
+/// The queue can instead sort the nodes in buckets of total costs (see initBuckets()), the nodes of a bucket being
+/// searched at every pop, so the buckets must be narrow. It requires the total cost of the nodes pushed to never be
+/// less than the one of the last node popped, which is the case of the A* searches when no traversal cost is less
+/// than the distance.
 class dtNodeQueue
 {
 public:
@@ -100,18 +133,28 @@ public:
 	~dtNodeQueue();
 	inline void operator=(dtNodeQueue&) {}
 	
-	inline void clear()
-	{
-		m_size = 0;
-	}
+	/// Makes the queue use buckets instead of a heap.
+	///
+	/// The nodes whose total cost is beyond the last bucket are kept in an overflow list, and are moved to the
+	/// buckets once the buckets reach their cost. The nodes of the same bucket are popped by total cost.
+	///
+	/// @param[in]	bucketWidth	The range of total costs of a bucket, 0 to use the heap. [Limit: >= 0]
+	/// @param[in]	nbBuckets	The number of buckets, rounded up to a power of two. [Limit: > 0]
+	/// @return False if the buckets could not be allocated, the queue then uses the heap.
+	bool initBuckets(const float bucketWidth, const int nbBuckets);
+	
+	void clear();
 	
 	inline dtNode* top()
 	{
-		return m_heap[0];
+		return m_bucketWidth > 0 ? m_heap[findBucketTop()] : m_heap[0];
 	}
 	
 	inline dtNode* pop()
 	{
+		if (m_bucketWidth > 0)
+			return popBucket();
+		
 		dtNode* result = m_heap[0];
 		m_size--;
 		trickleDown(0, m_heap[m_size]);
@@ -120,20 +163,27 @@ public:
 	
 	inline void push(dtNode* node)
 	{
+		if (m_bucketWidth > 0)
+		{
+			pushBucket(node);
+			return;
+		}
+		
 		m_size++;
 		bubbleUp(m_size-1, node);
 	}
 	
+	/// Updates the position of a node whose total cost decreased.
 	inline void modify(dtNode* node)
 	{
-		for (int i = 0; i < m_size; ++i)
+		if (m_bucketWidth > 0)
 		{
-			if (m_heap[i] == node)
-			{
-				bubbleUp(i, node);
-				return;
-			}
+			unlinkBucket(node->qidx);
+			linkBucket(node->qidx, node);
+			return;
 		}
+		
+		bubbleUp(node->qidx, node);
 	}
 	
 	inline bool empty() const { return m_size == 0; }
@@ -141,18 +191,48 @@ public:
 	inline int getMemUsed() const
 	{
 		return sizeof(*this) +
-		sizeof(dtNode*)*(m_capacity+1);
+		sizeof(dtNode*)*(m_capacity+1) +
+		(m_bucketWidth > 0 ? sizeof(int)*(3*m_capacity + m_nbBuckets) : 0);
 	}
 	
 	inline int getCapacity() const { return m_capacity; }
 	
+	/// Returns false if the heap could not be allocated.
+	inline bool isValid() const { return m_heap != 0; }
+	
+	inline float getBucketWidth() const { return m_bucketWidth; }
+	inline int getBucketCount() const { return m_nbBuckets; }
+	
 private:
 	void bubbleUp(int i, dtNode* node);
 	void trickleDown(int i, dtNode* node);
 	
-	dtNode** m_heap;
+	void pushBucket(dtNode* node);
+	dtNode* popBucket();
+	int findBucketTop();
+	void linkBucket(int slot, dtNode* node);
+	void unlinkBucket(int slot);
+	void redistributeOverflow();
+	void purgeBuckets();
+	
+	dtNode** m_heap;		///< The heap, or the nodes of the buckets indexed by slot
 	const int m_capacity;
 	int m_size;
+	
+	float m_bucketWidth;	///< The range of total costs of a bucket, 0 if the heap is used
+	float m_invBucketWidth;	///< The inverse of the range of total costs of a bucket
+	int m_nbBuckets;		///< The number of buckets (power of two)
+	int* m_buckets;			///< The first slot of every bucket, -1 if empty [Size: m_nbBuckets]
+	int* m_next;			///< The next slot of the bucket of every slot, or the next free slot [Size: m_capacity]
+	int* m_prev;			///< The previous slot of the bucket of every slot, -1 if first [Size: m_capacity]
+	int* m_slotBuckets;		///< The bucket of every slot, not wrapped around, -1 in the overflow list [Size: m_capacity]
+	int m_nbSlots;			///< The number of slots ever used since the last clear
+	int m_freeSlot;			///< The first free slot, -1 if none
+	float m_baseCost;		///< The total cost of the start of the first bucket
+	int m_currentBucket;	///< The first bucket which may not be empty, not wrapped around
+	int m_overflow;			///< The first slot of the nodes beyond the last bucket, -1 if none
+	int m_nbOverflow;		///< The number of nodes in the overflow list
+	float m_overflowCost;	///< The lowest total cost of the overflow list when its nodes were added
 };		
 
 
@@ -0,0 +1,39 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+
+#ifndef DETOURSIMD_H
+#define DETOURSIMD_H
+
+/**
+@file DetourSimd.h
+Selection of the SIMD instruction sets used by the vectorized code paths.
+
+@def DT_SIMD_SSE2
+Defined when the SSE2 instruction set is available.
+
+SSE2 is part of every x86-64 processor, so it is detected at compile time and no runtime check is needed.
+On other platforms, or when @c DT_NO_SIMD is defined, only the scalar code paths are compiled.
+*/
+
+#if !defined(DT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#	define DT_SIMD_SSE2 1
+#	include <emmintrin.h>
+#endif
+
+#endif // DETOURSIMD_H
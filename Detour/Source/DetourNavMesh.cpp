@@ -196,7 +196,8 @@ dtNavMesh::dtNavMesh() :
 	m_tiles(0),
 	m_saltBits(0),
 	m_tileBits(0),
-	m_polyBits(0)
+	m_polyBits(0),
+	m_revision(0)
 {
 	memset(&m_params, 0, sizeof(dtNavMeshParams));
 	m_orig[0] = 0;
@@ -221,6 +222,8 @@ dtNavMesh::~dtNavMesh()
 		
 dtStatus dtNavMesh::init(const dtNavMeshParams* params)
 {
+	++m_revision;
+
 	memcpy(&m_params, params, sizeof(dtNavMeshParams));
 	dtVcopy(m_orig, params->orig);
 	m_tileWidth = params->tileWidth;
@@ -265,7 +268,7 @@ dtStatus dtNavMesh::init(unsigned char* data, const int dataSize, const int flag
 	dtMeshHeader* header = (dtMeshHeader*)data;
 	if (header->magic != DT_NAVMESH_MAGIC)
 		return DT_FAILURE | DT_WRONG_MAGIC;
-	if (header->version != DT_NAVMESH_VERSION)
+	if (header->version != DT_NAVMESH_VERSION && header->version != DT_NAVMESH_VERSION_WIDE_BVH)
 		return DT_FAILURE | DT_WRONG_VERSION;
 
 	dtNavMeshParams params;
@@ -714,10 +717,8 @@ dtPolyRef dtNavMesh::findNearestPolyInTile(const dtMeshTile* tile,
 int dtNavMesh::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, const float* qmax,
 								   dtPolyRef* polys, const int maxPolys) const
 {
-	if (tile->bvTree)
+	if (tile->bvTree || tile->bvTree4)
 	{
-		const dtBVNode* node = &tile->bvTree[0];
-		const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
 		const float* tbmin = tile->header->bmin;
 		const float* tbmax = tile->header->bmax;
 		const float qfac = tile->header->bvQuantFactor;
@@ -742,6 +743,44 @@ int dtNavMesh::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, co
 		// Traverse tree
 		dtPolyRef base = getPolyRefBase(tile);
 		int n = 0;
+		
+		if (tile->bvTree4)
+		{
+			// Depth first, testing all the children of a node at once
+			int stack[DT_BVH_STACK_SIZE];
+			int nstack = 0;
+			stack[nstack++] = 0;
+			
+			while (nstack > 0)
+			{
+				const dtBVNode4* node = &tile->bvTree4[stack[--nstack]];
+				const unsigned int overlap = dtOverlapQuantBounds4(bmin, bmax, node->bmin, node->bmax);
+				
+				// The overlapping leaves are stored, the overlapping nodes are visited later
+				for (int j = DT_BVH_WIDTH-1; j >= 0; --j)
+				{
+					const int child = node->children[j];
+					if (!(overlap & (1u << j)) || !child)
+						continue;
+					
+					if (child < 0)
+					{
+						if (n < maxPolys)
+							polys[n++] = base | (dtPolyRef)~child;
+					}
+					else
+					{
+						dtAssert(nstack < DT_BVH_STACK_SIZE);
+						stack[nstack++] = child;
+					}
+				}
+			}
+			
+			return n;
+		}
+		
+		const dtBVNode* node = &tile->bvTree[0];
+		const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
 		while (node < end)
 		{
 			const bool overlap = dtOverlapQuantBounds(bmin, bmax, node->bmin, node->bmax);
@@ -813,8 +852,9 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	dtMeshHeader* header = (dtMeshHeader*)data;
 	if (header->magic != DT_NAVMESH_MAGIC)
 		return DT_FAILURE | DT_WRONG_MAGIC;
-	if (header->version != DT_NAVMESH_VERSION)
+	if (header->version != DT_NAVMESH_VERSION && header->version != DT_NAVMESH_VERSION_WIDE_BVH)
 		return DT_FAILURE | DT_WRONG_VERSION;
+	const bool wideBvTree = header->version == DT_NAVMESH_VERSION_WIDE_BVH;
 		
 	// Make sure the location is free.
 	if (getTileAt(header->x, header->y, header->layer))
@@ -876,7 +916,7 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*header->detailMeshCount);
 	const int detailVertsSize = dtAlign4(sizeof(float)*3*header->detailVertCount);
 	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*header->detailTriCount);
-	const int bvtreeSize = dtAlign4(sizeof(dtBVNode)*header->bvNodeCount);
+	const int bvtreeSize = wideBvTree ? dtAlign4(sizeof(dtBVNode4)*header->bvNodeCount) : dtAlign4(sizeof(dtBVNode)*header->bvNodeCount);
 	const int offMeshLinksSize = dtAlign4(sizeof(dtOffMeshConnection)*header->offMeshConCount);
 	
 	unsigned char* d = data + headerSize;
@@ -886,12 +926,17 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	tile->detailMeshes = (dtPolyDetail*)d; d += detailMeshesSize;
 	tile->detailVerts = (float*)d; d += detailVertsSize;
 	tile->detailTris = (unsigned char*)d; d += detailTrisSize;
-	tile->bvTree = (dtBVNode*)d; d += bvtreeSize;
+	tile->bvTree = wideBvTree ? 0 : (dtBVNode*)d;
+	tile->bvTree4 = wideBvTree ? (dtBVNode4*)d : 0;
+	d += bvtreeSize;
 	tile->offMeshCons = (dtOffMeshConnection*)d; d += offMeshLinksSize;
 
 	// If there are no items in the bvtree, reset the tree pointer.
 	if (!bvtreeSize)
+	{
 		tile->bvTree = 0;
+		tile->bvTree4 = 0;
+	}
 
 	// Build links freelist
 	tile->linksFreeList = 0;
@@ -941,6 +986,8 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	
 	if (result)
 		*result = getTileRef(tile);
+
+	++m_revision;
 	
 	return DT_SUCCESS;
 }
@@ -1206,6 +1253,7 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	tile->detailVerts = 0;
 	tile->detailTris = 0;
 	tile->bvTree = 0;
+	tile->bvTree4 = 0;
 	tile->offMeshCons = 0;
 
 	// Update salt, salt should never be zero.
@@ -1217,6 +1265,8 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	tile->next = m_nextFree;
 	m_nextFree = tile;
 
+	++m_revision;
+
 	return DT_SUCCESS;
 }
 
@@ -1333,6 +1383,8 @@ dtStatus dtNavMesh::restoreTileState(dtMeshTile* tile, const unsigned char* data
 		p->flags = s->flags;
 		p->setArea(s->area);
 	}
+
+	++m_revision;
 	
 	return DT_SUCCESS;
 }
@@ -1425,6 +1477,7 @@ dtStatus dtNavMesh::setPolyFlags(dtPolyRef ref, unsigned short flags)
 	
 	// Change flags.
 	poly->flags = flags;
+	++m_revision;
 	
 	return DT_SUCCESS;
 }
@@ -1457,6 +1510,7 @@ dtStatus dtNavMesh::setPolyArea(dtPolyRef ref, unsigned char area)
 	dtPoly* poly = &tile->polys[ip];
 	
 	poly->setArea(area);
+	++m_revision;
 	
 	return DT_SUCCESS;
 }
@@ -169,10 +169,87 @@ static void subdivide(BVItem* items, int nitems, int imin, int imax, int& curNod
 	}
 }
 
+static void sortItems(BVItem* items, int nitems, int imin, int imax)
+{
+	unsigned short bmin[3], bmax[3];
+	calcExtends(items, nitems, imin, imax, bmin, bmax);
+	
+	int	axis = longestAxis(bmax[0] - bmin[0],
+						   bmax[1] - bmin[1],
+						   bmax[2] - bmin[2]);
+	
+	if (axis == 0)
+		qsort(items+imin, imax-imin, sizeof(BVItem), compareItemX);
+	else if (axis == 1)
+		qsort(items+imin, imax-imin, sizeof(BVItem), compareItemY);
+	else
+		qsort(items+imin, imax-imin, sizeof(BVItem), compareItemZ);
+}
+
+static int subdivideWide(BVItem* items, int nitems, int imin, int imax, int& curNode, dtBVNode4* nodes)
+{
+	const int inum = imax - imin;
+	const int icur = curNode++;
+	
+	// Split the items in up to four ranges, halving them twice along their longest axis.
+	int ranges[DT_BVH_WIDTH+1];
+	int nranges = 0;
+	if (inum <= DT_BVH_WIDTH)
+	{
+		for (int i = 0; i <= inum; ++i)
+			ranges[i] = imin + i;
+		nranges = inum;
+	}
+	else
+	{
+		sortItems(items, nitems, imin, imax);
+		const int isplit = imin+inum/2;
+		sortItems(items, nitems, imin, isplit);
+		sortItems(items, nitems, isplit, imax);
+		
+		ranges[0] = imin;
+		ranges[1] = imin+(isplit-imin)/2;
+		ranges[2] = isplit;
+		ranges[3] = isplit+(imax-isplit)/2;
+		ranges[4] = imax;
+		nranges = 4;
+	}
+	
+	for (int j = 0; j < DT_BVH_WIDTH; ++j)
+	{
+		if (j >= nranges)
+		{
+			// Empty child, its bounds overlap nothing.
+			for (int k = 0; k < 3; ++k)
+			{
+				nodes[icur].bmin[k][j] = 0xffff;
+				nodes[icur].bmax[k][j] = 0;
+			}
+			nodes[icur].children[j] = 0;
+			continue;
+		}
+		
+		unsigned short bmin[3], bmax[3];
+		calcExtends(items, nitems, ranges[j], ranges[j+1], bmin, bmax);
+		for (int k = 0; k < 3; ++k)
+		{
+			nodes[icur].bmin[k][j] = bmin[k];
+			nodes[icur].bmax[k][j] = bmax[k];
+		}
+		
+		if (ranges[j+1] - ranges[j] == 1)
+			nodes[icur].children[j] = ~items[ranges[j]].i;
+		else
+			nodes[icur].children[j] = subdivideWide(items, nitems, ranges[j], ranges[j+1], curNode, nodes);
+	}
+	
+	return icur;
+}
+
 static int createBVTree(const unsigned short* verts, const int /*nverts*/,
 						const unsigned short* polys, const int npolys, const int nvp,
 						const float cs, const float ch,
-						const int /*nnodes*/, dtBVNode* nodes)
+						const int nnodes, dtBVNode* nodes, dtBVNode4* wideNodes)
 {
 	// Build tree
 	BVItem* items = (BVItem*)dtAlloc(sizeof(BVItem)*npolys, DT_ALLOC_TEMP);
@@ -207,7 +284,11 @@ static int createBVTree(const unsigned short* verts, const int /*nverts*/,
 	}
 	
 	int curNode = 0;
-	subdivide(items, npolys, 0, npolys, curNode, nodes);
+	if (wideNodes)
+		subdivideWide(items, npolys, 0, npolys, curNode, wideNodes);
+	else
+		subdivide(items, npolys, 0, npolys, curNode, nodes);
+	dtAssert(curNode <= nnodes);
 	
 	dtFree(items);
 	
@@ -405,7 +486,10 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*params->polyCount);
 	const int detailVertsSize = dtAlign4(sizeof(float)*3*uniqueDetailVertCount);
 	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*detailTriCount);
-	const int bvTreeSize = params->buildBvTree ? dtAlign4(sizeof(dtBVNode)*params->polyCount*2) : 0;
+	// A wide tree has less internal nodes than leaves.
+	const bool wideBvTree = params->buildBvTree && params->buildWideBvTree;
+	const int bvNodeCount = params->buildBvTree ? (wideBvTree ? params->polyCount : params->polyCount*2) : 0;
+	const int bvTreeSize = wideBvTree ? dtAlign4(sizeof(dtBVNode4)*bvNodeCount) : dtAlign4(sizeof(dtBVNode)*bvNodeCount);
 	const int offMeshConsSize = dtAlign4(sizeof(dtOffMeshConnection)*storedOffMeshConCount);
 	
 	const int dataSize = headerSize + vertsSize + polysSize + linksSize +
@@ -428,13 +512,13 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	dtPolyDetail* navDMeshes = (dtPolyDetail*)d; d += detailMeshesSize;
 	float* navDVerts = (float*)d; d += detailVertsSize;
 	unsigned char* navDTris = (unsigned char*)d; d += detailTrisSize;
-	dtBVNode* navBvtree = (dtBVNode*)d; d += bvTreeSize;
+	unsigned char* navBvtree = d; d += bvTreeSize;
 	dtOffMeshConnection* offMeshCons = (dtOffMeshConnection*)d; d += offMeshConsSize;
 	
 	
 	// Store header
 	header->magic = DT_NAVMESH_MAGIC;
-	header->version = DT_NAVMESH_VERSION;
+	header->version = wideBvTree ? DT_NAVMESH_VERSION_WIDE_BVH : DT_NAVMESH_VERSION;
 	header->x = params->tileX;
 	header->y = params->tileY;
 	header->layer = params->tileLayer;
@@ -453,7 +537,7 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	header->walkableRadius = params->walkableRadius;
 	header->walkableClimb = params->walkableClimb;
 	header->offMeshConCount = storedOffMeshConCount;
-	header->bvNodeCount = params->buildBvTree ? params->polyCount*2 : 0;
+	header->bvNodeCount = bvNodeCount;
 	
 	const int offMeshVertsBase = params->vertCount;
 	const int offMeshPolyBase = params->polyCount;
@@ -599,7 +683,8 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	if (params->buildBvTree)
 	{
 		createBVTree(params->verts, params->vertCount, params->polys, params->polyCount,
-					 nvp, params->cs, params->ch, params->polyCount*2, navBvtree);
+					 nvp, params->cs, params->ch, bvNodeCount, 
+					 wideBvTree ? 0 : (dtBVNode*)navBvtree, wideBvTree ? (dtBVNode4*)navBvtree : 0);
 	}
 	
 	// Store Off-Mesh connections.
@@ -638,11 +723,13 @@ bool dtNavMeshHeaderSwapEndian(unsigned char* data, const int /*dataSize*/)
 	
 	int swappedMagic = DT_NAVMESH_MAGIC;
 	int swappedVersion = DT_NAVMESH_VERSION;
+	int swappedWideVersion = DT_NAVMESH_VERSION_WIDE_BVH;
 	dtSwapEndian(&swappedMagic);
 	dtSwapEndian(&swappedVersion);
+	dtSwapEndian(&swappedWideVersion);
 	
-	if ((header->magic != DT_NAVMESH_MAGIC || header->version != DT_NAVMESH_VERSION) &&
-		(header->magic != swappedMagic || header->version != swappedVersion))
+	if ((header->magic != DT_NAVMESH_MAGIC || (header->version != DT_NAVMESH_VERSION && header->version != DT_NAVMESH_VERSION_WIDE_BVH)) &&
+		(header->magic != swappedMagic || (header->version != swappedVersion && header->version != swappedWideVersion)))
 	{
 		return false;
 	}
@@ -690,8 +777,9 @@ bool dtNavMeshDataSwapEndian(unsigned char* data, const int /*dataSize*/)
 	dtMeshHeader* header = (dtMeshHeader*)data;
 	if (header->magic != DT_NAVMESH_MAGIC)
 		return false;
-	if (header->version != DT_NAVMESH_VERSION)
+	if (header->version != DT_NAVMESH_VERSION && header->version != DT_NAVMESH_VERSION_WIDE_BVH)
 		return false;
+	const bool wideBvTree = header->version == DT_NAVMESH_VERSION_WIDE_BVH;
 	
 	// Patch header pointers.
 	const int headerSize = dtAlign4(sizeof(dtMeshHeader));
@@ -701,7 +789,7 @@ bool dtNavMeshDataSwapEndian(unsigned char* data, const int /*dataSize*/)
 	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*header->detailMeshCount);
 	const int detailVertsSize = dtAlign4(sizeof(float)*3*header->detailVertCount);
 	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*header->detailTriCount);
-	const int bvtreeSize = dtAlign4(sizeof(dtBVNode)*header->bvNodeCount);
+	const int bvtreeSize = wideBvTree ? dtAlign4(sizeof(dtBVNode4)*header->bvNodeCount) : dtAlign4(sizeof(dtBVNode)*header->bvNodeCount);
 	const int offMeshLinksSize = dtAlign4(sizeof(dtOffMeshConnection)*header->offMeshConCount);
 	
 	unsigned char* d = data + headerSize;
@@ -711,7 +799,7 @@ bool dtNavMeshDataSwapEndian(unsigned char* data, const int /*dataSize*/)
 	dtPolyDetail* detailMeshes = (dtPolyDetail*)d; d += detailMeshesSize;
 	float* detailVerts = (float*)d; d += detailVertsSize;
 	/*unsigned char* detailTris = (unsigned char*)d;*/ d += detailTrisSize;
-	dtBVNode* bvTree = (dtBVNode*)d; d += bvtreeSize;
+	unsigned char* bvTree = d; d += bvtreeSize;
 	dtOffMeshConnection* offMeshCons = (dtOffMeshConnection*)d; d += offMeshLinksSize;
 	
 	// Vertices
@@ -752,7 +840,22 @@ bool dtNavMeshDataSwapEndian(unsigned char* data, const int /*dataSize*/)
 	// BV-tree
 	for (int i = 0; i < header->bvNodeCount; ++i)
 	{
-		dtBVNode* node = &bvTree[i];
+		if (wideBvTree)
+		{
+			dtBVNode4* node = &((dtBVNode4*)bvTree)[i];
+			for (int j = 0; j < DT_BVH_WIDTH; ++j)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					dtSwapEndian(&node->bmin[k][j]);
+					dtSwapEndian(&node->bmax[k][j]);
+				}
+				dtSwapEndian(&node->children[j]);
+			}
+			continue;
+		}
+		
+		dtBVNode* node = &((dtBVNode*)bvTree)[i];
 		for (int j = 0; j < 3; ++j)
 		{
 			dtSwapEndian(&node->bmin[j]);
@@ -25,7 +25,9 @@
 #include "DetourCommon.h"
 #include "DetourAlloc.h"
 #include "DetourAssert.h"
+#include "DetourSimd.h"
 #include <new>
+#include <stdlib.h>
 
 /// @class dtQueryFilter
 ///
@@ -157,6 +159,42 @@ dtNavMeshQuery::~dtNavMeshQuery()
 	dtFree(m_openList);
 }
 
+/// Allocates a node pool, or returns null if the pool or its nodes could not be allocated.
+static dtNodePool* allocNodePool(const int maxNodes, const int hashSize)
+{
+	void* mem = dtAlloc(sizeof(dtNodePool), DT_ALLOC_PERM);
+	if (!mem)
+		return 0;
+	
+	dtNodePool* pool = new (mem) dtNodePool(maxNodes, hashSize);
+	if (!pool->isValid())
+	{
+		pool->~dtNodePool();
+		dtFree(pool);
+		return 0;
+	}
+	
+	return pool;
+}
+
+/// Allocates an open list, or returns null if the list or its heap could not be allocated.
+static dtNodeQueue* allocNodeQueue(const int capacity)
+{
+	void* mem = dtAlloc(sizeof(dtNodeQueue), DT_ALLOC_PERM);
+	if (!mem)
+		return 0;
+	
+	dtNodeQueue* queue = new (mem) dtNodeQueue(capacity);
+	if (!queue->isValid())
+	{
+		queue->~dtNodeQueue();
+		dtFree(queue);
+		return 0;
+	}
+	
+	return queue;
+}
+
 /// @par 
 ///
 /// Must be the first function called after construction, before other
@@ -175,7 +213,7 @@ dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 			dtFree(m_nodePool);
 			m_nodePool = 0;
 		}
-		m_nodePool = new (dtAlloc(sizeof(dtNodePool), DT_ALLOC_PERM)) dtNodePool(maxNodes, dtNextPow2(maxNodes/4));
+		m_nodePool = allocNodePool(maxNodes, dtNextPow2(maxNodes*2));
 		if (!m_nodePool)
 			return DT_FAILURE | DT_OUT_OF_MEMORY;
 	}
@@ -186,7 +224,7 @@ dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 	
 	if (!m_tinyNodePool)
 	{
-		m_tinyNodePool = new (dtAlloc(sizeof(dtNodePool), DT_ALLOC_PERM)) dtNodePool(64, 32);
+		m_tinyNodePool = allocNodePool(64, 128);
 		if (!m_tinyNodePool)
 			return DT_FAILURE | DT_OUT_OF_MEMORY;
 	}
@@ -198,15 +236,21 @@ dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 	// TODO: check the open list size too.
 	if (!m_openList || m_openList->getCapacity() < maxNodes)
 	{
+		float bucketWidth = 0;
+		int nbBuckets = 0;
 		if (m_openList)
 		{
+			bucketWidth = m_openList->getBucketWidth();
+			nbBuckets = m_openList->getBucketCount();
 			m_openList->~dtNodeQueue();
 			dtFree(m_openList);
 			m_openList = 0;
 		}
-		m_openList = new (dtAlloc(sizeof(dtNodeQueue), DT_ALLOC_PERM)) dtNodeQueue(maxNodes);
+		m_openList = allocNodeQueue(maxNodes);
 		if (!m_openList)
 			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		if (bucketWidth > 0 && !m_openList->initBuckets(bucketWidth, nbBuckets))
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
 	}
 	else
 	{
@@ -216,6 +260,28 @@ dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 	return DT_SUCCESS;
 }
 
+/// @par
+///
+/// The nodes of a bucket are searched at every pop, so the width of a bucket should be a fraction of the cost
+/// of crossing a polygon. The nodes whose total cost is beyond the last bucket are not sorted
+/// with the other ones, so the range of the buckets should cover the difference between the total costs of 
+/// the nodes open at the same time, or the paths found may not be the shortest ones.
+///
+/// The setting is kept by init(). It requires a traversal cost never less than the distance (see dtQueryFilter),
+/// and must not be changed during a sliced search.
+dtStatus dtNavMeshQuery::setOpenListBuckets(const float bucketWidth, const int nbBuckets)
+{
+	if (!m_openList)
+		return DT_FAILURE;
+	if (bucketWidth < 0 || (bucketWidth > 0 && nbBuckets <= 0))
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	if (!m_openList->initBuckets(bucketWidth, nbBuckets))
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	
+	return DT_SUCCESS;
+}
+
 dtStatus dtNavMeshQuery::findRandomPoint(const dtQueryFilter* filter, float (*frand)(),
 										 dtPolyRef* randomRef, float* randomPt) const
 {
@@ -764,6 +830,390 @@ dtStatus dtNavMeshQuery::findNearestPoly(const float* center, const float* exten
 	return DT_SUCCESS;
 }
 
+/// The maximum number of polygons crossed by locatePoint() before querying the BV trees
+static const int DT_LOCATE_POINT_MAX_STEPS = 8;
+
+/// @par
+///
+/// The point is searched by walking from the hint towards it, crossing the polygon edges
+/// leading to it, for a few polygons at most. If the walk fails (invalid hint, wall or filtered polygon on the way, 
+/// point too far), the polygon is found with findNearestPoly().
+///
+/// A point reached from the hint must be within the xz-bounds of the polygon, and its height within @p extents.
+/// When several layers of the mesh overlap the point, the polygon connected to the hint is returned, 
+/// even if the one of another layer is closer.
+dtStatus dtNavMeshQuery::locatePoint(dtPolyRef hintRef, const float* pos, const float* extents,
+									 const dtQueryFilter* filter,
+									 dtPolyRef* ref, float* nearest, bool* fromHint) const
+{
+	dtAssert(m_nav);
+
+	if (!pos || !extents || !filter || !ref)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	if (fromHint)
+		*fromHint = false;
+
+	dtPolyRef curRef = hintRef;
+
+	for (int step = 0; curRef && step < DT_LOCATE_POINT_MAX_STEPS; ++step)
+	{
+		const dtMeshTile* tile = 0;
+		const dtPoly* poly = 0;
+		if (dtStatusFailed(m_nav->getTileAndPolyByRef(curRef, &tile, &poly)))
+			break;
+
+		if (poly->getType() != DT_POLYTYPE_GROUND || !filter->passFilter(curRef, tile, poly))
+			break;
+
+		float verts[DT_VERTS_PER_POLYGON*3];
+		float center[3] = {0, 0, 0};
+		const int nv = (int)poly->vertCount;
+		for (int i = 0; i < nv; ++i)
+		{
+			dtVcopy(&verts[i*3], &tile->verts[poly->verts[i]*3]);
+			dtVadd(center, center, &verts[i*3]);
+		}
+		dtVscale(center, center, 1.0f / nv);
+
+		if (dtPointInPolygon(pos, verts, nv))
+		{
+			float height;
+			if (dtStatusFailed(getPolyHeight(curRef, pos, &height)) || dtAbs(height - pos[1]) > extents[1])
+				break;
+
+			*ref = curRef;
+			if (nearest)
+				dtVset(nearest, pos[0], height, pos[2]);
+			if (fromHint)
+				*fromHint = true;
+
+			return DT_SUCCESS;
+		}
+
+		// Leave the polygon through the edge crossed by the segment from its center to the point.
+		int edge = -1;
+		float edgeT = 0;
+		for (int j = 0; j < nv; ++j)
+		{
+			float s, t;
+			if (!dtIntersectSegSeg2D(center, pos, &verts[j*3], &verts[((j+1) % nv)*3], s, t))
+				continue;
+
+			if (s >= 0.0f && s <= 1.0f && t >= 0.0f && t <= 1.0f)
+			{
+				edge = j;
+				edgeT = t;
+				break;
+			}
+		}
+
+		if (edge < 0)
+			break;
+
+		// Tile border edges can have several neighbours, the one owning the crossing point is preferred.
+		dtPolyRef nextRef = 0;
+		for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
+		{
+			const dtLink* link = &tile->links[i];
+			if (link->edge != edge || !link->ref)
+				continue;
+
+			if (!nextRef)
+				nextRef = link->ref;
+
+			if (link->side == 0xff)
+				break;
+
+			const float s = 1.0f/255.0f;
+			if (edgeT >= link->bmin*s && edgeT <= link->bmax*s)
+			{
+				nextRef = link->ref;
+				break;
+			}
+		}
+
+		curRef = nextRef;
+	}
+
+	*ref = 0;
+	return findNearestPoly(pos, extents, filter, ref, nearest);
+}
+
+/// The number of queries whose bounds are tested at once against a node of a BV tree
+static const int DT_NEAREST_POLY_PACKET_SIZE = 8;
+
+/// The number of queries of a batch sorted by tile at once
+static const int DT_NEAREST_POLY_BATCH_SIZE = 64;
+
+/// A query of a batch located in a single tile cell
+struct dtNearestPolyQuery
+{
+	int x, y;		///< The location of the tile cell
+	int index;		///< The index of the query in the batch
+	float distSqr;	///< The squared distance to the nearest polygon found so far
+};
+
+static int compareNearestPolyQueries(const void* a, const void* b)
+{
+	const dtNearestPolyQuery* qa = (const dtNearestPolyQuery*) a;
+	const dtNearestPolyQuery* qb = (const dtNearestPolyQuery*) b;
+
+	if (qa->y != qb->y) return qa->y < qb->y ? -1 : 1;
+	if (qa->x != qb->x) return qa->x < qb->x ? -1 : 1;
+	return qa->index - qb->index;
+}
+
+/// @par
+///
+/// The result of every query is the same as the one of findNearestPoly(), as long as the search box of
+/// the query overlaps less than 128 polygons.
+///
+/// The queries are sorted by tile, so the tiles are looked up once for all the queries located in the same one.
+/// The BV tree of a tile is then traversed once for every packet of 8 queries, testing the bounds of a node
+/// against the bounds of every query at once when SSE2 is available.
+/// The queries whose search box overlaps several tiles are done one by one.
+dtStatus dtNavMeshQuery::findNearestPolyBatch(const float* centers, const int nbQueries, const float* extents,
+											  const dtQueryFilter* filter,
+											  dtPolyRef* nearestRefs, float* nearestPts) const
+{
+	dtAssert(m_nav);
+
+	if (!centers || !extents || !filter || !nearestRefs || nbQueries < 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	static const int MAX_NEIS = 32;
+	const dtMeshTile* neis[MAX_NEIS];
+
+	dtNearestPolyQuery queries[DT_NEAREST_POLY_BATCH_SIZE];
+	int packet[DT_NEAREST_POLY_PACKET_SIZE];
+	float packetDistSqr[DT_NEAREST_POLY_PACKET_SIZE];
+
+	for (int first = 0; first < nbQueries; first += DT_NEAREST_POLY_BATCH_SIZE)
+	{
+		const int last = dtMin(first + DT_NEAREST_POLY_BATCH_SIZE, nbQueries);
+		int n = 0;
+
+		for (int i = first; i < last; ++i)
+		{
+			const float* center = &centers[i*3];
+			float bmin[3], bmax[3];
+			dtVsub(bmin, center, extents);
+			dtVadd(bmax, center, extents);
+
+			int minx, miny, maxx, maxy;
+			m_nav->calcTileLoc(bmin, &minx, &miny);
+			m_nav->calcTileLoc(bmax, &maxx, &maxy);
+
+			nearestRefs[i] = 0;
+
+			if (minx != maxx || miny != maxy)
+			{
+				findNearestPoly(center, extents, filter, &nearestRefs[i], nearestPts ? &nearestPts[i*3] : 0);
+				continue;
+			}
+
+			dtNearestPolyQuery& query = queries[n++];
+			query.x = minx;
+			query.y = miny;
+			query.index = i;
+			query.distSqr = FLT_MAX;
+		}
+
+		qsort(queries, n, sizeof(dtNearestPolyQuery), compareNearestPolyQueries);
+
+		// Every run of queries located in the same tile cell shares the tiles
+		for (int runStart = 0; runStart < n; )
+		{
+			int runEnd = runStart + 1;
+			while (runEnd < n && queries[runEnd].x == queries[runStart].x && queries[runEnd].y == queries[runStart].y)
+				++runEnd;
+
+			const int nneis = m_nav->getTilesAt(queries[runStart].x, queries[runStart].y, neis, MAX_NEIS);
+
+			for (int j = 0; j < nneis; ++j)
+			{
+				for (int p = runStart; p < runEnd; p += DT_NEAREST_POLY_PACKET_SIZE)
+				{
+					const int nbPacket = dtMin(DT_NEAREST_POLY_PACKET_SIZE, runEnd - p);
+
+					for (int k = 0; k < nbPacket; ++k)
+					{
+						packet[k] = queries[p + k].index;
+						packetDistSqr[k] = queries[p + k].distSqr;
+					}
+
+					findNearestPolyInTilePacket(neis[j], centers, packet, nbPacket, extents, filter, 
+												nearestRefs, nearestPts, packetDistSqr);
+
+					for (int k = 0; k < nbPacket; ++k)
+						queries[p + k].distSqr = packetDistSqr[k];
+				}
+			}
+
+			runStart = runEnd;
+		}
+	}
+
+	return DT_SUCCESS;
+}
+
+/// Gets the lanes of a packet whose quantized bounds overlap the bounds of a node, as a bit mask.
+inline unsigned dtOverlapQuantBoundsPacket(const unsigned short qmin[3][DT_NEAREST_POLY_PACKET_SIZE], 
+										   const unsigned short qmax[3][DT_NEAREST_POLY_PACKET_SIZE],
+										   const unsigned short* nmin, const unsigned short* nmax)
+{
+#ifdef DT_SIMD_SSE2
+	// SSE2 only compares signed integers, the bounds are shifted to keep their order
+	const __m128i bias = _mm_set1_epi16((short) 0x8000);
+	__m128i outside = _mm_setzero_si128();
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const __m128i lmin = _mm_xor_si128(_mm_loadu_si128((const __m128i*) qmin[axis]), bias);
+		const __m128i lmax = _mm_xor_si128(_mm_loadu_si128((const __m128i*) qmax[axis]), bias);
+		const __m128i bmin = _mm_set1_epi16((short) (nmin[axis] ^ 0x8000));
+		const __m128i bmax = _mm_set1_epi16((short) (nmax[axis] ^ 0x8000));
+
+		outside = _mm_or_si128(outside, _mm_or_si128(_mm_cmpgt_epi16(lmin, bmax), _mm_cmpgt_epi16(bmin, lmax)));
+	}
+
+	// Two bits per lane, only the even ones are kept
+	const unsigned bits = ~(unsigned) _mm_movemask_epi8(outside) & 0x5555;
+	unsigned mask = 0;
+	for (int lane = 0; lane < DT_NEAREST_POLY_PACKET_SIZE; ++lane)
+		mask |= ((bits >> (lane * 2)) & 1) << lane;
+
+	return mask;
+#else
+	unsigned mask = 0;
+
+	for (int lane = 0; lane < DT_NEAREST_POLY_PACKET_SIZE; ++lane)
+	{
+		const unsigned short lmin[3] = {qmin[0][lane], qmin[1][lane], qmin[2][lane]};
+		const unsigned short lmax[3] = {qmax[0][lane], qmax[1][lane], qmax[2][lane]};
+
+		if (dtOverlapQuantBounds(lmin, lmax, nmin, nmax))
+			mask |= 1u << lane;
+	}
+
+	return mask;
+#endif
+}
+
+void dtNavMeshQuery::findNearestPolyInTilePacket(const dtMeshTile* tile, const float* centers, const int* queries, const int nbQueries,
+												 const float* extents, const dtQueryFilter* filter,
+												 dtPolyRef* nearestRefs, float* nearestPts, float* nearestDistSqr) const
+{
+	dtAssert(nbQueries <= DT_NEAREST_POLY_PACKET_SIZE);
+
+	if (!tile->bvTree)
+	{
+		// Tiles without binary BV tree are tested one query at a time
+		for (int k = 0; k < nbQueries; ++k)
+		{
+			const float* center = &centers[queries[k]*3];
+			float nearest[3];
+			const dtPolyRef ref = findNearestPolyInTile(tile, center, extents, filter, nearest);
+			if (!ref)
+				continue;
+
+			const float d = dtVdistSqr(center, nearest);
+			if (d < nearestDistSqr[k])
+			{
+				nearestDistSqr[k] = d;
+				nearestRefs[queries[k]] = ref;
+				if (nearestPts)
+					dtVcopy(&nearestPts[queries[k]*3], nearest);
+			}
+		}
+
+		return;
+	}
+
+	const float* tbmin = tile->header->bmin;
+	const float* tbmax = tile->header->bmax;
+	const float qfac = tile->header->bvQuantFactor;
+
+	// The quantized boxes of the queries, one lane per query [axis][lane]
+	unsigned short qmin[3][DT_NEAREST_POLY_PACKET_SIZE];
+	unsigned short qmax[3][DT_NEAREST_POLY_PACKET_SIZE];
+	unsigned lanes = 0;
+
+	for (int k = 0; k < DT_NEAREST_POLY_PACKET_SIZE; ++k)
+	{
+		if (k >= nbQueries)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				qmin[axis][k] = 0xffff;
+				qmax[axis][k] = 0;
+			}
+			continue;
+		}
+
+		const float* center = &centers[queries[k]*3];
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			// Same quantization as queryPolygonsInTile()
+			const float lmin = dtClamp(center[axis] - extents[axis], tbmin[axis], tbmax[axis]) - tbmin[axis];
+			const float lmax = dtClamp(center[axis] + extents[axis], tbmin[axis], tbmax[axis]) - tbmin[axis];
+			qmin[axis][k] = (unsigned short)(qfac * lmin) & 0xfffe;
+			qmax[axis][k] = (unsigned short)(qfac * lmax + 1) | 1;
+		}
+
+		lanes |= 1u << k;
+	}
+
+	// Traverse the tree once for all the queries, a node is entered if it overlaps one of them
+	const dtBVNode* node = &tile->bvTree[0];
+	const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
+	const dtPolyRef base = m_nav->getPolyRefBase(tile);
+
+	while (node < end)
+	{
+		const unsigned overlap = dtOverlapQuantBoundsPacket(qmin, qmax, node->bmin, node->bmax) & lanes;
+		const bool isLeafNode = node->i >= 0;
+
+		if (isLeafNode && overlap)
+		{
+			const dtPolyRef ref = base | (dtPolyRef)node->i;
+			const dtPoly* poly = &tile->polys[node->i];
+
+			if (filter->passFilter(ref, tile, poly))
+			{
+				for (int k = 0; k < nbQueries; ++k)
+				{
+					if (!(overlap & (1u << k)))
+						continue;
+
+					const float* center = &centers[queries[k]*3];
+					float closest[3];
+					closestPointOnPolyInTile(tile, poly, center, closest);
+
+					const float d = dtVdistSqr(center, closest);
+					if (d < nearestDistSqr[k])
+					{
+						nearestDistSqr[k] = d;
+						nearestRefs[queries[k]] = ref;
+						if (nearestPts)
+							dtVcopy(&nearestPts[queries[k]*3], closest);
+					}
+				}
+			}
+		}
+
+		if (overlap || isLeafNode)
+			node++;
+		else
+		{
+			const int escapeIndex = -node->i;
+			node += escapeIndex;
+		}
+	}
+}
+
 dtPolyRef dtNavMeshQuery::findNearestPolyInTile(const dtMeshTile* tile, const float* center, const float* extents,
 												const dtQueryFilter* filter, float* nearestPt) const
 {
@@ -806,10 +1256,8 @@ int dtNavMeshQuery::queryPolygonsInTile(const dtMeshTile* tile, const float* qmi
 {
 	dtAssert(m_nav);
 
-	if (tile->bvTree)
+	if (tile->bvTree || tile->bvTree4)
 	{
-		const dtBVNode* node = &tile->bvTree[0];
-		const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
 		const float* tbmin = tile->header->bmin;
 		const float* tbmax = tile->header->bmax;
 		const float qfac = tile->header->bvQuantFactor;
@@ -834,6 +1282,48 @@ int dtNavMeshQuery::queryPolygonsInTile(const dtMeshTile* tile, const float* qmi
 		// Traverse tree
 		const dtPolyRef base = m_nav->getPolyRefBase(tile);
 		int n = 0;
+		
+		if (tile->bvTree4)
+		{
+			// Depth first, testing all the children of a node at once
+			int stack[DT_BVH_STACK_SIZE];
+			int nstack = 0;
+			stack[nstack++] = 0;
+			
+			while (nstack > 0)
+			{
+				const dtBVNode4* node = &tile->bvTree4[stack[--nstack]];
+				const unsigned int overlap = dtOverlapQuantBounds4(bmin, bmax, node->bmin, node->bmax);
+				
+				// The overlapping leaves are stored, the overlapping nodes are visited later
+				for (int j = DT_BVH_WIDTH-1; j >= 0; --j)
+				{
+					const int child = node->children[j];
+					if (!(overlap & (1u << j)) || !child)
+						continue;
+					
+					if (child < 0)
+					{
+						const dtPolyRef ref = base | (dtPolyRef)~child;
+						if (filter->passFilter(ref, tile, &tile->polys[~child]))
+						{
+							if (n < maxPolys)
+								polys[n++] = ref;
+						}
+					}
+					else
+					{
+						dtAssert(nstack < DT_BVH_STACK_SIZE);
+						stack[nstack++] = child;
+					}
+				}
+			}
+			
+			return n;
+		}
+		
+		const dtBVNode* node = &tile->bvTree[0];
+		const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
 		while (node < end)
 		{
 			const bool overlap = dtOverlapQuantBounds(bmin, bmax, node->bmin, node->bmax);
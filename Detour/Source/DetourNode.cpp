@@ -36,81 +36,85 @@ inline unsigned int dtHashRef(dtPolyRef a)
 //////////////////////////////////////////////////////////////////////////////////////////
 dtNodePool::dtNodePool(int maxNodes, int hashSize) :
 	m_nodes(0),
-	m_first(0),
-	m_next(0),
+	m_slots(0),
 	m_maxNodes(maxNodes),
 	m_hashSize(hashSize),
-	m_nodeCount(0)
+	m_nodeCount(0),
+	m_generation(1)
 {
 	dtAssert(dtNextPow2(m_hashSize) == (unsigned int)m_hashSize);
-	dtAssert(m_maxNodes > 0);
+	dtAssert(m_maxNodes > 0 && m_maxNodes < DT_NULL_IDX);
+	// A free slot always remains to end the probes.
+	dtAssert(m_hashSize > m_maxNodes);
 
 	m_nodes = (dtNode*)dtAlloc(sizeof(dtNode)*m_maxNodes, DT_ALLOC_PERM);
-	m_next = (dtNodeIndex*)dtAlloc(sizeof(dtNodeIndex)*m_maxNodes, DT_ALLOC_PERM);
-	m_first = (dtNodeIndex*)dtAlloc(sizeof(dtNodeIndex)*hashSize, DT_ALLOC_PERM);
-
-	dtAssert(m_nodes);
-	dtAssert(m_next);
-	dtAssert(m_first);
+	m_slots = (Slot*)dtAlloc(sizeof(Slot)*m_hashSize, DT_ALLOC_PERM);
 
-	memset(m_first, 0xff, sizeof(dtNodeIndex)*m_hashSize);
-	memset(m_next, 0xff, sizeof(dtNodeIndex)*m_maxNodes);
+	// The allocation failures are reported by isValid().
+	if (m_slots)
+		memset(m_slots, 0, sizeof(Slot)*m_hashSize);
 }
 
 dtNodePool::~dtNodePool()
 {
 	dtFree(m_nodes);
-	dtFree(m_next);
-	dtFree(m_first);
+	dtFree(m_slots);
 }
 
 void dtNodePool::clear()
 {
-	memset(m_first, 0xff, sizeof(dtNodeIndex)*m_hashSize);
 	m_nodeCount = 0;
+
+	// The slots are only reset when the generations wrap around.
+	if (++m_generation == 0)
+	{
+		memset(m_slots, 0, sizeof(Slot)*m_hashSize);
+		m_generation = 1;
+	}
+}
+
+inline dtNodePool::Slot* dtNodePool::findSlot(dtPolyRef id)
+{
+	unsigned int i = dtHashRef(id) & (m_hashSize-1);
+	
+	// Linear probing, the slots of the previous generations are empty.
+	while (m_slots[i].generation == m_generation && m_slots[i].id != id)
+		i = (i+1) & (m_hashSize-1);
+	
+	return &m_slots[i];
 }
 
 dtNode* dtNodePool::findNode(dtPolyRef id)
 {
-	unsigned int bucket = dtHashRef(id) & (m_hashSize-1);
-	dtNodeIndex i = m_first[bucket];
-	while (i != DT_NULL_IDX)
-	{
-		if (m_nodes[i].id == id)
-			return &m_nodes[i];
-		i = m_next[i];
-	}
-	return 0;
+	const Slot* slot = findSlot(id);
+	if (slot->generation != m_generation)
+		return 0;
+	return &m_nodes[slot->idx];
 }
 
 dtNode* dtNodePool::getNode(dtPolyRef id)
 {
-	unsigned int bucket = dtHashRef(id) & (m_hashSize-1);
-	dtNodeIndex i = m_first[bucket];
-	dtNode* node = 0;
-	while (i != DT_NULL_IDX)
-	{
-		if (m_nodes[i].id == id)
-			return &m_nodes[i];
-		i = m_next[i];
-	}
+	Slot* slot = findSlot(id);
+	if (slot->generation == m_generation)
+		return &m_nodes[slot->idx];
 	
 	if (m_nodeCount >= m_maxNodes)
 		return 0;
 	
-	i = (dtNodeIndex)m_nodeCount;
+	const dtNodeIndex i = (dtNodeIndex)m_nodeCount;
 	m_nodeCount++;
 	
 	// Init node
-	node = &m_nodes[i];
+	dtNode* node = &m_nodes[i];
 	node->pidx = 0;
 	node->cost = 0;
 	node->total = 0;
 	node->id = id;
 	node->flags = 0;
 	
-	m_next[i] = m_first[bucket];
-	m_first[bucket] = i;
+	slot->id = id;
+	slot->idx = i;
+	slot->generation = m_generation;
 	
 	return node;
 }
@@ -120,45 +124,267 @@ dtNode* dtNodePool::getNode(dtPolyRef id)
 dtNodeQueue::dtNodeQueue(int n) :
 	m_heap(0),
 	m_capacity(n),
-	m_size(0)
+	m_size(0),
+	m_bucketWidth(0),
+	m_invBucketWidth(0),
+	m_nbBuckets(0),
+	m_buckets(0),
+	m_next(0),
+	m_prev(0),
+	m_slotBuckets(0),
+	m_nbSlots(0),
+	m_freeSlot(-1),
+	m_baseCost(0),
+	m_currentBucket(0),
+	m_overflow(-1),
+	m_nbOverflow(0),
+	m_overflowCost(0)
 {
 	dtAssert(m_capacity > 0);
 	
+	// The allocation failure is reported by isValid().
 	m_heap = (dtNode**)dtAlloc(sizeof(dtNode*)*(m_capacity+1), DT_ALLOC_PERM);
-	dtAssert(m_heap);
 }
 
 dtNodeQueue::~dtNodeQueue()
 {
+	purgeBuckets();
 	dtFree(m_heap);
 }
 
+void dtNodeQueue::purgeBuckets()
+{
+	dtFree(m_buckets);
+	m_buckets = 0;
+	dtFree(m_next);
+	m_next = 0;
+	dtFree(m_prev);
+	m_prev = 0;
+	dtFree(m_slotBuckets);
+	m_slotBuckets = 0;
+	
+	m_bucketWidth = 0;
+	m_invBucketWidth = 0;
+	m_nbBuckets = 0;
+}
+
+bool dtNodeQueue::initBuckets(const float bucketWidth, const int nbBuckets)
+{
+	dtAssert(bucketWidth >= 0);
+	
+	purgeBuckets();
+	m_size = 0;
+	
+	if (bucketWidth <= 0 || nbBuckets <= 0)
+		return true;
+	
+	const int n = (int)dtNextPow2((unsigned int)nbBuckets);
+	m_buckets = (int*)dtAlloc(sizeof(int)*n, DT_ALLOC_PERM);
+	m_next = (int*)dtAlloc(sizeof(int)*m_capacity, DT_ALLOC_PERM);
+	m_prev = (int*)dtAlloc(sizeof(int)*m_capacity, DT_ALLOC_PERM);
+	m_slotBuckets = (int*)dtAlloc(sizeof(int)*m_capacity, DT_ALLOC_PERM);
+	if (!m_buckets || !m_next || !m_prev || !m_slotBuckets)
+	{
+		purgeBuckets();
+		return false;
+	}
+	
+	m_bucketWidth = bucketWidth;
+	m_invBucketWidth = 1.0f / bucketWidth;
+	m_nbBuckets = n;
+	memset(m_buckets, 0xff, sizeof(int)*m_nbBuckets);
+	m_nbSlots = 0;
+	m_freeSlot = -1;
+	m_overflow = -1;
+	m_nbOverflow = 0;
+	
+	return true;
+}
+
+/// @par
+///
+/// With buckets, only the buckets still holding nodes are reset.
+void dtNodeQueue::clear()
+{
+	if (m_bucketWidth > 0)
+	{
+		if (m_size > 0)
+			memset(m_buckets, 0xff, sizeof(int)*m_nbBuckets);
+		m_nbSlots = 0;
+		m_freeSlot = -1;
+		m_overflow = -1;
+		m_nbOverflow = 0;
+	}
+	
+	m_size = 0;
+}
+
 void dtNodeQueue::bubbleUp(int i, dtNode* node)
 {
-	int parent = (i-1)/2;
+	int parent = (i-1)/DT_NODE_QUEUE_ARITY;
 	// note: (index > 0) means there is a parent
 	while ((i > 0) && (m_heap[parent]->total > node->total))
 	{
 		m_heap[i] = m_heap[parent];
+		m_heap[i]->qidx = i;
 		i = parent;
-		parent = (i-1)/2;
+		parent = (i-1)/DT_NODE_QUEUE_ARITY;
 	}
 	m_heap[i] = node;
+	node->qidx = i;
 }
 
 void dtNodeQueue::trickleDown(int i, dtNode* node)
 {
-	int child = (i*2)+1;
+	int child = (i*DT_NODE_QUEUE_ARITY)+1;
 	while (child < m_size)
 	{
-		if (((child+1) < m_size) && 
-			(m_heap[child]->total > m_heap[child+1]->total))
+		// Least of the children
+		const int last = dtMin(child+DT_NODE_QUEUE_ARITY, m_size);
+		int best = child;
+		for (int j = child+1; j < last; ++j)
 		{
-			child++;
+			if (m_heap[j]->total < m_heap[best]->total)
+				best = j;
 		}
-		m_heap[i] = m_heap[child];
-		i = child;
-		child = (i*2)+1;
+		
+		if (m_heap[best]->total >= node->total)
+			break;
+		
+		m_heap[i] = m_heap[best];
+		m_heap[i]->qidx = i;
+		i = best;
+		child = (i*DT_NODE_QUEUE_ARITY)+1;
 	}
-	bubbleUp(i, node);
+	m_heap[i] = node;
+	node->qidx = i;
+}
+
+void dtNodeQueue::linkBucket(int slot, dtNode* node)
+{
+	// The nodes cheaper than the current bucket go in it, the ones beyond the last bucket go in the overflow list.
+	const float bucket = (node->total - m_baseCost) * m_invBucketWidth;
+	int b = m_currentBucket;
+	if (bucket >= (float)(m_currentBucket + m_nbBuckets))
+		b = -1;
+	else if (bucket > (float)m_currentBucket)
+		b = (int)bucket;
+	
+	if (b < 0)
+	{
+		if (m_nbOverflow == 0 || node->total < m_overflowCost)
+			m_overflowCost = node->total;
+		m_nbOverflow++;
+	}
+	
+	int& head = b >= 0 ? m_buckets[b & (m_nbBuckets-1)] : m_overflow;
+	m_slotBuckets[slot] = b;
+	m_prev[slot] = -1;
+	m_next[slot] = head;
+	if (head >= 0)
+		m_prev[head] = slot;
+	head = slot;
+}
+
+void dtNodeQueue::unlinkBucket(int slot)
+{
+	const int prev = m_prev[slot];
+	const int next = m_next[slot];
+	if (prev >= 0)
+		m_next[prev] = next;
+	else if (m_slotBuckets[slot] >= 0)
+		m_buckets[m_slotBuckets[slot] & (m_nbBuckets-1)] = next;
+	else
+		m_overflow = next;
+	if (next >= 0)
+		m_prev[next] = prev;
+	
+	if (m_slotBuckets[slot] < 0)
+		m_nbOverflow--;
+}
+
+void dtNodeQueue::redistributeOverflow()
+{
+	int slot = m_overflow;
+	m_overflow = -1;
+	m_nbOverflow = 0;
+	
+	while (slot >= 0)
+	{
+		const int next = m_next[slot];
+		linkBucket(slot, m_heap[slot]);
+		slot = next;
+	}
+}
+
+void dtNodeQueue::pushBucket(dtNode* node)
+{
+	// The buckets start at the first node pushed in the empty queue.
+	if (m_size == 0)
+	{
+		m_baseCost = node->total;
+		m_currentBucket = 0;
+	}
+	
+	int slot;
+	if (m_freeSlot >= 0)
+	{
+		slot = m_freeSlot;
+		m_freeSlot = m_next[slot];
+	}
+	else
+	{
+		dtAssert(m_nbSlots < m_capacity);
+		slot = m_nbSlots++;
+	}
+	
+	m_heap[slot] = node;
+	node->qidx = slot;
+	linkBucket(slot, node);
+	m_size++;
+}
+
+int dtNodeQueue::findBucketTop()
+{
+	dtAssert(m_size > 0);
+	
+	// The overflow list is moved to the buckets before any of its nodes could be cheaper than a node of the buckets.
+	// When only the overflow list is left, the buckets restart from its cheapest node, which is known exactly once it
+	// has been redistributed.
+	while (m_nbOverflow == m_size)
+	{
+		m_baseCost = m_overflowCost;
+		m_currentBucket = 0;
+		redistributeOverflow();
+	}
+	if (m_nbOverflow > 0 && (m_overflowCost - m_baseCost) * m_invBucketWidth < (float)(m_currentBucket + m_nbBuckets))
+	{
+		redistributeOverflow();
+	}
+	
+	const int mask = m_nbBuckets-1;
+	while (m_buckets[m_currentBucket & mask] < 0)
+		m_currentBucket++;
+	
+	int best = m_buckets[m_currentBucket & mask];
+	for (int slot = m_next[best]; slot >= 0; slot = m_next[slot])
+	{
+		if (m_heap[slot]->total < m_heap[best]->total)
+			best = slot;
+	}
+	
+	return best;
+}
+
+dtNode* dtNodeQueue::popBucket()
+{
+	const int slot = findBucketTop();
+	dtNode* result = m_heap[slot];
+	
+	unlinkBucket(slot);
+	m_next[slot] = m_freeSlot;
+	m_freeSlot = slot;
+	m_size--;
+	
+	return result;
 }
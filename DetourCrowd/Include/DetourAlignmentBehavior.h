@@ -22,6 +22,7 @@
 #include "DetourSteeringBehavior.h"
 
 struct dtCrowdAgent;
+class dtFlockGroup;
 
 
 /// Parameters for the alignment behavior
@@ -30,11 +31,13 @@ struct dtAlignmentBehaviorParams
 {
 	const unsigned* targets;	///< The indices of the targets
 	unsigned nbTargets;			///< The number of target
+	const dtFlockGroup* group;	///< The group whose other members are the targets. If not null, the targets are ignored.
 };
 
 /// Defines the alignment behavior.
 ///
 /// An agent using this behavior will keep its velocity aligned with its targets'.
+/// When the agent belongs to a group, the average velocity is computed from the aggregates of the group.
 /// @ingroup behavior
 class dtAlignmentBehavior : public dtSteeringBehavior<dtAlignmentBehaviorParams>
 {
@@ -32,11 +32,67 @@ public:
 
 	/// Updates the data of an agent so it can behave in the desired way and stores the updated data into the second agent
 	///
+	/// Both agents can be the same object, when the behavior is a stage of a pipeline updating the agent in place.
+	///
 	/// @param[in]	query		The crowd query object used to access elements of the crowd (agents, navmesh, etc.)
 	/// @param[in]	oldAgent	The agent we want to update.
 	/// @param[out]	newAgent	The agent storing the updated version of the oldAgent.
 	/// @param[in]	dt			The time, in seconds, to update the simulation. [Limit: > 0, otherwise strange things can happen (undefined behavior)]
 	virtual void update(const dtCrowdQuery& query, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, float dt) = 0;
+
+	/// Updates a batch of agents using this behavior.
+	///
+	/// The crowd calls this method once per update with every agent using the behavior, 
+	/// so the work shared by the agents can be done once for all of them.
+	/// By default, calls update() for every agent of the batch.
+	///
+	/// As in update(), both arrays can be the same one.
+	///
+	/// @param[in]	query		The crowd query object used to access elements of the crowd (agents, navmesh, etc.)
+	/// @param[in]	oldAgents	The agents we want to update, indexed by id.
+	/// @param[out]	newAgents	The agents storing the updated versions of the old agents, indexed by id.
+	/// @param[in]	ids			The ids of the agents to update. [Size: nbIds]
+	/// @param[in]	nbIds		The number of agents to update.
+	/// @param[in]	dt			The time, in seconds, to update the simulation. [Limit: > 0]
+	virtual void updateBatch(const dtCrowdQuery& query, const dtCrowdAgent* oldAgents, dtCrowdAgent* newAgents, 
+							 const unsigned* ids, unsigned nbIds, float dt);
+
+	/// Prepares the behavior before the agents using it are updated.
+	///
+	/// The crowd calls this method once per update, before updating any agent.
+	/// Calling it again during the same update of the crowd has no effect.
+	///
+	/// @param[in]	query		The crowd query object used to access elements of the crowd (agents, navmesh, etc.)
+	/// @param[in]	dt			The time, in seconds, to update the simulation.
+	void preUpdate(const dtCrowdQuery& query, float dt);
+
+	/// Finishes the work of the behavior after the agents using it have been updated.
+	///
+	/// The crowd calls this method once per update, after updating every agent.
+	/// Calling it again during the same update of the crowd has no effect.
+	///
+	/// @param[in]	query		The crowd query object used to access elements of the crowd (agents, navmesh, etc.)
+	/// @param[in]	dt			The time, in seconds, to update the simulation.
+	void postUpdate(const dtCrowdQuery& query, float dt);
+
+protected:
+	/// Work done once per update before updating the agents. Does nothing by default.
+	///
+	/// @param[in]	query		The crowd query object used to access elements of the crowd (agents, navmesh, etc.)
+	/// @param[in]	dt			The time, in seconds, to update the simulation.
+	virtual void doPreUpdate(const dtCrowdQuery& query, float dt);
+
+	/// Work done once per update after updating the agents. Does nothing by default.
+	///
+	/// @param[in]	query		The crowd query object used to access elements of the crowd (agents, navmesh, etc.)
+	/// @param[in]	dt			The time, in seconds, to update the simulation.
+	virtual void doPostUpdate(const dtCrowdQuery& query, float dt);
+
+private:
+	const dtCrowdQuery* m_preUpdateQuery;	///< The crowd which last prepared the behavior
+	unsigned m_preUpdateFrame;				///< The update of the crowd which last prepared the behavior
+	const dtCrowdQuery* m_postUpdateQuery;	///< The crowd which last finished the behavior
+	unsigned m_postUpdateFrame;				///< The update of the crowd which last finished the behavior
 };
 
 #endif
@@ -79,6 +135,11 @@ This is the highest interface in the behavior hierarchy. When implementing this
 the user has to implement the `dtBehavior::update()` method, which defines how the behavior will affect the data of the 
 given agent.
 
+The `dtBehavior::doPreUpdate()` and `dtBehavior::doPostUpdate()` methods can also be overloaded. 
+They are called once per update of the crowd, before and after updating the agents, 
+no matter how many agents use the behavior. This is the place for the work shared by every agent, 
+like the path requests computed by `dtPathFollowing`.
+
 __Steering behavior:__ #dtSteeringBehavior
 
 A steering behavior is a special kind of behavior. A steering behavior works by computing a force that should 
@@ -207,4 +268,7 @@ crowd.setAgentBehavior(idAgent, &b);
 Now our behavior has been assigned to the agent. The next time the crowd updates its agents, 
 the agent will go in the opposite direction of its target.
 
+When the agent is removed from the crowd, its parameters can be released with 
+`b.removeBehaviorParams(idAgent)`: their memory will be reused by the next agent getting parameters.
+
 */
@@ -24,6 +24,7 @@
 struct dtCrowdAgent;
 class dtArriveBehavior;
 class dtCrowdQuery;
+class dtFlockGroup;
 
 
 /// Parameters for the alignment behavior
@@ -32,6 +33,7 @@ struct dtCohesionBehaviorParams
 {
 	const unsigned* targets;	///< The indices of the targets
 	unsigned nbTargets;			///< The number of target
+	const dtFlockGroup* group;	///< The group whose other members are the targets. If not null, the targets are ignored.
 };
 
 
@@ -39,6 +41,7 @@ struct dtCohesionBehaviorParams
 ///
 /// An agent using the cohesion behavior will move towards the 
 /// center of gravity of its targets.
+/// When the agent belongs to a group, the center of gravity is computed from the aggregates of the group.
 /// @ingroup behavior
 class dtCohesionBehavior : public dtSteeringBehavior<dtCohesionBehaviorParams>
 {
@@ -105,6 +105,8 @@ void dtFreeObstacleAvoidanceDebugData(dtObstacleAvoidanceDebugData* ptr);
 
 static const unsigned DT_MAX_PATTERN_DIVS = 32;	///< Max number of adaptive divs.
 static const unsigned DT_MAX_PATTERN_RINGS = 4;	///< Max number of adaptive rings.
+static const unsigned DT_MAX_AVOIDANCE_CIRCLES = 32;	///< Max number of circles considered by the collision avoidance.
+static const unsigned DT_MAX_AVOIDANCE_SEGMENTS = 32;	///< Max number of segments considered by the collision avoidance.
 
 /// Parameters for the collision avoidance behavior
 /// @ingroup behavior
@@ -129,6 +131,8 @@ struct dtCollisionAvoidanceParams
 ///
 /// The agents use this behavior in order to change their velocity 
 /// to avoid obstacles.
+/// The obstacles of an agent are stored on the stack during its update, 
+/// so the same instance can update several agents concurrently.
 /// @ingroup behavior
 class dtCollisionAvoidance : public dtParametrizedBehavior<dtCollisionAvoidanceParams>
 {
@@ -148,63 +152,87 @@ public:
 	/// @param[in]	ptr	A pointer to the behavior we want to free
 	static void free(dtCollisionAvoidance* ptr);
 
-	/// Initializes the behavior.
+	/// Changes the number of obstacles considered by the behavior.
 	///
-	/// Must be called before using the behavior.
-	/// @param[in]		maxCircles	Maximal number of circles supported by the obstacle avoidance query.
-	/// @param[in]		maxSegments	Maximal number of segments supported by the obstacle avoidance query.
+	/// By default, 6 circles and 8 segments are considered. At most 32 circles (#DT_MAX_AVOIDANCE_CIRCLES)
+	/// and 32 segments (#DT_MAX_AVOIDANCE_SEGMENTS) can be considered, since the obstacles are stored on the stack.
+	/// @param[in]		maxCircles	Maximal number of circles supported by the obstacle avoidance query. [Limit: <= #DT_MAX_AVOIDANCE_CIRCLES]
+	/// @param[in]		maxSegments	Maximal number of segments supported by the obstacle avoidance query. [Limit: <= #DT_MAX_AVOIDANCE_SEGMENTS]
 	///
-	/// @return True if the initialization succeeded.
+	/// @return False if a limit is exceeded, the behavior then keeps its current limits.
 	bool init(unsigned maxCircles = 6, unsigned maxSegments = 8);
 
 	/// Cleans the behavior.
 	void purge();
-	
-	/// Returns the number of velocity samples.
-	int getVelocitySamplesCount() const { return m_velocitySamplesCount; }
+
+	/// Chooses whether the velocity samples are scored four at a time using SSE2, when it is available.
+	/// Enabled by default. The scalar code is always used when debug data are requested.
+	///
+	/// @param[in]	enabled		True to score the samples using SSE2, false to score them one at a time.
+	void setVectorizedSampling(bool enabled) { m_vectorizedSampling = enabled; }
+
+	/// Returns true if the velocity samples are scored four at a time when SSE2 is available.
+	bool isVectorizedSampling() const { return m_vectorizedSampling; }
 
 private:
     dtCollisionAvoidance(const dtCollisionAvoidance&);
     dtCollisionAvoidance& operator=(const dtCollisionAvoidance&);
 
+	/// The obstacles and settings used while computing the velocity of one agent.
+	struct Context
+	{
+		dtObstacleCircle circles[DT_MAX_AVOIDANCE_CIRCLES];		///< The obstacles as circles.
+		int ncircles;											///< Number of registered circles.
+		dtObstacleSegment segments[DT_MAX_AVOIDANCE_SEGMENTS];	///< The obstacles as segments.
+		int nsegments;											///< Number of registered segments.
+
+		float invHorizTime;										///< The inverse of the time horizon.
+		float vmax;												///< The maximal speed.
+		float invVmax;											///< The inverse of the maximal speed.
+	};
+
 	virtual void doUpdate(const dtCrowdQuery& query, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, 
 		const dtCollisionAvoidanceParams& currentParams, dtCollisionAvoidanceParams& newParams, float dt);
 
 	/// Registers all the neighbors of the given agent as obstacles.
 	///
+	/// @param[out]		ctx		The context receiving the obstacles.
 	/// @param[in]		ag		The index we want to change.
 	/// @param[in]		query	Allows the user to query data from the crowd.
-	void addObtacles(const dtCrowdAgent& ag, const dtCrowdQuery& query);
+	void addObtacles(Context& ctx, const dtCrowdAgent& ag, const dtCrowdQuery& query) const;
 
 	/// Updates the velocity of the old agent according to its parameters, and puts the result into the new agent.
 	///
+	/// @param[in]	ctx				The context containing the obstacles.
 	/// @param[in]	oldAgent		The agent whose velocity must be updated.
 	/// @param[out]	newAgent		The agent storing the new parameters.
 	/// @param[in]	currentParams	The parameters of the agent.
 	/// @param[out]	newParams		The new parameters of the agent.
-	void updateVelocity(const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, 
-		const dtCollisionAvoidanceParams& currentParams, dtCollisionAvoidanceParams& newParams);
-
-	/// Resets the number of circles and segments.
-	void reset();
+	///
+	/// @return The number of velocities sampled.
+	int updateVelocity(Context& ctx, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, 
+		const dtCollisionAvoidanceParams& currentParams, dtCollisionAvoidanceParams& newParams) const;
 
 	/// Adds a circle to the obstacles list.
 	///
+	/// @param[out]		ctx		The context receiving the circle.
 	/// @param[in]		pos		The position of the circle.
 	/// @param[in]		rad		The radius of the circle.
 	/// @param[in]		vel		The current velocity of the obstacle.
 	/// @param[in]		dvel	The desired velocity of the obstacle.
-	void addCircle(const float* pos, const float rad,
-		const float* vel, const float* dvel);
+	void addCircle(Context& ctx, const float* pos, const float rad,
+		const float* vel, const float* dvel) const;
 	
 	/// Adds a segment to the obstacles list.
 	///
+	/// @param[out]	ctx	The context receiving the segment.
 	/// @param[in]	p	The position of the segment.
 	/// @param[in]	q	The radius of the segment.
-	void addSegment(const float* p, const float* q);
+	void addSegment(Context& ctx, const float* p, const float* q) const;
 	
 	/// Computes the desired velocity of an agent.
 	///
+	/// @param[in]		ctx			The context containing the obstacles.
 	/// @param[in]		pos			The position of the agent.
 	/// @param[in]		rad			The radius of the agent.
 	/// @param[in]		vmax		The maximal speed of the agent.
@@ -213,27 +241,20 @@ private:
 	/// @param[in]		nvel		The new velocity of the agent.
 	/// @param[in]		oldParams	The parameters of the agent.
 	/// @param[out]		newParams	The new parameters of the agent.
-	int sampleVelocityAdaptive(const float* pos, const float rad, const float vmax,
+	int sampleVelocityAdaptive(Context& ctx, const float* pos, const float rad, const float vmax,
 							   const float* vel, const float* dvel, float* nvel,
-							   const dtCollisionAvoidanceParams& oldParams, dtCollisionAvoidanceParams& newParams);
-
-	/// Access to the obstacles (other agents for instance)
-	/// @{
-	inline unsigned getObstacleCircleCount() const { return m_ncircles; }
-	const dtObstacleCircle* getObstacleCircle(const int i) { return &m_circles[i]; }
-
-	inline unsigned getObstacleSegmentCount() const { return m_nsegments; }
-	const dtObstacleSegment* getObstacleSegment(const int i) { return &m_segments[i]; }
-	/// @}
+							   const dtCollisionAvoidanceParams& oldParams, dtCollisionAvoidanceParams& newParams) const;
 
 	/// Checks if the agent is in conflict with the registered obstacles.
 	///
+	/// @param[in,out]	ctx		The context containing the obstacles.
 	/// @param[in]		pos		The position of the agent.
 	/// @param[in]		dvel	The desired velocity of the agent.
-	void prepare(const float* pos, const float* dvel);
+	void prepare(Context& ctx, const float* pos, const float* dvel) const;
 
 	/// Checks if a collision is going to happen with the given velocity sample.
 	///
+	/// @param[in]		ctx			The context containing the obstacles.
 	/// @param[in]		vcand		The samples velocity.
 	/// @param[in]		pos			The position of the agent.
 	/// @param[in]		rad			The radius of the agent.
@@ -242,28 +263,34 @@ private:
 	/// @param[in]		nvel		The new velocity of the agent.
 	/// @param[in]		oldParams	The parameters of the agent.
 	/// @param[out]		newParams	The new parameters of the agent.
-	float processSample(const float* vcand, const float cs,
+	float processSample(const Context& ctx, const float* vcand, const float cs,
 		const float* pos, const float rad,
 		const float* vel, const float* dvel,
 		const dtCollisionAvoidanceParams& oldParams, 
-		dtCollisionAvoidanceParams& newParams);
+		dtCollisionAvoidanceParams& newParams) const;
 
-	int m_velocitySamplesCount;				///< The number of velocity samples generate on the last frame.
-	const int m_maxAvoidanceParams;			///< The maximum number of crowd avoidance configurations supported by the collision avoidance.
+	/// Computes the penalties of four velocity samples at once.
+	/// Gives the same penalties as processSample(), without filling the debug data.
+	///
+	/// @param[in]		ctx			The context containing the obstacles.
+	/// @param[in]		vx			The x coordinates of the samples velocities. [Size: 4]
+	/// @param[in]		vz			The z coordinates of the samples velocities. [Size: 4]
+	/// @param[in]		pos			The position of the agent.
+	/// @param[in]		rad			The radius of the agent.
+	/// @param[in]		vel			The current velocity of the agent.
+	/// @param[in]		dvel		The desired velocity of the agent.
+	/// @param[in]		params		The parameters of the agent.
+	/// @param[out]		penalties	The penalties of the samples. [Size: 4]
+	void processSamples(const Context& ctx, const float* vx, const float* vz,
+		const float* pos, const float rad,
+		const float* vel, const float* dvel,
+		const dtCollisionAvoidanceParams& params, float* penalties) const;
 
-	float m_invHorizTime;		
-	float m_vmax;							///< The maximal speed.
-	float m_invVmax;						///< The inverse of the maximal speed.
+	const int m_maxAvoidanceParams;			///< The maximum number of crowd avoidance configurations supported by the collision avoidance.
 
 	int m_maxCircles;						///< Maximum number of circles.
-	dtObstacleCircle* m_circles;			///< The obstacles as circles.
-	int m_ncircles;							///< Number of registered circles.
-
 	int m_maxSegments;						///< Maximum number of segments.
-	dtObstacleSegment* m_segments;			///< The obstacles as segments.
-	int m_nsegments;						///< Number of registered segments.
-
-	const dtCrowdAgentEnvironment* m_env;	///< The environment of the agents (neighborhood, etc.)
+	bool m_vectorizedSampling;				///< True if the samples are scored four at a time when possible.
 };
 
 #endif
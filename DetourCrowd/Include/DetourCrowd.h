@@ -21,16 +21,21 @@
 
 #include "DetourBehavior.h"
 #include "DetourLocalBoundary.h"
+#include "DetourLodScheduler.h"
 #include "DetourNavMeshQuery.h"
 #include "DetourPipelineBehavior.h"
+#include "DetourProximityGrid.h"
+
+class dtCrowdKinematics;
 
 class dtObstacleAvoidanceDebugData;
 class dtPathFollowing;
 
 
-/// The maximum number of neighbors that a crowd agent can take into account
+/// The default maximum number of neighbors that a crowd agent can take into account
 /// for steering decisions.
 /// @ingroup crowd
+/// @see dtCrowd::init
 static const int DT_CROWDAGENT_MAX_NEIGHBOURS = 6;
 
 
@@ -64,9 +69,9 @@ struct dtCrowdAgentEnvironment
 	explicit dtCrowdAgentEnvironment();
 	~dtCrowdAgentEnvironment();
 
-	dtLocalBoundary boundary;									///< The local boundary data for the agent.
-	dtCrowdNeighbour neighbors[DT_CROWDAGENT_MAX_NEIGHBOURS];	///< The known neighbors of the agent.
-	unsigned nbNeighbors;										///< The number of neighbors.
+	dtLocalBoundary boundary;		///< The local boundary data for the agent.
+	dtCrowdNeighbour* neighbors;	///< The known neighbors of the agent, sorted by distance, stored by the crowd. [Size: dtCrowd::getMaxNeighbors()]
+	unsigned nbNeighbors;			///< The number of neighbors.
 };
 
 /// Represents an agent managed by a #dtCrowd object.
@@ -113,6 +118,55 @@ enum UpdateFlags
 	DT_CROWD_OPTIMIZE_TOPO = 16,		///< Use dtPathCorridor::optimizePathTopology() to optimize the agent path.
 };
 
+/// Measures of the cost of the updates of a crowd.
+///
+/// The statistics are only gathered when enabled with dtCrowd::setStatsEnabled().
+/// The times are given in microseconds.
+/// @ingroup crowd
+/// @see dtCrowd::getStats
+struct dtCrowdStats
+{
+	/// Maximal number of behaviors whose time is measured separately.
+	static const int MAX_BEHAVIORS = 16;
+
+	/// Time spent updating the agents of a behavior
+	struct BehaviorTime
+	{
+		const dtBehavior* behavior;		///< The behavior of the agents
+		unsigned nbAgents;				///< The number of agents updated
+		float time;						///< The time spent in the update of these agents and in the hooks of the behavior
+	};
+
+	float environmentTime;				///< Time spent in dtCrowd::updateEnvironment(), or building the proximity grid and the snapshot of a budgeted update
+	float velocityTime;					///< Time spent in dtCrowd::updateVelocity()
+	float positionTime;					///< Time spent in dtCrowd::updatePosition()
+
+	BehaviorTime behaviors[MAX_BEHAVIORS];	///< Time spent per behavior during the velocity update
+	int nbBehaviors;					///< The number of behaviors in @p behaviors, the other behaviors are not measured
+
+	unsigned nearestPolyQueries;		///< Polygons looked up with dtNavMeshQuery::findNearestPoly() or dtNavMeshQuery::findNearestPolyBatch()
+	unsigned moveAlongSurfaceQueries;	///< Calls to dtNavMeshQuery::moveAlongSurface()
+	unsigned boundaryUpdates;			///< Local boundaries rebuilt
+	unsigned wallSegmentQueries;		///< Wall segments of a polygon extracted from the navigation mesh (misses of the wall segment caches)
+	unsigned neighborCandidates;		///< Agents returned by the proximity grid and tested as neighbors
+	unsigned avoidanceSamples;			///< Velocities sampled by the collision avoidance
+	unsigned pathQueueIterations;		///< Path finding iterations done by the path queues
+	unsigned skippedAgents;				///< Agents whose environment and velocity were not updated because of the update budget
+
+	/// Sets every measure to 0.
+	void reset();
+
+	/// Adds the counters (but not the times) of the given statistics to these ones.
+	void addCounters(const dtCrowdStats& other);
+
+	/// Adds the given time spent updating agents with the given behavior.
+	///
+	/// @param[in]	behavior	The behavior.
+	/// @param[in]	time		The time spent, in microseconds.
+	/// @param[in]	nbAgents	The number of agents updated during this time.
+	void addBehaviorTime(const dtBehavior* behavior, float time, unsigned nbAgents);
+};
+
 /// Utility class used to get access to some useful elements of the crowd
 /// @ingroup crowd
 class dtCrowdQuery
@@ -123,7 +177,10 @@ public:
 	/// @param[in]	maxAgents	The maximum number of agents for the crowd.
 	/// @param[in]	agents		The agents of the crowd.
 	/// @param[in]	env			The environments of the agents of the crowd.
-	dtCrowdQuery(unsigned maxAgents, const dtCrowdAgent* agents, const dtCrowdAgentEnvironment* env);
+	/// @param[in]	grid		The proximity grid containing the agents of the crowd. [Opt]
+	/// @param[in]	polys		The last polygon known for every agent of the crowd. [Opt]
+	dtCrowdQuery(unsigned maxAgents, const dtCrowdAgent* agents, const dtCrowdAgentEnvironment* env, 
+				 const dtProximityGrid* grid = 0, const dtPolyRef* polys = 0);
 
 	~dtCrowdQuery();
 
@@ -160,6 +217,26 @@ public:
 	/// @return Returns the environment of the given agent
 	const dtCrowdAgentEnvironment* getAgentEnvironment(unsigned id) const;
 
+	/// Gets the last polygon the given agent was known to be on.
+	/// It is a good hint to locate the agent with dtNavMeshQuery::locatePoint().
+	/// @param[in]	id	The id of the agent
+	/// @return Returns the polygon, or 0 if it is not known.
+	dtPolyRef getAgentPoly(unsigned id) const;
+
+	/// Gets the proximity grid containing the active agents of the crowd.
+	/// The grid is rebuilt by the crowd every time its environment is updated.
+	/// @return Returns the proximity grid, or null if the crowd does not use one.
+	const dtProximityGrid* getProximityGrid() const;
+
+	/// Gets the number of velocity updates done by the crowd.
+	/// The behaviors can use it to know whether they were already prepared for the current update.
+	/// @return Returns the index of the current velocity update.
+	unsigned getFrame() const;
+
+	/// Gets the statistics the behaviors can fill while they update the agents.
+	/// @return Returns the statistics, or null if they are not gathered.
+	dtCrowdStats* getStats() const;
+
 	/// Get the offMesh connection the agent is on or close to.
 	/// The user can specify an additional distance if he wants to know if an offMesh connection
 	/// is located at a certain distance of the agent.
@@ -175,12 +252,54 @@ public:
 	void startOffMeshConnection(dtCrowdAgent& ag, const dtOffMeshConnection& connection) const;
 
 private:
+	friend class dtCrowd;
+
 	float m_ext[3];								///< The query filters used for navigation queries.
 	dtNavMeshQuery* m_navMeshQuery;				///< Used to perform queries on the navigation mesh.
 	dtQueryFilter m_filter;						///< Defines polygon filtering and traversal costs for navigation mesh query operations.
 	const dtCrowdAgent* m_agents;				///< The agents of the crowd
 	unsigned m_maxAgents;						///< Max number of agents in the crowd
 	const dtCrowdAgentEnvironment* m_agentsEnv;	///< The environments of the agents
+	const dtProximityGrid* m_grid;				///< The proximity grid containing the agents
+	const dtPolyRef* m_agentsPolys;				///< The last polygon known for every agent
+	unsigned m_frame;							///< The index of the current velocity update
+	dtCrowdStats* m_stats;						///< The statistics filled using this query, null if not gathered
+};
+
+/// A piece of work the crowd wants to split across several workers.
+/// @ingroup crowd
+/// @see dtCrowdWorkerPool
+class dtCrowdTask
+{
+public:
+	virtual ~dtCrowdTask() {}
+
+	/// Executes the share of the task assigned to the given worker.
+	///
+	/// @param[in]	worker	The index of the worker. [Limit: < number of workers]
+	virtual void execute(unsigned worker) = 0;
+};
+
+/// Interface to the thread pool used by the crowd to update its agents in parallel.
+///
+/// The crowd never creates threads by itself, the user provides the pool so it can be 
+/// shared with the rest of the application (job system, thread pool, etc.)
+/// @ingroup crowd
+/// @see dtCrowd::setWorkerPool
+class dtCrowdWorkerPool
+{
+public:
+	virtual ~dtCrowdWorkerPool() {}
+
+	/// Executes every share of the given task.
+	///
+	/// Must call @p task.execute(i) exactly once for every i in [0, @p nbWorkers).
+	/// The calls may run concurrently and in any order, but the method must only return
+	/// once all of them are finished.
+	///
+	/// @param[in]	task		The task to execute.
+	/// @param[in]	nbWorkers	The number of shares of the task.
+	virtual void run(dtCrowdTask& task, unsigned nbWorkers) = 0;
 };
 
 /// Class containing and handling the agents of the simulation.
@@ -196,13 +315,85 @@ class dtCrowd
 	unsigned m_maxAgents;					///< The maximum number of agents contained by the crowd
 	unsigned m_nbActiveAgents;				///< The number of active agents
 	dtCrowdAgent* m_agents;					///< The agents of the crowd
-	dtCrowdAgent** m_activeAgents;			///< the actives agents of the crowd
-	unsigned* m_agentsToUpdate;				///< indexes of all agents
+	dtCrowdAgent* m_agentsSnapshot;			///< State of the agents at the beginning of the behaviors update, read by the behaviors
+	dtCrowdAgent** m_activeAgents;			///< The active agents of the crowd, sorted by id [Size: m_nbActiveAgents]
+	unsigned* m_agentsToUpdate;				///< The ids of the active agents, sorted, updated by default [Size: m_nbActiveAgents]
+	unsigned* m_freeSlots;					///< Stack of the ids of the inactive agents
+	unsigned m_nbFreeSlots;					///< The number of ids in m_freeSlots
 		
 	float m_maxAgentRadius;					///< Maximal radius for an agent
 	unsigned m_maxCommonNodes;				///< Maximal number of search nodes for the navigation mesh
 
 	float** m_disp;							///< Used to prevent agents from bumping into each other
+	dtPolyRef* m_currentPosPoly;			///< The polygons of the agents being updated before their movement [Size: maxAgents]
+	float* m_currentPos;					///< The positions of the agents being updated before their movement [Size: maxAgents * 3]
+	dtPolyRef* m_agentsPolys;				///< The polygon every agent was last located on, 0 if unknown [Size: maxAgents]
+
+	dtProximityGrid* m_grid;				///< Spatial hash of the active agents used to find neighbors
+	dtWallSegmentCache* m_wallCaches;		///< The wall segments read by the local boundaries (one cache per worker) [Size: m_nbWorkers]
+	unsigned* m_neighborsCandidates;		///< Ids of the agents returned by the proximity grid (one list per worker)
+	dtCrowdNeighbour* m_neighbors;			///< The neighbors of every agent, pointed to by their environment [Size: m_maxAgents * m_maxNeighbors]
+	unsigned m_maxNeighbors;				///< The maximum number of neighbors of an agent
+	dtLodScheduler* m_lod;					///< Chooses the agents updated by updateScheduled()
+
+	dtCrowdWorkerPool* m_workerPool;		///< Pool used to run the update in parallel, null for a serial update
+	unsigned m_nbWorkers;					///< The number of workers the agents are split across
+	dtCrowdQuery** m_workersQueries;		///< The crowd query of every worker (the first one is m_crowdQuery)
+
+	dtCrowdKinematics* m_kinematics;		///< Structure of arrays copy of the kinematic data of the agents being updated
+	bool m_kinematicsEnabled;				///< True if the kinematic steps run on m_kinematics
+
+	dtCrowdStats* m_stats;					///< The statistics of the crowd, followed by the counters of every other worker [Size: m_nbWorkers]
+	bool m_statsEnabled;					///< True if the statistics are gathered
+
+	unsigned m_budgetMaxAgents;				///< The maximum number of agents whose environment and velocity are updated by update(), 0 if unlimited
+	float m_budgetMaxTime;					///< The time after which update() stops updating environments and velocities, 0 if unlimited
+	unsigned m_budgetCursor;				///< Index in m_agentsToUpdate of the first agent the next budgeted update starts from
+	unsigned* m_budgetIds;					///< The ids of the agents of the slice being updated by a budgeted update [Size: BUDGET_SLICE_SIZE]
+
+	/// The agents updated by the same behavior.
+	struct BehaviorBatch
+	{
+		dtBehavior* behavior;			///< The behavior of the agents
+		unsigned first;					///< The index of the first agent of the batch in m_batchIds
+		unsigned nbAgents;				///< The number of agents of the batch
+		unsigned hashSlot;				///< The slot of the batch in m_batchHash
+	};
+
+	BehaviorBatch* m_batches;				///< The batches of the current update [Size: maxAgents]
+	unsigned* m_batchIds;					///< The ids of the agents being updated, grouped by batch [Size: maxAgents]
+	int* m_batchHash;						///< The batch of every behavior, indexed by the hash of the behavior, -1 if none
+	unsigned m_batchHashSize;				///< The number of slots of m_batchHash (power of two)
+	dtBehavior** m_updatedBehaviors;		///< The behaviors prepared by the current velocity update [Size: maxAgents]
+	unsigned m_nbUpdatedBehaviors;			///< The number of behaviors prepared by the current velocity update
+
+	/// The steps of the update that are split across the workers.
+	enum UpdateStep
+	{
+		STEP_ENVIRONMENT,				///< Local boundaries and neighbors
+		STEP_INTEGRATE,					///< Current polygon and integration of the velocity
+		STEP_COMPUTE_DISPLACEMENTS,		///< Displacements solving the collisions between the agents
+		STEP_APPLY_DISPLACEMENTS,		///< Application of the displacements
+		STEP_CONSTRAIN_POSITIONS,		///< Movement along the navigation mesh and off-mesh connections
+	};
+
+	/// The data shared by the workers during an update step.
+	struct UpdateContext
+	{
+		UpdateStep step;				///< The step to execute
+		const unsigned* agentsIdx;		///< The indices of the agents to update
+		unsigned nbIdx;					///< The number of indices
+		const dtLodScheduler::Group* groups;	///< The time step of the agents, by contiguous ranges of @p agentsIdx
+		unsigned nbGroups;				///< The number of groups
+	};
+
+	friend class dtCrowdStepTask;
+
+	/// Executes the given update step, in parallel if a worker pool is available.
+	void runStep(const UpdateContext& context);
+
+	/// Executes the share of the given update step assigned to the given worker.
+	void executeStep(const UpdateContext& context, unsigned worker);
 	
 	/// Returns the index of the given agent
 	inline unsigned getAgentIndex(const dtCrowdAgent* agent) const  { return agent - m_agents; }
@@ -217,9 +408,71 @@ class dtCrowd
 	/// Uses the field of view of the agent for that.
 	/// The neighbors will be stored in the agent environment
 	///
-	/// @param[in]	id	ID of the agent
+	/// @param[in]	id			ID of the agent
+	/// @param[in]	candidates	Buffer receiving the agents found in the proximity grid. [Size: maxAgents]
+	/// @param[out]	stats		The statistics counting the candidates tested. [Opt]
 	/// @return	The number of neighbors found
-	unsigned computeNeighbors(unsigned id);
+	unsigned computeNeighbors(unsigned id, unsigned* candidates, dtCrowdStats* stats);
+
+	/// Finds the polygon the given agent is standing on.
+	/// The last known polygon of the agent is reused if the agent is still above it, 
+	/// otherwise the polygon is searched using the navigation mesh query.
+	///
+	/// @param[in]	ag			The agent.
+	/// @param[in]	query		The crowd query used to search the polygon.
+	/// @param[out]	ref			The polygon of the agent, 0 if none was found.
+	/// @param[out]	pos			The position of the agent on the polygon. [(x, y, z)]
+	void locateAgent(const dtCrowdAgent& ag, dtCrowdQuery& query, dtPolyRef* ref, float* pos);
+
+	/// Allocates the data of the given number of workers, the previous ones being freed.
+	/// @return False if the allocation failed, the crowd then has no worker and cannot be updated.
+	bool allocateWorkers(dtCrowdWorkerPool* pool, const unsigned nbWorkers);
+
+	/// Frees the data of the workers.
+	void freeWorkers();
+
+	/// Makes the queries of the workers point to their statistics, or to nothing if the statistics are disabled.
+	void attachStats();
+
+	/// Adds the counters of the workers to the statistics of the crowd.
+	void gatherStats();
+
+	/// Inserts every active agent into the proximity grid.
+	void updateProximityGrid();
+
+	/// Computes the neighbors and the local boundary of the given agents, the proximity grid being up to date.
+	void computeEnvironment(unsigned* agentsIdx, unsigned nbIdx);
+
+	/// Copies the active agents into the snapshot read by the behaviors, and starts a new velocity update.
+	void takeSnapshot();
+
+	/// Prepares the behaviors of the given agents, the snapshot being taken.
+	/// Called once per update of the crowd, however many times computeVelocity() is called during it.
+	void beginVelocityUpdate(const float dt, const unsigned* agentsIdx, unsigned nbIdx);
+
+	/// Updates the velocity of the given agents, between beginVelocityUpdate() and endVelocityUpdate().
+	void computeVelocity(const float dt, unsigned* agentsIdx, unsigned nbIdx);
+
+	/// Finishes the behaviors prepared by beginVelocityUpdate().
+	void endVelocityUpdate(const float dt);
+
+	/// Moves the given agents, every group of agents with its own time step. The collisions are solved between all of them at once.
+	void computePosition(unsigned* agentsIdx, unsigned nbIdx, const dtLodScheduler::Group* groups, unsigned nbGroups);
+
+	/// Updates the agents within the limits of the update budget.
+	void updateBudgeted(const float dt);
+
+	/// Groups the given agents by behavior into m_batches.
+	/// The agents of a batch keep the order in which they were given.
+	/// @return The number of batches
+	unsigned buildBehaviorBatches(const unsigned* agentsIdx, unsigned nbIdx);
+
+	/// Returns the slot of the given behavior in m_batchHash, or the empty slot where it should be inserted.
+	unsigned findBatchSlot(const dtBehavior* behavior) const;
+
+	/// Returns the position of the given agent in the list of the active agents,
+	/// or the position where it should be inserted if it is not active.
+	unsigned findActiveAgent(unsigned id) const;
 
 	/// Cleans the crowd so it can be used for a fresh start
 	void purge();
@@ -232,8 +485,73 @@ public:
 	///  @param[in]		maxAgents		The maximum number of agents the crowd can manage. [Limit: >= 1]
 	///  @param[in]		maxAgentRadius	The maximum radius of any agent that will be added to the crowd. [Limit: > 0]
 	///  @param[in]		nav				The navigation mesh to use for planning.
+	///  @param[in]		maxNeighbors	The maximum number of neighbors an agent takes into account. [Limit: >= 1]
 	/// @return True if the initialization succeeded.
-	bool init(const unsigned maxAgents, const float maxAgentRadius, dtNavMesh* nav);	
+	bool init(const unsigned maxAgents, const float maxAgentRadius, dtNavMesh* nav, 
+			  const unsigned maxNeighbors = DT_CROWDAGENT_MAX_NEIGHBOURS);
+
+	/// The maximum number of neighbors an agent takes into account.
+	unsigned getMaxNeighbors() const { return m_maxNeighbors; }
+
+	/// Sets the pool used to update the agents in parallel.
+	///
+	/// Must be called after init(). Every worker gets its own navigation mesh query, 
+	/// so the navigation mesh queries of the environment and position updates can run concurrently.
+	/// The behaviors are still updated serially, using the crowd query of the crowd.
+	/// The results do not depend on the number of workers.
+	///
+	///  @param[in]		pool		The pool running the workers, null to update the crowd serially.
+	///  @param[in]		nbWorkers	The number of workers the agents are split across. [Limit: >= 1]
+	/// @return True if the workers could be initialized, otherwise the crowd is updated serially.
+	bool setWorkerPool(dtCrowdWorkerPool* pool, const unsigned nbWorkers);
+
+	/// Gets the number of workers the agents are split across when updated.
+	unsigned getWorkerCount() const { return m_nbWorkers; }
+
+	/// Chooses whether the integration, the acceleration clamp and the collision resolution
+	/// work on a structure of arrays copy of the agents, four agents at a time when SSE2 is available.
+	/// Enabled by default. The results are the same in both cases.
+	///
+	///  @param[in]		enabled		True to use the structure of arrays, false to work on the agents directly.
+	void setKinematicsEnabled(const bool enabled) { m_kinematicsEnabled = enabled; }
+
+	/// Returns true if the kinematic steps work on a structure of arrays copy of the agents.
+	bool isKinematicsEnabled() const { return m_kinematicsEnabled; }
+
+	/// Chooses whether the crowd measures the cost of its updates. Disabled by default.
+	///
+	/// The statistics are reset at the beginning of every call to update(). 
+	/// When the phases of the update are called separately, they accumulate until resetStats() is called.
+	///
+	///  @param[in]		enabled		True to gather the statistics.
+	void setStatsEnabled(const bool enabled);
+
+	/// Returns true if the crowd measures the cost of its updates.
+	bool isStatsEnabled() const { return m_statsEnabled; }
+
+	/// Limits the work done by update() when it updates every agent.
+	///
+	/// The environment and velocity updates, which are the expensive ones, are done slice by slice,
+	/// starting from the agent where the previous update stopped, until the budget is spent.
+	/// The other agents keep their velocity: their motion is extrapolated by the position update, 
+	/// which still moves every agent.
+	///
+	///  @param[in]		maxAgents	The maximum number of agents whose environment and velocity are updated, 0 if unlimited.
+	///  @param[in]		maxTime		The time, in microseconds, after which no other slice is started, 0 if unlimited.
+	void setUpdateBudget(const unsigned maxAgents, const float maxTime);
+
+	/// The maximum number of agents whose environment and velocity are updated by update(), 0 if unlimited.
+	unsigned getUpdateBudgetAgents() const { return m_budgetMaxAgents; }
+
+	/// The time, in microseconds, after which update() stops updating environments and velocities, 0 if unlimited.
+	float getUpdateBudgetTime() const { return m_budgetMaxTime; }
+
+	/// Sets every statistic of the crowd to 0.
+	void resetStats();
+
+	/// Gets the statistics of the last updates.
+	/// @return The statistics, or null if they are not gathered.
+	const dtCrowdStats* getStats() const { return m_statsEnabled ? m_stats : 0; }
 
 	/// @name Data access
 	/// @{
@@ -272,6 +590,11 @@ public:
 
 	const dtCrowdQuery* getCrowdQuery() const { return m_crowdQuery; }
 	dtCrowdQuery* getCrowdQuery() { return m_crowdQuery; }
+
+	/// Gets the scheduler choosing the agents updated by updateScheduled().
+	/// Its tiers, points of interest and the tiers of the agents can be edited at any time.
+	const dtLodScheduler* getLodScheduler() const { return m_lod; }
+	dtLodScheduler* getLodScheduler() { return m_lod; }
 	/// @}
 
 	/// @name Data modifiers
@@ -319,13 +642,25 @@ public:
 
 	/// Updates the steering and positions of the agents whose indices may be given by the user.
 	/// If no indices are given, then the method updates every agent.
+	/// If no indices are given and an update budget is set, only some of the agents have their environment and velocity updated.
 	///  @param[in]		dt			The time, in seconds, to update the simulation. [Limit: > 0]
 	///  @param[in]		agentsIdx	The list of the indices of the agents we want to update. [Opt]
 	///  @param[in]		nbIdx		Size of the list of indices. [Opt]
+	/// @see setUpdateBudget
 	void update(const float dt, unsigned* agentsIdx = 0, unsigned nbIdx = 0);
 
+	/// Updates the agents chosen by the level of detail scheduler (see getLodScheduler()).
+	/// The environment of every scheduled agent is updated at once, then their velocity and position, 
+	/// every group of agents with the time elapsed since the last update of its agents.
+	/// Without any tier in the scheduler, this is the same as update().
+	///  @param[in]		dt			The time, in seconds, elapsed since the last update. [Limit: > 0]
+	void updateScheduled(const float dt);
+
 	/// Updates the velocity of the agents whose indices may be given by the user (but not their position).
 	/// If no indices are given, then the method updates every agent.
+	/// The behaviors read the agents from a snapshot taken at the beginning of the update, 
+	/// so the results do not depend on the order in which the agents are updated.
+	/// The agents are grouped by behavior, and every behavior updates its agents in a single call to dtBehavior::updateBatch().
 	///  @param[in]		dt			The time, in seconds, to update the simulation. [Limit: > 0]
 	///  @param[in]		agentsIdx	The list of the indices of the agents we want to update. [Opt]
 	///  @param[in]		nbIdx		Size of the list of indices. [Opt]
@@ -400,12 +735,12 @@ dtCrowd crowd;
 int nbMaxAgents = 1000;
 // The maximum radius for an agent
 float maxRadius = 10.f;
-// How close should an element be before being considered as an obstacle?
-float collisionRange = 4.f;
+// How many neighbors can an agent take into account?
+unsigned nbMaxNeighbors = 6;
 
 // Note: the navigation mesh must already be initialized
 // The navigation mesh will be used by the agents for navigation
-crowd.init(nbMaxAgents, mawRadius, navigationMesh, collisionRange);
+crowd.init(nbMaxAgents, maxRadius, navigationMesh, nbMaxNeighbors);
 @endcode
 
 You now have a crowd ready to work, but empty...
@@ -544,6 +879,72 @@ You can individually call these updates using the following methods:
 
 @note Calling the method `dtCrowd::update()` will call all three methods listed above.
 
+## Level of detail
+
+The agents far from what matters (the camera, the players...) do not need to be updated at every frame.
+The level of detail scheduler of the crowd puts every agent in a tier, given by its distance to some points of interest 
+or chosen explicitly, and every tier is updated at its own rate:
+
+@code
+dtLodTier tiers[] = {{30.f, 1}, {100.f, 4}, {FLT_MAX, 16}};
+crowd.getLodScheduler()->setTiers(tiers, 3);
+crowd.getLodScheduler()->setPointsOfInterest(cameraPosition, 1);
+
+// Every frame
+crowd.updateScheduled(dt);
+@endcode
+
+The agents of a slow tier are updated in turns, with the time elapsed since their last update, 
+so the cost of the tier is spread over the frames.
+
+## Parallel update
+
+The environment and the position updates can be split across several threads. The crowd does not create any thread, 
+it uses the pool you give it by implementing `dtCrowdWorkerPool`:
+
+@code
+class MyPool : public dtCrowdWorkerPool
+{
+public:
+	virtual void run(dtCrowdTask& task, unsigned nbWorkers)
+	{
+		// Calls task.execute(i) for every i in [0, nbWorkers) on your threads, 
+		// and waits for all of them to be finished.
+	}
+};
+
+MyPool pool;
+crowd.setWorkerPool(&pool, 4); // The agents are now split across 4 workers
+@endcode
+
+Every worker has its own `dtNavMeshQuery`, so the navigation mesh queries run concurrently. 
+The results of the update are the same whatever the number of workers.
+
+## Kinematics
+
+During the position update and the acceleration clamp, the position, velocity, radius, and acceleration of the agents 
+being updated are copied into a structure of arrays (`dtCrowdKinematics`). The integration and the collision 
+resolution then process four agents at a time using SSE2 when it is available (define `DT_NO_SIMD` to disable it), 
+and the results are copied back to the agents. The results are exactly the same as the ones of the scalar update, 
+which can be selected using `dtCrowd::setKinematicsEnabled(false)`.
+
+## Statistics
+
+The crowd can measure the cost of its updates, so you know which part of the update takes the most time 
+without using a profiler:
+
+@code
+crowd.setStatsEnabled(true);
+crowd.update(dt);
+
+const dtCrowdStats* stats = crowd.getStats();
+// stats->environmentTime, stats->velocityTime, stats->positionTime (in microseconds),
+// the time spent per behavior, and the number of navigation mesh queries, local boundary updates, 
+// neighbor candidates, avoidance samples and path finding iterations
+@endcode
+
+The behaviors can fill the statistics through `dtCrowdQuery::getStats()`, which returns null when they are disabled.
+
 # Other features
 
 ## Change the position of an agent
@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+
+#ifndef DETOURCROWDKINEMATICS_H
+#define DETOURCROWDKINEMATICS_H
+
+struct dtCrowdAgent;
+struct dtCrowdAgentEnvironment;
+
+/// Structure of arrays storing the kinematic data of the agents updated by the crowd.
+///
+/// Every agent to update is copied into a lane of the store, the lane being the position of the agent
+/// in the list of agents to update. The integration, the acceleration clamp and the collision resolution 
+/// then run on contiguous arrays, four agents at a time when SSE2 is available.
+/// The results are exactly the same as the ones of the scalar code working on the agents.
+///
+/// @ingroup crowd
+class dtCrowdKinematics
+{
+	float* m_posX;				///< Position of the agents on the x axis
+	float* m_posY;				///< Position of the agents on the y axis
+	float* m_posZ;				///< Position of the agents on the z axis
+	float* m_velX;				///< Velocity of the agents on the x axis
+	float* m_velY;				///< Velocity of the agents on the y axis
+	float* m_velZ;				///< Velocity of the agents on the z axis
+	float* m_dvelX;				///< Desired velocity of the agents on the x axis
+	float* m_dvelY;				///< Desired velocity of the agents on the y axis
+	float* m_dvelZ;				///< Desired velocity of the agents on the z axis
+	float* m_dispX;				///< Displacement of the agents on the x axis
+	float* m_dispZ;				///< Displacement of the agents on the z axis
+	float* m_radius;			///< Radius of the agents
+	float* m_maxAcceleration;	///< Maximum acceleration of the agents
+	float* m_walking;			///< 1 if the agent is walking, 0 if the lane must not be modified
+	unsigned* m_ids;			///< Id of the agent stored in every lane
+	int* m_lanes;				///< Lane of every agent of the crowd, -1 if the agent is not stored
+
+	unsigned m_maxLanes;		///< The maximum number of lanes
+	unsigned m_maxAgents;		///< The maximum number of agents of the crowd
+
+	/// Cleans the store
+	void purge();
+
+public:
+	dtCrowdKinematics();
+	~dtCrowdKinematics();
+
+	/// Initializes the store.
+	///
+	/// @param[in]	maxAgents	The maximum number of agents of the crowd, and of lanes of the store.
+	///
+	/// @return True if the initialization succeeded, false otherwise.
+	bool init(const unsigned maxAgents);
+
+	/// Copies the kinematic data of the given agent into the given lane.
+	/// Lanes of agents that are not walking are stored but never modified.
+	///
+	/// @param[in]	lane	The lane receiving the data. [Limit: < maxAgents]
+	/// @param[in]	ag		The agent to copy, null to mark the lane as unused.
+	void load(const unsigned lane, const dtCrowdAgent* ag);
+
+	/// Forgets the lanes of the given agents, so they are read from the agents of the crowd again.
+	///
+	/// @param[in]	ids		The ids of the agents.
+	/// @param[in]	nbIds	The number of ids.
+	void unload(const unsigned* ids, const unsigned nbIds);
+
+	/// Copies the position and velocity stored in the given lane into the given agent.
+	void storePositionAndVelocity(const unsigned lane, dtCrowdAgent& ag) const;
+
+	/// Copies the velocity stored in the given lane into the given agent.
+	void storeVelocity(const unsigned lane, dtCrowdAgent& ag) const;
+
+	/// Moves the walking agents of the given lanes along their velocity.
+	/// Agents whose velocity is too small are stopped.
+	void integrate(const unsigned begin, const unsigned end, const float dt);
+
+	/// Changes the velocity of the walking agents of the given lanes toward their desired velocity,
+	/// according to their maximum acceleration.
+	void clampAcceleration(const unsigned begin, const unsigned end, const float dt);
+
+	/// Computes the displacements pushing the walking agents of the given lanes away from their neighbors.
+	///
+	/// @param[in]	begin		The first lane.
+	/// @param[in]	end			The lane after the last one.
+	/// @param[in]	agents		The agents of the crowd, used for the neighbors that are not stored.
+	/// @param[in]	envs		The environments of the agents of the crowd.
+	/// @param[in]	factor		The fraction of the penetration solved by the displacement.
+	void computeDisplacements(const unsigned begin, const unsigned end, const dtCrowdAgent* agents, 
+							  const dtCrowdAgentEnvironment* envs, const float factor);
+
+	/// Moves the walking agents of the given lanes by their displacement.
+	void applyDisplacements(const unsigned begin, const unsigned end);
+};
+
+#endif // DETOURCROWDKINEMATICS_H
@@ -0,0 +1,99 @@
+//
+// Copyright (c) 2013 MASA Group recastdetour@masagroup.net
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURFLOCKGROUP_H
+#define DETOURFLOCKGROUP_H
+
+struct dtCrowdAgent;
+class dtCrowdQuery;
+
+/// A group of agents flocking together.
+///
+/// The members of a group share its aggregates (the sum of their positions and velocities).
+/// The aggregates are computed once per update of the crowd, by the first member needing them, 
+/// so a behavior using the group costs O(1) per agent instead of a loop over every other member.
+///
+/// The aggregates are read from the crowd query, so the group must only be used while the behaviors are updated.
+/// @ingroup behavior
+class dtFlockGroup
+{
+public:
+	dtFlockGroup();
+	~dtFlockGroup();
+
+	/// Creates an instance of the group
+	/// @return		A pointer on a newly allocated group
+	static dtFlockGroup* allocate();
+
+	/// Frees the given group
+	/// @param[in]	ptr	A pointer to the group we want to free
+	static void free(dtFlockGroup* ptr);
+
+	/// Sets the members of the group.
+	/// The ids are copied.
+	///
+	/// @param[in]	ids			The ids of the members.
+	/// @param[in]	nbMembers	The number of members.
+	///
+	/// @return False if the memory for the members could not be allocated. True otherwise
+	bool setMembers(const unsigned* ids, unsigned nbMembers);
+
+	/// Indicates whether the given agent is a member of the group. O(log n)
+	bool isMember(unsigned id) const;
+
+	/// Computes the average position of the active members of the group, except the given agent.
+	///
+	/// @param[in]	query	The crowd query used to access the agents.
+	/// @param[in]	ag		The agent asking for the center of the group.
+	/// @param[out]	center	The average position. [(x, y, z)]
+	///
+	/// @return False if no other member is active. True otherwise
+	bool getCenter(const dtCrowdQuery& query, const dtCrowdAgent& ag, float* center) const;
+
+	/// Computes the average velocity of the active members of the group, except the given agent.
+	///
+	/// @param[in]	query		The crowd query used to access the agents.
+	/// @param[in]	ag			The agent asking for the velocity of the group.
+	/// @param[out]	velocity	The average velocity. [(x, y, z)]
+	///
+	/// @return False if no other member is active. True otherwise
+	bool getAverageVelocity(const dtCrowdQuery& query, const dtCrowdAgent& ag, float* velocity) const;
+
+	/// @name Data access
+	/// @{
+	const unsigned* getMembers() const { return m_members; }
+	unsigned getMemberCount() const { return m_nbMembers; }
+	/// @}
+
+private:
+	/// Computes the aggregates of the group if they were not computed during the current update of the crowd.
+	/// @return The number of active members which are not the given agent.
+	unsigned updateAggregates(const dtCrowdQuery& query, const dtCrowdAgent& ag) const;
+
+	unsigned* m_members;			///< The ids of the members, sorted
+	unsigned m_nbMembers;			///< The number of members
+
+	mutable float m_positionSum[3];			///< The sum of the positions of the active members
+	mutable float m_velocitySum[3];			///< The sum of the velocities of the active members
+	mutable unsigned m_nbActive;			///< The number of active members
+
+	mutable const dtCrowdQuery* m_query;	///< The crowd for which the aggregates were computed
+	mutable unsigned m_frame;				///< The update of the crowd for which the aggregates were computed
+};
+
+#endif // DETOURFLOCKGROUP_H
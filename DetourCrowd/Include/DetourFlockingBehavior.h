@@ -25,6 +25,7 @@ struct dtCrowdAgent;
 class dtSeparationBehavior;
 class dtCohesionBehavior;
 class dtAlignmentBehavior;
+class dtFlockGroup;
 struct dtCrowdAgentEnvironment;
 
 
@@ -34,12 +35,18 @@ struct dtFlockingBehaviorParams
 {
 	unsigned* toFlockWith;			///< Indices of the agents to flock with.
 	unsigned nbflockingTargets;		///< Number of agents to flock with.
+	const dtFlockGroup* group;		///< The group the agent flocks with. If not null, toFlockWith is ignored.
 };
 
 /// Flocking behavior.
 /// Agents behaving that way will behave like a flock, or a herd. This basically means that 
 /// they will try to stick together as they move, heading in the same direction, and without 
 /// bumping into each other.
+///
+/// An agent either flocks with the agents listed in its parameters, which costs a loop over them per update, 
+/// or with a dtFlockGroup. The cohesion and alignment of the members of a group use the aggregates of the group,
+/// computed once per update, and their separation only considers the neighbors of the agent belonging to the group.
+/// This makes the update of a large group linear in the number of its members.
 /// @ingroup behavior
 class dtFlockingBehavior : public dtSteeringBehavior<dtFlockingBehaviorParams>
 {
@@ -72,6 +79,9 @@ public:
 	float separationDistance;	///< If the distance between two agents is less than this value, we try to separate them.
 	
 private:
+	/// Computes the flocking force of an agent belonging to a group.
+	void computeGroupForce(const dtCrowdQuery& query, const dtCrowdAgent& ag, const dtFlockGroup& group, float* force);
+
 	dtSeparationBehavior* m_separationBehavior;	///< The separation behavior
 	dtCohesionBehavior* m_cohesionBehavior;		///< The cohesion behavior
 	dtAlignmentBehavior* m_alignmentBehavior;	///< The alignment behavior
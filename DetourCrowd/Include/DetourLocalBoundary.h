@@ -21,6 +21,88 @@
 
 #include "DetourNavMeshQuery.h"
 
+class dtNavMesh;
+
+/// Cache of the wall segments of the polygons of a navigation mesh.
+///
+/// The segments of a polygon are extracted from the navigation mesh the first time they are requested,
+/// then shared by every local boundary reading them.
+/// The cache is emptied when the revision of the navigation mesh or the flags of the filter change
+/// (see #validate), so tiles can be added or removed and the state of the polygons can change.
+/// When it is full, the cache is emptied as well.
+///
+/// The segments depend on the filter: a filter overriding dtQueryFilter::passFilter must empty 
+/// the cache when its result changes.
+class dtWallSegmentCache
+{
+	/// The segments of a polygon
+	struct Entry
+	{
+		dtPolyRef ref;		///< The polygon, 0 if the entry is empty
+		int first;			///< The index of the first segment of the polygon
+		int count;			///< The number of segments of the polygon
+	};
+
+	Entry* m_entries;			///< Hash table of the polygons [Size: m_entriesSize]
+	int m_entriesSize;			///< The number of entries of the table (power of two)
+	int m_nbEntries;			///< The number of polygons in the cache
+	int m_maxEntries;			///< The maximum number of polygons in the cache
+
+	float* m_segs;				///< The segments of the polygons [(ax, ay, az, bx, by, bz) * m_maxSegs]
+	int m_nbSegs;				///< The number of segments in the cache
+	int m_maxSegs;				///< The maximum number of segments in the cache
+
+	const dtNavMesh* m_nav;		///< The navigation mesh the segments were extracted from
+	unsigned int m_revision;	///< The revision of the navigation mesh the segments were extracted from
+	unsigned short m_includeFlags;	///< The include flags of the filter the segments were extracted with
+	unsigned short m_excludeFlags;	///< The exclude flags of the filter the segments were extracted with
+
+	int m_hits;					///< The number of requests served by the cache
+	int m_misses;				///< The number of requests that extracted the segments from the navigation mesh
+
+	/// Cleans the cache
+	void purge();
+
+public:
+	dtWallSegmentCache();
+	~dtWallSegmentCache();
+
+	/// Initializes the cache.
+	///
+	/// @param[in]	maxPolys		The maximum number of polygons in the cache. [Limit: > 0]
+	/// @param[in]	maxSegments		The maximum number of segments in the cache. [Limit: > 0]
+	///
+	/// @return True if the initialization succeeded, false otherwise
+	bool init(const int maxPolys, const int maxSegments);
+
+	/// Removes every polygon from the cache.
+	void clear();
+
+	/// Empties the cache if the navigation mesh or the filter changed since the segments were extracted.
+	///
+	/// @param[in]	nav		The navigation mesh the segments are extracted from.
+	/// @param[in]	filter	The filter used to extract the segments.
+	void validate(const dtNavMesh* nav, const dtQueryFilter* filter);
+
+	/// Gets the wall segments of the given polygon, extracting them if they are not in the cache.
+	///
+	/// @param[in]	ref			The polygon.
+	/// @param[in]	navquery	The query used to extract the segments.
+	/// @param[in]	filter		The filter used to extract the segments.
+	/// @param[out]	segs		The segments of the polygon, valid until the next call. [(ax, ay, az, bx, by, bz) * count]
+	///
+	/// @return The number of segments of the polygon.
+	int getWallSegments(dtPolyRef ref, const dtNavMeshQuery* navquery, const dtQueryFilter* filter, const float** segs);
+
+	/// @name Data access
+	/// @{
+	inline int getPolyCount() const { return m_nbEntries; }
+	inline int getHitCount() const { return m_hits; }
+	inline int getMissCount() const { return m_misses; }
+	inline void resetCounters() { m_hits = 0; m_misses = 0; }
+	/// @}
+};
+
 
 /// Set of segments representing the obstacles around an agent
 class dtLocalBoundary
@@ -62,8 +144,9 @@ public:
 	/// @param[in]	collisionQueryRange		The polygon on the navigation mesh where the given position is located
 	/// @param[in]	navquery				The polygon on the navigation mesh where the given position is located
 	/// @param[in]	filter					The polygon on the navigation mesh where the given position is located
+	/// @param[in]	cache					The cache the wall segments of the polygons are read from. [Opt]
 	void update(dtPolyRef ref, const float* pos, const float collisionQueryRange,
-				dtNavMeshQuery* navquery, const dtQueryFilter* filter);
+				dtNavMeshQuery* navquery, const dtQueryFilter* filter, dtWallSegmentCache* cache = 0);
 	
 	/// Checks that all polygons still pass query filter and are still valid.
 	bool isValid(dtNavMeshQuery* navquery, const dtQueryFilter* filter);
@@ -0,0 +1,169 @@
+//
+// Copyright (c) 2013 MASA Group recastdetour@masagroup.net
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURLODSCHEDULER_H
+#define DETOURLODSCHEDULER_H
+
+struct dtCrowdAgent;
+
+/// The maximum number of level of detail tiers of a scheduler.
+/// @ingroup crowd
+static const int DT_LOD_MAX_TIERS = 8;
+
+/// A level of detail tier: how often its agents are updated.
+/// @ingroup crowd
+struct dtLodTier
+{
+	float maxDistance;	///< The agents closer than this distance to a point of interest belong to the tier (if not to a previous one). [Limit: >= 0]
+	unsigned period;	///< The agents of the tier are updated once every @p period updates. [Limit: >= 1]
+};
+
+/// Decides which agents of a crowd are updated, and with which time step.
+///
+/// Every agent belongs to a tier, either chosen explicitly or given by its distance to the closest point of interest
+/// (a camera, a player...). The agents further than the distance of every tier belong to the last one.
+/// The agents of a tier are split in @p period slices by id, and one slice is updated at every update,
+/// so the cost of a tier is spread over the updates. An agent is updated with the time accumulated since its last update.
+///
+/// Without any tier, every agent is updated at every update.
+///
+/// @ingroup crowd
+/// @see dtCrowd::updateScheduled
+class dtLodScheduler
+{
+public:
+	/// Agents updated with the same time step.
+	struct Group
+	{
+		unsigned first;		///< Index of the first agent of the group in getScheduledIds().
+		unsigned nbAgents;	///< The number of agents of the group.
+		float dt;			///< The time step of the agents of the group.
+	};
+
+private:
+	/// An agent to update, and the time accumulated since its last update
+	struct ScheduledAgent
+	{
+		float dt;
+		unsigned id;
+	};
+
+	unsigned m_maxAgents;			///< The maximum number of agents
+	float* m_accumulatedTime;		///< The time elapsed since the last update of every agent [Size: m_maxAgents]
+	signed char* m_explicitTiers;	///< The tier chosen for every agent, -1 if given by the distance [Size: m_maxAgents]
+	unsigned char* m_tiers;			///< The tier of every agent at the last update [Size: m_maxAgents]
+
+	dtLodTier m_lodTiers[DT_LOD_MAX_TIERS];	///< The tiers, sorted by distance
+	unsigned m_nbLodTiers;					///< The number of tiers
+
+	float* m_points;				///< The points of interest [(x, y, z) * m_nbPoints]
+	unsigned m_nbPoints;			///< The number of points of interest
+	unsigned m_maxPoints;			///< The number of points m_points can contain
+
+	ScheduledAgent* m_scheduled;	///< The agents to update [Size: m_maxAgents]
+	unsigned* m_scheduledIds;		///< The ids of the agents to update, grouped by time step [Size: m_maxAgents]
+	unsigned m_nbScheduled;			///< The number of agents to update
+	Group* m_groups;				///< The groups of agents sharing the same time step [Size: m_maxAgents]
+	unsigned m_nbGroups;			///< The number of groups
+
+	unsigned m_tick;				///< The number of updates scheduled so far
+
+	/// Computes the tier of the given agent.
+	unsigned computeTier(const dtCrowdAgent& ag) const;
+
+	/// Sorts the scheduled agents by time step, then by id.
+	static int compareScheduledAgents(const void* a, const void* b);
+
+	/// Cleans the scheduler
+	void purge();
+
+public:
+	dtLodScheduler();
+	~dtLodScheduler();
+
+	/// Initializes the scheduler.
+	///
+	/// @param[in]	maxAgents	The maximum number of agents of the crowd. [Limit: > 0]
+	///
+	/// @return True if the initialization succeeded, false otherwise.
+	bool init(const unsigned maxAgents);
+
+	/// Sets the tiers of the scheduler.
+	///
+	/// @param[in]	tiers	The tiers, sorted by increasing distance. [Size: nbTiers]
+	/// @param[in]	nbTiers	The number of tiers. [Limit: <= #DT_LOD_MAX_TIERS]
+	///
+	/// @return False if the tiers are not sorted or have a null period, or if there are too many of them.
+	bool setTiers(const dtLodTier* tiers, const unsigned nbTiers);
+
+	/// Sets the points of interest deciding the tier of the agents.
+	///
+	/// @param[in]	points		The points of interest. [(x, y, z) * nbPoints]
+	/// @param[in]	nbPoints	The number of points.
+	///
+	/// @return False if the points could not be stored.
+	bool setPointsOfInterest(const float* points, const unsigned nbPoints);
+
+	/// Chooses the tier of an agent, whatever its distance to the points of interest.
+	///
+	/// @param[in]	id		The id of the agent.
+	/// @param[in]	tier	The tier of the agent, or -1 to use the distance to the points of interest.
+	///
+	/// @return False if the id or the tier is out of bounds.
+	bool setAgentTier(const unsigned id, const int tier);
+
+	/// Gets the tier of the agent at the last update.
+	int getAgentTier(const unsigned id) const;
+
+	/// Forgets everything about an agent. Called when the agent is added to or removed from the crowd.
+	void resetAgent(const unsigned id);
+
+	/// Chooses the agents to update.
+	///
+	/// The scheduled agents are grouped by time step, and sorted by id inside of a group.
+	///
+	/// @param[in]	agents	The agents of the crowd, indexed by id.
+	/// @param[in]	ids		The ids of the active agents. [Size: nbIds]
+	/// @param[in]	nbIds	The number of active agents.
+	/// @param[in]	dt		The time elapsed since the last update. [Limit: > 0]
+	///
+	/// @return The number of groups of agents to update.
+	unsigned schedule(const dtCrowdAgent* agents, const unsigned* ids, const unsigned nbIds, const float dt);
+
+	/// @name Data access
+	/// @{
+	inline unsigned* getScheduledIds() { return m_scheduledIds; }
+	inline unsigned getScheduledCount() const { return m_nbScheduled; }
+	inline const Group& getGroup(const unsigned i) const { return m_groups[i]; }
+	inline unsigned getGroupCount() const { return m_nbGroups; }
+	inline unsigned getTierCount() const { return m_nbLodTiers; }
+	inline unsigned getPointCount() const { return m_nbPoints; }
+	/// @}
+};
+
+/// Allocates a scheduler object using the Detour allocator.
+/// @return A scheduler object that is ready for initialization, or null on failure.
+///  @ingroup crowd
+dtLodScheduler* dtAllocLodScheduler();
+
+/// Frees the specified scheduler object using the Detour allocator.
+///  @param[in]		ptr		A scheduler object allocated using #dtAllocLodScheduler
+///  @ingroup crowd
+void dtFreeLodScheduler(dtLodScheduler* ptr);
+
+#endif // DETOURLODSCHEDULER_H
@@ -22,8 +22,10 @@
 #include "DetourAlloc.h"
 #include "DetourCrowd.h"
 #include "DetourBehavior.h"
+#include "DetourCommon.h"
 
 #include <climits>
+#include <string.h>
 #include <new>
 
 
@@ -34,7 +36,17 @@ struct NoData
 
 /// A behavior that can be parametrized.
 ///
-/// Each agents can have parameters related to the behaviors
+/// Each agents can have parameters related to the behaviors.
+///
+/// The parameters are stored in blocks of contiguous `T` that are never moved, 
+/// so a pointer to the parameters of an agent stays valid until they are removed.
+/// An index maps the id of the agent to its slot in the blocks: 
+/// looking up existing parameters is a constant time operation that never allocates memory.
+/// Memory is only allocated when parameters are created and every slot is used, 
+/// or when the id of the agent is greater than the ids seen so far.
+/// The slots of removed parameters are reused by the next parameters created.
+///
+/// Creating or removing parameters is not thread safe, they should be created before updating the crowd.
 /// @ingroup behavior
 template <typename T = NoData>
 class dtParametrizedBehavior : public dtBehavior
@@ -43,10 +55,11 @@ public:
 	/// Constructs the behavior
 	/// The user must specify how many agents will be using this behavior.
 	/// You can have have a number of agents greater than this number, 
-	/// but it will be slower (because of the collisions in the Hash Table)
+	/// the storage will grow when needed.
 	///
 	/// @param[in]	nbAgentsEstimated	An estimation of the number of agents that will be using this behavior. 
-	///									You have more agents than this number indicates in the end, or less. It is just an estimation
+	///									You have more agents than this number indicates in the end, or less. It is just an estimation.
+	///									A behavior constructed with 0 can not store any parameter.
 	explicit dtParametrizedBehavior(unsigned nbAgentsEstimated);
 	virtual ~dtParametrizedBehavior();
 
@@ -54,9 +67,23 @@ public:
 	/// If the parameters already existed, then it is returned.
 	/// If either the id of the agent is invalid or a parameter already exists for this agent, it return a NULL pointer.
 	/// @param[in]	id 	The id of the agent we must add a parameter for
-	/// Returns the behavior parameter for the given agent. NULL if it doesn't exist.
+	/// Returns the behavior parameter for the given agent. NULL if it couldn't be created.
 	T* getBehaviorParams(unsigned id) const;
 
+	/// Finds the behavior parameters of the given agent, without creating them.
+	/// @param[in]	id 	The id of the agent
+	/// Returns the behavior parameter for the given agent. NULL if it doesn't exist.
+	T* findBehaviorParams(unsigned id) const;
+
+	/// Removes the behavior parameters of the given agent.
+	/// The pointers previously returned for this agent are no longer valid.
+	/// @param[in]	id 	The id of the agent
+	/// Returns true if the parameters existed, false otherwise.
+	bool removeBehaviorParams(unsigned id);
+
+	/// Returns the number of agents having parameters for this behavior.
+	unsigned getBehaviorParamsCount() const { return m_nbSlots - m_nbFreeSlots; }
+
 	/// This method automatically gets the parameters of the given agents and perform some checks on them (do they exist?). 
 	/// It then calls the `dtParametrizedBehavior::doUpdate()` method, which contains the implementation of the behavior.
 	/// This is the method the user must call from its main loop, but not the one he should overload.
@@ -75,94 +102,185 @@ protected:
 	virtual void doUpdate(const dtCrowdQuery& query, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, 
 						  const T& currentParams, T& newParams, float dt) = 0;
 
-	/// Linked List 
-	struct Node
-	{
-		T value;		///< The parameter
-		Node* next;		///< Pointer to the next element
-		unsigned id;	///< The id of the agent owning this parameter. Mandatory to handle collisions
-	};
+	static const unsigned BLOCK_SIZE = 64;	///< The number of parameters stored in a block
+
+	/// Gets the parameters stored in the given slot
+	T* getSlot(unsigned slot) const { return &m_blocks[slot / BLOCK_SIZE][slot % BLOCK_SIZE]; }
+
+	/// Grows the index so it can store the given id.
+	bool growIndex(unsigned id) const;
+
+	/// Finds or creates a slot that is not used.
+	bool allocSlot(unsigned& slot) const;
+
+	unsigned m_estimatedSize;		///< Number of parameters at the beginning, 0 if the behavior stores no parameter
+
+	mutable unsigned* m_index;		///< For every id, the slot of its parameters plus one, 0 if it has none
+	mutable unsigned m_indexSize;	///< The number of ids the index can store
 
-	unsigned m_size;		///< Number of parameters at the beginning
-	Node* m_agentsParams;	///< The data structure containing the parameters
+	mutable T** m_blocks;			///< The blocks of parameters
+	mutable unsigned m_nbBlocks;	///< The number of allocated blocks
+	mutable unsigned m_maxBlocks;	///< The number of blocks that @p m_blocks can store
+
+	mutable unsigned* m_freeSlots;	///< The stack of the slots of removed parameters
+	mutable unsigned m_nbFreeSlots;	///< The number of slots in the stack
+	mutable unsigned m_nbSlots;		///< The number of slots used so far (used or free)
 };
 
 
 template <typename T>
 dtParametrizedBehavior<T>::dtParametrizedBehavior(unsigned preAllocationSize)
-	: m_size(preAllocationSize)
+	: m_estimatedSize(preAllocationSize)
+	, m_index(0)
+	, m_indexSize(0)
+	, m_blocks(0)
+	, m_nbBlocks(0)
+	, m_maxBlocks(0)
+	, m_freeSlots(0)
+	, m_nbFreeSlots(0)
+	, m_nbSlots(0)
 {
-	if (m_size == 0)
-		m_agentsParams = 0;
-	else
+	if (m_estimatedSize > 0)
+		growIndex(m_estimatedSize - 1);
+}
+
+template <typename T>
+dtParametrizedBehavior<T>::~dtParametrizedBehavior()
+{
+	// Destroys the parameters still in use
+	for (unsigned id = 0; id < m_indexSize; ++id)
 	{
-		m_agentsParams = (Node*) dtAlloc(sizeof(Node) * m_size, DT_ALLOC_PERM);
+		if (m_index[id])
+			getSlot(m_index[id] - 1)->~T();
+	}
 
-		for (unsigned i = 0; i < m_size; ++i)
-		{
-			new(&m_agentsParams[i]) Node();
-			m_agentsParams[i].next = 0;
-			m_agentsParams[i].id = UINT_MAX;
-		}
+	for (unsigned i = 0; i < m_nbBlocks; ++i)
+		dtFree(m_blocks[i]);
+
+	dtFree(m_blocks);
+	dtFree(m_freeSlots);
+	dtFree(m_index);
+	m_blocks = 0;
+	m_freeSlots = 0;
+	m_index = 0;
+}
+
+template <typename T>
+bool dtParametrizedBehavior<T>::growIndex(unsigned id) const
+{
+	if (id < m_indexSize)
+		return true;
+
+	unsigned newSize = dtMax(m_indexSize, 16u);
+	while (newSize <= id)
+	{
+		if (newSize > UINT_MAX / 2)
+			return false;
+		newSize *= 2;
 	}
+
+	unsigned* newIndex = (unsigned*) dtAlloc(sizeof(unsigned) * newSize, DT_ALLOC_PERM);
+	if (!newIndex)
+		return false;
+
+	if (m_indexSize)
+		memcpy(newIndex, m_index, sizeof(unsigned) * m_indexSize);
+	memset(newIndex + m_indexSize, 0, sizeof(unsigned) * (newSize - m_indexSize));
+
+	dtFree(m_index);
+	m_index = newIndex;
+	m_indexSize = newSize;
+
+	return true;
 }
 
 template <typename T>
-dtParametrizedBehavior<T>::~dtParametrizedBehavior()
+bool dtParametrizedBehavior<T>::allocSlot(unsigned& slot) const
 {
-	for (unsigned i = 0; i < m_size; ++i)
+	if (m_nbFreeSlots)
 	{
-		Node* n = &m_agentsParams[i];
+		slot = m_freeSlots[--m_nbFreeSlots];
+		return true;
+	}
 
-		while (n->next)
+	if (m_nbSlots == m_nbBlocks * BLOCK_SIZE)
+	{
+		if (m_nbBlocks == m_maxBlocks)
 		{
-			Node* toDelete = n->next;
-			n->next = n->next->next;
-			toDelete->~Node();
-			dtFree(toDelete);
+			const unsigned newMaxBlocks = dtMax(m_maxBlocks * 2, 4u);
+
+			T** newBlocks = (T**) dtAlloc(sizeof(T*) * newMaxBlocks, DT_ALLOC_PERM);
+			unsigned* newFreeSlots = (unsigned*) dtAlloc(sizeof(unsigned) * newMaxBlocks * BLOCK_SIZE, DT_ALLOC_PERM);
+			if (!newBlocks || !newFreeSlots)
+			{
+				dtFree(newBlocks);
+				dtFree(newFreeSlots);
+				return false;
+			}
+
+			if (m_nbBlocks)
+				memcpy(newBlocks, m_blocks, sizeof(T*) * m_nbBlocks);
+
+			// The stack is empty at this point, there is nothing to copy
+			dtFree(m_blocks);
+			dtFree(m_freeSlots);
+			m_blocks = newBlocks;
+			m_freeSlots = newFreeSlots;
+			m_maxBlocks = newMaxBlocks;
 		}
+
+		T* block = (T*) dtAlloc(sizeof(T) * BLOCK_SIZE, DT_ALLOC_PERM);
+		if (!block)
+			return false;
+
+		m_blocks[m_nbBlocks++] = block;
 	}
 
-	dtFree(m_agentsParams);
-	m_agentsParams = 0;
+	slot = m_nbSlots++;
+	return true;
 }
 
 template <typename T>
-T* dtParametrizedBehavior<T>::getBehaviorParams(unsigned id) const
+T* dtParametrizedBehavior<T>::findBehaviorParams(unsigned id) const
 {
-	if (m_size == 0)
+	if (id >= m_indexSize || !m_index[id])
 		return 0;
 
-	unsigned index = id % m_size;
+	return getSlot(m_index[id] - 1);
+}
 
-	if (index >= m_size)
-		return 0;
+template <typename T>
+T* dtParametrizedBehavior<T>::getBehaviorParams(unsigned id) const
+{
+	if (id < m_indexSize && m_index[id])
+		return getSlot(m_index[id] - 1);
 
-	Node* head = &m_agentsParams[index];
+	if (m_estimatedSize == 0 || id == UINT_MAX)
+		return 0;
 
-	if (head->id == id && head->id < UINT_MAX)
-		return &head->value;
-	
-	while (head->next)
-	{
-		head = head->next;
+	unsigned slot;
+	if (!growIndex(id) || !allocSlot(slot))
+		return 0;
 
-		if (head->id == id && head->id < UINT_MAX)
-			return &head->value;
-	}
+	T* params = new(getSlot(slot)) T();
+	m_index[id] = slot + 1;
 
-	void* mem = dtAlloc(sizeof(Node), DT_ALLOC_PERM);
+	return params;
+}
 
-	if (mem == 0)
-		return 0;
+template <typename T>
+bool dtParametrizedBehavior<T>::removeBehaviorParams(unsigned id)
+{
+	if (id >= m_indexSize || !m_index[id])
+		return false;
 
-	Node* newNode = new(mem) Node;
+	const unsigned slot = m_index[id] - 1;
 
-	newNode->next = 0;
-	newNode->id = id;
-	head->next = newNode;
+	getSlot(slot)->~T();
+	m_index[id] = 0;
+	m_freeSlots[m_nbFreeSlots++] = slot;
 
-	return &newNode->value;
+	return true;
 }
 
 template <typename T>
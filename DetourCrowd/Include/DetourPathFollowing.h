@@ -135,9 +135,10 @@ public:
 	/// Must be called before using the behavior.
 	/// @param[in]		crowdQuery	An object granting access to several elements of the crowd (animations, navigation mesh queries, etc.)
 	/// @param[in]		maxPathRes	Maximum number of polygons for a path.
+	/// @param[in]		maxPathRequests	Maximum number of path requests waiting in the path queue.
 	///
 	/// @return True if the initialization succeeded, false otherwise.
-	bool init(dtCrowdQuery& crowdQuery, unsigned maxPathRes = 256);
+	bool init(dtCrowdQuery& crowdQuery, unsigned maxPathRes = 256, unsigned maxPathRequests = 32);
 
 	/// Submits a new move request for the specified agent.
 	///  @param[in]		idx		The agent index. [Limits: 0 <= value < #getAgentCount()]
@@ -179,6 +180,12 @@ private:
 	virtual void doUpdate(const dtCrowdQuery& query, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, 
 		const dtPathFollowingParams& currentParams, dtPathFollowingParams& newParams, float dt);
 
+	/// Computes the path requests made by the agents during the update.
+	///
+	/// The path queue is updated once per update of the crowd, so the cost of the path finding 
+	/// does not depend on the number of agents. The results are read by the agents during the next update.
+	virtual void doPostUpdate(const dtCrowdQuery& query, float dt);
+
 	/// Optimize path topology.
 	/// 
 	/// @param[in]		ag			The agent to work on.
@@ -26,13 +26,17 @@ static const unsigned int DT_PATHQ_INVALID = 0;
 
 typedef unsigned int dtPathQueueRef;
 
-/// A path queue is a succession of destination in order to reach a specific location
+/// A queue of path requests, computed over several updates using sliced path finding.
+///
+/// The pending requests are served by increasing priority, then in the order they were made.
+/// Several requests can be computed at the same time, each one using its own navigation mesh query,
+/// and the iterations allowed for an update are shared between them.
 class dtPathQueue
 {
 	/// The query to create a path of polygons between two points
 	struct PathQuery
 	{
-		dtPathQueueRef ref;
+		dtPathQueueRef ref;				///< Handle of the query, DT_PATHQ_INVALID if the slot is free.
 		
 		float startPos[3], endPos[3];	///< Path find start and end location.
 		dtPolyRef startRef, endRef;		///< Path find start and end polygons.
@@ -42,18 +46,62 @@ class dtPathQueue
 		
 		dtStatus status;				///< State of the query.
 		int keepAlive;					///< Number of ticks during which the query has been kept alive.
+		int completedIndex;				///< Index of the query in m_completed once it is completed.
 		const dtQueryFilter* filter;	///< TODO: This is potentially dangerous!
+
+		float priority;					///< Priority of the query, the lowest ones are served first.
+		unsigned order;					///< Order in which the queries were requested, used to break priority ties.
+		unsigned short salt;			///< Incremented every time the slot is reused, so old handles become invalid.
+	};
+
+	/// A sliced path search in progress
+	struct Search
+	{
+		dtNavMeshQuery* navquery;		///< The query used for the search.
+		int slot;						///< The request being computed, -1 if none.
 	};
 	
-	static const int MAX_QUEUE = 8;		///< Maximal number of queue
-	PathQuery m_queue[MAX_QUEUE];		///< The queues
-	dtPathQueueRef m_nextHandle;		
+	PathQuery* m_queue;					///< The requests [Size: m_maxRequests]
+	int m_maxRequests;					///< Maximal number of requests
+
+	int* m_freeSlots;					///< Stack of the free slots [Size: m_maxRequests]
+	int m_nbFreeSlots;					///< Number of free slots
+
+	int* m_pending;						///< Heap of the requests waiting for a search, the next one first [Size: m_maxRequests]
+	int m_nbPending;					///< Number of pending requests
+
+	int* m_completed;					///< Requests completed and waiting for their result to be read [Size: m_maxRequests]
+	int m_nbCompleted;					///< Number of completed requests
+
+	Search* m_searches;					///< The searches that can run at the same time
+	int m_maxSearches;					///< Number of searches
+
+	unsigned m_nextOrder;				///< Order of the next request
 	int m_maxPathSize;					///< Maximum size for a path
-	int m_queueHead;					///< Used to navigate through the queues
-	dtNavMeshQuery* m_navquery;			///< Used to perform queries on the navigation mesh
 	
 	/// Cleans the path queue
 	void purge();
+
+	/// Returns true if the request in slot @p a must be served before the one in slot @p b.
+	bool isBefore(const int a, const int b) const;
+
+	/// Adds the given slot to the pending requests.
+	void pushPending(const int slot);
+
+	/// Removes and returns the next pending request.
+	int popPending();
+
+	/// Returns the slot of the given request, -1 if the handle is not valid anymore.
+	int getSlot(dtPathQueueRef ref) const;
+
+	/// Marks the request of the given slot as completed.
+	void complete(const int slot);
+
+	/// Removes the request at the given index of m_completed.
+	void removeCompleted(const int index);
+
+	/// Releases the given slot.
+	void release(const int slot);
 	
 public:
 	dtPathQueue();
@@ -62,16 +110,24 @@ public:
 	/// Initializes the path queue (queries and navigation mesh)
 	///
 	/// @param[in]	maxPathSize				Maximum size for a path
-	/// @param[in]	maxSearchNodeCount		Maximum number of search nodes
+	/// @param[in]	maxSearchNodeCount		Maximum number of search nodes of every search
 	/// @param[in]	nav						The navigation mesh
+	/// @param[in]	maxRequests				Maximum number of requests in the queue [Limit: 1 <= value < 65536]
+	/// @param[in]	maxSearches				Maximum number of paths computed at the same time [Limit: >= 1]
 	///
 	/// @return True if the initialization succeeded, false otherwise
-	bool init(const int maxPathSize, const int maxSearchNodeCount, const dtNavMesh* nav);
+	bool init(const int maxPathSize, const int maxSearchNodeCount, const dtNavMesh* nav, 
+			  const int maxRequests = 8, const int maxSearches = 1);
 	
-	/// Updates the path request until there is nothing to update or until maxIters pathfinder iterations has been consumed.
+	/// Updates the path requests until there is nothing to update or until maxIters pathfinder iterations has been consumed.
+	///
+	/// The iterations are shared evenly between the searches in progress.
+	/// When a search is done, the next pending request is started using the remaining iterations.
+	///
+	/// @param[in]	maxIters	The maximal number of iterations allowed to update the path requests
 	///
-	/// @param[in]	maxIters	The maximal number of iterations allowed to update the path request
-	void update(const int maxIters);
+	/// @return The number of iterations done.
+	int update(const int maxIters);
 	
 	/// Requests a path between the given points.
 	///
@@ -80,11 +136,12 @@ public:
 	/// @param[in]	startPos	The start position
 	/// @param[in]	endPos		The destination position
 	/// @param[in]	filter		The query filter
+	/// @param[in]	priority	The priority of the request, the lowest priorities are served first
 	///
-	/// @return	Returns a reference on the path query of the newly created path
+	/// @return	Returns a reference on the path query of the newly created path, or #DT_PATHQ_INVALID if the queue is full
 	dtPathQueueRef request(dtPolyRef startRef, dtPolyRef endRef,
 						   const float* startPos, const float* endPos, 
-						   const dtQueryFilter* filter);
+						   const dtQueryFilter* filter, const float priority = 0.f);
 	
 	/// @name Data access
 	/// @{
@@ -101,7 +158,13 @@ public:
 	/// @return	Returns DT_SUCCESS if the operation succeeded, DT_FAILURE otherwise
 	dtStatus getPathResult(dtPathQueueRef ref, dtPolyRef* path, int* pathSize, const int maxPath);
 	
-	inline const dtNavMeshQuery* getNavQuery() const { return m_navquery; }
+	inline const dtNavMeshQuery* getNavQuery() const { return m_searches ? m_searches[0].navquery : 0; }
+
+	/// Returns the number of requests waiting for a search to start.
+	inline int getPendingCount() const { return m_nbPending; }
+
+	/// Returns the maximum number of requests of the queue.
+	inline int getMaxRequests() const { return m_maxRequests; }
 	/// @}
 
 };
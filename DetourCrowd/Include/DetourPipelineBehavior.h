@@ -19,16 +19,20 @@
 #ifndef DETOURPIPELINEBEHAVIOR_H
 #define DETOURPIPELINEBEHAVIOR_H
 
+#include "DetourAlloc.h"
 #include "DetourBehavior.h"
+#include "DetourCrowd.h"
 
-struct dtCrowdAgent;
-class dtCrowdQuery;
+#include <new>
 
 /// Behavior having the ability to contain other behaviors.
 /// 
 /// The behavior will be called one after another, this means that there is a risk that 
 /// a behavior might erase the modifications done by the previous one (depending on how they were implemented).
 /// Also, the order in which you put your behaviors into the pipeline matters.
+///
+/// The first behavior reads the original state of the agent. The next ones update the agent in place:
+/// their old and new agents are the same object, so they must read a field of the agent before writing it.
 /// @ingroup behavior
 class dtPipelineBehavior : public dtBehavior
 {
@@ -46,6 +50,10 @@ public:
 
 	virtual void update(const dtCrowdQuery& query, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, float dt);
 
+	/// Updates the agents stage by stage, so every behavior of the pipeline updates the whole batch at once.
+	virtual void updateBatch(const dtCrowdQuery& query, const dtCrowdAgent* oldAgents, dtCrowdAgent* newAgents, 
+							 const unsigned* ids, unsigned nbIds, float dt);
+
 	/// Affects the given behaviors to the pipeline
 	/// The behaviors are not copied, but their references are.
 	/// In order to clear the behaviors of the pipeline, give the 0 value to one of the parameters.
@@ -56,11 +64,147 @@ public:
 	/// @return	False if the memory for the behaviors could not be allocated. True otherwise
 	bool setBehaviors(dtBehavior const * const * behaviors, unsigned nbBehaviors);
 
-private:
-	void recursiveUpdate(const dtCrowdQuery& query, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, float dt, unsigned remainingBehaviors);
+protected:
+	/// Prepares every behavior of the pipeline.
+	virtual void doPreUpdate(const dtCrowdQuery& query, float dt);
+
+	/// Finishes every behavior of the pipeline.
+	virtual void doPostUpdate(const dtCrowdQuery& query, float dt);
 
+private:
 	dtBehavior** m_behaviors;	///< The behaviors affected to the pipeline
 	int m_nbBehaviors;			///< The number of behaviors affected to the pipeline
 };
 
+/// Empty stage of a dtStaticPipeline.
+/// @ingroup behavior
+class dtNullStage
+{
+public:
+	void update(const dtCrowdQuery&, const dtCrowdAgent&, dtCrowdAgent&, float) {}
+	void preUpdate(const dtCrowdQuery&, float) {}
+	void postUpdate(const dtCrowdQuery&, float) {}
+};
+
+/// Calls the stages of a dtStaticPipeline.
+/// The update of the stage is called through its qualified name, so this call is not virtual.
+/// The calls made by the stage itself are unchanged: a dtParametrizedBehavior still calls its doUpdate() method, 
+/// and a dtSteeringBehavior its computeForce() method, through the virtual table.
+/// @ingroup behavior
+template <typename B>
+struct dtStaticPipelineStage
+{
+	/// Updates the agent in place with the stage, the agent holding the result of the previous stage.
+	static void update(B* stage, const dtCrowdQuery& query, dtCrowdAgent& agent, float dt)
+	{
+		if (stage)
+			stage->B::update(query, agent, agent, dt);
+	}
+
+	static void preUpdate(B* stage, const dtCrowdQuery& query, float dt)
+	{
+		if (stage)
+			stage->preUpdate(query, dt);
+	}
+
+	static void postUpdate(B* stage, const dtCrowdQuery& query, float dt)
+	{
+		if (stage)
+			stage->postUpdate(query, dt);
+	}
+};
+
+/// The empty stages do nothing.
+template <>
+struct dtStaticPipelineStage<dtNullStage>
+{
+	static void update(dtNullStage*, const dtCrowdQuery&, dtCrowdAgent&, float) {}
+	static void preUpdate(dtNullStage*, const dtCrowdQuery&, float) {}
+	static void postUpdate(dtNullStage*, const dtCrowdQuery&, float) {}
+};
+
+/// Pipeline whose stages are known at compile time.
+///
+/// The stages are updated in the same way as in a dtPipelineBehavior,
+/// but the pipeline calls the update of every stage directly instead of going through the virtual table,
+/// and there is no loop over a list of behaviors.
+/// Only this outer call is resolved at compile time: the virtual methods the stages call in their own update
+/// (such as dtParametrizedBehavior::doUpdate()) are still dispatched at run time.
+/// Up to 4 stages can be given, the unused ones being dtNullStage.
+///
+/// @code
+/// dtStaticPipeline<dtPathFollowing, dtCollisionAvoidance> pipeline(pathFollowing, avoidance);
+/// crowd.setAgentBehavior(idAgent, &pipeline);
+/// @endcode
+/// @ingroup behavior
+template <typename B1, typename B2, typename B3 = dtNullStage, typename B4 = dtNullStage>
+class dtStaticPipeline : public dtBehavior
+{
+public:
+	/// Constructs the pipeline, the stages are not copied.
+	/// A null stage is skipped.
+	dtStaticPipeline(B1* b1, B2* b2, B3* b3 = 0, B4* b4 = 0)
+		: m_b1(b1), m_b2(b2), m_b3(b3), m_b4(b4)
+	{}
+
+	/// Creates an instance of the pipeline
+	/// @return		A pointer on a newly allocated pipeline
+	static dtStaticPipeline* allocate(B1* b1, B2* b2, B3* b3 = 0, B4* b4 = 0)
+	{
+		void* mem = dtAlloc(sizeof(dtStaticPipeline), DT_ALLOC_PERM);
+
+		if (mem)
+			return new(mem) dtStaticPipeline(b1, b2, b3, b4);
+
+		return 0;
+	}
+
+	/// Frees the given pipeline
+	/// @param[in]	ptr	A pointer to the pipeline we want to free
+	static void free(dtStaticPipeline* ptr)
+	{
+		if (!ptr)
+			return;
+
+		ptr->~dtStaticPipeline();
+		dtFree(ptr);
+	}
+
+	virtual void update(const dtCrowdQuery& query, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, float dt)
+	{
+		// The first stage reads the original state, the others update the result of the previous stage in place
+		if (m_b1)
+			m_b1->B1::update(query, oldAgent, newAgent, dt);
+
+		dtStaticPipelineStage<B2>::update(m_b2, query, newAgent, dt);
+		dtStaticPipelineStage<B3>::update(m_b3, query, newAgent, dt);
+		dtStaticPipelineStage<B4>::update(m_b4, query, newAgent, dt);
+	}
+
+protected:
+	/// Prepares every stage of the pipeline.
+	virtual void doPreUpdate(const dtCrowdQuery& query, float dt)
+	{
+		dtStaticPipelineStage<B1>::preUpdate(m_b1, query, dt);
+		dtStaticPipelineStage<B2>::preUpdate(m_b2, query, dt);
+		dtStaticPipelineStage<B3>::preUpdate(m_b3, query, dt);
+		dtStaticPipelineStage<B4>::preUpdate(m_b4, query, dt);
+	}
+
+	/// Finishes every stage of the pipeline.
+	virtual void doPostUpdate(const dtCrowdQuery& query, float dt)
+	{
+		dtStaticPipelineStage<B1>::postUpdate(m_b1, query, dt);
+		dtStaticPipelineStage<B2>::postUpdate(m_b2, query, dt);
+		dtStaticPipelineStage<B3>::postUpdate(m_b3, query, dt);
+		dtStaticPipelineStage<B4>::postUpdate(m_b4, query, dt);
+	}
+
+private:
+	B1* m_b1;	///< The first stage
+	B2* m_b2;	///< The second stage
+	B3* m_b3;	///< The third stage
+	B4* m_b4;	///< The fourth stage
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,121 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURPROXIMITYGRID_H
+#define DETOURPROXIMITYGRID_H
+
+/// Uniform grid used to quickly find the items located around a position.
+///
+/// The grid works on the (x, z) plane and is stored as a spatial hash, so its extent is not bounded.
+/// Items are stored as points: when looking for items having a size, the query area must be enlarged accordingly.
+/// Since only the horizontal coordinates are used, the grid is meant to prune candidates,
+/// the vertical tests must still be done by the user.
+///
+/// @ingroup crowd
+class dtProximityGrid
+{
+	/// An item stored in the grid
+	struct Item
+	{
+		unsigned id;	///< The id of the item
+		int x, y;		///< The coordinates of the cell containing the item
+		int next;		///< Index of the next item of the bucket, -1 if none
+	};
+
+	float m_cellSize;		///< The size of a cell
+	float m_invCellSize;	///< The inverse of the size of a cell
+
+	Item* m_pool;			///< The items of the grid
+	int m_poolHead;			///< The number of items in the grid
+	int m_poolSize;			///< The maximum number of items of the grid
+
+	int* m_buckets;			///< The first item of every bucket, -1 if none
+	int m_bucketsSize;		///< The number of buckets (power of two)
+
+	int m_bounds[4];		///< The bounds of the occupied cells [(xmin, ymin, xmax, ymax)]
+
+	/// Cleans the grid
+	void purge();
+
+public:
+	dtProximityGrid();
+	~dtProximityGrid();
+
+	/// Initializes the grid.
+	///
+	/// @param[in]	maxItems	The maximum number of items the grid can contain. [Limit: > 0]
+	/// @param[in]	cellSize	The size of a cell of the grid. [Limit: > 0]
+	///
+	/// @return True if the initialization succeeded, false otherwise
+	bool init(const int maxItems, const float cellSize);
+
+	/// Removes every item from the grid and changes the size of its cells.
+	///
+	/// @param[in]	cellSize	The new size of a cell. [Limit: > 0]
+	void clear(const float cellSize);
+
+	/// Removes every item from the grid.
+	void clear();
+
+	/// Adds an item to the grid.
+	///
+	/// @param[in]	id	The id of the item.
+	/// @param[in]	x	The x coordinate of the item.
+	/// @param[in]	y	The z coordinate of the item.
+	///
+	/// @return False if the grid is full, true otherwise.
+	bool addItem(const unsigned id, const float x, const float y);
+
+	/// Gets the items contained by the cells overlapping the given area.
+	///
+	/// The items are returned in no particular order.
+	/// Some of them may be located outside of the area, but within the cells overlapping it.
+	///
+	/// @param[in]	minx	The minimum x coordinate of the area.
+	/// @param[in]	miny	The minimum z coordinate of the area.
+	/// @param[in]	maxx	The maximum x coordinate of the area.
+	/// @param[in]	maxy	The maximum z coordinate of the area.
+	/// @param[out]	ids		The ids of the items found.
+	/// @param[in]	maxIds	The maximum number of ids that can be stored in @p ids.
+	///
+	/// @return The number of ids stored in @p ids.
+	int queryItems(const float minx, const float miny, const float maxx, const float maxy,
+				   unsigned* ids, const int maxIds) const;
+
+	/// Gets the number of items stored in the cell containing the given coordinates.
+	int getItemCountAt(const float x, const float y) const;
+
+	/// @name Data access
+	/// @{
+	inline int getItemCount() const { return m_poolHead; }
+	inline const int* getBounds() const { return m_bounds; }
+	inline float getCellSize() const { return m_cellSize; }
+	/// @}
+};
+
+/// Allocates a proximity grid object using the Detour allocator.
+/// @return A proximity grid object that is ready for initialization, or null on failure.
+///  @ingroup crowd
+dtProximityGrid* dtAllocProximityGrid();
+
+/// Frees the specified proximity grid object using the Detour allocator.
+///  @param[in]		ptr		A proximity grid object allocated using #dtAllocProximityGrid
+///  @ingroup crowd
+void dtFreeProximityGrid(dtProximityGrid* ptr);
+
+#endif // DETOURPROXIMITYGRID_H
@@ -64,6 +64,16 @@ public:
 
 	virtual void computeForce(const dtCrowdQuery& query, const dtCrowdAgent& ag, float* force, 
 							  const dtSeparationBehaviorParams& currentParams, dtSeparationBehaviorParams& newParams);
+
+	/// Adds the force separating an agent from one of its targets.
+	///
+	/// @param[in]	ag		The agent to separate.
+	/// @param[in]	target	The target to separate the agent from.
+	/// @param[in]	params	The parameters giving the distance and the weight of the separation, the targets are ignored.
+	/// @param[out]	force	The force the separation is added to.
+	///
+	/// @return	True if the target is close enough to be separated from, false otherwise.
+	static bool addTargetForce(const dtCrowdAgent& ag, const dtCrowdAgent& target, const dtSeparationBehaviorParams& params, float* force);
 };
 
 #endif // DETOURSEPARATIONBEHAVIOR_H
\ No newline at end of file
@@ -20,6 +20,7 @@
 
 #include "DetourCrowd.h"
 #include "DetourCommon.h"
+#include "DetourFlockGroup.h"
 
 #include <new>
 
@@ -39,6 +40,16 @@ void dtAlignmentBehavior::computeForce(const dtCrowdQuery& query, const dtCrowdA
 	const unsigned* targets = currentParams.targets;
 	const unsigned nbTargets = currentParams.nbTargets;
 
+	if (currentParams.group)
+	{
+		if (!currentParams.group->getAverageVelocity(query, ag, force))
+			return;
+
+		dtVsub(force, force, ag.velocity);
+		force[1] = 0;
+		return;
+	}
+
 	const dtCrowdAgent** agents = (const dtCrowdAgent**) dtAlloc(sizeof(dtCrowdAgent*) * nbTargets, DT_ALLOC_TEMP);
 	query.getAgents(targets, nbTargets, agents);
 
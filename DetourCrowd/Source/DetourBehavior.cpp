@@ -17,12 +17,54 @@
 //
 
 #include "DetourBehavior.h"
+#include "DetourCrowd.h"
 
 
 dtBehavior::dtBehavior()
+	: m_preUpdateQuery(0)
+	, m_preUpdateFrame(0)
+	, m_postUpdateQuery(0)
+	, m_postUpdateFrame(0)
 {
 }
 
 dtBehavior::~dtBehavior()
 {
 }
+
+void dtBehavior::updateBatch(const dtCrowdQuery& query, const dtCrowdAgent* oldAgents, dtCrowdAgent* newAgents, 
+							 const unsigned* ids, unsigned nbIds, float dt)
+{
+	for (unsigned i = 0; i < nbIds; ++i)
+		update(query, oldAgents[ids[i]], newAgents[ids[i]], dt);
+}
+
+void dtBehavior::preUpdate(const dtCrowdQuery& query, float dt)
+{
+	if (m_preUpdateQuery == &query && m_preUpdateFrame == query.getFrame())
+		return;
+
+	m_preUpdateQuery = &query;
+	m_preUpdateFrame = query.getFrame();
+
+	doPreUpdate(query, dt);
+}
+
+void dtBehavior::postUpdate(const dtCrowdQuery& query, float dt)
+{
+	if (m_postUpdateQuery == &query && m_postUpdateFrame == query.getFrame())
+		return;
+
+	m_postUpdateQuery = &query;
+	m_postUpdateFrame = query.getFrame();
+
+	doPostUpdate(query, dt);
+}
+
+void dtBehavior::doPreUpdate(const dtCrowdQuery& /*query*/, float /*dt*/)
+{
+}
+
+void dtBehavior::doPostUpdate(const dtCrowdQuery& /*query*/, float /*dt*/)
+{
+}
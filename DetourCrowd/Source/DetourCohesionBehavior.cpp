@@ -20,6 +20,7 @@
 
 #include "DetourCommon.h"
 #include "DetourCrowd.h"
+#include "DetourFlockGroup.h"
 #include "DetourGoToBehavior.h"
 
 #include <new>
@@ -61,6 +62,16 @@ void dtCohesionBehavior::computeForce(const dtCrowdQuery& query, const dtCrowdAg
 
 	float center[] = {0, 0, 0};
 
+	if (currentParams.group)
+	{
+		if (!currentParams.group->getCenter(query, ag, center))
+			return;
+
+		dtVsub(force, center, ag.position);
+		force[1] = 0;
+		return;
+	}
+
 	if (nbTargets == 0 || !targets)
 		return;
 
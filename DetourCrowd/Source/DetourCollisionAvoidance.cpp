@@ -21,6 +21,7 @@
 #include "DetourAssert.h"
 #include "DetourCommon.h"
 #include "DetourCrowd.h"
+#include "DetourSimd.h"
 
 #include <new>
 
@@ -31,14 +32,10 @@
 
 dtCollisionAvoidance::dtCollisionAvoidance(unsigned nbMaxAgents) :
 	dtParametrizedBehavior<dtCollisionAvoidanceParams>(nbMaxAgents),
-	m_velocitySamplesCount(0),
 	m_maxAvoidanceParams(4),
-	m_maxCircles(0),
-	m_circles(0),
-	m_ncircles(0),
-	m_maxSegments(0),
-	m_segments(0),
-	m_nsegments(0)
+	m_maxCircles(6),
+	m_maxSegments(8),
+	m_vectorizedSampling(true)
 {
 }
 
@@ -69,57 +66,50 @@ void dtCollisionAvoidance::free(dtCollisionAvoidance* ptr)
 
 bool dtCollisionAvoidance::init(unsigned maxCircles, unsigned maxSegments)
 {
-	purge();
-
-	m_maxCircles = maxCircles;
-	m_ncircles = 0;
-	m_circles = (dtObstacleCircle*)dtAlloc(sizeof(dtObstacleCircle)*m_maxCircles, DT_ALLOC_PERM);
-
-	if (!m_circles)
+	// The current limits are kept when the new ones are rejected
+	if (maxCircles > DT_MAX_AVOIDANCE_CIRCLES || maxSegments > DT_MAX_AVOIDANCE_SEGMENTS)
 		return false;
 
-	memset(m_circles, 0, sizeof(dtObstacleCircle)*m_maxCircles);
-
+	m_maxCircles = maxCircles;
 	m_maxSegments = maxSegments;
-	m_nsegments = 0;
-	m_segments = (dtObstacleSegment*)dtAlloc(sizeof(dtObstacleSegment)*m_maxSegments, DT_ALLOC_PERM);
-
-	if (!m_segments)
-		return false;
-
-	memset(m_segments, 0, sizeof(dtObstacleSegment)*m_maxSegments);
 
 	return true;
 }
 
 void dtCollisionAvoidance::purge()
 {
-	dtFree(m_circles);
-	m_circles = 0;
-
-	dtFree(m_segments);
-	m_segments = 0;
+	m_maxCircles = 0;
+	m_maxSegments = 0;
 }
 
+/// @par
+///
+/// The obstacles are gathered in a context living on the stack, 
+/// so this method can be called concurrently for different agents.
 void dtCollisionAvoidance::doUpdate(const dtCrowdQuery& query, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, 
 	const dtCollisionAvoidanceParams& currentParams, dtCollisionAvoidanceParams& newParams, float /*dt*/)
 {
-	m_velocitySamplesCount = 0;
+	Context ctx;
 
-	addObtacles(oldAgent, query);
-	updateVelocity(oldAgent, newAgent, currentParams, newParams);
+	addObtacles(ctx, oldAgent, query);
+	const int nbSamples = updateVelocity(ctx, oldAgent, newAgent, currentParams, newParams);
+
+	if (query.getStats())
+		query.getStats()->avoidanceSamples += nbSamples;
 }
 
-void dtCollisionAvoidance::addObtacles(const dtCrowdAgent& ag, const dtCrowdQuery& query)
+void dtCollisionAvoidance::addObtacles(Context& ctx, const dtCrowdAgent& ag, const dtCrowdQuery& query) const
 {
-	reset();
+	ctx.ncircles = 0;
+	ctx.nsegments = 0;
+
 	const dtCrowdAgentEnvironment* agEnv = query.getAgentEnvironment(ag.id);
 
 	// Add neighbours as obstacles.
 	for (unsigned j = 0; j < agEnv->nbNeighbors; ++j)
 	{
 		const dtCrowdAgent& nei = *query.getAgent(agEnv->neighbors[j].idx);
-		addCircle(nei.position, nei.radius, nei.velocity, nei.desiredVelocity);
+		addCircle(ctx, nei.position, nei.radius, nei.velocity, nei.desiredVelocity);
 	}
 
 	// Append neighbour segments as obstacles.
@@ -130,18 +120,20 @@ void dtCollisionAvoidance::addObtacles(const dtCrowdAgent& ag, const dtCrowdQuer
 		if (dtTriArea2D(ag.position, s, s+3) < 0.f)
 			continue;
 
-		addSegment(s, s+3);
+		addSegment(ctx, s, s+3);
 	}
 }
 
-void dtCollisionAvoidance::updateVelocity(const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, 
-	const dtCollisionAvoidanceParams& currentParams, dtCollisionAvoidanceParams& newParams)
+int dtCollisionAvoidance::updateVelocity(Context& ctx, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, 
+	const dtCollisionAvoidanceParams& currentParams, dtCollisionAvoidanceParams& newParams) const
 {
 	float newVelocity[] = {0, 0, 0};
-	m_velocitySamplesCount += sampleVelocityAdaptive(oldAgent.position, oldAgent.radius, oldAgent.maxSpeed,
-													 oldAgent.velocity, oldAgent.desiredVelocity, newVelocity, 
-													 currentParams, newParams);
+	const int nbSamples = sampleVelocityAdaptive(ctx, oldAgent.position, oldAgent.radius, oldAgent.maxSpeed,
+												 oldAgent.velocity, oldAgent.desiredVelocity, newVelocity, 
+												 currentParams, newParams);
 	dtVcopy(newAgent.desiredVelocity, newVelocity);
+
+	return nbSamples;
 }
 
 
@@ -308,41 +300,35 @@ void dtObstacleAvoidanceDebugData::normalizeSamples()
 	normalizeArray(m_tpen, m_nsamples);
 }
 
-void dtCollisionAvoidance::reset()
-{
-	m_ncircles = 0;
-	m_nsegments = 0;
-}
-
-void dtCollisionAvoidance::addCircle(const float* pos, const float rad,
-									 const float* vel, const float* dvel)
+void dtCollisionAvoidance::addCircle(Context& ctx, const float* pos, const float rad,
+									 const float* vel, const float* dvel) const
 {
-	if (m_ncircles >= m_maxCircles)
+	if (ctx.ncircles >= m_maxCircles)
 		return;
 
-	dtObstacleCircle* cir = &m_circles[m_ncircles++];
+	dtObstacleCircle* cir = &ctx.circles[ctx.ncircles++];
 	dtVcopy(cir->position, pos);
 	cir->radius = rad;
 	dtVcopy(cir->velocity, vel);
 	dtVcopy(cir->desiredVelocity, dvel);
 }
 
-void dtCollisionAvoidance::addSegment(const float* p, const float* q)
+void dtCollisionAvoidance::addSegment(Context& ctx, const float* p, const float* q) const
 {
-	if (m_nsegments > m_maxSegments)
+	if (ctx.nsegments >= m_maxSegments)
 		return;
 
-	dtObstacleSegment* seg = &m_segments[m_nsegments++];
+	dtObstacleSegment* seg = &ctx.segments[ctx.nsegments++];
 	dtVcopy(seg->p, p);
 	dtVcopy(seg->q, q);
 }
 
-void dtCollisionAvoidance::prepare(const float* pos, const float* dvel)
+void dtCollisionAvoidance::prepare(Context& ctx, const float* pos, const float* dvel) const
 {
 	// Prepare obstacles
-	for (int i = 0; i < m_ncircles; ++i)
+	for (int i = 0; i < ctx.ncircles; ++i)
 	{
-		dtObstacleCircle* cir = &m_circles[i];
+		dtObstacleCircle* cir = &ctx.circles[i];
 
 		// Side
 		const float* pa = pos;
@@ -367,9 +353,9 @@ void dtCollisionAvoidance::prepare(const float* pos, const float* dvel)
 		}
 	}	
 
-	for (int i = 0; i < m_nsegments; ++i)
+	for (int i = 0; i < ctx.nsegments; ++i)
 	{
-		dtObstacleSegment* seg = &m_segments[i];
+		dtObstacleSegment* seg = &ctx.segments[i];
 
 		// Precalc if the agent is really close to the segment.
 		const float r = 0.01f;
@@ -378,20 +364,20 @@ void dtCollisionAvoidance::prepare(const float* pos, const float* dvel)
 	}	
 }
 
-float dtCollisionAvoidance::processSample(const float* vcand, const float cs,
+float dtCollisionAvoidance::processSample(const Context& ctx, const float* vcand, const float cs,
 										  const float* pos, const float rad,
 										  const float* vel, const float* dvel,
 										  const dtCollisionAvoidanceParams& oldParams, 
-										  dtCollisionAvoidanceParams& newParams)
+										  dtCollisionAvoidanceParams& newParams) const
 {
 	// Find min time of impact and exit amongst all obstacles.
 	float tmin = oldParams.horizTime;
 	float side = 0;
 	int nside = 0;
 
-	for (int i = 0; i < m_ncircles; ++i)
+	for (int i = 0; i < ctx.ncircles; ++i)
 	{
-		const dtObstacleCircle* cir = &m_circles[i];
+		const dtObstacleCircle* cir = &ctx.circles[i];
 
 		// RVO
 		float vab[3];
@@ -422,9 +408,9 @@ float dtCollisionAvoidance::processSample(const float* vcand, const float cs,
 		}
 	}
 
-	for (int i = 0; i < m_nsegments; ++i)
+	for (int i = 0; i < ctx.nsegments; ++i)
 	{
-		const dtObstacleSegment* seg = &m_segments[i];
+		const dtObstacleSegment* seg = &ctx.segments[i];
 		float htmin = 0;
 
 		if (seg->touch)
@@ -458,10 +444,10 @@ float dtCollisionAvoidance::processSample(const float* vcand, const float cs,
 	if (nside)
 		side /= nside;
 
-	const float vpen = oldParams.weightDesVel * (dtVdist2D(vcand, dvel) * m_invVmax);
-	const float vcpen = oldParams.weightCurVel * (dtVdist2D(vcand, vel) * m_invVmax);
+	const float vpen = oldParams.weightDesVel * (dtVdist2D(vcand, dvel) * ctx.invVmax);
+	const float vcpen = oldParams.weightCurVel * (dtVdist2D(vcand, vel) * ctx.invVmax);
 	const float spen = oldParams.weightSide * side;
-	const float tpen = oldParams.weightToi * (1.0f/(0.1f+tmin*m_invHorizTime));
+	const float tpen = oldParams.weightToi * (1.0f/(0.1f+tmin*ctx.invHorizTime));
 
 	const float penalty = vpen + vcpen + spen + tpen;
 
@@ -472,15 +458,158 @@ float dtCollisionAvoidance::processSample(const float* vcand, const float cs,
 	return penalty;
 }
 
-int dtCollisionAvoidance::sampleVelocityAdaptive(const float* pos, const float rad, const float vmax,
+/// @par
+///
+/// The four samples are tested against the same obstacle at the same time, 
+/// and every operation is done in the same order as in processSample().
+void dtCollisionAvoidance::processSamples(const Context& ctx, const float* vx, const float* vz,
+										  const float* pos, const float rad,
+										  const float* vel, const float* dvel,
+										  const dtCollisionAvoidanceParams& params, float* penalties) const
+{
+#ifdef DT_SIMD_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 two = _mm_set1_ps(2.f);
+	const __m128 signMask = _mm_set1_ps(-0.f);
+
+	const __m128 candX = _mm_loadu_ps(vx);
+	const __m128 candZ = _mm_loadu_ps(vz);
+
+	// Find min time of impact and exit amongst all obstacles.
+	__m128 tmin = _mm_set1_ps(params.horizTime);
+	__m128 side = zero;
+
+	for (int i = 0; i < ctx.ncircles; ++i)
+	{
+		const dtObstacleCircle* cir = &ctx.circles[i];
+
+		// RVO
+		const __m128 vabX = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(candX, two), _mm_set1_ps(vel[0])), _mm_set1_ps(cir->velocity[0]));
+		const __m128 vabZ = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(candZ, two), _mm_set1_ps(vel[2])), _mm_set1_ps(cir->velocity[2]));
+
+		// Side
+		const __m128 dpDot = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(cir->dp[0]), vabX), _mm_mul_ps(_mm_set1_ps(cir->dp[2]), vabZ));
+		const __m128 npDot = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(cir->np[0]), vabX), _mm_mul_ps(_mm_set1_ps(cir->np[2]), vabZ));
+		const __m128 sideValue = _mm_min_ps(_mm_add_ps(_mm_mul_ps(dpDot, half), half), _mm_mul_ps(npDot, two));
+		const __m128 below = _mm_cmplt_ps(sideValue, zero);
+		const __m128 above = _mm_cmpgt_ps(sideValue, one);
+		const __m128 clamped = _mm_or_ps(_mm_and_ps(above, one), _mm_andnot_ps(_mm_or_ps(below, above), sideValue));
+		side = _mm_add_ps(side, clamped);
+
+		// Sweep of the agent against the circle (see sweepCircleCircle())
+		const float sx = cir->position[0] - pos[0];
+		const float sz = cir->position[2] - pos[2];
+		const float r = rad + cir->radius;
+		const __m128 c = _mm_set1_ps((sx*sx + sz*sz) - r*r);
+
+		__m128 a = _mm_add_ps(_mm_mul_ps(vabX, vabX), _mm_mul_ps(vabZ, vabZ));
+		const __m128 b = _mm_add_ps(_mm_mul_ps(vabX, _mm_set1_ps(sx)), _mm_mul_ps(vabZ, _mm_set1_ps(sz)));
+		const __m128 d = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, c));
+		const __m128 hit = _mm_and_ps(_mm_cmpnlt_ps(a, _mm_set1_ps(0.0001f)), _mm_cmpnlt_ps(d, zero));
+
+		a = _mm_div_ps(one, a);
+		const __m128 rd = _mm_sqrt_ps(d);
+		__m128 htmin = _mm_mul_ps(_mm_sub_ps(b, rd), a);
+		const __m128 htmax = _mm_mul_ps(_mm_add_ps(b, rd), a);
+
+		// Handle overlapping obstacles.
+		const __m128 overlap = _mm_and_ps(_mm_cmplt_ps(htmin, zero), _mm_cmpgt_ps(htmax, zero));
+		htmin = _mm_or_ps(_mm_and_ps(overlap, _mm_mul_ps(_mm_xor_ps(htmin, signMask), half)), _mm_andnot_ps(overlap, htmin));
+
+		// The closest obstacle is somewhere ahead of us, keep track of nearest obstacle.
+		const __m128 closer = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(htmin, zero), _mm_cmplt_ps(htmin, tmin)));
+		tmin = _mm_or_ps(_mm_and_ps(closer, htmin), _mm_andnot_ps(closer, tmin));
+	}
+
+	for (int i = 0; i < ctx.nsegments; ++i)
+	{
+		const dtObstacleSegment* seg = &ctx.segments[i];
+		__m128 valid;
+		__m128 htmin;
+
+		if (seg->touch)
+		{
+			// Special case when the agent is very close to the segment.
+			const float snormX = -(seg->q[2] - seg->p[2]);
+			const float snormZ = seg->q[0] - seg->p[0];
+
+			// If the velocity is pointing towards the segment, no collision. Else immediate collision.
+			const __m128 dot = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(snormX), candX), _mm_mul_ps(_mm_set1_ps(snormZ), candZ));
+			valid = _mm_cmpnlt_ps(dot, zero);
+			htmin = zero;
+		}
+		else
+		{
+			// Intersection of the ray with the segment (see isectRaySeg())
+			float v[3], w[3];
+			dtVsub(v, seg->q, seg->p);
+			dtVsub(w, pos, seg->p);
+
+			__m128 d = _mm_sub_ps(_mm_mul_ps(candZ, _mm_set1_ps(v[0])), _mm_mul_ps(candX, _mm_set1_ps(v[2])));
+			valid = _mm_cmpnlt_ps(_mm_andnot_ps(signMask, d), _mm_set1_ps(1e-6f));
+			d = _mm_div_ps(one, d);
+
+			const __m128 t = _mm_mul_ps(_mm_set1_ps(dtVperp2D(v, w)), d);
+			valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpnlt_ps(t, zero), _mm_cmpngt_ps(t, one)));
+
+			const __m128 perp = _mm_sub_ps(_mm_mul_ps(candZ, _mm_set1_ps(w[0])), _mm_mul_ps(candX, _mm_set1_ps(w[2])));
+			const __m128 s = _mm_mul_ps(perp, d);
+			valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpnlt_ps(s, zero), _mm_cmpngt_ps(s, one)));
+
+			htmin = t;
+		}
+
+		// Avoid less when facing walls.
+		htmin = _mm_mul_ps(htmin, two);
+
+		// The closest obstacle is somewhere ahead of us, keep track of nearest obstacle.
+		const __m128 closer = _mm_and_ps(valid, _mm_cmplt_ps(htmin, tmin));
+		tmin = _mm_or_ps(_mm_and_ps(closer, htmin), _mm_andnot_ps(closer, tmin));
+	}
+
+	// Normalize side bias, to prevent it dominating too much.
+	if (ctx.ncircles)
+		side = _mm_div_ps(side, _mm_set1_ps((float) ctx.ncircles));
+
+	const __m128 invVmax = _mm_set1_ps(ctx.invVmax);
+
+	const __m128 dvX = _mm_sub_ps(_mm_set1_ps(dvel[0]), candX);
+	const __m128 dvZ = _mm_sub_ps(_mm_set1_ps(dvel[2]), candZ);
+	const __m128 desDist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dvX, dvX), _mm_mul_ps(dvZ, dvZ)));
+
+	const __m128 vX = _mm_sub_ps(_mm_set1_ps(vel[0]), candX);
+	const __m128 vZ = _mm_sub_ps(_mm_set1_ps(vel[2]), candZ);
+	const __m128 curDist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vX, vX), _mm_mul_ps(vZ, vZ)));
+
+	const __m128 vpen = _mm_mul_ps(_mm_set1_ps(params.weightDesVel), _mm_mul_ps(desDist, invVmax));
+	const __m128 vcpen = _mm_mul_ps(_mm_set1_ps(params.weightCurVel), _mm_mul_ps(curDist, invVmax));
+	const __m128 spen = _mm_mul_ps(_mm_set1_ps(params.weightSide), side);
+	const __m128 tpen = _mm_mul_ps(_mm_set1_ps(params.weightToi), 
+		_mm_div_ps(one, _mm_add_ps(_mm_set1_ps(0.1f), _mm_mul_ps(tmin, _mm_set1_ps(ctx.invHorizTime)))));
+
+	_mm_storeu_ps(penalties, _mm_add_ps(_mm_add_ps(_mm_add_ps(vpen, vcpen), spen), tpen));
+#else
+	dtCollisionAvoidanceParams unused = params;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		const float vcand[] = {vx[i], 0, vz[i]};
+		penalties[i] = processSample(ctx, vcand, 0, pos, rad, vel, dvel, params, unused);
+	}
+#endif
+}
+
+int dtCollisionAvoidance::sampleVelocityAdaptive(Context& ctx, const float* pos, const float rad, const float vmax,
 												 const float* vel, const float* dvel, float* nvel,
-												 const dtCollisionAvoidanceParams& oldParams, dtCollisionAvoidanceParams& newParams)
+												 const dtCollisionAvoidanceParams& oldParams, dtCollisionAvoidanceParams& newParams) const
 {
-	prepare(pos, dvel);
+	prepare(ctx, pos, dvel);
 
-	m_invHorizTime = 1.0f / oldParams.horizTime;
-	m_vmax = vmax;
-	m_invVmax = 1.0f / vmax;
+	ctx.invHorizTime = 1.0f / oldParams.horizTime;
+	ctx.vmax = vmax;
+	ctx.invVmax = 1.0f / vmax;
 
 	dtVset(nvel, 0,0,0);
 
@@ -524,12 +653,26 @@ int dtCollisionAvoidance::sampleVelocityAdaptive(const float* pos, const float r
 	dtVset(res, dvel[0] * oldParams.velBias, 0, dvel[2] * oldParams.velBias);
 	int ns = 0;
 
+#ifdef DT_SIMD_SSE2
+	const bool vectorized = m_vectorizedSampling && !oldParams.debug;
+#else
+	const bool vectorized = false;
+#endif
+
+	// The candidates of a refinement level, padded to a multiple of 4
+	static const int MAX_CANDIDATES = (DT_MAX_PATTERN_DIVS*DT_MAX_PATTERN_RINGS+1+3) & ~3;
+	float candX[MAX_CANDIDATES];
+	float candZ[MAX_CANDIDATES];
+	float penalties[MAX_CANDIDATES];
+
 	for (int k = 0; k < depth; ++k)
 	{
 		float minPenalty = FLT_MAX;
 		float bvel[3];
 		dtVset(bvel, 0,0,0);
 
+		int ncand = 0;
+
 		for (int i = 0; i < npat; ++i)
 		{
 			float vcand[3];
@@ -539,12 +682,35 @@ int dtCollisionAvoidance::sampleVelocityAdaptive(const float* pos, const float r
 
 			if (dtSqr(vcand[0])+dtSqr(vcand[2]) > dtSqr(vmax + EPSILON)) continue;
 
-			const float penalty = processSample(vcand,cr / 10, pos,rad,vel,dvel, oldParams, newParams);
-			++ns;
-			if (penalty < minPenalty)
+			candX[ncand] = vcand[0];
+			candZ[ncand] = vcand[2];
+
+			if (!vectorized)
+				penalties[ncand] = processSample(ctx, vcand,cr / 10, pos,rad,vel,dvel, oldParams, newParams);
+
+			++ncand;
+		}
+
+		if (vectorized)
+		{
+			for (int i = ncand; i < ((ncand + 3) & ~3); ++i)
+			{
+				candX[i] = 0;
+				candZ[i] = 0;
+			}
+
+			for (int i = 0; i < ncand; i += 4)
+				processSamples(ctx, candX + i, candZ + i, pos, rad, vel, dvel, oldParams, penalties + i);
+		}
+
+		ns += ncand;
+
+		for (int i = 0; i < ncand; ++i)
+		{
+			if (penalties[i] < minPenalty)
 			{
-				minPenalty = penalty;
-				dtVcopy(bvel, vcand);
+				minPenalty = penalties[i];
+				dtVset(bvel, candX[i], 0, candZ[i]);
 			}
 		}
 
@@ -28,10 +28,20 @@
 #include "DetourBehavior.h"
 #include "DetourCommon.h"
 #include "DetourCrowd.h"
+#include "DetourCrowdKinematics.h"
 #include "DetourNavMesh.h"
 #include "DetourNavMeshQuery.h"
 #include "DetourPathFollowing.h"
 
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#elif defined(__APPLE__)
+#	include <mach/mach_time.h>
+#else
+#	include <time.h>
+#endif
 
 
 dtCrowd* dtAllocCrowd()
@@ -57,6 +67,68 @@ inline float tween(const float t, const float t0, const float t1)
 	return dtClamp((t-t0) / (t1-t0), 0.0f, 1.0f);
 }
 
+/// Returns the time of a monotonic clock, in microseconds.
+static double getStatsTime()
+{
+#if defined(_WIN32)
+	static LARGE_INTEGER freq = {};
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+	return (double) count.QuadPart * 1000000.0 / (double) freq.QuadPart;
+#elif defined(__APPLE__)
+	static mach_timebase_info_data_t timebase = {0, 0};
+	if (!timebase.denom)
+		mach_timebase_info(&timebase);
+
+	return (double) mach_absolute_time() * timebase.numer / timebase.denom / 1000.0;
+#else
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) now.tv_sec * 1000000.0 + (double) now.tv_nsec / 1000.0;
+#endif
+}
+
+void dtCrowdStats::reset()
+{
+	memset(this, 0, sizeof(dtCrowdStats));
+}
+
+void dtCrowdStats::addCounters(const dtCrowdStats& other)
+{
+	nearestPolyQueries += other.nearestPolyQueries;
+	moveAlongSurfaceQueries += other.moveAlongSurfaceQueries;
+	boundaryUpdates += other.boundaryUpdates;
+	wallSegmentQueries += other.wallSegmentQueries;
+	neighborCandidates += other.neighborCandidates;
+	avoidanceSamples += other.avoidanceSamples;
+	pathQueueIterations += other.pathQueueIterations;
+	skippedAgents += other.skippedAgents;
+}
+
+void dtCrowdStats::addBehaviorTime(const dtBehavior* behavior, float time, unsigned nbAgents)
+{
+	for (int i = 0; i < nbBehaviors; ++i)
+	{
+		if (behaviors[i].behavior == behavior)
+		{
+			behaviors[i].nbAgents += nbAgents;
+			behaviors[i].time += time;
+			return;
+		}
+	}
+
+	if (nbBehaviors >= MAX_BEHAVIORS)
+		return;
+
+	behaviors[nbBehaviors].behavior = behavior;
+	behaviors[nbBehaviors].nbAgents = nbAgents;
+	behaviors[nbBehaviors].time = time;
+	++nbBehaviors;
+}
+
 static void integrate(dtCrowdAgent* ag, const float dt)
 {
 	if (dtVlen(ag->velocity) > EPSILON)
@@ -65,46 +137,132 @@ static void integrate(dtCrowdAgent* ag, const float dt)
 		dtVset(ag->velocity,0,0,0);
 }
 
-static int addNeighbour(const int idx, const float dist,
-						dtCrowdNeighbour* neis, const int nneis, const int maxNeis)
+/// Ties between neighbors at the same distance are broken by id, so the selection does not depend on
+/// the order in which the candidates are visited.
+inline bool isFarther(const dtCrowdNeighbour& a, const dtCrowdNeighbour& b)
+{
+	return a.dist > b.dist || (a.dist == b.dist && a.idx > b.idx);
+}
+
+static void siftNeighbourDown(dtCrowdNeighbour* neis, const unsigned nneis, unsigned i)
 {
-	// Insert neighbour based on the distance.
-	dtCrowdNeighbour* nei = 0;
-	if (!nneis)
+	const dtCrowdNeighbour nei = neis[i];
+
+	for (;;)
 	{
-		nei = &neis[nneis];
+		unsigned child = 2 * i + 1;
+		if (child >= nneis)
+			break;
+
+		if (child + 1 < nneis && isFarther(neis[child + 1], neis[child]))
+			++child;
+
+		if (!isFarther(neis[child], nei))
+			break;
+
+		neis[i] = neis[child];
+		i = child;
 	}
-	else if (dist >= neis[nneis-1].dist)
+
+	neis[i] = nei;
+}
+
+/// Adds a neighbour to a max-heap of the closest neighbours, the farthest one being at the root.
+static unsigned addNeighbour(const unsigned idx, const float dist,
+							 dtCrowdNeighbour* neis, const unsigned nneis, const unsigned maxNeis)
+{
+	dtCrowdNeighbour nei;
+	nei.idx = idx;
+	nei.dist = dist;
+
+	if (nneis < maxNeis)
 	{
-		if (nneis >= maxNeis)
-			return nneis;
-		nei = &neis[nneis];
+		unsigned i = nneis;
+
+		while (i > 0)
+		{
+			const unsigned parent = (i - 1) / 2;
+			if (!isFarther(nei, neis[parent]))
+				break;
+
+			neis[i] = neis[parent];
+			i = parent;
+		}
+
+		neis[i] = nei;
+		return nneis + 1;
 	}
-	else
+
+	// Only replaces the farthest neighbour
+	if (isFarther(neis[0], nei))
 	{
-		int i;
-		for (i = 0; i < nneis; ++i)
-			if (dist <= neis[i].dist)
-				break;
-		
-		const int tgt = i+1;
-		const int n = dtMin(nneis-i, maxNeis-tgt);
-		
-		dtAssert(tgt+n <= maxNeis);
-		
-		if (n > 0)
-			memmove(&neis[tgt], &neis[i], sizeof(dtCrowdNeighbour)*n);
-		nei = &neis[i];
+		neis[0] = nei;
+		siftNeighbourDown(neis, nneis, 0);
+	}
+
+	return nneis;
+}
+
+/// Sorts a heap of neighbours by increasing distance.
+static void sortNeighbours(dtCrowdNeighbour* neis, const unsigned nneis)
+{
+	for (unsigned end = nneis; end > 1; --end)
+	{
+		dtSwap(neis[0], neis[end - 1]);
+		siftNeighbourDown(neis, end - 1, 0);
 	}
-	
-	memset(nei, 0, sizeof(dtCrowdNeighbour));
-	
-	nei->idx = idx;
-	nei->dist = dist;
-	
-	return dtMin(nneis+1, maxNeis);
 }
 
+static void freeWallCaches(dtWallSegmentCache* caches, const unsigned nbWorkers)
+{
+	if (!caches)
+		return;
+
+	for (unsigned i = 0; i < nbWorkers; ++i)
+		caches[i].~dtWallSegmentCache();
+
+	dtFree(caches);
+}
+
+static void freeWorkersQueries(dtCrowdQuery** queries, const unsigned nbWorkers)
+{
+	if (!queries)
+		return;
+
+	// The first query is the one of the crowd
+	for (unsigned i = 1; i < nbWorkers; ++i)
+	{
+		if (queries[i])
+		{
+			queries[i]->~dtCrowdQuery();
+			dtFree(queries[i]);
+		}
+	}
+
+	dtFree(queries);
+}
+
+/// Task executing one step of the update of the crowd.
+class dtCrowdStepTask : public dtCrowdTask
+{
+public:
+	dtCrowdStepTask(dtCrowd& crowd, const dtCrowd::UpdateContext& context) : 
+		m_crowd(crowd), 
+		m_context(context) 
+	{}
+
+	virtual void execute(unsigned worker)
+	{
+		m_crowd.executeStep(m_context, worker);
+	}
+
+private:
+	dtCrowd& m_crowd;
+	const dtCrowd::UpdateContext& m_context;
+
+	dtCrowdStepTask& operator=(const dtCrowdStepTask&);
+};
+
 
 /**
 @class dtCrowd
@@ -133,17 +291,52 @@ For a more complete documentation, check the @ref crowd module.
 
 static const int MAX_AVOIDANCE_PARAMS = 4;
 
+/// The number of polygons whose wall segments are cached by every worker
+static const int MAX_CACHED_WALL_POLYS = 1024;
+
+/// The number of agents updated between two checks of the update budget
+static const unsigned BUDGET_SLICE_SIZE = 128;
+
 dtCrowd::dtCrowd() :
 	m_crowdQuery(0),
 	m_agentsEnv(0),
 	m_maxAgents(0),
 	m_nbActiveAgents(0),
 	m_agents(0),
+	m_agentsSnapshot(0),
 	m_activeAgents(0),
 	m_agentsToUpdate(0),
+	m_freeSlots(0),
+	m_nbFreeSlots(0),
 	m_maxAgentRadius(0),
 	m_maxCommonNodes(512),
-	m_disp(0)
+	m_disp(0),
+	m_currentPosPoly(0),
+	m_currentPos(0),
+	m_agentsPolys(0),
+	m_grid(0),
+	m_wallCaches(0),
+	m_neighborsCandidates(0),
+	m_neighbors(0),
+	m_maxNeighbors(0),
+	m_lod(0),
+	m_workerPool(0),
+	m_nbWorkers(1),
+	m_workersQueries(0),
+	m_kinematics(0),
+	m_kinematicsEnabled(true),
+	m_stats(0),
+	m_statsEnabled(false),
+	m_budgetMaxAgents(0),
+	m_budgetMaxTime(0),
+	m_budgetCursor(0),
+	m_budgetIds(0),
+	m_batches(0),
+	m_batchIds(0),
+	m_batchHash(0),
+	m_batchHashSize(0),
+	m_updatedBehaviors(0),
+	m_nbUpdatedBehaviors(0)
 {
 }
 
@@ -169,8 +362,20 @@ void dtCrowd::purge()
 		m_disp = 0;
 	}
 
+	dtFree(m_currentPosPoly);
+	m_currentPosPoly = 0;
+
+	dtFree(m_currentPos);
+	m_currentPos = 0;
+
+	dtFree(m_agentsPolys);
+	m_agentsPolys = 0;
+
 	dtFree(m_agents);
 	m_agents = 0;
+
+	dtFree(m_agentsSnapshot);
+	m_agentsSnapshot = 0;
 	m_maxAgents = 0;
 	m_nbActiveAgents = 0;
 	
@@ -180,6 +385,47 @@ void dtCrowd::purge()
 	dtFree(m_agentsToUpdate);
 	m_agentsToUpdate = 0;
 
+	dtFree(m_freeSlots);
+	m_freeSlots = 0;
+	m_nbFreeSlots = 0;
+
+	freeWorkers();
+
+	dtFreeProximityGrid(m_grid);
+	m_grid = 0;
+
+	dtFree(m_neighbors);
+	m_neighbors = 0;
+	m_maxNeighbors = 0;
+
+	dtFreeLodScheduler(m_lod);
+	m_lod = 0;
+
+	dtFree(m_budgetIds);
+	m_budgetIds = 0;
+	m_budgetCursor = 0;
+
+	dtFree(m_batches);
+	m_batches = 0;
+
+	dtFree(m_batchIds);
+	m_batchIds = 0;
+
+	dtFree(m_batchHash);
+	m_batchHash = 0;
+	m_batchHashSize = 0;
+
+	dtFree(m_updatedBehaviors);
+	m_updatedBehaviors = 0;
+	m_nbUpdatedBehaviors = 0;
+
+	if (m_kinematics)
+	{
+		m_kinematics->~dtCrowdKinematics();
+		dtFree(m_kinematics);
+		m_kinematics = 0;
+	}
+
 	if (m_crowdQuery)
 	{
 		m_crowdQuery->~dtCrowdQuery();
@@ -194,15 +440,27 @@ void dtCrowd::purge()
 /// @par
 ///
 /// May be called more than once to purge and re-initialize the crowd.
-bool dtCrowd::init(const unsigned maxAgents, const float maxAgentRadius, dtNavMesh* nav)
+bool dtCrowd::init(const unsigned maxAgents, const float maxAgentRadius, dtNavMesh* nav, const unsigned maxNeighbors)
 {
 	purge();
 
+	if (maxNeighbors == 0)
+		return false;
+
 	m_disp = (float**) dtAlloc(sizeof(float*) * maxAgents, DT_ALLOC_PERM);
 
 	for (unsigned i = 0; i < maxAgents; ++i)
 		m_disp[i] = (float*) dtAlloc(sizeof(float) * 3, DT_ALLOC_PERM);
 
+	// Scratch storage of the position update
+	m_currentPosPoly = (dtPolyRef*) dtAlloc(sizeof(dtPolyRef) * maxAgents, DT_ALLOC_PERM);
+	m_currentPos = (float*) dtAlloc(sizeof(float) * 3 * maxAgents, DT_ALLOC_PERM);
+	m_agentsPolys = (dtPolyRef*) dtAlloc(sizeof(dtPolyRef) * maxAgents, DT_ALLOC_PERM);
+	if (!m_currentPosPoly || !m_currentPos || !m_agentsPolys)
+		return false;
+
+	memset(m_agentsPolys, 0, sizeof(dtPolyRef) * maxAgents);
+
 	// Creation of the crowd query
 	void* mem = (dtCrowdQuery*) dtAlloc(sizeof(dtCrowdQuery), DT_ALLOC_PERM);
 	if (!mem)
@@ -214,6 +472,16 @@ bool dtCrowd::init(const unsigned maxAgents, const float maxAgentRadius, dtNavMe
 
 	for (unsigned i = 0; i < maxAgents; ++i)
 		new(&m_agentsEnv[i]) dtCrowdAgentEnvironment();
+
+	// The neighbors of all the agents are stored contiguously
+	m_neighbors = (dtCrowdNeighbour*) dtAlloc(sizeof(dtCrowdNeighbour) * maxAgents * maxNeighbors, DT_ALLOC_PERM);
+	if (!m_neighbors)
+		return false;
+
+	m_maxNeighbors = maxNeighbors;
+
+	for (unsigned i = 0; i < maxAgents; ++i)
+		m_agentsEnv[i].neighbors = m_neighbors + i * maxNeighbors;
 				
 	m_maxAgents = maxAgents;
 	m_maxAgentRadius = maxAgentRadius;
@@ -223,17 +491,66 @@ bool dtCrowd::init(const unsigned maxAgents, const float maxAgentRadius, dtNavMe
 	if (!m_agentsToUpdate)
 		return false;
 
+	// The slots are popped from the end, so the agents are first given increasing ids
+	m_freeSlots = (unsigned*) dtAlloc(sizeof(unsigned) * maxAgents, DT_ALLOC_PERM);
+	if (!m_freeSlots)
+		return false;
+
 	for (unsigned i = 0; i < m_maxAgents; ++i)
-		m_agentsToUpdate[i] = i;
+		m_freeSlots[i] = m_maxAgents - 1 - i;
+
+	m_nbFreeSlots = m_maxAgents;
 		
 	m_agents = (dtCrowdAgent*)dtAlloc(sizeof(dtCrowdAgent) * m_maxAgents, DT_ALLOC_PERM);
 	if (!m_agents)
 		return false;
 
-	m_crowdQuery = new(mem) dtCrowdQuery(maxAgents, m_agents, m_agentsEnv);
+	m_agentsSnapshot = (dtCrowdAgent*)dtAlloc(sizeof(dtCrowdAgent) * m_maxAgents, DT_ALLOC_PERM);
+	if (!m_agentsSnapshot)
+		return false;
+
+	// Scratch storage used to group the agents by behavior
+	m_batchHashSize = dtNextPow2(m_maxAgents * 2);
+	m_batches = (BehaviorBatch*) dtAlloc(sizeof(BehaviorBatch) * m_maxAgents, DT_ALLOC_PERM);
+	m_batchIds = (unsigned*) dtAlloc(sizeof(unsigned) * m_maxAgents, DT_ALLOC_PERM);
+	m_batchHash = (int*) dtAlloc(sizeof(int) * m_batchHashSize, DT_ALLOC_PERM);
+	m_updatedBehaviors = (dtBehavior**) dtAlloc(sizeof(dtBehavior*) * m_maxAgents, DT_ALLOC_PERM);
+	if (!m_batches || !m_batchIds || !m_batchHash || !m_updatedBehaviors)
+		return false;
+
+	memset(m_batchHash, 0xff, sizeof(int) * m_batchHashSize);
+
+	// The size of the cells is adjusted to the perception of the agents every time the grid is rebuilt
+	m_grid = dtAllocProximityGrid();
+	if (!m_grid)
+		return false;
+
+	if (!m_grid->init(m_maxAgents, dtMax(m_maxAgentRadius, EPSILON) * 4.f))
+		return false;
+
+	m_lod = dtAllocLodScheduler();
+	if (!m_lod || !m_lod->init(m_maxAgents))
+		return false;
+
+	m_budgetIds = (unsigned*) dtAlloc(sizeof(unsigned) * BUDGET_SLICE_SIZE, DT_ALLOC_PERM);
+	if (!m_budgetIds)
+		return false;
+
+	void* kinematicsMem = dtAlloc(sizeof(dtCrowdKinematics), DT_ALLOC_PERM);
+	if (!kinematicsMem)
+		return false;
+
+	m_kinematics = new(kinematicsMem) dtCrowdKinematics;
+	if (!m_kinematics->init(m_maxAgents))
+		return false;
+
+	m_crowdQuery = new(mem) dtCrowdQuery(maxAgents, m_agents, m_agentsEnv, m_grid, m_agentsPolys);
 
 	if (dtStatusFailed(m_crowdQuery->getNavMeshQuery()->init(nav, m_maxCommonNodes)))
 		return false;
+
+	if (!setWorkerPool(0, 1))
+		return false;
 	
 	m_activeAgents = (dtCrowdAgent**)dtAlloc(sizeof(dtCrowdAgent*) * m_maxAgents, DT_ALLOC_PERM);
 	if (!m_activeAgents)
@@ -247,6 +564,8 @@ bool dtCrowd::init(const unsigned maxAgents, const float maxAgentRadius, dtNavMe
 		m_agents[i].behavior = 0;
 		m_agents[i].userData = 0;
 	}
+
+	memcpy(m_agentsSnapshot, m_agents, sizeof(dtCrowdAgent) * m_maxAgents);
 	
 	m_crowdQuery->getQueryExtents()[0] = m_maxAgentRadius * 2.0f;
 	m_crowdQuery->getQueryExtents()[1] = m_maxAgentRadius * 1.5f;
@@ -255,6 +574,444 @@ bool dtCrowd::init(const unsigned maxAgents, const float maxAgentRadius, dtNavMe
 	return true;
 }
 
+/// @par
+///
+/// If the workers cannot be allocated, the crowd falls back to a serial update.
+bool dtCrowd::setWorkerPool(dtCrowdWorkerPool* pool, const unsigned nbWorkers)
+{
+	if (!m_crowdQuery)
+		return false;
+
+	if (allocateWorkers((pool && nbWorkers > 1) ? pool : 0, (pool && nbWorkers > 1) ? nbWorkers : 1))
+		return true;
+
+	allocateWorkers(0, 1);
+	return false;
+}
+
+void dtCrowd::freeWorkers()
+{
+	freeWorkersQueries(m_workersQueries, m_nbWorkers);
+	m_workersQueries = 0;
+
+	freeWallCaches(m_wallCaches, m_nbWorkers);
+	m_wallCaches = 0;
+
+	dtFree(m_neighborsCandidates);
+	m_neighborsCandidates = 0;
+
+	dtFree(m_stats);
+	m_stats = 0;
+
+	if (m_crowdQuery)
+		m_crowdQuery->m_stats = 0;
+
+	m_workerPool = 0;
+	m_nbWorkers = 1;
+}
+
+bool dtCrowd::allocateWorkers(dtCrowdWorkerPool* pool, const unsigned nbWorkers)
+{
+	freeWorkers();
+
+	m_workerPool = pool;
+	m_nbWorkers = nbWorkers;
+
+	m_workersQueries = (dtCrowdQuery**) dtAlloc(sizeof(dtCrowdQuery*) * m_nbWorkers, DT_ALLOC_PERM);
+	m_neighborsCandidates = (unsigned*) dtAlloc(sizeof(unsigned) * m_maxAgents * m_nbWorkers, DT_ALLOC_PERM);
+	m_stats = (dtCrowdStats*) dtAlloc(sizeof(dtCrowdStats) * m_nbWorkers, DT_ALLOC_PERM);
+
+	// The workers never share a cache, so they can fill them concurrently
+	m_wallCaches = (dtWallSegmentCache*) dtAlloc(sizeof(dtWallSegmentCache) * m_nbWorkers, DT_ALLOC_PERM);
+
+	if (m_wallCaches)
+	{
+		for (unsigned i = 0; i < m_nbWorkers; ++i)
+			new(&m_wallCaches[i]) dtWallSegmentCache();
+	}
+
+	if (m_workersQueries)
+	{
+		memset(m_workersQueries, 0, sizeof(dtCrowdQuery*) * m_nbWorkers);
+		m_workersQueries[0] = m_crowdQuery;
+	}
+
+	bool ok = m_workersQueries && m_neighborsCandidates && m_stats && m_wallCaches;
+
+	for (unsigned i = 0; ok && i < m_nbWorkers; ++i)
+		ok = m_wallCaches[i].init(MAX_CACHED_WALL_POLYS, MAX_CACHED_WALL_POLYS * 4);
+
+	const dtNavMesh* nav = m_crowdQuery->getNavMeshQuery()->getAttachedNavMesh();
+
+	// Every worker gets its own navigation mesh query (and node pool)
+	for (unsigned i = 1; ok && i < m_nbWorkers; ++i)
+	{
+		void* mem = dtAlloc(sizeof(dtCrowdQuery), DT_ALLOC_PERM);
+		if (!mem)
+		{
+			ok = false;
+			break;
+		}
+
+		m_workersQueries[i] = new(mem) dtCrowdQuery(m_maxAgents, m_agents, m_agentsEnv, m_grid, m_agentsPolys);
+
+		ok = m_workersQueries[i]->getNavMeshQuery() &&
+			dtStatusSucceed(m_workersQueries[i]->getNavMeshQuery()->init(nav, m_maxCommonNodes));
+	}
+
+	if (!ok)
+	{
+		freeWorkers();
+		return false;
+	}
+
+	resetStats();
+	attachStats();
+
+	return true;
+}
+
+void dtCrowd::setStatsEnabled(const bool enabled)
+{
+	m_statsEnabled = enabled && m_stats;
+	attachStats();
+}
+
+void dtCrowd::resetStats()
+{
+	for (unsigned i = 0; m_stats && i < m_nbWorkers; ++i)
+		m_stats[i].reset();
+}
+
+void dtCrowd::attachStats()
+{
+	for (unsigned i = 0; m_workersQueries && i < m_nbWorkers; ++i)
+	{
+		if (m_workersQueries[i])
+			m_workersQueries[i]->m_stats = m_statsEnabled ? &m_stats[i] : 0;
+	}
+}
+
+void dtCrowd::gatherStats()
+{
+	for (unsigned i = 1; i < m_nbWorkers; ++i)
+	{
+		m_stats[0].addCounters(m_stats[i]);
+		m_stats[i].reset();
+	}
+}
+
+void dtCrowd::runStep(const UpdateContext& context)
+{
+	if (!m_workerPool || m_nbWorkers <= 1)
+	{
+		executeStep(context, 0);
+		return;
+	}
+
+	// The workers use the same settings as the crowd
+	for (unsigned i = 1; i < m_nbWorkers; ++i)
+	{
+		*m_workersQueries[i]->getQueryFilter() = *m_crowdQuery->getQueryFilter();
+		dtVcopy(m_workersQueries[i]->getQueryExtents(), m_crowdQuery->getQueryExtents());
+	}
+
+	dtCrowdStepTask task(*this, context);
+	m_workerPool->run(task, m_nbWorkers);
+}
+
+/// @par
+///
+/// Every worker processes a contiguous range of the agents to update. 
+/// During a step, an agent only writes its own data, so the results do not depend on the way the agents are split.
+void dtCrowd::executeStep(const UpdateContext& context, unsigned worker)
+{
+	const unsigned chunkSize = context.nbIdx / m_nbWorkers;
+	const unsigned remainder = context.nbIdx % m_nbWorkers;
+	const unsigned begin = chunkSize * worker + dtMin(worker, remainder);
+	const unsigned end = begin + chunkSize + (worker < remainder ? 1 : 0);
+
+	dtCrowdQuery* query = m_workersQueries[worker];
+	dtNavMeshQuery* navQuery = query->getNavMeshQuery();
+	const dtQueryFilter* filter = query->getQueryFilter();
+	dtCrowdStats* stats = query->getStats();
+	const unsigned* agentsIdx = context.agentsIdx;
+
+	switch (context.step)
+	{
+	case STEP_ENVIRONMENT:
+		{
+			unsigned* candidates = m_neighborsCandidates + worker * m_maxAgents;
+			dtWallSegmentCache* wallCache = &m_wallCaches[worker];
+			const int wallMisses = wallCache->getMissCount();
+
+			// The agents whose boundary must be rebuilt are located by batches
+			static const unsigned BOUNDARY_BATCH_SIZE = 64;
+			dtCrowdAgent* rebuilt[BOUNDARY_BATCH_SIZE];
+			float positions[BOUNDARY_BATCH_SIZE * 3];
+			dtPolyRef refs[BOUNDARY_BATCH_SIZE];
+			unsigned nbRebuilt = 0;
+
+			// Get nearby navmesh segments and agents to collide with.
+			for (unsigned i = begin; i <= end; ++i)
+			{
+				dtCrowdAgent* ag = 0;
+				const bool isAgent = i < end && getActiveAgent(&ag, agentsIdx[i]) && ag->state == DT_CROWDAGENT_STATE_WALKING;
+
+				if (isAgent)
+				{
+					// Update the collision boundary after certain distance has been passed or
+					// if it has become invalid.
+					const float updateThr = ag->perceptionDistance * 0.25f;
+					if (dtVdist2DSqr(ag->position, m_agentsEnv[ag->id].boundary.getCenter()) > dtSqr(updateThr) ||
+						!m_agentsEnv[ag->id].boundary.isValid(navQuery, filter))
+					{
+						dtVcopy(positions + nbRebuilt * 3, ag->position);
+						rebuilt[nbRebuilt++] = ag;
+					}
+				}
+
+				if (nbRebuilt == BOUNDARY_BATCH_SIZE || (i == end && nbRebuilt > 0))
+				{
+					navQuery->findNearestPolyBatch(positions, (int) nbRebuilt, query->getQueryExtents(), filter, refs, 0);
+
+					for (unsigned j = 0; j < nbRebuilt; ++j)
+						m_agentsEnv[rebuilt[j]->id].boundary.update(refs[j], rebuilt[j]->position, rebuilt[j]->perceptionDistance, 
+																	navQuery, filter, wallCache);
+
+					if (stats)
+					{
+						stats->nearestPolyQueries += nbRebuilt;
+						stats->boundaryUpdates += nbRebuilt;
+					}
+
+					nbRebuilt = 0;
+				}
+
+				if (!isAgent)
+					continue;
+
+				// Query neighbour agents
+				m_agentsEnv[ag->id].nbNeighbors = computeNeighbors(ag->id, candidates, stats);
+
+				for (unsigned j = 0; j < m_agentsEnv[ag->id].nbNeighbors; j++)
+					m_agentsEnv[ag->id].neighbors[j].idx = getAgentIndex(&m_agents[m_agentsEnv[ag->id].neighbors[j].idx]);
+			}
+
+			if (stats)
+				stats->wallSegmentQueries += (unsigned) (wallCache->getMissCount() - wallMisses);
+		}
+		break;
+
+	case STEP_INTEGRATE:
+		for (unsigned g = 0; g < context.nbGroups; ++g)
+		{
+			const dtLodScheduler::Group& group = context.groups[g];
+			const unsigned groupBegin = dtMax(begin, group.first);
+			const unsigned groupEnd = dtMin(end, group.first + group.nbAgents);
+
+			for (unsigned i = groupBegin; i < groupEnd; ++i)
+			{
+				dtCrowdAgent* ag = 0;
+
+				if (!getActiveAgent(&ag, agentsIdx[i]))
+				{
+					if (m_kinematicsEnabled)
+						m_kinematics->load(i, 0);
+
+					continue;
+				}
+
+				locateAgent(*ag, *query, m_currentPosPoly + i, m_currentPos + (i * 3));
+
+				if (m_kinematicsEnabled)
+				{
+					m_kinematics->load(i, ag);
+					continue;
+				}
+
+				if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+					continue;
+
+				integrate(ag, group.dt);
+			}
+
+			if (m_kinematicsEnabled && groupBegin < groupEnd)
+				m_kinematics->integrate(groupBegin, groupEnd, group.dt);
+		}
+		break;
+
+	case STEP_COMPUTE_DISPLACEMENTS:
+		{
+			static const float COLLISION_RESOLVE_FACTOR = 0.7f;
+
+			if (m_kinematicsEnabled)
+			{
+				m_kinematics->computeDisplacements(begin, end, m_agents, m_agentsEnv, COLLISION_RESOLVE_FACTOR);
+				break;
+			}
+
+			for (unsigned i = begin; i < end; ++i)
+			{
+				dtCrowdAgent* ag = 0;
+
+				if (!getActiveAgent(&ag, agentsIdx[i]))
+					continue;
+
+				const int idx0 = getAgentIndex(ag);
+
+				if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+					continue;
+
+				float* disp = m_disp[agentsIdx[i]];
+				dtVset(disp, 0, 0, 0);
+
+				float w = 0;
+
+				for (unsigned j = 0; j < m_agentsEnv[ag->id].nbNeighbors; ++j)
+				{
+					const dtCrowdAgent* nei = &m_agents[m_agentsEnv[ag->id].neighbors[j].idx];
+					const int idx1 = getAgentIndex(nei);
+
+					float diff[3];
+					dtVsub(diff, ag->position, nei->position);
+					diff[1] = 0;
+
+					float dist = dtVlenSqr(diff);
+
+					if (dist > dtSqr(ag->radius + nei->radius) + EPSILON)
+						continue;
+
+					dist = sqrtf(dist);
+					float pen = (ag->radius + nei->radius) - dist;
+					if (dist < EPSILON)
+					{
+						// Agents on top of each other, try to choose diverging separation directions.
+						if (idx0 > idx1)
+							dtVset(diff, -ag->desiredVelocity[2], 0, ag->desiredVelocity[0]);
+						else
+							dtVset(diff, ag->desiredVelocity[2], 0, -ag->desiredVelocity[0]);
+						pen = 0.01f;
+					}
+					else
+					{
+						pen = (1.0f / dist) * (pen * 0.5f) * COLLISION_RESOLVE_FACTOR;
+					}
+
+					dtVmad(disp, disp, diff, pen);			
+
+					w += 1.0f;
+				}
+
+				if (w > EPSILON)
+				{
+					const float iw = 1.0f / w;
+					dtVscale(disp, disp, iw);
+				}
+			}
+		}
+		break;
+
+	case STEP_APPLY_DISPLACEMENTS:
+		if (m_kinematicsEnabled)
+		{
+			m_kinematics->applyDisplacements(begin, end);
+			break;
+		}
+
+		for (unsigned i = begin; i < end; ++i)
+		{
+			dtCrowdAgent* ag = 0;
+
+			if (!getActiveAgent(&ag, agentsIdx[i]))
+				continue;
+
+			if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+				continue;
+
+			float* disp = m_disp[agentsIdx[i]];
+
+			dtVadd(ag->position, ag->position, disp);
+		}
+		break;
+
+	case STEP_CONSTRAIN_POSITIONS:
+		for (unsigned g = 0; g < context.nbGroups; ++g)
+		{
+			const dtLodScheduler::Group& group = context.groups[g];
+			const unsigned groupBegin = dtMax(begin, group.first);
+			const unsigned groupEnd = dtMin(end, group.first + group.nbAgents);
+
+			for (unsigned i = groupBegin; i < groupEnd; ++i)
+			{
+				dtCrowdAgent* ag = 0;
+
+				if (!getActiveAgent(&ag, agentsIdx[i]))
+					continue;
+
+				if (ag->state == DT_CROWDAGENT_STATE_WALKING)
+				{
+					if (m_kinematicsEnabled)
+						m_kinematics->storePositionAndVelocity(i, *ag);
+
+					// Move along navmesh.
+					float newPos[3];
+					dtPolyRef visited[dtPathCorridor::MAX_VISITED];
+					int visitedCount = 0;
+					navQuery->moveAlongSurface(m_currentPosPoly[i], m_currentPos + (i * 3), ag->position, filter, newPos, 
+											   visited, &visitedCount, dtPathCorridor::MAX_VISITED);
+
+					if (stats)
+						++stats->moveAlongSurfaceQueries;
+
+					// The last visited polygon contains the new position
+					if (visitedCount > 0)
+						m_agentsPolys[ag->id] = visited[visitedCount - 1];
+
+					// Get valid constrained position back.
+					float newHeight = *(m_currentPos + (i * 3) + 1);
+					navQuery->getPolyHeight(m_currentPosPoly[i], newPos, &newHeight);
+					newPos[1] = newHeight;
+
+					dtVcopy(ag->position, newPos);
+					continue;
+				}
+
+				// Update agents using off-mesh connection.
+				float offmeshTotalTime = ag->offmeshInitToStartTime + ag->offmeshStartToEndTime;
+				if (ag->state == DT_CROWDAGENT_STATE_OFFMESH && offmeshTotalTime > EPSILON)
+				{
+					ag->offmeshElaspedTime += group.dt;
+
+					if (ag->offmeshElaspedTime > offmeshTotalTime)
+					{
+						// Prepare agent for walking.
+						ag->state = DT_CROWDAGENT_STATE_WALKING;
+						continue;
+					}
+
+					// Update position
+					if (ag->offmeshElaspedTime < ag->offmeshInitToStartTime)
+					{
+						const float u = tween(ag->offmeshElaspedTime, 0.0, ag->offmeshInitToStartTime);
+						dtVlerp(ag->position, ag->offmeshInitPos, ag->offmeshStartPos, u);
+					}
+					else
+					{
+						const float u = tween(ag->offmeshElaspedTime, ag->offmeshInitToStartTime, offmeshTotalTime);
+						dtVlerp(ag->position, ag->offmeshStartPos, ag->offmeshEndPos, u);
+					}
+
+					// Update velocity.
+					dtVset(ag->velocity, 0,0,0);
+					dtVset(ag->desiredVelocity, 0,0,0);
+				}
+			}
+		}
+		break;
+	}
+}
+
 const unsigned dtCrowd::getAgentCount() const
 {
 	return m_maxAgents;
@@ -284,19 +1041,10 @@ const dtCrowdAgentEnvironment* dtCrowd::getAgentEnvironment(unsigned id) const
 bool dtCrowd::addAgent(dtCrowdAgent& agent, const float* pos)
 {
 	// Find empty slot.
-	int idx = -1;
-	for (unsigned i = 0; i < m_maxAgents; ++i)
-	{
-		if (!m_agents[i].active)
-		{
-			idx = i;
-			break;
-		}
-	}
-
-	if (idx == -1)
+	if (!m_nbFreeSlots)
 		return false;
-	
+
+	const unsigned idx = m_freeSlots[--m_nbFreeSlots];
 	dtCrowdAgent* ag = &m_agents[idx];
 
 	// Find nearest position on navmesh and place the agent there.
@@ -309,6 +1057,8 @@ bool dtCrowd::addAgent(dtCrowdAgent& agent, const float* pos)
 	dtVset(ag->velocity, 0, 0, 0);
 	dtVcopy(ag->position, nearest);
 	
+	m_agentsPolys[idx] = ref;
+
 	if (ref)
 		ag->state = DT_CROWDAGENT_STATE_WALKING;
 	else
@@ -316,6 +1066,16 @@ bool dtCrowd::addAgent(dtCrowdAgent& agent, const float* pos)
 		
 	ag->active = 1;
 
+	// Keep the active agents sorted by id
+	const unsigned activeIdx = findActiveAgent(idx);
+	memmove(m_agentsToUpdate + activeIdx + 1, m_agentsToUpdate + activeIdx, sizeof(unsigned) * (m_nbActiveAgents - activeIdx));
+	memmove(m_activeAgents + activeIdx + 1, m_activeAgents + activeIdx, sizeof(dtCrowdAgent*) * (m_nbActiveAgents - activeIdx));
+	m_agentsToUpdate[activeIdx] = idx;
+	m_activeAgents[activeIdx] = ag;
+	++m_nbActiveAgents;
+
+	m_lod->resetAgent(idx);
+
 	agent = *ag;
 	
 
@@ -333,318 +1093,521 @@ void dtCrowd::removeAgent(unsigned id)
 		if (m_agents[id].active != 0)
 		{
 			m_agents[id].active = 0;
+			m_agentsSnapshot[id].active = 0;
+
+			const unsigned activeIdx = findActiveAgent(id);
 			--m_nbActiveAgents;
+			memmove(m_agentsToUpdate + activeIdx, m_agentsToUpdate + activeIdx + 1, sizeof(unsigned) * (m_nbActiveAgents - activeIdx));
+			memmove(m_activeAgents + activeIdx, m_activeAgents + activeIdx + 1, sizeof(dtCrowdAgent*) * (m_nbActiveAgents - activeIdx));
+
+			m_freeSlots[m_nbFreeSlots++] = id;
+			m_lod->resetAgent(id);
 		}
 	}
 }
 
-unsigned dtCrowd::getActiveAgents(const dtCrowdAgent** agents, const unsigned maxAgents)
+unsigned dtCrowd::getActiveAgents(const dtCrowdAgent** agents, const unsigned maxAgents)
+{
+	const unsigned n = dtMin(m_nbActiveAgents, maxAgents);
+	memcpy(agents, m_activeAgents, sizeof(dtCrowdAgent*) * n);
+	return n;
+}
+
+bool dtCrowd::getActiveAgent(dtCrowdAgent** ag, int id)
+{
+	if (id >= 0 && id < static_cast<unsigned>(m_maxAgents))
+	{
+		if (m_agents[id].active)
+		{
+			*ag = &m_agents[id];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/// @par
+///
+/// The batches are found with an open addressing hash of the behaviors, 
+/// then the agents are placed in their batch with a counting sort.
+unsigned dtCrowd::buildBehaviorBatches(const unsigned* agentsIdx, unsigned nbIdx)
+{
+	unsigned nbBatches = 0;
+
+	// Counts the agents of every behavior
+	for (unsigned i = 0; i < nbIdx; ++i)
+	{
+		dtCrowdAgent* ag = 0;
+
+		if (!getActiveAgent(&ag, agentsIdx[i]) || !ag->behavior)
+			continue;
+
+		const unsigned slot = findBatchSlot(ag->behavior);
+
+		if (m_batchHash[slot] == -1)
+		{
+			BehaviorBatch& batch = m_batches[nbBatches];
+			batch.behavior = ag->behavior;
+			batch.nbAgents = 0;
+			batch.hashSlot = slot;
+			m_batchHash[slot] = (int) nbBatches++;
+		}
+
+		++m_batches[m_batchHash[slot]].nbAgents;
+	}
+
+	unsigned first = 0;
+
+	for (unsigned i = 0; i < nbBatches; ++i)
+	{
+		m_batches[i].first = first;
+		first += m_batches[i].nbAgents;
+		m_batches[i].nbAgents = 0;
+	}
+
+	// Places the agents in their batch
+	for (unsigned i = 0; i < nbIdx; ++i)
+	{
+		dtCrowdAgent* ag = 0;
+
+		if (!getActiveAgent(&ag, agentsIdx[i]) || !ag->behavior)
+			continue;
+
+		BehaviorBatch& batch = m_batches[m_batchHash[findBatchSlot(ag->behavior)]];
+		m_batchIds[batch.first + batch.nbAgents++] = ag->id;
+	}
+
+	// The hash is left empty for the next update
+	for (unsigned i = 0; i < nbBatches; ++i)
+		m_batchHash[m_batches[i].hashSlot] = -1;
+
+	return nbBatches;
+}
+
+unsigned dtCrowd::findBatchSlot(const dtBehavior* behavior) const
+{
+	const unsigned mask = m_batchHashSize - 1;
+	unsigned slot = (unsigned) ((((size_t) behavior) >> 4) * 2654435761u) & mask;
+
+	while (m_batchHash[slot] != -1 && m_batches[m_batchHash[slot]].behavior != behavior)
+		slot = (slot + 1) & mask;
+
+	return slot;
+}
+
+void dtCrowd::updateVelocity(const float dt, unsigned* agentsIdx, unsigned nbIdx)
+{
+	if (!m_workersQueries)
+		return;
+
+	const double startTime = m_statsEnabled ? getStatsTime() : 0;
+
+	nbIdx = (nbIdx < m_maxAgents) ? nbIdx : m_maxAgents;
+	
+	// If we want to update every agent
+	if (agentsIdx == 0)
+	{
+		agentsIdx = m_agentsToUpdate;
+		nbIdx = m_nbActiveAgents;
+	}
+
+	takeSnapshot();
+	beginVelocityUpdate(dt, agentsIdx, nbIdx);
+	computeVelocity(dt, agentsIdx, nbIdx);
+	endVelocityUpdate(dt);
+
+	if (m_statsEnabled)
+		m_stats->velocityTime += (float) (getStatsTime() - startTime);
+}
+
+void dtCrowd::takeSnapshot()
+{
+	// The behaviors read the state of the agents from a snapshot and write into the agents of the crowd, 
+	// so an agent never sees the velocities already computed for the other agents during this update.
+	// Only the active agents are copied, the copies of the inactive ones are just kept inactive.
+	for (unsigned i = 0; i < m_nbActiveAgents; ++i)
+		memcpy(&m_agentsSnapshot[m_agentsToUpdate[i]], m_activeAgents[i], sizeof(dtCrowdAgent));
+
+	++m_crowdQuery->m_frame;
+}
+
+/// @par
+///
+/// The behaviors are prepared once for the whole update, no matter how many agents use them
+/// and how many times computeVelocity() is called.
+void dtCrowd::beginVelocityUpdate(const float dt, const unsigned* agentsIdx, unsigned nbIdx)
 {
-	unsigned n = 0;
-	for (unsigned i = 0; i < m_maxAgents; ++i)
+	m_crowdQuery->m_agents = m_agentsSnapshot;
+
+	m_nbUpdatedBehaviors = buildBehaviorBatches(agentsIdx, nbIdx);
+
+	for (unsigned i = 0; i < m_nbUpdatedBehaviors; ++i)
+		m_updatedBehaviors[i] = m_batches[i].behavior;
+
+	for (unsigned i = 0; i < m_nbUpdatedBehaviors; ++i)
 	{
-		if (!m_agents[i].active) continue;
-		if (n < maxAgents)
-			agents[n++] = &m_agents[i];
+		dtBehavior* behavior = m_updatedBehaviors[i];
+
+		if (m_statsEnabled)
+		{
+			const double behaviorStartTime = getStatsTime();
+			behavior->preUpdate(*m_crowdQuery, dt);
+			m_stats->addBehaviorTime(behavior, (float) (getStatsTime() - behaviorStartTime), 0);
+		}
+		else
+		{
+			behavior->preUpdate(*m_crowdQuery, dt);
+		}
 	}
-	return n;
 }
 
-bool dtCrowd::getActiveAgent(dtCrowdAgent** ag, int id)
+void dtCrowd::endVelocityUpdate(const float dt)
 {
-	if (id >= 0 && id < static_cast<unsigned>(m_maxAgents))
+	m_crowdQuery->m_agents = m_agents;
+
+	for (unsigned i = 0; i < m_nbUpdatedBehaviors; ++i)
 	{
-		if (m_agents[id].active)
+		dtBehavior* behavior = m_updatedBehaviors[i];
+
+		if (m_statsEnabled)
 		{
-			*ag = &m_agents[id];
-			return true;
+			const double behaviorStartTime = getStatsTime();
+			behavior->postUpdate(*m_crowdQuery, dt);
+			m_stats->addBehaviorTime(behavior, (float) (getStatsTime() - behaviorStartTime), 0);
+		}
+		else
+		{
+			behavior->postUpdate(*m_crowdQuery, dt);
 		}
 	}
 
-	return false;
+	m_nbUpdatedBehaviors = 0;
 }
 
-void dtCrowd::updateVelocity(const float dt, unsigned* agentsIdx, unsigned nbIdx)
+void dtCrowd::computeVelocity(const float dt, unsigned* agentsIdx, unsigned nbIdx)
 {
-	nbIdx = (nbIdx < m_maxAgents) ? nbIdx : m_maxAgents;
-	
-	// If we want to update every agent
-	if (agentsIdx == 0)
-	{
-		agentsIdx = m_agentsToUpdate;
-		nbIdx = m_maxAgents;
-	}
+	m_crowdQuery->m_agents = m_agentsSnapshot;
 
-	for (unsigned i = 0; i < nbIdx; ++i)
+	const unsigned nbBatches = buildBehaviorBatches(agentsIdx, nbIdx);
+
+	for (unsigned i = 0; i < nbBatches; ++i)
 	{
-		dtCrowdAgent* ag = 0;
+		const BehaviorBatch& batch = m_batches[i];
 
-		if (!getActiveAgent(&ag, agentsIdx[i]))
-			continue;
-		
-		if (ag->behavior)
-			ag->behavior->update(*m_crowdQuery, *ag, *ag, dt);
+		if (m_statsEnabled)
+		{
+			const double behaviorStartTime = getStatsTime();
+			batch.behavior->updateBatch(*m_crowdQuery, m_agentsSnapshot, m_agents, m_batchIds + batch.first, batch.nbAgents, dt);
+			m_stats->addBehaviorTime(batch.behavior, (float) (getStatsTime() - behaviorStartTime), batch.nbAgents);
+		}
+		else
+		{
+			batch.behavior->updateBatch(*m_crowdQuery, m_agentsSnapshot, m_agents, m_batchIds + batch.first, batch.nbAgents, dt);
+		}
 	}
 
+	m_crowdQuery->m_agents = m_agents;
+
 	// Fake dynamic constraint
-	for (unsigned i = 0; i < nbIdx; ++i)
+	if (m_kinematicsEnabled)
 	{
-		dtCrowdAgent* ag = 0;
+		for (unsigned i = 0; i < nbIdx; ++i)
+		{
+			dtCrowdAgent* ag = 0;
+			m_kinematics->load(i, getActiveAgent(&ag, agentsIdx[i]) ? ag : 0);
+		}
 
-		if (!getActiveAgent(&ag, agentsIdx[i]))
-			continue;
+		m_kinematics->clampAcceleration(0, nbIdx, dt);
 
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-			continue;
+		for (unsigned i = 0; i < nbIdx; ++i)
+		{
+			dtCrowdAgent* ag = 0;
 
-		const float maxDelta = ag->maxAcceleration * dt;
-		float dv[3];
-		dtVsub(dv, ag->desiredVelocity, ag->velocity);
-		float ds = dtVlen(dv);
+			if (getActiveAgent(&ag, agentsIdx[i]) && ag->state == DT_CROWDAGENT_STATE_WALKING)
+				m_kinematics->storeVelocity(i, *ag);
+		}
 
-		if (ds > maxDelta)
-			dtVscale(dv, dv, maxDelta/ds);
-		
-		dtVadd(ag->velocity, ag->velocity, dv);
+		m_kinematics->unload(agentsIdx, nbIdx);
+	}
+	else
+	{
+		for (unsigned i = 0; i < nbIdx; ++i)
+		{
+			dtCrowdAgent* ag = 0;
+
+			if (!getActiveAgent(&ag, agentsIdx[i]))
+				continue;
+
+			if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+				continue;
+
+			const float maxDelta = ag->maxAcceleration * dt;
+			float dv[3];
+			dtVsub(dv, ag->desiredVelocity, ag->velocity);
+			float ds = dtVlen(dv);
+
+			if (ds > maxDelta)
+				dtVscale(dv, dv, maxDelta/ds);
+			
+			dtVadd(ag->velocity, ag->velocity, dv);
+		}
 	}
 }
 
 void dtCrowd::updatePosition(const float dt, unsigned* agentsIdx, unsigned nbIdx)
 {
+	if (!m_workersQueries)
+		return;
+
+	const double startTime = m_statsEnabled ? getStatsTime() : 0;
+
 	// If we want to update every agent
 	if (nbIdx == 0)
 	{
 		agentsIdx = m_agentsToUpdate;
-		nbIdx = m_maxAgents;
+		nbIdx = m_nbActiveAgents;
 	}
 	
 	nbIdx = (nbIdx < m_maxAgents) ? nbIdx : m_maxAgents;
 
-	// The current start position of the agent (not yet modified)
-	dtPolyRef* currentPosPoly = (dtPolyRef*) dtAlloc(sizeof(dtPolyRef) * nbIdx, DT_ALLOC_TEMP);
-	float* currentPos = (float*) dtAlloc(sizeof(float) * 3 * nbIdx, DT_ALLOC_TEMP);
-
-	for (unsigned i = 0; i < nbIdx; ++i)
-	{
-		dtCrowdAgent* ag = 0;
-
-		if (!getActiveAgent(&ag, agentsIdx[i]))
-			continue;
+	dtLodScheduler::Group group;
+	group.first = 0;
+	group.nbAgents = nbIdx;
+	group.dt = dt;
 
-		m_crowdQuery->getNavMeshQuery()->findNearestPoly(ag->position, m_crowdQuery->getQueryExtents(), m_crowdQuery->getQueryFilter(), currentPosPoly + i, currentPos + (i * 3));
-	}
+	computePosition(agentsIdx, nbIdx, &group, 1);
 
-	// Integrate.
-	for (unsigned i = 0; i < nbIdx; ++i)
+	if (m_statsEnabled)
 	{
-		dtCrowdAgent* ag = 0;
+		gatherStats();
+		m_stats->positionTime += (float) (getStatsTime() - startTime);
+	}
+}
 
-		if (!getActiveAgent(&ag, agentsIdx[i]))
-			continue;
+void dtCrowd::computePosition(unsigned* agentsIdx, unsigned nbIdx, const dtLodScheduler::Group* groups, unsigned nbGroups)
+{
+	UpdateContext context;
+	context.agentsIdx = agentsIdx;
+	context.nbIdx = nbIdx;
+	context.groups = groups;
+	context.nbGroups = nbGroups;
 
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-			continue;
-		integrate(ag, dt);
-	}
+	// Integrate.
+	context.step = STEP_INTEGRATE;
+	runStep(context);
 
 	// Handle collisions.
-	static const float COLLISION_RESOLVE_FACTOR = 0.7f;
-
 	for (unsigned iter = 0; iter < 4; ++iter)
 	{
-		for (unsigned i = 0; i < nbIdx; ++i)
-		{
-			dtCrowdAgent* ag = 0;
-
-			if (!getActiveAgent(&ag, agentsIdx[i]))
-				continue;
+		context.step = STEP_COMPUTE_DISPLACEMENTS;
+		runStep(context);
 
-			const int idx0 = getAgentIndex(ag);
+		context.step = STEP_APPLY_DISPLACEMENTS;
+		runStep(context);
+	}
 
-			if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-				continue;
+	// Move along the navigation mesh, or along the off-mesh connections
+	context.step = STEP_CONSTRAIN_POSITIONS;
+	runStep(context);
 
-			float* disp = m_disp[agentsIdx[i]];
-			dtVset(disp, 0, 0, 0);
+	if (m_kinematicsEnabled)
+		m_kinematics->unload(agentsIdx, nbIdx);
+}
 
-			float w = 0;
+void dtCrowd::updateEnvironment(unsigned* agentsIdx, unsigned nbIdx)
+{
+	if (!m_workersQueries)
+		return;
 
-			for (unsigned j = 0; j < m_agentsEnv[ag->id].nbNeighbors; ++j)
-			{
-				const dtCrowdAgent* nei = &m_agents[m_agentsEnv[ag->id].neighbors[j].idx];
-				const int idx1 = getAgentIndex(nei);
+	const double startTime = m_statsEnabled ? getStatsTime() : 0;
 
-				float diff[3];
-				dtVsub(diff, ag->position, nei->position);
-				diff[1] = 0;
+	// If we want to update every agent
+	if (agentsIdx == 0)
+	{
+		agentsIdx = m_agentsToUpdate;
+		nbIdx = m_nbActiveAgents;
+	}
 
-				float dist = dtVlenSqr(diff);
+	nbIdx = (nbIdx < m_maxAgents) ? nbIdx : m_maxAgents;
 
-				if (dist > dtSqr(ag->radius + nei->radius) + EPSILON)
-					continue;
+	updateProximityGrid();
+	computeEnvironment(agentsIdx, nbIdx);
 
-				dist = sqrtf(dist);
-				float pen = (ag->radius + nei->radius) - dist;
-				if (dist < EPSILON)
-				{
-					// Agents on top of each other, try to choose diverging separation directions.
-					if (idx0 > idx1)
-						dtVset(diff, -ag->desiredVelocity[2], 0, ag->desiredVelocity[0]);
-					else
-						dtVset(diff, ag->desiredVelocity[2], 0, -ag->desiredVelocity[0]);
-					pen = 0.01f;
-				}
-				else
-				{
-					pen = (1.0f / dist) * (pen * 0.5f) * COLLISION_RESOLVE_FACTOR;
-				}
+	if (m_statsEnabled)
+	{
+		gatherStats();
+		m_stats->environmentTime += (float) (getStatsTime() - startTime);
+	}
+}
 
-				dtVmad(disp, disp, diff, pen);			
+void dtCrowd::computeEnvironment(unsigned* agentsIdx, unsigned nbIdx)
+{
+	// The cached wall segments are dropped when the navigation mesh or the filter changed
+	const dtNavMesh* nav = m_crowdQuery->getNavMeshQuery()->getAttachedNavMesh();
+	for (unsigned i = 0; i < m_nbWorkers; ++i)
+		m_wallCaches[i].validate(nav, m_workersQueries[i]->getQueryFilter());
+
+	UpdateContext context;
+	context.step = STEP_ENVIRONMENT;
+	context.agentsIdx = agentsIdx;
+	context.nbIdx = nbIdx;
+	context.groups = 0;
+	context.nbGroups = 0;
+
+	runStep(context);
+}
+	
+void dtCrowd::setUpdateBudget(const unsigned maxAgents, const float maxTime)
+{
+	m_budgetMaxAgents = maxAgents;
+	m_budgetMaxTime = dtMax(maxTime, 0.f);
+}
 
-				w += 1.0f;
-			}
+void dtCrowd::update(const float dt, unsigned* indexList, unsigned nbIndex)
+{
+	// The workers could not be allocated
+	if (!m_workersQueries)
+		return;
 
-			if (w > EPSILON)
-			{
-				const float iw = 1.0f / w;
-				dtVscale(disp, disp, iw);
-			}
-		}
-		
-		for (unsigned i = 0; i < nbIdx; ++i)
-		{
-			dtCrowdAgent* ag = 0;
+	if (m_statsEnabled)
+		resetStats();
 
-			if (!getActiveAgent(&ag, agentsIdx[i]))
-				continue;
+	if (!indexList && (m_budgetMaxAgents || m_budgetMaxTime > 0.f))
+	{
+		updateBudgeted(dt);
+		return;
+	}
 
-			if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-				continue;
+	updateEnvironment(indexList, nbIndex);
+	updateVelocity(dt, indexList, nbIndex);
+	updatePosition(dt, indexList, nbIndex);
+}
 
-			float* disp = m_disp[agentsIdx[i]];
+/// @par
+///
+/// Every slice of agents sees the proximity grid and the snapshot taken at the beginning of the update,
+/// so the results of the agents updated do not depend on the size of the slices.
+/// The behaviors of all the active agents are prepared before the first slice and finished after the last one,
+/// since the agents the budget lets through are not known in advance.
+void dtCrowd::updateBudgeted(const float dt)
+{
+	const double startTime = getStatsTime();
+	unsigned nbUpdated = 0;
 
-			dtVadd(ag->position, ag->position, disp);
-		}
-	}
-	
-	for (unsigned i = 0; i < nbIdx; ++i)
+	if (m_nbActiveAgents > 0)
 	{
-		dtCrowdAgent* ag = 0;
+		const unsigned maxAgents = m_budgetMaxAgents ? dtMin(m_budgetMaxAgents, m_nbActiveAgents) : m_nbActiveAgents;
 
-		if (!getActiveAgent(&ag, agentsIdx[i]))
-			continue;
+		updateProximityGrid();
+		takeSnapshot();
 
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-			continue;
+		double phaseStartTime = getStatsTime();
+		beginVelocityUpdate(dt, m_agentsToUpdate, m_nbActiveAgents);
 
-		// Move along navmesh.
-		float newPos[3];
-		dtPolyRef visited[dtPathCorridor::MAX_VISITED];
-		int visitedCount;
-		m_crowdQuery->getNavMeshQuery()->moveAlongSurface(currentPosPoly[i], currentPos + (i * 3), ag->position, m_crowdQuery->getQueryFilter(), newPos, 
-			visited, &visitedCount, dtPathCorridor::MAX_VISITED);
+		if (m_statsEnabled)
+		{
+			m_stats->environmentTime += (float) (phaseStartTime - startTime);
+			m_stats->velocityTime += (float) (getStatsTime() - phaseStartTime);
+		}
 
-		// Get valid constrained position back.
-		float newHeight = *(currentPos + (i * 3) + 1);
-		m_crowdQuery->getNavMeshQuery()->getPolyHeight(currentPosPoly[i], newPos, &newHeight);
-		newPos[1] = newHeight;
+		m_budgetCursor = m_budgetCursor % m_nbActiveAgents;
 
-		dtVcopy(ag->position, newPos);
-	}
+		while (nbUpdated < maxAgents)
+		{
+			// The slices wrap around the active agents, so every agent eventually gets updated
+			const unsigned nbIds = dtMin(BUDGET_SLICE_SIZE, maxAgents - nbUpdated);
 
-	// Update agents using off-mesh connection.
-	for (unsigned i = 0; i < nbIdx; ++i)
-	{
-		dtCrowdAgent* ag = 0;
+			for (unsigned i = 0; i < nbIds; ++i)
+				m_budgetIds[i] = m_agentsToUpdate[(m_budgetCursor + i) % m_nbActiveAgents];
 
-		if (!getActiveAgent(&ag, agentsIdx[i]))
-			continue;
+			phaseStartTime = getStatsTime();
+			computeEnvironment(m_budgetIds, nbIds);
 
-		float offmeshTotalTime = ag->offmeshInitToStartTime + ag->offmeshStartToEndTime;
-		if (ag->state == DT_CROWDAGENT_STATE_OFFMESH && offmeshTotalTime > EPSILON)
-		{
-			ag->offmeshElaspedTime += dt;
+			const double velocityStartTime = getStatsTime();
+			computeVelocity(dt, m_budgetIds, nbIds);
 
-			if (ag->offmeshElaspedTime > offmeshTotalTime)
-			{
-				// Prepare agent for walking.
-				ag->state = DT_CROWDAGENT_STATE_WALKING;
-				continue;
-			}
+			const double endTime = getStatsTime();
 
-			// Update position
-			if (ag->offmeshElaspedTime < ag->offmeshInitToStartTime)
-			{
-				const float u = tween(ag->offmeshElaspedTime, 0.0, ag->offmeshInitToStartTime);
-				dtVlerp(ag->position, ag->offmeshInitPos, ag->offmeshStartPos, u);
-			}
-			else
+			if (m_statsEnabled)
 			{
-				const float u = tween(ag->offmeshElaspedTime, ag->offmeshInitToStartTime, offmeshTotalTime);
-				dtVlerp(ag->position, ag->offmeshStartPos, ag->offmeshEndPos, u);
+				m_stats->environmentTime += (float) (velocityStartTime - phaseStartTime);
+				m_stats->velocityTime += (float) (endTime - velocityStartTime);
 			}
 
-			// Update velocity.
-			dtVset(ag->velocity, 0,0,0);
-			dtVset(ag->desiredVelocity, 0,0,0);
+			m_budgetCursor = (m_budgetCursor + nbIds) % m_nbActiveAgents;
+			nbUpdated += nbIds;
+
+			if (m_budgetMaxTime > 0.f && endTime - startTime >= m_budgetMaxTime)
+				break;
+		}
+
+		phaseStartTime = getStatsTime();
+		endVelocityUpdate(dt);
+
+		if (m_statsEnabled)
+		{
+			m_stats->velocityTime += (float) (getStatsTime() - phaseStartTime);
+			gatherStats();
+			m_stats->skippedAgents += m_nbActiveAgents - nbUpdated;
 		}
 	}
 
-	dtFree(currentPosPoly);
-	dtFree(currentPos);
+	// The skipped agents keep their velocity
+	updatePosition(dt);
 }
 
-void dtCrowd::updateEnvironment(unsigned* agentsIdx, unsigned nbIdx)
+/// @par
+///
+/// The agents which are not scheduled keep their velocity and position, but are still seen by the others.
+/// Every group reads the snapshot taken at the beginning of the update, and the behaviors are prepared and finished
+/// once for all the groups, with the time elapsed since the last update of the crowd.
+/// The positions are updated once all the velocities are known: every group is integrated with its own time step,
+/// then the collisions are solved between all the scheduled agents, so the results do not depend on the order of the groups.
+void dtCrowd::updateScheduled(const float dt)
 {
-	// If we want to update every agent
-	if (agentsIdx == 0)
-	{
-		agentsIdx = m_agentsToUpdate;
-		nbIdx = m_maxAgents;
-	}
+	if (!m_workersQueries)
+		return;
 
-	nbIdx = (nbIdx < m_maxAgents) ? nbIdx : m_maxAgents;
+	if (m_statsEnabled)
+		resetStats();
 
-	// Get nearby navmesh segments and agents to collide with.
-	for (unsigned i = 0; i < nbIdx; ++i)
-	{
-		dtCrowdAgent* ag = 0;
+	const unsigned nbGroups = m_lod->schedule(m_agents, m_agentsToUpdate, m_nbActiveAgents, dt);
+	if (nbGroups == 0)
+		return;
 
-		if (!getActiveAgent(&ag, agentsIdx[i]))
-			continue;
+	unsigned* ids = m_lod->getScheduledIds();
+	const unsigned nbIds = m_lod->getScheduledCount();
 
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-			continue;
+	updateEnvironment(ids, nbIds);
 
-		if (ag->state == DT_CROWDAGENT_STATE_INVALID)
-			m_agentsEnv[ag->id].boundary.reset();
+	double startTime = m_statsEnabled ? getStatsTime() : 0;
 
-		// Update the collision boundary after certain distance has been passed or
-		// if it has become invalid.
-		const float updateThr = ag->perceptionDistance * 0.25f;
-		if (dtVdist2DSqr(ag->position, m_agentsEnv[ag->id].boundary.getCenter()) > dtSqr(updateThr) ||
-			!m_agentsEnv[ag->id].boundary.isValid(m_crowdQuery->getNavMeshQuery(), m_crowdQuery->getQueryFilter()))
-		{
-			dtPolyRef ref;
-			float nearest[3];
-			m_crowdQuery->getNavMeshQuery()->findNearestPoly(ag->position, m_crowdQuery->getQueryExtents(), m_crowdQuery->getQueryFilter(), &ref, nearest);
+	takeSnapshot();
+	beginVelocityUpdate(dt, ids, nbIds);
 
-			m_agentsEnv[ag->id].boundary.update(ref, ag->position, ag->perceptionDistance, 
-				m_crowdQuery->getNavMeshQuery(), m_crowdQuery->getQueryFilter());
-		}
-		// Query neighbour agents
-		m_agentsEnv[ag->id].nbNeighbors = this->computeNeighbors(ag->id);
+	for (unsigned i = 0; i < nbGroups; ++i)
+	{
+		const dtLodScheduler::Group& group = m_lod->getGroup(i);
 
-		for (unsigned j = 0; j < m_agentsEnv[ag->id].nbNeighbors; j++)
-			m_agentsEnv[ag->id].neighbors[j].idx = getAgentIndex(&m_agents[m_agentsEnv[ag->id].neighbors[j].idx]);
+		computeVelocity(group.dt, ids + group.first, group.nbAgents);
+	}
+
+	endVelocityUpdate(dt);
+
+	if (m_statsEnabled)
+	{
+		m_stats->velocityTime += (float) (getStatsTime() - startTime);
+		startTime = getStatsTime();
+	}
+
+	computePosition(ids, nbIds, &m_lod->getGroup(0), nbGroups);
+
+	if (m_statsEnabled)
+	{
+		gatherStats();
+		m_stats->positionTime += (float) (getStatsTime() - startTime);
 	}
-}
-	
-void dtCrowd::update(const float dt, unsigned* indexList, unsigned nbIndex)
-{
-	updateEnvironment(indexList, nbIndex);
-	updateVelocity(dt, indexList, nbIndex);
-	updatePosition(dt, indexList, nbIndex);
 }
 
 bool dtCrowd::updateAgentPosition(unsigned id, const float* position)
@@ -655,7 +1618,8 @@ bool dtCrowd::updateAgentPosition(unsigned id, const float* position)
 		dtPolyRef ref = 0;
 		float nearestPosition[] = {0, 0, 0};
 
-		if (dtStatusFailed(m_crowdQuery->getNavMeshQuery()->findNearestPoly(position, m_crowdQuery->getQueryExtents(), m_crowdQuery->getQueryFilter(), &ref, nearestPosition)))
+		if (dtStatusFailed(m_crowdQuery->getNavMeshQuery()->locatePoint(m_agentsPolys[id], position, m_crowdQuery->getQueryExtents(), 
+																		 m_crowdQuery->getQueryFilter(), &ref, nearestPosition)))
 			return false;
 
 		// If no polygons have been found, it's a failure
@@ -665,6 +1629,7 @@ bool dtCrowd::updateAgentPosition(unsigned id, const float* position)
 		dtVset(ag.desiredVelocity, 0, 0, 0);
 		dtVset(ag.velocity, 0, 0, 0);
 		dtVcopy(ag.position, nearestPosition);
+		m_agentsPolys[id] = ref;
 
 		ag.state = DT_CROWDAGENT_STATE_WALKING;
 		
@@ -689,15 +1654,19 @@ bool dtCrowd::applyAgent(const dtCrowdAgent& ag)
 
 	// Find nearest position on navmesh and place the agent there.
 	float nearest[3];
-	dtPolyRef ref;
-	m_crowdQuery->getNavMeshQuery()->findNearestPoly(ag.position, m_crowdQuery->getQueryExtents(), 
+	dtPolyRef ref = 0;
+	m_crowdQuery->getNavMeshQuery()->locatePoint(m_agentsPolys[ag.id], ag.position, m_crowdQuery->getQueryExtents(), 
 		m_crowdQuery->getQueryFilter(), &ref, nearest);
 
 	// If a position could not be found on the navigation mesh, then we do not apply the changes
 	if (!ref)
 		return false;
 
+	// The activity of an agent is only changed by addAgent() and removeAgent()
+	const unsigned char active = m_agents[ag.id].active;
 	m_agents[ag.id] = ag;
+	m_agents[ag.id].active = active;
+	m_agentsPolys[ag.id] = ref;
 
 	// Checking out of bound limits
 	m_agents[ag.id].radius = (m_agents[ag.id].radius < 0) ? 0 : m_agents[ag.id].radius;
@@ -724,17 +1693,92 @@ unsigned dtCrowd::getAgents(const unsigned* ids, unsigned size, const dtCrowdAge
 	return m_crowdQuery->getAgents(ids, size, agents);
 }
 
-unsigned dtCrowd::computeNeighbors(unsigned id)
+void dtCrowd::updateProximityGrid()
+{
+	// Cells are half as large as the average perception distance, 
+	// so a neighbors query usually touches 5x5 cells.
+	float perception = 0.f;
+	unsigned nbAgents = 0;
+
+	for (unsigned i = 0; i < m_nbActiveAgents; ++i)
+	{
+		perception += m_activeAgents[i]->perceptionDistance;
+		++nbAgents;
+	}
+
+	if (nbAgents > 0 && perception > EPSILON)
+		m_grid->clear(perception / (2.f * nbAgents));
+	else
+		m_grid->clear();
+
+	for (unsigned i = 0; i < m_nbActiveAgents; ++i)
+	{
+		const dtCrowdAgent& ag = *m_activeAgents[i];
+		m_grid->addItem(ag.id, ag.position[0], ag.position[2]);
+	}
+}
+
+/// @par
+///
+/// Most of the time an agent is still on the polygon it ended up on during the previous update,
+/// so a point in polygon test replaces a search in the BV tree of the navigation mesh.
+void dtCrowd::locateAgent(const dtCrowdAgent& ag, dtCrowdQuery& query, dtPolyRef* ref, float* pos)
+{
+	const dtNavMeshQuery* navQuery = query.getNavMeshQuery();
+	const dtQueryFilter* filter = query.getQueryFilter();
+	bool fromHint = false;
+
+	// The agent usually stays on its last polygon or moves to a neighbour of it
+	*ref = 0;
+	navQuery->locatePoint(m_agentsPolys[ag.id], ag.position, query.getQueryExtents(), filter, ref, pos, &fromHint);
+	m_agentsPolys[ag.id] = *ref;
+
+	if (query.getStats() && !fromHint)
+		++query.getStats()->nearestPolyQueries;
+}
+
+unsigned dtCrowd::findActiveAgent(unsigned id) const
+{
+	unsigned first = 0;
+	unsigned last = m_nbActiveAgents;
+
+	while (first < last)
+	{
+		const unsigned middle = first + (last - first) / 2;
+
+		if (m_agentsToUpdate[middle] < id)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	return first;
+}
+
+/// @par
+///
+/// The candidates are given by the proximity grid, and the closest ones are kept in a bounded max-heap
+/// (O(n log k) for n candidates and k neighbors). Ties are broken by id, so the resulting list is 
+/// the same as the one obtained by testing every agent of the crowd.
+unsigned dtCrowd::computeNeighbors(unsigned id, unsigned* candidates, dtCrowdStats* stats)
 {
 	unsigned n = 0;
 	const dtCrowdAgent* agent = m_crowdQuery->getAgent(id);
+	const float range = agent->perceptionDistance;
 
-	for (unsigned i = 0; i < m_maxAgents; ++i)
+	const int nbCandidates = m_grid->queryItems(agent->position[0] - range, agent->position[2] - range, 
+												agent->position[0] + range, agent->position[2] + range, 
+												candidates, m_maxAgents);
+
+	if (stats)
+		stats->neighborCandidates += nbCandidates;
+
+	for (int i = 0; i < nbCandidates; ++i)
 	{
 		dtCrowdAgent* target = 0;
 
 		// Check if the agent is active and is not the tested one
-		if (!getActiveAgent(&target, i) || target->id == agent->id)
+		if (!getActiveAgent(&target, candidates[i]) || target->id == agent->id)
 			continue;
 				
 		float diff[3];
@@ -750,9 +1794,11 @@ unsigned dtCrowd::computeNeighbors(unsigned id)
 		if (dist2D > dtSqr(agent->perceptionDistance))
 			continue;
 
-		n = addNeighbour(target->id, dist2D, m_agentsEnv[agent->id].neighbors, n, DT_CROWDAGENT_MAX_NEIGHBOURS);
+		n = addNeighbour(target->id, dist2D, m_agentsEnv[agent->id].neighbors, n, m_maxNeighbors);
 	}
 
+	sortNeighbours(m_agentsEnv[agent->id].neighbors, n);
+
 	return n;
 }
 
@@ -762,10 +1808,15 @@ dtCrowdQuery::~dtCrowdQuery()
 	m_navMeshQuery = 0;
 }
 
-dtCrowdQuery::dtCrowdQuery(unsigned maxAgents, const dtCrowdAgent* agents, const dtCrowdAgentEnvironment* env)
+dtCrowdQuery::dtCrowdQuery(unsigned maxAgents, const dtCrowdAgent* agents, const dtCrowdAgentEnvironment* env, 
+						   const dtProximityGrid* grid, const dtPolyRef* polys)
 	: m_agents(agents),
 	m_maxAgents(maxAgents),
-	m_agentsEnv(env)
+	m_agentsEnv(env),
+	m_grid(grid),
+	m_agentsPolys(polys),
+	m_frame(0),
+	m_stats(0)
 {
 	m_navMeshQuery = dtAllocNavMeshQuery();
 }
@@ -843,6 +1894,29 @@ const dtCrowdAgentEnvironment* dtCrowdQuery::getAgentEnvironment(unsigned id) co
 	return 0;
 }
 
+const dtProximityGrid* dtCrowdQuery::getProximityGrid() const
+{
+	return m_grid;
+}
+
+dtPolyRef dtCrowdQuery::getAgentPoly(unsigned id) const
+{
+	if (!m_agentsPolys || id >= m_maxAgents)
+		return 0;
+
+	return m_agentsPolys[id];
+}
+
+unsigned dtCrowdQuery::getFrame() const
+{
+	return m_frame;
+}
+
+dtCrowdStats* dtCrowdQuery::getStats() const
+{
+	return m_stats;
+}
+
 dtOffMeshConnection* dtCrowdQuery::getOffMeshConnection(unsigned id, float dist) const
 {
 	// Check validity of the ID
@@ -850,11 +1924,11 @@ dtOffMeshConnection* dtCrowdQuery::getOffMeshConnection(unsigned id, float dist)
 		return 0;
 
 	const dtCrowdAgent ag = *getAgent(id);
-	dtPolyRef agentPolyRef;
+	dtPolyRef agentPolyRef = 0;
 	float nearest[3];
 
 	// Get the polygon reference the agent is on
-	m_navMeshQuery->findNearestPoly(ag.position, m_ext, &m_filter, &agentPolyRef, nearest);
+	m_navMeshQuery->locatePoint(getAgentPoly(id), ag.position, m_ext, &m_filter, &agentPolyRef, nearest);
 
 	if (!agentPolyRef)
 		return 0;
@@ -915,7 +1989,8 @@ void dtCrowdQuery::startOffMeshConnection(dtCrowdAgent& ag, const dtOffMeshConne
 }
 
 dtCrowdAgentEnvironment::dtCrowdAgentEnvironment() 
-	: nbNeighbors(0) 
+	: neighbors(0),
+	nbNeighbors(0) 
 {
 	boundary.reset();
 }
@@ -0,0 +1,487 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+
+#include <math.h>
+#include <string.h>
+
+#include "DetourCrowdKinematics.h"
+#include "DetourAlloc.h"
+#include "DetourCommon.h"
+#include "DetourCrowd.h"
+#include "DetourSimd.h"
+
+
+dtCrowdKinematics::dtCrowdKinematics() :
+	m_posX(0), m_posY(0), m_posZ(0),
+	m_velX(0), m_velY(0), m_velZ(0),
+	m_dvelX(0), m_dvelY(0), m_dvelZ(0),
+	m_dispX(0), m_dispZ(0),
+	m_radius(0),
+	m_maxAcceleration(0),
+	m_walking(0),
+	m_ids(0),
+	m_lanes(0),
+	m_maxLanes(0),
+	m_maxAgents(0)
+{
+}
+
+dtCrowdKinematics::~dtCrowdKinematics()
+{
+	purge();
+}
+
+void dtCrowdKinematics::purge()
+{
+	float** arrays[] = {&m_posX, &m_posY, &m_posZ, &m_velX, &m_velY, &m_velZ, &m_dvelX, &m_dvelY, &m_dvelZ, 
+						&m_dispX, &m_dispZ, &m_radius, &m_maxAcceleration, &m_walking};
+
+	for (unsigned i = 0; i < sizeof(arrays) / sizeof(arrays[0]); ++i)
+	{
+		dtFree(*arrays[i]);
+		*arrays[i] = 0;
+	}
+
+	dtFree(m_ids);
+	m_ids = 0;
+
+	dtFree(m_lanes);
+	m_lanes = 0;
+
+	m_maxLanes = 0;
+	m_maxAgents = 0;
+}
+
+bool dtCrowdKinematics::init(const unsigned maxAgents)
+{
+	purge();
+
+	// The lanes are processed four at a time, the arrays are padded accordingly
+	const unsigned maxLanes = (maxAgents + 3) & ~3u;
+
+	float** arrays[] = {&m_posX, &m_posY, &m_posZ, &m_velX, &m_velY, &m_velZ, &m_dvelX, &m_dvelY, &m_dvelZ, 
+						&m_dispX, &m_dispZ, &m_radius, &m_maxAcceleration, &m_walking};
+
+	for (unsigned i = 0; i < sizeof(arrays) / sizeof(arrays[0]); ++i)
+	{
+		*arrays[i] = (float*) dtAlloc(sizeof(float) * maxLanes, DT_ALLOC_PERM);
+		if (!*arrays[i])
+			return false;
+
+		memset(*arrays[i], 0, sizeof(float) * maxLanes);
+	}
+
+	m_ids = (unsigned*) dtAlloc(sizeof(unsigned) * maxLanes, DT_ALLOC_PERM);
+	if (!m_ids)
+		return false;
+
+	memset(m_ids, 0, sizeof(unsigned) * maxLanes);
+
+	m_lanes = (int*) dtAlloc(sizeof(int) * maxAgents, DT_ALLOC_PERM);
+	if (!m_lanes)
+		return false;
+
+	memset(m_lanes, 0xff, sizeof(int) * maxAgents);
+
+	m_maxLanes = maxLanes;
+	m_maxAgents = maxAgents;
+
+	return true;
+}
+
+void dtCrowdKinematics::load(const unsigned lane, const dtCrowdAgent* ag)
+{
+	if (lane >= m_maxLanes)
+		return;
+
+	if (!ag)
+	{
+		m_walking[lane] = 0.f;
+		m_dispX[lane] = 0.f;
+		m_dispZ[lane] = 0.f;
+		return;
+	}
+
+	m_posX[lane] = ag->position[0];
+	m_posY[lane] = ag->position[1];
+	m_posZ[lane] = ag->position[2];
+	m_velX[lane] = ag->velocity[0];
+	m_velY[lane] = ag->velocity[1];
+	m_velZ[lane] = ag->velocity[2];
+	m_dvelX[lane] = ag->desiredVelocity[0];
+	m_dvelY[lane] = ag->desiredVelocity[1];
+	m_dvelZ[lane] = ag->desiredVelocity[2];
+	m_dispX[lane] = 0.f;
+	m_dispZ[lane] = 0.f;
+	m_radius[lane] = ag->radius;
+	m_maxAcceleration[lane] = ag->maxAcceleration;
+	m_walking[lane] = (ag->state == DT_CROWDAGENT_STATE_WALKING) ? 1.f : 0.f;
+	m_ids[lane] = ag->id;
+
+	if (ag->id < m_maxAgents)
+		m_lanes[ag->id] = (int) lane;
+}
+
+void dtCrowdKinematics::unload(const unsigned* ids, const unsigned nbIds)
+{
+	for (unsigned i = 0; i < nbIds; ++i)
+		if (ids[i] < m_maxAgents)
+			m_lanes[ids[i]] = -1;
+}
+
+void dtCrowdKinematics::storePositionAndVelocity(const unsigned lane, dtCrowdAgent& ag) const
+{
+	ag.position[0] = m_posX[lane];
+	ag.position[1] = m_posY[lane];
+	ag.position[2] = m_posZ[lane];
+
+	storeVelocity(lane, ag);
+}
+
+void dtCrowdKinematics::storeVelocity(const unsigned lane, dtCrowdAgent& ag) const
+{
+	ag.velocity[0] = m_velX[lane];
+	ag.velocity[1] = m_velY[lane];
+	ag.velocity[2] = m_velZ[lane];
+}
+
+/// @par
+///
+/// Same computation as integrate() in DetourCrowd.cpp, on the lanes of the store.
+void dtCrowdKinematics::integrate(const unsigned begin, const unsigned end, const float dt)
+{
+	unsigned i = begin;
+
+#ifdef DT_SIMD_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 eps = _mm_set1_ps(EPSILON);
+	const __m128 vdt = _mm_set1_ps(dt);
+
+	for (; i + 4 <= end; i += 4)
+	{
+		const __m128 walking = _mm_cmpneq_ps(_mm_loadu_ps(m_walking + i), zero);
+		const __m128 vx = _mm_loadu_ps(m_velX + i);
+		const __m128 vy = _mm_loadu_ps(m_velY + i);
+		const __m128 vz = _mm_loadu_ps(m_velZ + i);
+
+		const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)));
+		const __m128 moving = _mm_and_ps(walking, _mm_cmpgt_ps(len, eps));
+		const __m128 stopped = _mm_andnot_ps(moving, walking);
+
+		__m128 px = _mm_loadu_ps(m_posX + i);
+		__m128 py = _mm_loadu_ps(m_posY + i);
+		__m128 pz = _mm_loadu_ps(m_posZ + i);
+
+		px = _mm_or_ps(_mm_and_ps(moving, _mm_add_ps(px, _mm_mul_ps(vx, vdt))), _mm_andnot_ps(moving, px));
+		py = _mm_or_ps(_mm_and_ps(moving, _mm_add_ps(py, _mm_mul_ps(vy, vdt))), _mm_andnot_ps(moving, py));
+		pz = _mm_or_ps(_mm_and_ps(moving, _mm_add_ps(pz, _mm_mul_ps(vz, vdt))), _mm_andnot_ps(moving, pz));
+
+		_mm_storeu_ps(m_posX + i, px);
+		_mm_storeu_ps(m_posY + i, py);
+		_mm_storeu_ps(m_posZ + i, pz);
+		_mm_storeu_ps(m_velX + i, _mm_andnot_ps(stopped, vx));
+		_mm_storeu_ps(m_velY + i, _mm_andnot_ps(stopped, vy));
+		_mm_storeu_ps(m_velZ + i, _mm_andnot_ps(stopped, vz));
+	}
+#endif
+
+	for (; i < end; ++i)
+	{
+		if (m_walking[i] == 0.f)
+			continue;
+
+		const float len = dtSqrt(m_velX[i]*m_velX[i] + m_velY[i]*m_velY[i] + m_velZ[i]*m_velZ[i]);
+
+		if (len > EPSILON)
+		{
+			m_posX[i] = m_posX[i] + m_velX[i]*dt;
+			m_posY[i] = m_posY[i] + m_velY[i]*dt;
+			m_posZ[i] = m_posZ[i] + m_velZ[i]*dt;
+		}
+		else
+		{
+			m_velX[i] = 0.f;
+			m_velY[i] = 0.f;
+			m_velZ[i] = 0.f;
+		}
+	}
+}
+
+/// @par
+///
+/// Same computation as the acceleration clamp of dtCrowd::updateVelocity(), on the lanes of the store.
+void dtCrowdKinematics::clampAcceleration(const unsigned begin, const unsigned end, const float dt)
+{
+	unsigned i = begin;
+
+#ifdef DT_SIMD_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 vdt = _mm_set1_ps(dt);
+
+	for (; i + 4 <= end; i += 4)
+	{
+		const __m128 walking = _mm_cmpneq_ps(_mm_loadu_ps(m_walking + i), zero);
+		const __m128 maxDelta = _mm_mul_ps(_mm_loadu_ps(m_maxAcceleration + i), vdt);
+
+		const __m128 vx = _mm_loadu_ps(m_velX + i);
+		const __m128 vy = _mm_loadu_ps(m_velY + i);
+		const __m128 vz = _mm_loadu_ps(m_velZ + i);
+
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(m_dvelX + i), vx);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(m_dvelY + i), vy);
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(m_dvelZ + i), vz);
+
+		const __m128 ds = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		const __m128 clamped = _mm_cmpgt_ps(ds, maxDelta);
+		const __m128 scale = _mm_div_ps(maxDelta, ds);
+
+		dx = _mm_or_ps(_mm_and_ps(clamped, _mm_mul_ps(dx, scale)), _mm_andnot_ps(clamped, dx));
+		dy = _mm_or_ps(_mm_and_ps(clamped, _mm_mul_ps(dy, scale)), _mm_andnot_ps(clamped, dy));
+		dz = _mm_or_ps(_mm_and_ps(clamped, _mm_mul_ps(dz, scale)), _mm_andnot_ps(clamped, dz));
+
+		_mm_storeu_ps(m_velX + i, _mm_or_ps(_mm_and_ps(walking, _mm_add_ps(vx, dx)), _mm_andnot_ps(walking, vx)));
+		_mm_storeu_ps(m_velY + i, _mm_or_ps(_mm_and_ps(walking, _mm_add_ps(vy, dy)), _mm_andnot_ps(walking, vy)));
+		_mm_storeu_ps(m_velZ + i, _mm_or_ps(_mm_and_ps(walking, _mm_add_ps(vz, dz)), _mm_andnot_ps(walking, vz)));
+	}
+#endif
+
+	for (; i < end; ++i)
+	{
+		if (m_walking[i] == 0.f)
+			continue;
+
+		const float maxDelta = m_maxAcceleration[i] * dt;
+		float dv[3];
+		dv[0] = m_dvelX[i] - m_velX[i];
+		dv[1] = m_dvelY[i] - m_velY[i];
+		dv[2] = m_dvelZ[i] - m_velZ[i];
+		const float ds = dtVlen(dv);
+
+		if (ds > maxDelta)
+			dtVscale(dv, dv, maxDelta/ds);
+
+		m_velX[i] = m_velX[i] + dv[0];
+		m_velY[i] = m_velY[i] + dv[1];
+		m_velZ[i] = m_velZ[i] + dv[2];
+	}
+}
+
+/// @par
+///
+/// Same computation as the collision handling of dtCrowd::updatePosition(), on the lanes of the store.
+/// When SSE2 is available, four agents are processed at once, each of them using its j-th neighbor at the same time. 
+/// The contributions of the neighbors are therefore summed in the same order as the scalar code.
+void dtCrowdKinematics::computeDisplacements(const unsigned begin, const unsigned end, const dtCrowdAgent* agents, 
+											 const dtCrowdAgentEnvironment* envs, const float factor)
+{
+	unsigned i = begin;
+
+#ifdef DT_SIMD_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 eps = _mm_set1_ps(EPSILON);
+	const __m128 smallPen = _mm_set1_ps(0.01f);
+	const __m128 vfactor = _mm_set1_ps(factor);
+
+	for (; i + 4 <= end; i += 4)
+	{
+		const __m128 px = _mm_loadu_ps(m_posX + i);
+		const __m128 pz = _mm_loadu_ps(m_posZ + i);
+		const __m128 rad = _mm_loadu_ps(m_radius + i);
+		const __m128 dvx = _mm_loadu_ps(m_dvelX + i);
+		const __m128 dvz = _mm_loadu_ps(m_dvelZ + i);
+
+		__m128 dispX = zero;
+		__m128 dispZ = zero;
+		__m128 w = zero;
+
+		unsigned maxNeighbors = 0;
+		for (unsigned k = 0; k < 4; ++k)
+			if (m_walking[i + k] != 0.f)
+				maxNeighbors = dtMax(maxNeighbors, envs[m_ids[i + k]].nbNeighbors);
+
+		for (unsigned j = 0; j < maxNeighbors; ++j)
+		{
+			// Gather the j-th neighbor of every agent
+			float nx[4], nz[4], nrad[4], valid[4], order[4];
+
+			for (unsigned k = 0; k < 4; ++k)
+			{
+				const unsigned lane = i + k;
+				const dtCrowdAgentEnvironment& env = envs[m_ids[lane]];
+
+				if (m_walking[lane] == 0.f || j >= env.nbNeighbors)
+				{
+					nx[k] = nz[k] = nrad[k] = order[k] = 0.f;
+					valid[k] = 0.f;
+					continue;
+				}
+
+				const unsigned nei = env.neighbors[j].idx;
+				const int neiLane = m_lanes[nei];
+
+				if (neiLane >= 0)
+				{
+					nx[k] = m_posX[neiLane];
+					nz[k] = m_posZ[neiLane];
+					nrad[k] = m_radius[neiLane];
+				}
+				else
+				{
+					nx[k] = agents[nei].position[0];
+					nz[k] = agents[nei].position[2];
+					nrad[k] = agents[nei].radius;
+				}
+
+				valid[k] = 1.f;
+				// Direction used by agents on top of each other
+				order[k] = (m_ids[lane] > nei) ? 1.f : -1.f;
+			}
+
+			const __m128 diffX = _mm_sub_ps(px, _mm_loadu_ps(nx));
+			const __m128 diffZ = _mm_sub_ps(pz, _mm_loadu_ps(nz));
+			const __m128 sumRad = _mm_add_ps(rad, _mm_loadu_ps(nrad));
+
+			const __m128 distSqr = _mm_add_ps(_mm_mul_ps(diffX, diffX), _mm_mul_ps(diffZ, diffZ));
+			const __m128 colliding = _mm_and_ps(_mm_cmpneq_ps(_mm_loadu_ps(valid), zero), 
+												_mm_cmple_ps(distSqr, _mm_add_ps(_mm_mul_ps(sumRad, sumRad), eps)));
+
+			const __m128 dist = _mm_sqrt_ps(distSqr);
+			const __m128 overlapping = _mm_cmplt_ps(dist, eps);
+
+			// Agents on top of each other, try to choose diverging separation directions.
+			const __m128 vorder = _mm_loadu_ps(order);
+			const __m128 divergeX = _mm_sub_ps(zero, _mm_mul_ps(vorder, dvz));
+			const __m128 divergeZ = _mm_mul_ps(vorder, dvx);
+
+			const __m128 pen = _mm_mul_ps(_mm_mul_ps(_mm_div_ps(one, dist), _mm_mul_ps(_mm_sub_ps(sumRad, dist), half)), vfactor);
+
+			const __m128 dx = _mm_or_ps(_mm_and_ps(overlapping, divergeX), _mm_andnot_ps(overlapping, diffX));
+			const __m128 dz = _mm_or_ps(_mm_and_ps(overlapping, divergeZ), _mm_andnot_ps(overlapping, diffZ));
+			const __m128 p = _mm_or_ps(_mm_and_ps(overlapping, smallPen), _mm_andnot_ps(overlapping, pen));
+
+			dispX = _mm_or_ps(_mm_and_ps(colliding, _mm_add_ps(dispX, _mm_mul_ps(dx, p))), _mm_andnot_ps(colliding, dispX));
+			dispZ = _mm_or_ps(_mm_and_ps(colliding, _mm_add_ps(dispZ, _mm_mul_ps(dz, p))), _mm_andnot_ps(colliding, dispZ));
+			w = _mm_add_ps(w, _mm_and_ps(colliding, one));
+		}
+
+		const __m128 weighted = _mm_cmpgt_ps(w, eps);
+		const __m128 iw = _mm_div_ps(one, w);
+
+		dispX = _mm_or_ps(_mm_and_ps(weighted, _mm_mul_ps(dispX, iw)), _mm_andnot_ps(weighted, dispX));
+		dispZ = _mm_or_ps(_mm_and_ps(weighted, _mm_mul_ps(dispZ, iw)), _mm_andnot_ps(weighted, dispZ));
+
+		_mm_storeu_ps(m_dispX + i, dispX);
+		_mm_storeu_ps(m_dispZ + i, dispZ);
+	}
+#endif
+
+	for (; i < end; ++i)
+	{
+		m_dispX[i] = 0.f;
+		m_dispZ[i] = 0.f;
+
+		if (m_walking[i] == 0.f)
+			continue;
+
+		const dtCrowdAgentEnvironment& env = envs[m_ids[i]];
+		float w = 0.f;
+
+		for (unsigned j = 0; j < env.nbNeighbors; ++j)
+		{
+			const unsigned nei = env.neighbors[j].idx;
+			const int neiLane = m_lanes[nei];
+
+			const float nx = (neiLane >= 0) ? m_posX[neiLane] : agents[nei].position[0];
+			const float nz = (neiLane >= 0) ? m_posZ[neiLane] : agents[nei].position[2];
+			const float nrad = (neiLane >= 0) ? m_radius[neiLane] : agents[nei].radius;
+
+			float diffX = m_posX[i] - nx;
+			float diffZ = m_posZ[i] - nz;
+
+			float dist = diffX*diffX + diffZ*diffZ;
+
+			if (dist > dtSqr(m_radius[i] + nrad) + EPSILON)
+				continue;
+
+			dist = dtSqrt(dist);
+			float pen = (m_radius[i] + nrad) - dist;
+			if (dist < EPSILON)
+			{
+				// Agents on top of each other, try to choose diverging separation directions.
+				if (m_ids[i] > nei)
+				{
+					diffX = -m_dvelZ[i];
+					diffZ = m_dvelX[i];
+				}
+				else
+				{
+					diffX = m_dvelZ[i];
+					diffZ = -m_dvelX[i];
+				}
+				pen = 0.01f;
+			}
+			else
+			{
+				pen = (1.0f / dist) * (pen * 0.5f) * factor;
+			}
+
+			m_dispX[i] = m_dispX[i] + diffX*pen;
+			m_dispZ[i] = m_dispZ[i] + diffZ*pen;
+
+			w += 1.0f;
+		}
+
+		if (w > EPSILON)
+		{
+			const float iw = 1.0f / w;
+			m_dispX[i] = m_dispX[i] * iw;
+			m_dispZ[i] = m_dispZ[i] * iw;
+		}
+	}
+}
+
+void dtCrowdKinematics::applyDisplacements(const unsigned begin, const unsigned end)
+{
+	unsigned i = begin;
+
+#ifdef DT_SIMD_SSE2
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= end; i += 4)
+	{
+		const __m128 walking = _mm_cmpneq_ps(_mm_loadu_ps(m_walking + i), zero);
+		const __m128 dx = _mm_and_ps(walking, _mm_loadu_ps(m_dispX + i));
+		const __m128 dz = _mm_and_ps(walking, _mm_loadu_ps(m_dispZ + i));
+
+		_mm_storeu_ps(m_posX + i, _mm_add_ps(_mm_loadu_ps(m_posX + i), dx));
+		_mm_storeu_ps(m_posZ + i, _mm_add_ps(_mm_loadu_ps(m_posZ + i), dz));
+	}
+#endif
+
+	for (; i < end; ++i)
+	{
+		if (m_walking[i] == 0.f)
+			continue;
+
+		m_posX[i] = m_posX[i] + m_dispX[i];
+		m_posZ[i] = m_posZ[i] + m_dispZ[i];
+	}
+}
@@ -0,0 +1,182 @@
+//
+// Copyright (c) 2013 MASA Group recastdetour@masagroup.net
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include "DetourFlockGroup.h"
+
+#include "DetourAlloc.h"
+#include "DetourCommon.h"
+#include "DetourCrowd.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+
+static int compareIds(const void* a, const void* b)
+{
+	const unsigned ia = *(const unsigned*) a;
+	const unsigned ib = *(const unsigned*) b;
+
+	return (ia < ib) ? -1 : (ia > ib) ? 1 : 0;
+}
+
+dtFlockGroup::dtFlockGroup()
+	: m_members(0)
+	, m_nbMembers(0)
+	, m_nbActive(0)
+	, m_query(0)
+	, m_frame(0)
+{
+	dtVset(m_positionSum, 0, 0, 0);
+	dtVset(m_velocitySum, 0, 0, 0);
+}
+
+dtFlockGroup::~dtFlockGroup()
+{
+	dtFree(m_members);
+	m_members = 0;
+}
+
+dtFlockGroup* dtFlockGroup::allocate()
+{
+	void* mem = dtAlloc(sizeof(dtFlockGroup), DT_ALLOC_PERM);
+
+	if (mem)
+		return new(mem) dtFlockGroup();
+
+	return 0;
+}
+
+void dtFlockGroup::free(dtFlockGroup* ptr)
+{
+	if (!ptr)
+		return;
+
+	ptr->~dtFlockGroup();
+	dtFree(ptr);
+	ptr = 0;
+}
+
+bool dtFlockGroup::setMembers(const unsigned* ids, unsigned nbMembers)
+{
+	dtFree(m_members);
+	m_members = 0;
+	m_nbMembers = 0;
+
+	// The aggregates must be computed again
+	m_query = 0;
+
+	if (!ids || !nbMembers)
+		return true;
+
+	m_members = (unsigned*) dtAlloc(sizeof(unsigned) * nbMembers, DT_ALLOC_PERM);
+
+	if (!m_members)
+		return false;
+
+	memcpy(m_members, ids, sizeof(unsigned) * nbMembers);
+	qsort(m_members, nbMembers, sizeof(unsigned), compareIds);
+	m_nbMembers = nbMembers;
+
+	return true;
+}
+
+bool dtFlockGroup::isMember(unsigned id) const
+{
+	unsigned first = 0;
+	unsigned last = m_nbMembers;
+
+	while (first < last)
+	{
+		const unsigned middle = first + (last - first) / 2;
+
+		if (m_members[middle] < id)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	return first < m_nbMembers && m_members[first] == id;
+}
+
+unsigned dtFlockGroup::updateAggregates(const dtCrowdQuery& query, const dtCrowdAgent& ag) const
+{
+	if (m_query != &query || m_frame != query.getFrame())
+	{
+		m_query = &query;
+		m_frame = query.getFrame();
+
+		dtVset(m_positionSum, 0, 0, 0);
+		dtVset(m_velocitySum, 0, 0, 0);
+		m_nbActive = 0;
+
+		for (unsigned i = 0; i < m_nbMembers; ++i)
+		{
+			const dtCrowdAgent* member = query.getAgent(m_members[i]);
+
+			if (!member || !member->active)
+				continue;
+
+			dtVadd(m_positionSum, m_positionSum, member->position);
+			dtVadd(m_velocitySum, m_velocitySum, member->velocity);
+			++m_nbActive;
+		}
+	}
+
+	// The agent does not take itself into account
+	const dtCrowdAgent* self = query.getAgent(ag.id);
+
+	if (self && self->active && isMember(ag.id))
+		return m_nbActive - 1;
+
+	return m_nbActive;
+}
+
+bool dtFlockGroup::getCenter(const dtCrowdQuery& query, const dtCrowdAgent& ag, float* center) const
+{
+	const unsigned count = updateAggregates(query, ag);
+
+	if (count == 0)
+		return false;
+
+	dtVcopy(center, m_positionSum);
+
+	if (count < m_nbActive)
+		dtVsub(center, center, query.getAgent(ag.id)->position);
+
+	dtVscale(center, center, 1.f / (float) count);
+
+	return true;
+}
+
+bool dtFlockGroup::getAverageVelocity(const dtCrowdQuery& query, const dtCrowdAgent& ag, float* velocity) const
+{
+	const unsigned count = updateAggregates(query, ag);
+
+	if (count == 0)
+		return false;
+
+	dtVcopy(velocity, m_velocitySum);
+
+	if (count < m_nbActive)
+		dtVsub(velocity, velocity, query.getAgent(ag.id)->velocity);
+
+	dtVscale(velocity, velocity, 1.f / (float) count);
+
+	return true;
+}
@@ -23,6 +23,7 @@
 #include "DetourCohesionBehavior.h"
 #include "DetourCommon.h"
 #include "DetourCrowd.h"
+#include "DetourFlockGroup.h"
 #include "DetourSeparationBehavior.h"
 
 #include <cstring>
@@ -74,6 +75,12 @@ void dtFlockingBehavior::free(dtFlockingBehavior* ptr)
 void dtFlockingBehavior::computeForce(const dtCrowdQuery& query, const dtCrowdAgent& oldAgent, float* force, 
 									  const dtFlockingBehaviorParams& currentParams, dtFlockingBehaviorParams& /*newParam*/)
 {
+	if (currentParams.group)
+	{
+		computeGroupForce(query, oldAgent, *currentParams.group, force);
+		return;
+	}
+
 	unsigned* neighborsList = currentParams.toFlockWith;
 	unsigned nbNeighbors = currentParams.nbflockingTargets;
 
@@ -134,3 +141,57 @@ void dtFlockingBehavior::computeForce(const dtCrowdQuery& query, const dtCrowdAg
 
 	force[1] = 0;
 }
+
+void dtFlockingBehavior::computeGroupForce(const dtCrowdQuery& query, const dtCrowdAgent& ag, const dtFlockGroup& group, float* force)
+{
+	dtSeparationBehaviorParams separationParams;
+	separationParams.targetsID = 0;
+	separationParams.nbTargets = 0;
+	separationParams.distance = separationDistance;
+	separationParams.weight = separationWeight;
+
+	float separationForce[] = {0, 0, 0};
+	int nbSeparated = 0;
+
+	// Only the neighbors of the agent belonging to the group are close enough to be separated from.
+	// They are filtered while the force is computed, so no list of targets is built.
+	const dtCrowdAgentEnvironment* env = query.getAgentEnvironment(ag.id);
+
+	for (unsigned i = 0; env && i < env->nbNeighbors; ++i)
+	{
+		const unsigned idx = env->neighbors[i].idx;
+
+		if (!group.isMember(idx))
+			continue;
+
+		const dtCrowdAgent* target = query.getAgent(idx);
+
+		if (target && target->active && dtSeparationBehavior::addTargetForce(ag, *target, separationParams, separationForce))
+			++nbSeparated;
+	}
+
+	if (nbSeparated > 0)
+		dtVscale(separationForce, separationForce, (1.f / (float) nbSeparated));
+
+	dtCohesionBehaviorParams cohesionParams;
+	cohesionParams.targets = 0;
+	cohesionParams.nbTargets = 0;
+	cohesionParams.group = &group;
+
+	dtAlignmentBehaviorParams alignmentParams;
+	alignmentParams.targets = 0;
+	alignmentParams.nbTargets = 0;
+	alignmentParams.group = &group;
+
+	float cohesionForce[] = {0, 0, 0};
+	float alignmentForce[] = {0, 0, 0};
+
+	m_cohesionBehavior->computeForce(query, ag, cohesionForce, cohesionParams, cohesionParams);
+	m_alignmentBehavior->computeForce(query, ag, alignmentForce, alignmentParams, alignmentParams);
+
+	dtVmad(force, force, separationForce, separationWeight);
+	dtVmad(force, force, cohesionForce, cohesionWeight);
+	dtVmad(force, force, alignmentForce, alignmentWeight);
+
+	force[1] = 0;
+}
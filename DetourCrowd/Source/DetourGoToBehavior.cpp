@@ -63,8 +63,9 @@ void dtArriveBehavior::computeForce(const dtCrowdQuery& /*query*/, const dtCrowd
 
 void dtArriveBehavior::applyForce(const dtCrowdQuery& /*query*/, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, float* force, float dt)
 {
-	const float* target = getBehaviorParams(oldAgent.id)->target;
-	const float distance = getBehaviorParams(oldAgent.id)->distance;
+	const dtArriveBehaviorParams* params = findBehaviorParams(oldAgent.id);
+	const float* target = params->target;
+	const float distance = params->distance;
 
 	float tmpForce[3] = {0, 0, 0};
 	float newVelocity[] = {0, 0, 0};
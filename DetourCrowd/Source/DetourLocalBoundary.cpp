@@ -20,7 +20,9 @@
 #include <string.h>
 #include "DetourLocalBoundary.h"
 #include "DetourNavMeshQuery.h"
+#include "DetourNavMesh.h"
 #include "DetourCommon.h"
+#include "DetourAlloc.h"
 #include "DetourAssert.h"
 
 
@@ -82,7 +84,7 @@ void dtLocalBoundary::addSegment(const float dist, const float* s)
 }
 
 void dtLocalBoundary::update(dtPolyRef ref, const float* pos, const float collisionQueryRange,
-							 dtNavMeshQuery* navquery, const dtQueryFilter* filter)
+							 dtNavMeshQuery* navquery, const dtQueryFilter* filter, dtWallSegmentCache* cache)
 {
 	static const int MAX_SEGS_PER_POLY = DT_VERTS_PER_POLYGON*3;
 	
@@ -102,11 +104,16 @@ void dtLocalBoundary::update(dtPolyRef ref, const float* pos, const float collis
 	
 	// Secondly, store all polygon edges.
 	m_nsegs = 0;
-	float segs[MAX_SEGS_PER_POLY*6];
+	float polySegs[MAX_SEGS_PER_POLY*6];
+	const float* segs = polySegs;
 	int nsegs = 0;
 	for (int j = 0; j < m_npolys; ++j)
 	{
-		navquery->getPolyWallSegments(m_polys[j], filter, segs, 0, &nsegs, MAX_SEGS_PER_POLY);
+		if (cache)
+			nsegs = cache->getWallSegments(m_polys[j], navquery, filter, &segs);
+		else
+			navquery->getPolyWallSegments(m_polys[j], filter, polySegs, 0, &nsegs, MAX_SEGS_PER_POLY);
+
 		for (int k = 0; k < nsegs; ++k)
 		{
 			const float* s = &segs[k*6];
@@ -135,3 +142,136 @@ bool dtLocalBoundary::isValid(dtNavMeshQuery* navquery, const dtQueryFilter* fil
 	return true;
 }
 
+
+static const int MAX_CACHED_SEGS_PER_POLY = DT_VERTS_PER_POLYGON*3;
+
+dtWallSegmentCache::dtWallSegmentCache() :
+	m_entries(0),
+	m_entriesSize(0),
+	m_nbEntries(0),
+	m_maxEntries(0),
+	m_segs(0),
+	m_nbSegs(0),
+	m_maxSegs(0),
+	m_nav(0),
+	m_revision(0),
+	m_includeFlags(0),
+	m_excludeFlags(0),
+	m_hits(0),
+	m_misses(0)
+{
+}
+
+dtWallSegmentCache::~dtWallSegmentCache()
+{
+	purge();
+}
+
+void dtWallSegmentCache::purge()
+{
+	dtFree(m_entries);
+	m_entries = 0;
+	m_entriesSize = 0;
+	m_nbEntries = 0;
+	m_maxEntries = 0;
+
+	dtFree(m_segs);
+	m_segs = 0;
+	m_nbSegs = 0;
+	m_maxSegs = 0;
+}
+
+bool dtWallSegmentCache::init(const int maxPolys, const int maxSegments)
+{
+	dtAssert(maxPolys > 0);
+	dtAssert(maxSegments > 0);
+
+	purge();
+
+	// The table is kept at most half full
+	m_entriesSize = (int) dtNextPow2((unsigned int) maxPolys * 2);
+	m_entries = (Entry*) dtAlloc(sizeof(Entry) * m_entriesSize, DT_ALLOC_PERM);
+	if (!m_entries)
+		return false;
+
+	// There must always be room for the segments of one polygon
+	m_maxSegs = dtMax(maxSegments, MAX_CACHED_SEGS_PER_POLY);
+	m_segs = (float*) dtAlloc(sizeof(float) * 6 * m_maxSegs, DT_ALLOC_PERM);
+	if (!m_segs)
+		return false;
+
+	m_maxEntries = maxPolys;
+	clear();
+
+	return true;
+}
+
+void dtWallSegmentCache::clear()
+{
+	if (m_entries)
+		memset(m_entries, 0, sizeof(Entry) * m_entriesSize);
+
+	m_nbEntries = 0;
+	m_nbSegs = 0;
+}
+
+void dtWallSegmentCache::validate(const dtNavMesh* nav, const dtQueryFilter* filter)
+{
+	if (m_nav == nav && m_revision == nav->getRevision() &&
+		m_includeFlags == filter->getIncludeFlags() && m_excludeFlags == filter->getExcludeFlags())
+		return;
+
+	m_nav = nav;
+	m_revision = nav->getRevision();
+	m_includeFlags = filter->getIncludeFlags();
+	m_excludeFlags = filter->getExcludeFlags();
+
+	clear();
+}
+
+inline int hashPolyRef(dtPolyRef ref, int mask)
+{
+	return (int) ((ref * 2654435761u) & (unsigned int) mask);
+}
+
+int dtWallSegmentCache::getWallSegments(dtPolyRef ref, const dtNavMeshQuery* navquery, const dtQueryFilter* filter, const float** segs)
+{
+	const int mask = m_entriesSize - 1;
+	int h = hashPolyRef(ref, mask);
+
+	while (m_entries[h].ref && m_entries[h].ref != ref)
+		h = (h + 1) & mask;
+
+	if (m_entries[h].ref == ref)
+	{
+		++m_hits;
+		*segs = &m_segs[m_entries[h].first * 6];
+		return m_entries[h].count;
+	}
+
+	++m_misses;
+
+	// Not enough space for the worst case, start again from an empty cache
+	if (m_nbEntries >= m_maxEntries || m_nbSegs + MAX_CACHED_SEGS_PER_POLY > m_maxSegs)
+	{
+		clear();
+
+		h = hashPolyRef(ref, mask);
+	}
+
+	float* polySegs = &m_segs[m_nbSegs * 6];
+	int nsegs = 0;
+
+	navquery->getPolyWallSegments(ref, filter, polySegs, 0, &nsegs, MAX_CACHED_SEGS_PER_POLY);
+
+	Entry& entry = m_entries[h];
+	entry.ref = ref;
+	entry.first = m_nbSegs;
+	entry.count = nsegs;
+
+	m_nbSegs += nsegs;
+	++m_nbEntries;
+
+	*segs = polySegs;
+	return nsegs;
+}
@@ -0,0 +1,296 @@
+//
+// Copyright (c) 2013 MASA Group recastdetour@masagroup.net
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include "DetourLodScheduler.h"
+#include "DetourAlloc.h"
+#include "DetourAssert.h"
+#include "DetourCommon.h"
+#include "DetourCrowd.h"
+
+
+dtLodScheduler* dtAllocLodScheduler()
+{
+	void* mem = dtAlloc(sizeof(dtLodScheduler), DT_ALLOC_PERM);
+	if (!mem) return 0;
+	return new(mem) dtLodScheduler;
+}
+
+void dtFreeLodScheduler(dtLodScheduler* ptr)
+{
+	if (!ptr) return;
+	ptr->~dtLodScheduler();
+	dtFree(ptr);
+}
+
+
+dtLodScheduler::dtLodScheduler() :
+	m_maxAgents(0),
+	m_accumulatedTime(0),
+	m_explicitTiers(0),
+	m_tiers(0),
+	m_nbLodTiers(0),
+	m_points(0),
+	m_nbPoints(0),
+	m_maxPoints(0),
+	m_scheduled(0),
+	m_scheduledIds(0),
+	m_nbScheduled(0),
+	m_groups(0),
+	m_nbGroups(0),
+	m_tick(0)
+{
+}
+
+dtLodScheduler::~dtLodScheduler()
+{
+	purge();
+}
+
+void dtLodScheduler::purge()
+{
+	dtFree(m_accumulatedTime);
+	m_accumulatedTime = 0;
+
+	dtFree(m_explicitTiers);
+	m_explicitTiers = 0;
+
+	dtFree(m_tiers);
+	m_tiers = 0;
+
+	dtFree(m_points);
+	m_points = 0;
+	m_nbPoints = 0;
+	m_maxPoints = 0;
+
+	dtFree(m_scheduled);
+	m_scheduled = 0;
+
+	dtFree(m_scheduledIds);
+	m_scheduledIds = 0;
+	m_nbScheduled = 0;
+
+	dtFree(m_groups);
+	m_groups = 0;
+	m_nbGroups = 0;
+
+	m_maxAgents = 0;
+	m_nbLodTiers = 0;
+	m_tick = 0;
+}
+
+bool dtLodScheduler::init(const unsigned maxAgents)
+{
+	dtAssert(maxAgents > 0);
+
+	purge();
+
+	m_accumulatedTime = (float*) dtAlloc(sizeof(float) * maxAgents, DT_ALLOC_PERM);
+	m_explicitTiers = (signed char*) dtAlloc(sizeof(signed char) * maxAgents, DT_ALLOC_PERM);
+	m_tiers = (unsigned char*) dtAlloc(sizeof(unsigned char) * maxAgents, DT_ALLOC_PERM);
+	m_scheduled = (ScheduledAgent*) dtAlloc(sizeof(ScheduledAgent) * maxAgents, DT_ALLOC_PERM);
+	m_scheduledIds = (unsigned*) dtAlloc(sizeof(unsigned) * maxAgents, DT_ALLOC_PERM);
+	m_groups = (Group*) dtAlloc(sizeof(Group) * maxAgents, DT_ALLOC_PERM);
+
+	if (!m_accumulatedTime || !m_explicitTiers || !m_tiers || !m_scheduled || !m_scheduledIds || !m_groups)
+		return false;
+
+	m_maxAgents = maxAgents;
+
+	for (unsigned i = 0; i < m_maxAgents; ++i)
+		resetAgent(i);
+
+	return true;
+}
+
+bool dtLodScheduler::setTiers(const dtLodTier* tiers, const unsigned nbTiers)
+{
+	if (nbTiers > (unsigned) DT_LOD_MAX_TIERS || (nbTiers && !tiers))
+		return false;
+
+	for (unsigned i = 0; i < nbTiers; ++i)
+	{
+		if (tiers[i].period == 0 || tiers[i].maxDistance < 0.f)
+			return false;
+
+		if (i > 0 && tiers[i].maxDistance < tiers[i - 1].maxDistance)
+			return false;
+	}
+
+	memcpy(m_lodTiers, tiers, sizeof(dtLodTier) * nbTiers);
+	m_nbLodTiers = nbTiers;
+
+	// The explicit tiers which do not exist anymore are dropped
+	for (unsigned i = 0; i < m_maxAgents; ++i)
+	{
+		if (m_explicitTiers[i] >= (int) m_nbLodTiers)
+			m_explicitTiers[i] = -1;
+
+		if (m_tiers[i] >= m_nbLodTiers)
+			m_tiers[i] = 0;
+	}
+
+	return true;
+}
+
+bool dtLodScheduler::setPointsOfInterest(const float* points, const unsigned nbPoints)
+{
+	if (nbPoints && !points)
+		return false;
+
+	// The storage only grows, the points usually move every update
+	if (nbPoints > m_maxPoints)
+	{
+		float* newPoints = (float*) dtAlloc(sizeof(float) * 3 * nbPoints, DT_ALLOC_PERM);
+		if (!newPoints)
+			return false;
+
+		dtFree(m_points);
+		m_points = newPoints;
+		m_maxPoints = nbPoints;
+	}
+
+	if (nbPoints)
+		memcpy(m_points, points, sizeof(float) * 3 * nbPoints);
+
+	m_nbPoints = nbPoints;
+
+	return true;
+}
+
+bool dtLodScheduler::setAgentTier(const unsigned id, const int tier)
+{
+	if (id >= m_maxAgents || tier < -1 || tier >= (int) m_nbLodTiers)
+		return false;
+
+	m_explicitTiers[id] = (signed char) tier;
+
+	return true;
+}
+
+int dtLodScheduler::getAgentTier(const unsigned id) const
+{
+	if (id >= m_maxAgents)
+		return -1;
+
+	return m_tiers[id];
+}
+
+void dtLodScheduler::resetAgent(const unsigned id)
+{
+	if (id >= m_maxAgents)
+		return;
+
+	m_accumulatedTime[id] = 0.f;
+	m_explicitTiers[id] = -1;
+	m_tiers[id] = 0;
+}
+
+unsigned dtLodScheduler::computeTier(const dtCrowdAgent& ag) const
+{
+	if (m_explicitTiers[ag.id] >= 0)
+		return (unsigned) m_explicitTiers[ag.id];
+
+	float minDist = FLT_MAX;
+
+	for (unsigned i = 0; i < m_nbPoints; ++i)
+		minDist = dtMin(minDist, dtVdistSqr(ag.position, m_points + i * 3));
+
+	for (unsigned i = 0; i < m_nbLodTiers; ++i)
+	{
+		if (minDist <= dtSqr(m_lodTiers[i].maxDistance))
+			return i;
+	}
+
+	return m_nbLodTiers - 1;
+}
+
+int dtLodScheduler::compareScheduledAgents(const void* a, const void* b)
+{
+	const ScheduledAgent& sa = *(const ScheduledAgent*) a;
+	const ScheduledAgent& sb = *(const ScheduledAgent*) b;
+
+	if (sa.dt < sb.dt) return -1;
+	if (sa.dt > sb.dt) return 1;
+	if (sa.id < sb.id) return -1;
+	if (sa.id > sb.id) return 1;
+	return 0;
+}
+
+/// @par
+///
+/// The agents of a slice share the same time step, unless they changed of tier recently.
+/// So there usually are as many groups as tiers updated.
+unsigned dtLodScheduler::schedule(const dtCrowdAgent* agents, const unsigned* ids, const unsigned nbIds, const float dt)
+{
+	m_nbScheduled = 0;
+	m_nbGroups = 0;
+
+	const unsigned n = dtMin(nbIds, m_maxAgents);
+
+	for (unsigned i = 0; i < n; ++i)
+	{
+		const unsigned id = ids[i];
+		if (id >= m_maxAgents)
+			continue;
+
+		m_accumulatedTime[id] += dt;
+
+		if (m_nbLodTiers > 0)
+		{
+			const unsigned tier = computeTier(agents[id]);
+			const unsigned period = m_lodTiers[tier].period;
+			m_tiers[id] = (unsigned char) tier;
+
+			// Round robin over the slices of the tier
+			if (id % period != m_tick % period)
+				continue;
+		}
+
+		ScheduledAgent& scheduled = m_scheduled[m_nbScheduled++];
+		scheduled.dt = m_accumulatedTime[id];
+		scheduled.id = id;
+
+		m_accumulatedTime[id] = 0.f;
+	}
+
+	++m_tick;
+
+	qsort(m_scheduled, m_nbScheduled, sizeof(ScheduledAgent), compareScheduledAgents);
+
+	for (unsigned i = 0; i < m_nbScheduled; ++i)
+	{
+		m_scheduledIds[i] = m_scheduled[i].id;
+
+		if (m_nbGroups == 0 || m_groups[m_nbGroups - 1].dt != m_scheduled[i].dt)
+		{
+			Group& group = m_groups[m_nbGroups++];
+			group.first = i;
+			group.nbAgents = 0;
+			group.dt = m_scheduled[i].dt;
+		}
+
+		++m_groups[m_nbGroups - 1].nbAgents;
+	}
+
+	return m_nbGroups;
+}
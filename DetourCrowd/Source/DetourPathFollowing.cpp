@@ -45,14 +45,15 @@ dtPathFollowing::~dtPathFollowing()
 	purge();
 }
 
-bool dtPathFollowing::init(dtCrowdQuery& crowdQuery, unsigned maxPathRes)
+bool dtPathFollowing::init(dtCrowdQuery& crowdQuery, unsigned maxPathRes, unsigned maxPathRequests)
 {
 	purge();
 
 	m_pathResult = (dtPolyRef*) dtAlloc(sizeof(dtPolyRef) * maxPathRes, DT_ALLOC_PERM);
 	m_maxPathRes = maxPathRes;
 
-	if (!m_pathQueue.init(m_maxPathRes, m_maxPathQueueNodes, crowdQuery.getNavMeshQuery()->getAttachedNavMesh()))
+	if (!m_pathQueue.init(m_maxPathRes, m_maxPathQueueNodes, crowdQuery.getNavMeshQuery()->getAttachedNavMesh(),
+						   (int) maxPathRequests))
 		return false;
 
 	if (!m_pathResult)
@@ -204,7 +205,7 @@ void dtPathFollowing::triggerOffMeshConnections(const dtCrowdQuery& query, const
 
 void dtPathFollowing::getNextCorner(const dtCrowdQuery& crowdQuery, const dtCrowdAgent& ag, dtPathFollowingParams& agParams)
 {
-	dtCrowdAgentDebugInfo* debug = getBehaviorParams(ag.id)->debugInfos;
+	dtCrowdAgentDebugInfo* debug = agParams.debugInfos;
 	const int debugIdx = debug ? debug->idx : -1;
 
 	if (ag.state != DT_CROWDAGENT_STATE_WALKING)
@@ -221,14 +222,13 @@ void dtPathFollowing::getNextCorner(const dtCrowdQuery& crowdQuery, const dtCrow
 	// and short cut to there.
 	if ((ag.updateFlags & DT_CROWD_OPTIMIZE_VIS) && agParams.ncorners > 0)
 	{
-		dtPathFollowingParams* params = this->getBehaviorParams(ag.id);
-		float pathOptRange = (params) ? params->pathOptimizationRange : 0.f;
+		const float pathOptRange = agParams.pathOptimizationRange;
 
 		const float* target = &agParams.cornerVerts[dtMin<unsigned>(1,agParams.ncorners-1)*3];
 		agParams.corridor.optimizePathVisibility(target, pathOptRange, crowdQuery.getNavMeshQuery(), crowdQuery.getQueryFilter());
 
 		// Copy data for debug purposes.
-		if (debugIdx == static_cast<int>(this->getBehaviorParams(ag.id)->debugIndex))
+		if (debugIdx == static_cast<int>(agParams.debugIndex))
 		{
 			dtVcopy(debug->optStart, agParams.corridor.getPos());
 			dtVcopy(debug->optEnd, target);
@@ -237,7 +237,7 @@ void dtPathFollowing::getNextCorner(const dtCrowdQuery& crowdQuery, const dtCrow
 	else
 	{
 		// Copy data for debug purposes.
-		if (debugIdx == static_cast<int>(getBehaviorParams(ag.id)->debugIndex))
+		if (debugIdx == static_cast<int>(agParams.debugIndex))
 		{
 			dtVset(debug->optStart, 0,0,0);
 			dtVset(debug->optEnd, 0,0,0);
@@ -269,11 +269,11 @@ void dtPathFollowing::updateTopologyOptimization(const dtCrowdQuery& crowdQuery,
 
 int dtPathFollowing::addToOptQueue(const dtCrowdAgent& newag, dtCrowdAgent** agents, const unsigned nagents, const unsigned maxAgents)
 {
-	const dtPathFollowingParams* newAgParams = getBehaviorParams(newag.id);
+	const dtPathFollowingParams* newAgParams = findBehaviorParams(newag.id);
 	if (!newAgParams)
 		return 0;
 
-	const dtPathFollowingParams* agParams = getBehaviorParams(agents[nagents-1]->id);
+	const dtPathFollowingParams* agParams = findBehaviorParams(agents[nagents-1]->id);
 	if (!agParams)
 		return 0;
 
@@ -294,7 +294,7 @@ int dtPathFollowing::addToOptQueue(const dtCrowdAgent& newag, dtCrowdAgent** age
 		unsigned i;
 		for (i = 0; i < nagents; ++i)
 		{
-			dtPathFollowingParams* pfParams = getBehaviorParams(agents[i]->id);
+			dtPathFollowingParams* pfParams = findBehaviorParams(agents[i]->id);
 			if (!pfParams)
 				continue;
 
@@ -343,7 +343,8 @@ void dtPathFollowing::checkPathValidity(const dtCrowdQuery& crowdQuery, const dt
 		// TODO: this can snap agents, how to handle that?
 		float nearest[3];
 		agentRef = 0;
-		crowdQuery.getNavMeshQuery()->findNearestPoly(oldAgent.position, crowdQuery.getQueryExtents(), crowdQuery.getQueryFilter(), &agentRef, nearest);
+		crowdQuery.getNavMeshQuery()->locatePoint(crowdQuery.getAgentPoly(oldAgent.id), oldAgent.position, crowdQuery.getQueryExtents(), 
+												  crowdQuery.getQueryFilter(), &agentRef, nearest);
 		dtVcopy(agentPos, nearest);
 
 		if (!agentRef)
@@ -573,16 +574,14 @@ void dtPathFollowing::updateMoveRequest(const dtCrowdQuery& crowdQuery, const dt
 		if (ag->id == oldAgent.id)
 			pfParams = &newParams;
 
+		// The agents waiting for the longest time are served first.
 		pfParams->targetPathqRef = m_pathQueue.request(pfParams->corridor.getLastPoly(), pfParams->targetRef,
-			pfParams->corridor.getTarget(), pfParams->targetPos, crowdQuery.getQueryFilter());
+			pfParams->corridor.getTarget(), pfParams->targetPos, crowdQuery.getQueryFilter(), -pfParams->targetReplanTime);
 		if (pfParams->targetPathqRef != DT_PATHQ_INVALID)
 			pfParams->targetState = DT_CROWDAGENT_TARGET_WAITING_FOR_PATH;
 	}
 
 
-	// Update requests.
-	m_pathQueue.update(m_maxIterPerUpdate);
-
 	dtStatus status;
 
 	// Process path results.
@@ -700,7 +699,7 @@ void dtPathFollowing::updateMoveRequest(const dtCrowdQuery& crowdQuery, const dt
 
 int dtPathFollowing::addToPathQueue(const dtCrowdAgent& newag, dtCrowdAgent** agents, const unsigned nagents, const unsigned maxAgents)
 {
-	const dtPathFollowingParams* pfParams = getBehaviorParams(newag.id);
+	const dtPathFollowingParams* pfParams = findBehaviorParams(newag.id);
 	if (!pfParams)
 		return 0;
 
@@ -710,7 +709,7 @@ int dtPathFollowing::addToPathQueue(const dtCrowdAgent& newag, dtCrowdAgent** ag
 	{
 		slot = nagents;
 	}
-	else if (pfParams->targetReplanTime <= getBehaviorParams(agents[nagents-1]->id)->targetReplanTime)
+	else if (pfParams->targetReplanTime <= findBehaviorParams(agents[nagents-1]->id)->targetReplanTime)
 	{
 		if (nagents >= maxAgents)
 			return nagents;
@@ -720,7 +719,7 @@ int dtPathFollowing::addToPathQueue(const dtCrowdAgent& newag, dtCrowdAgent** ag
 	{
 		unsigned i;
 		for (i = 0; i < nagents; ++i)
-			if (pfParams->targetReplanTime >= getBehaviorParams(agents[i]->id)->targetReplanTime)
+			if (pfParams->targetReplanTime >= findBehaviorParams(agents[i]->id)->targetReplanTime)
 				break;
 
 		const unsigned tgt = i+1;
@@ -754,6 +753,15 @@ bool dtPathFollowing::overOffmeshConnection(const dtCrowdAgent& ag, const float
 	return false;
 }
 
+void dtPathFollowing::doPostUpdate(const dtCrowdQuery& query, float /*dt*/)
+{
+	// Update requests.
+	const int nbIters = m_pathQueue.update(m_maxIterPerUpdate);
+
+	if (query.getStats())
+		query.getStats()->pathQueueIterations += nbIters;
+}
+
 void dtPathFollowing::doUpdate(const dtCrowdQuery& query, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, 
 	const dtPathFollowingParams& /*currentParams*/, dtPathFollowingParams& newParams, float dt)
 {
@@ -21,17 +21,26 @@
 #include "DetourNavMesh.h"
 #include "DetourNavMeshQuery.h"
 #include "DetourAlloc.h"
+#include "DetourAssert.h"
 #include "DetourCommon.h"
 
 
+static const int MAX_KEEP_ALIVE = 2; // in update ticks.
+
 dtPathQueue::dtPathQueue() :
-	m_nextHandle(1),
-	m_maxPathSize(0),
-	m_queueHead(0),
-	m_navquery(0)
+	m_queue(0),
+	m_maxRequests(0),
+	m_freeSlots(0),
+	m_nbFreeSlots(0),
+	m_pending(0),
+	m_nbPending(0),
+	m_completed(0),
+	m_nbCompleted(0),
+	m_searches(0),
+	m_maxSearches(0),
+	m_nextOrder(0),
+	m_maxPathSize(0)
 {
-	for (int i = 0; i < MAX_QUEUE; ++i)
-		m_queue[i].path = 0;
 }
 
 dtPathQueue::~dtPathQueue()
@@ -41,122 +50,302 @@ dtPathQueue::~dtPathQueue()
 
 void dtPathQueue::purge()
 {
-	dtFreeNavMeshQuery(m_navquery);
-	m_navquery = 0;
+	for (int i = 0; i < m_maxSearches; ++i)
+		dtFreeNavMeshQuery(m_searches[i].navquery);
+
+	dtFree(m_searches);
+	m_searches = 0;
+	m_maxSearches = 0;
 
-	for (int i = 0; i < MAX_QUEUE; ++i)
+	if (m_queue)
 	{
-		dtFree(m_queue[i].path);
-		m_queue[i].path = 0;
+		for (int i = 0; i < m_maxRequests; ++i)
+			dtFree(m_queue[i].path);
 	}
+
+	dtFree(m_queue);
+	m_queue = 0;
+	m_maxRequests = 0;
+
+	dtFree(m_freeSlots);
+	m_freeSlots = 0;
+	m_nbFreeSlots = 0;
+
+	dtFree(m_pending);
+	m_pending = 0;
+	m_nbPending = 0;
+
+	dtFree(m_completed);
+	m_completed = 0;
+	m_nbCompleted = 0;
 }
 
-bool dtPathQueue::init(const int maxPathSize, const int maxSearchNodeCount, const dtNavMesh* nav)
+bool dtPathQueue::init(const int maxPathSize, const int maxSearchNodeCount, const dtNavMesh* nav, 
+					   const int maxRequests, const int maxSearches)
 {
 	purge();
 
-	m_navquery = dtAllocNavMeshQuery();
-
-	if (!m_navquery)
+	if (maxRequests < 1 || maxRequests > 0xffff || maxSearches < 1)
 		return false;
 
-	if (dtStatusFailed(m_navquery->init(nav, maxSearchNodeCount)))
+	m_searches = (Search*) dtAlloc(sizeof(Search) * maxSearches, DT_ALLOC_PERM);
+	if (!m_searches)
 		return false;
+
+	memset(m_searches, 0, sizeof(Search) * maxSearches);
+	m_maxSearches = maxSearches;
+
+	for (int i = 0; i < m_maxSearches; ++i)
+	{
+		m_searches[i].slot = -1;
+		m_searches[i].navquery = dtAllocNavMeshQuery();
+
+		if (!m_searches[i].navquery)
+			return false;
+
+		if (dtStatusFailed(m_searches[i].navquery->init(nav, maxSearchNodeCount)))
+			return false;
+	}
 	
 	m_maxPathSize = maxPathSize;
 
-	for (int i = 0; i < MAX_QUEUE; ++i)
+	m_queue = (PathQuery*) dtAlloc(sizeof(PathQuery) * maxRequests, DT_ALLOC_PERM);
+	m_freeSlots = (int*) dtAlloc(sizeof(int) * maxRequests, DT_ALLOC_PERM);
+	m_pending = (int*) dtAlloc(sizeof(int) * maxRequests, DT_ALLOC_PERM);
+	m_completed = (int*) dtAlloc(sizeof(int) * maxRequests, DT_ALLOC_PERM);
+
+	if (!m_queue || !m_freeSlots || !m_pending || !m_completed)
+		return false;
+
+	memset(m_queue, 0, sizeof(PathQuery) * maxRequests);
+	m_maxRequests = maxRequests;
+
+	for (int i = 0; i < m_maxRequests; ++i)
 	{
 		m_queue[i].ref = DT_PATHQ_INVALID;
+		m_queue[i].salt = 1;
 		m_queue[i].path = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*m_maxPathSize, DT_ALLOC_PERM);
 
 		if (!m_queue[i].path)
 			return false;
+
+		// The first slots are used first
+		m_freeSlots[i] = m_maxRequests - 1 - i;
 	}
-	
-	m_queueHead = 0;
+
+	m_nbFreeSlots = m_maxRequests;
+	m_nbPending = 0;
+	m_nbCompleted = 0;
+	m_nextOrder = 0;
 	
 	return true;
 }
 
-void dtPathQueue::update(const int maxIters)
+bool dtPathQueue::isBefore(const int a, const int b) const
 {
-	static const int MAX_KEEP_ALIVE = 2; // in update ticks.
-	int iterCount = maxIters;
-	
-	for (int i = 0; i < MAX_QUEUE; ++i)
+	const PathQuery& qa = m_queue[a];
+	const PathQuery& qb = m_queue[b];
+
+	if (qa.priority != qb.priority)
+		return qa.priority < qb.priority;
+
+	// The difference handles the wrap around of the counter
+	return (int) (qa.order - qb.order) < 0;
+}
+
+void dtPathQueue::pushPending(const int slot)
+{
+	int i = m_nbPending++;
+
+	while (i > 0)
+	{
+		const int parent = (i - 1) / 2;
+
+		if (!isBefore(slot, m_pending[parent]))
+			break;
+
+		m_pending[i] = m_pending[parent];
+		i = parent;
+	}
+
+	m_pending[i] = slot;
+}
+
+int dtPathQueue::popPending()
+{
+	dtAssert(m_nbPending > 0);
+
+	const int result = m_pending[0];
+	const int last = m_pending[--m_nbPending];
+	int i = 0;
+
+	while (true)
+	{
+		int child = i * 2 + 1;
+
+		if (child >= m_nbPending)
+			break;
+
+		if (child + 1 < m_nbPending && isBefore(m_pending[child + 1], m_pending[child]))
+			++child;
+
+		if (!isBefore(m_pending[child], last))
+			break;
+
+		m_pending[i] = m_pending[child];
+		i = child;
+	}
+
+	if (m_nbPending > 0)
+		m_pending[i] = last;
+
+	return result;
+}
+
+int dtPathQueue::getSlot(dtPathQueueRef ref) const
+{
+	if (ref == DT_PATHQ_INVALID)
+		return -1;
+
+	const int slot = (int) (ref & 0xffff);
+
+	if (slot >= m_maxRequests || m_queue[slot].ref != ref)
+		return -1;
+
+	return slot;
+}
+
+void dtPathQueue::complete(const int slot)
+{
+	m_queue[slot].keepAlive = 0;
+	m_queue[slot].completedIndex = m_nbCompleted;
+	m_completed[m_nbCompleted++] = slot;
+}
+
+void dtPathQueue::removeCompleted(const int index)
+{
+	const int last = m_completed[--m_nbCompleted];
+
+	m_completed[index] = last;
+	m_queue[last].completedIndex = index;
+}
+
+void dtPathQueue::release(const int slot)
+{
+	PathQuery& q = m_queue[slot];
+
+	q.ref = DT_PATHQ_INVALID;
+	q.status = 0;
+
+	// Old handles of this slot must not be valid anymore
+	if (++q.salt == 0)
+		q.salt = 1;
+
+	m_freeSlots[m_nbFreeSlots++] = slot;
+}
+
+/// @par
+///
+/// Every round, the remaining iterations are split evenly between the searches in progress,
+/// so a long search cannot starve the others.
+int dtPathQueue::update(const int maxIters)
+{
+	// If the path result has not been read in few frames, free the slot.
+	for (int i = 0; i < m_nbCompleted; )
 	{
-		PathQuery& q = m_queue[m_queueHead % MAX_QUEUE];
-		
-		// Skip inactive requests.
-		if (q.ref == DT_PATHQ_INVALID)
+		const int slot = m_completed[i];
+
+		if (++m_queue[slot].keepAlive > MAX_KEEP_ALIVE)
 		{
-			m_queueHead++;
-			continue;
+			removeCompleted(i);
+			release(slot);
 		}
-		
-		// Handle completed request.
-		if (dtStatusSucceed(q.status) || dtStatusFailed(q.status))
+		else
 		{
-			// If the path result has not been read in few frames, free the slot.
-			q.keepAlive++;
-			if (q.keepAlive > MAX_KEEP_ALIVE)
+			++i;
+		}
+	}
+
+	int iterCount = maxIters;
+	int nbIters = 0;
+
+	while (iterCount > 0)
+	{
+		// Start the pending requests on the idle searches.
+		int nbActive = 0;
+
+		for (int i = 0; i < m_maxSearches; ++i)
+		{
+			Search& search = m_searches[i];
+
+			while (search.slot == -1 && m_nbPending > 0)
 			{
-				q.ref = DT_PATHQ_INVALID;
-				q.status = 0;
+				const int slot = popPending();
+				PathQuery& q = m_queue[slot];
+
+				q.status = search.navquery->initSlicedFindPath(q.startRef, q.endRef, q.startPos, q.endPos, q.filter);
+
+				if (dtStatusInProgress(q.status))
+					search.slot = slot;
+				else
+				{
+					if (dtStatusSucceed(q.status))
+						q.status = search.navquery->finalizeSlicedFindPath(q.path, &q.npath, m_maxPathSize);
+
+					complete(slot);
+				}
 			}
-			
-			m_queueHead++;
-			continue;
+
+			if (search.slot != -1)
+				++nbActive;
 		}
-		
-		// Handle query start.
-		if (q.status == 0)
-		{
-			q.status = m_navquery->initSlicedFindPath(q.startRef, q.endRef, q.startPos, q.endPos, q.filter);
-		}		
-		// Handle query in progress.
-		if (dtStatusInProgress(q.status))
+
+		if (!nbActive)
+			break;
+
+		// Share the remaining iterations between the searches.
+		const int share = dtMax(iterCount / nbActive, 1);
+
+		for (int i = 0; i < m_maxSearches && iterCount > 0; ++i)
 		{
+			Search& search = m_searches[i];
+
+			if (search.slot == -1)
+				continue;
+
+			PathQuery& q = m_queue[search.slot];
 			int iters = 0;
-			q.status = m_navquery->updateSlicedFindPath(iterCount, &iters);
-			iterCount -= iters;
-		}
-		if (dtStatusSucceed(q.status))
-		{
-			q.status = m_navquery->finalizeSlicedFindPath(q.path, &q.npath, m_maxPathSize);
-		}
 
-		if (iterCount <= 0)
-			break;
+			q.status = search.navquery->updateSlicedFindPath(dtMin(share, iterCount), &iters);
+			iterCount -= dtMax(iters, 1);
+			nbIters += iters;
+
+			if (dtStatusInProgress(q.status))
+				continue;
+
+			if (dtStatusSucceed(q.status))
+				q.status = search.navquery->finalizeSlicedFindPath(q.path, &q.npath, m_maxPathSize);
 
-		m_queueHead++;
+			complete(search.slot);
+			search.slot = -1;
+		}
 	}
+
+	return nbIters;
 }
 
 dtPathQueueRef dtPathQueue::request(dtPolyRef startRef, dtPolyRef endRef,
 									const float* startPos, const float* endPos,
-									const dtQueryFilter* filter)
+									const dtQueryFilter* filter, const float priority)
 {
-	// Find empty slot
-	int slot = -1;
-	for (int i = 0; i < MAX_QUEUE; ++i)
-	{
-		if (m_queue[i].ref == DT_PATHQ_INVALID)
-		{
-			slot = i;
-			break;
-		}
-	}
 	// Could not find slot.
-	if (slot == -1)
+	if (!m_nbFreeSlots)
 		return DT_PATHQ_INVALID;
-	
-	dtPathQueueRef ref = m_nextHandle++;
-	if (m_nextHandle == DT_PATHQ_INVALID) m_nextHandle++;
+
+	const int slot = m_freeSlots[--m_nbFreeSlots];
 	
 	PathQuery& q = m_queue[slot];
-	q.ref = ref;
+	q.ref = ((dtPathQueueRef) q.salt << 16) | (dtPathQueueRef) slot;
 	dtVcopy(q.startPos, startPos);
 	q.startRef = startRef;
 	dtVcopy(q.endPos, endPos);
@@ -166,36 +355,50 @@ dtPathQueueRef dtPathQueue::request(dtPolyRef startRef, dtPolyRef endRef,
 	q.npath = 0;
 	q.filter = filter;
 	q.keepAlive = 0;
+	q.priority = priority;
+	q.order = m_nextOrder++;
+
+	pushPending(slot);
 	
-	return ref;
+	return q.ref;
 }
 
+/// @par
+///
+/// The status is 0 while the request is waiting for a search to start.
 dtStatus dtPathQueue::getRequestStatus(dtPathQueueRef ref) const
 {
-	for (int i = 0; i < MAX_QUEUE; ++i)
-	{
-		if (m_queue[i].ref == ref)
-			return m_queue[i].status;
-	}
-	return DT_FAILURE;
+	const int slot = getSlot(ref);
+
+	if (slot == -1)
+		return DT_FAILURE;
+
+	return m_queue[slot].status;
 }
 
+/// @par
+///
+/// Fails if the request is unknown or still being computed. Otherwise the request is freed.
 dtStatus dtPathQueue::getPathResult(dtPathQueueRef ref, dtPolyRef* path, int* pathSize, const int maxPath)
 {
-	for (int i = 0; i < MAX_QUEUE; ++i)
-	{
-		if (m_queue[i].ref == ref)
-		{
-			PathQuery& q = m_queue[i];
-			// Free request for reuse.
-			q.ref = DT_PATHQ_INVALID;
-			q.status = 0;
-			// Copy path
-			int n = dtMin(q.npath, maxPath);
-			memcpy(path, q.path, sizeof(dtPolyRef)*n);
-			*pathSize = n;
-			return DT_SUCCESS;
-		}
-	}
-	return DT_FAILURE;
+	const int slot = getSlot(ref);
+
+	if (slot == -1)
+		return DT_FAILURE;
+
+	PathQuery& q = m_queue[slot];
+
+	if (!dtStatusSucceed(q.status) && !dtStatusFailed(q.status))
+		return DT_FAILURE;
+
+	// Copy path
+	int n = dtMin(q.npath, maxPath);
+	memcpy(path, q.path, sizeof(dtPolyRef)*n);
+	*pathSize = n;
+
+	// Free request for reuse.
+	removeCompleted(q.completedIndex);
+	release(slot);
+
+	return DT_SUCCESS;
 }
@@ -60,28 +60,72 @@ void dtPipelineBehavior::free(dtPipelineBehavior* ptr)
 	ptr = 0;
 }
 
+/// @par
+///
+/// Every stage reads the agent computed by the previous stage and writes over it.
+/// Since @p newAgent always holds the result of the previous stage, the stages after the first one
+/// are given @p newAgent as both their input and their output, so the agent is never copied.
 void dtPipelineBehavior::update(const dtCrowdQuery& query, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, float dt)
 {
 	if (m_behaviors == 0 || m_nbBehaviors == 0)
 		return;
 
-	recursiveUpdate(query, oldAgent, newAgent, dt, m_nbBehaviors);
+	// The first stage which actually updates the agent reads the original state
+	int i = 0;
+	while (i < m_nbBehaviors && !m_behaviors[i])
+		++i;
+
+	if (i == m_nbBehaviors)
+		return;
+
+	m_behaviors[i]->update(query, oldAgent, newAgent, dt);
+
+	for (++i; i < m_nbBehaviors; ++i)
+	{
+		if (m_behaviors[i])
+			m_behaviors[i]->update(query, newAgent, newAgent, dt);
+	}
 }
 
-void dtPipelineBehavior::recursiveUpdate(const dtCrowdQuery& query, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, float dt, unsigned remainingBehaviors)
+/// @par
+///
+/// The stages are applied in the same way as in update(), but each stage updates every agent of the batch
+/// before the next stage starts. The stages after the first one update @p newAgents in place.
+void dtPipelineBehavior::updateBatch(const dtCrowdQuery& query, const dtCrowdAgent* oldAgents, dtCrowdAgent* newAgents, 
+									 const unsigned* ids, unsigned nbIds, float dt)
 {
-	if (remainingBehaviors == 0)
+	if (m_behaviors == 0 || m_nbBehaviors == 0 || nbIds == 0)
 		return;
 
-	dtBehavior* behavior = m_behaviors[m_nbBehaviors - remainingBehaviors];
+	bool first = true;
 
-	if (behavior)
-		behavior->update(query, oldAgent, newAgent, dt);
+	for (int i = 0; i < m_nbBehaviors; ++i)
+	{
+		if (!m_behaviors[i])
+			continue;
 
-	dtCrowdAgent ag = newAgent;
+		// The first stage reads the original state, the others update the result of the previous stage
+		m_behaviors[i]->updateBatch(query, first ? oldAgents : newAgents, newAgents, ids, nbIds, dt);
+		first = false;
+	}
+}
 
-	recursiveUpdate(query, newAgent, ag, dt, remainingBehaviors - 1);
-	newAgent = ag;
+void dtPipelineBehavior::doPreUpdate(const dtCrowdQuery& query, float dt)
+{
+	for (int i = 0; i < m_nbBehaviors; ++i)
+	{
+		if (m_behaviors[i])
+			m_behaviors[i]->preUpdate(query, dt);
+	}
+}
+
+void dtPipelineBehavior::doPostUpdate(const dtCrowdQuery& query, float dt)
+{
+	for (int i = 0; i < m_nbBehaviors; ++i)
+	{
+		if (m_behaviors[i])
+			m_behaviors[i]->postUpdate(query, dt);
+	}
 }
 
 bool dtPipelineBehavior::setBehaviors(dtBehavior const * const * behaviors, unsigned nbBehaviors)
@@ -90,6 +134,7 @@ bool dtPipelineBehavior::setBehaviors(dtBehavior const * const * behaviors, unsi
 	{
 		dtFree(m_behaviors);
 		m_behaviors = 0;
+		m_nbBehaviors = 0;
 	}
 
 	// The behavior list has been reseted
@@ -0,0 +1,223 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <math.h>
+#include <string.h>
+#include <new>
+
+#include "DetourProximityGrid.h"
+#include "DetourAlloc.h"
+#include "DetourCommon.h"
+#include "DetourAssert.h"
+
+
+dtProximityGrid* dtAllocProximityGrid()
+{
+	void* mem = dtAlloc(sizeof(dtProximityGrid), DT_ALLOC_PERM);
+	if (!mem) return 0;
+	return new(mem) dtProximityGrid;
+}
+
+void dtFreeProximityGrid(dtProximityGrid* ptr)
+{
+	if (!ptr) return;
+	ptr->~dtProximityGrid();
+	dtFree(ptr);
+}
+
+
+inline int hashPos2(int x, int y, int n)
+{
+	return (int) (((unsigned) x * 73856093u) ^ ((unsigned) y * 19349663u)) & (n-1);
+}
+
+
+dtProximityGrid::dtProximityGrid() :
+	m_cellSize(0),
+	m_invCellSize(0),
+	m_pool(0),
+	m_poolHead(0),
+	m_poolSize(0),
+	m_buckets(0),
+	m_bucketsSize(0)
+{
+	clear();
+}
+
+dtProximityGrid::~dtProximityGrid()
+{
+	purge();
+}
+
+void dtProximityGrid::purge()
+{
+	dtFree(m_buckets);
+	m_buckets = 0;
+	m_bucketsSize = 0;
+
+	dtFree(m_pool);
+	m_pool = 0;
+	m_poolSize = 0;
+	m_poolHead = 0;
+}
+
+bool dtProximityGrid::init(const int maxItems, const float cellSize)
+{
+	dtAssert(maxItems > 0);
+	dtAssert(cellSize > 0.0f);
+
+	purge();
+
+	m_cellSize = cellSize;
+	m_invCellSize = 1.0f / m_cellSize;
+
+	// Allocate hash buckets
+	m_bucketsSize = (int) dtNextPow2((unsigned int) maxItems);
+	m_buckets = (int*) dtAlloc(sizeof(int) * m_bucketsSize, DT_ALLOC_PERM);
+	if (!m_buckets)
+		return false;
+
+	// Allocate pool of items.
+	m_poolSize = maxItems;
+	m_poolHead = 0;
+	m_pool = (Item*) dtAlloc(sizeof(Item) * m_poolSize, DT_ALLOC_PERM);
+	if (!m_pool)
+		return false;
+
+	clear();
+
+	return true;
+}
+
+void dtProximityGrid::clear(const float cellSize)
+{
+	dtAssert(cellSize > 0.0f);
+
+	m_cellSize = cellSize;
+	m_invCellSize = 1.0f / m_cellSize;
+
+	clear();
+}
+
+void dtProximityGrid::clear()
+{
+	if (m_buckets)
+		memset(m_buckets, 0xff, sizeof(int) * m_bucketsSize);
+
+	m_poolHead = 0;
+	m_bounds[0] = 0x7fffffff;
+	m_bounds[1] = 0x7fffffff;
+	m_bounds[2] = -0x7fffffff;
+	m_bounds[3] = -0x7fffffff;
+}
+
+bool dtProximityGrid::addItem(const unsigned id, const float x, const float y)
+{
+	if (m_poolHead >= m_poolSize)
+		return false;
+
+	const int ix = (int) floorf(x * m_invCellSize);
+	const int iy = (int) floorf(y * m_invCellSize);
+
+	m_bounds[0] = dtMin(m_bounds[0], ix);
+	m_bounds[1] = dtMin(m_bounds[1], iy);
+	m_bounds[2] = dtMax(m_bounds[2], ix);
+	m_bounds[3] = dtMax(m_bounds[3], iy);
+
+	const int h = hashPos2(ix, iy, m_bucketsSize);
+	const int idx = m_poolHead++;
+
+	Item& item = m_pool[idx];
+	item.id = id;
+	item.x = ix;
+	item.y = iy;
+	item.next = m_buckets[h];
+	m_buckets[h] = idx;
+
+	return true;
+}
+
+/// @par
+///
+/// The range of cells visited is clamped to the bounds of the occupied cells,
+/// so a large query area does not cost more than visiting every occupied cell.
+int dtProximityGrid::queryItems(const float minx, const float miny, const float maxx, const float maxy,
+								unsigned* ids, const int maxIds) const
+{
+	if (!m_poolHead)
+		return 0;
+
+	const int iminx = dtMax((int) floorf(minx * m_invCellSize), m_bounds[0]);
+	const int iminy = dtMax((int) floorf(miny * m_invCellSize), m_bounds[1]);
+	const int imaxx = dtMin((int) floorf(maxx * m_invCellSize), m_bounds[2]);
+	const int imaxy = dtMin((int) floorf(maxy * m_invCellSize), m_bounds[3]);
+
+	int n = 0;
+
+	for (int y = iminy; y <= imaxy; ++y)
+	{
+		for (int x = iminx; x <= imaxx; ++x)
+		{
+			const int h = hashPos2(x, y, m_bucketsSize);
+			int idx = m_buckets[h];
+
+			while (idx != -1)
+			{
+				const Item& item = m_pool[idx];
+
+				// Different cells may share the same bucket.
+				if (item.x == x && item.y == y)
+				{
+					if (n >= maxIds)
+						return n;
+
+					ids[n++] = item.id;
+				}
+
+				idx = item.next;
+			}
+		}
+	}
+
+	return n;
+}
+
+int dtProximityGrid::getItemCountAt(const float x, const float y) const
+{
+	if (!m_poolHead)
+		return 0;
+
+	const int ix = (int) floorf(x * m_invCellSize);
+	const int iy = (int) floorf(y * m_invCellSize);
+	const int h = hashPos2(ix, iy, m_bucketsSize);
+
+	int n = 0;
+	int idx = m_buckets[h];
+
+	while (idx != -1)
+	{
+		const Item& item = m_pool[idx];
+
+		if (item.x == ix && item.y == iy)
+			++n;
+
+		idx = item.next;
+	}
+
+	return n;
+}
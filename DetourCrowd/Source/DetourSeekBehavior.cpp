@@ -82,9 +82,9 @@ void dtSeekBehavior::applyForce(const dtCrowdQuery& query, const dtCrowdAgent& o
 {
 	float tmpForce[] = {0, 0, 0};
 	float newVelocity[] = {0, 0, 0};
-	const int targetID = getBehaviorParams(oldAgent.id)->targetID;
-	const dtCrowdAgent* target = query.getAgent(targetID);
-	const float distance = getBehaviorParams(oldAgent.id)->distance;
+	const dtSeekBehaviorParams* params = findBehaviorParams(oldAgent.id);
+	const dtCrowdAgent* target = query.getAgent(params->targetID);
+	const float distance = params->distance;
 
 	// Adapting the force to the dt and the previous velocity
 	dtVscale(tmpForce, force, dt);
@@ -59,7 +59,6 @@ void dtSeparationBehavior::computeForce(const dtCrowdQuery& query, const dtCrowd
 {
 	const unsigned* targets = currentParams.targetsID;
 	const unsigned nbTargets = currentParams.nbTargets;
-	const float distance = currentParams.distance;
 
 	const dtCrowdAgent** agents = (const dtCrowdAgent**) dtAlloc(sizeof(dtCrowdAgent*) * nbTargets, DT_ALLOC_TEMP);
 	query.getAgents(targets, nbTargets, agents);
@@ -69,35 +68,38 @@ void dtSeparationBehavior::computeForce(const dtCrowdQuery& query, const dtCrowd
 		return;
 	}
 
-	const float invSeparationDist = 1.f / distance;
-	float weight;
 	int count = 0;
 
 	for (unsigned i = 0; i < nbTargets; ++i)
 	{
 		const dtCrowdAgent& target = *agents[i];
 
-		if (!target.active)
-			continue;
+		if (target.active && addTargetForce(ag, target, currentParams, force))
+			++count;
+	}
 
-		float diff[3];
-		dtVsub(diff, ag.position, target.position);
+	if (count > 0)
+		dtVscale(force, force, (1.f / (float) count));
 
-		float dist = dtVlen(diff) - ag.radius - target.radius;
+	dtFree(agents);
+}
 
-		if (dist > distance || dist < EPSILON)
-			continue;
+bool dtSeparationBehavior::addTargetForce(const dtCrowdAgent& ag, const dtCrowdAgent& target, const dtSeparationBehaviorParams& params, 
+										  float* force)
+{
+	float diff[3];
+	dtVsub(diff, ag.position, target.position);
 
-		weight = currentParams.weight * (1.f - dtSqr(dist * invSeparationDist));
+	const float dist = dtVlen(diff) - ag.radius - target.radius;
 
-		++count;
-		dtVnormalize(diff);
-		dtVmad(force, force, diff, weight / dist);
-	}
+	if (dist > params.distance || dist < EPSILON)
+		return false;
 
-	if (count > 0)
-		dtVscale(force, force, (1.f / (float) count));
+	const float weight = params.weight * (1.f - dtSqr(dist * (1.f / params.distance)));
 
-	dtFree(agents);
+	dtVnormalize(diff);
+	dtVmad(force, force, diff, weight / dist);
+
+	return true;
 }
 
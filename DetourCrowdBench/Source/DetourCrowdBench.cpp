@@ -0,0 +1,870 @@
+//
+// Copyright (c) 2013 MASA Group recastdetour@masagroup.net
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+// Headless benchmark of the crowd.
+//
+// Builds the navigation mesh of a scene, then for every requested number of agents,
+// fills a crowd with agents walking to random destinations (path following + collision avoidance)
+// and measures a fixed number of updates. The results are written as JSON or CSV.
+//
+// Usage: DetourCrowdBench [options]
+//   --scene <file>      Scene file (same format as the DetourCrowdDemo samples), the paths it contains
+//                       are relative to the working directory. Without it, a flat square is used.
+//   --size <meters>     Side of the square used when no scene is given. (default: 100)
+//   --corridors <n>     Splits the square into n parallel corridors joined at alternate ends, so the
+//                       paths zigzag through the whole square. (default: 0, an open square)
+//   --agents <list>     Comma separated numbers of agents. (default: 100,1000,10000)
+//   --neighbors <list>  Comma separated maximum numbers of neighbors of an agent, every number of agents
+//                       is measured with each of them. (default: DT_CROWDAGENT_MAX_NEIGHBOURS)
+//   --ticks <n>         Number of measured updates. (default: 100)
+//   --warmup <n>        Number of updates done before measuring. (default: 10)
+//   --dt <seconds>      Time step of an update. (default: 0.1)
+//   --seed <n>          Seed of the placement of the agents. (default: 1)
+//   --budget-agents <n> Maximum number of agents whose environment and velocity are updated at every
+//                       update, see dtCrowd::setUpdateBudget(). (default: 0, unlimited)
+//   --budget-us <microseconds>
+//                       Time after which an update starts no other slice of agents. (default: 0, unlimited)
+//   --paths <n>         Number of long path searches measured before the crowd runs, JSON only. (default: 0)
+//   --path-buckets <w>  Also measures the path searches with an open list of buckets of width w. (default: 0)
+//   --format <json|csv> Output format. (default: json)
+//   --output <file>     Output file. (default: standard output)
+
+#include "BuildContext.h"
+#include "CrowdSample.h"
+#include "InputGeom.h"
+#include "PerfTimer.h"
+
+#include <DetourAlloc.h>
+#include <DetourCollisionAvoidance.h>
+#include <DetourCommon.h>
+#include <DetourCrowd.h>
+#include <DetourNavMesh.h>
+#include <DetourNavMeshQuery.h>
+#include <DetourNode.h>
+#include <DetourPathFollowing.h>
+#include <DetourPipelineBehavior.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+
+// Memory tracking
+
+/// Size of the header storing the size of an allocation, keeps the alignment of the memory returned.
+const size_t ALLOC_HEADER_SIZE = 16;
+
+size_t g_allocatedBytes = 0;
+size_t g_peakBytes = 0;
+
+void* trackingAlloc(int size, dtAllocHint /*hint*/)
+{
+	unsigned char* mem = (unsigned char*) malloc(size + ALLOC_HEADER_SIZE);
+	if (!mem)
+		return 0;
+
+	*(size_t*) mem = (size_t) size;
+	g_allocatedBytes += size;
+	g_peakBytes = std::max(g_peakBytes, g_allocatedBytes);
+
+	return mem + ALLOC_HEADER_SIZE;
+}
+
+void trackingFree(void* ptr)
+{
+	if (!ptr)
+		return;
+
+	unsigned char* mem = (unsigned char*) ptr - ALLOC_HEADER_SIZE;
+	g_allocatedBytes -= *(size_t*) mem;
+	free(mem);
+}
+
+/// Returns the peak resident memory of the process in kilobytes, 0 if unknown.
+long getMaxResidentKb()
+{
+#if defined(_WIN32)
+	return 0;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#if defined(__APPLE__)
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// Random numbers, deterministic on every platform
+
+unsigned g_seed = 1;
+
+float frand()
+{
+	g_seed = g_seed * 1103515245u + 12345u;
+	return (float) ((g_seed >> 8) & 0xffffff) / (float) 0x1000000;
+}
+
+// Options
+
+struct Options
+{
+	std::string scene;
+	float size;
+	unsigned corridors;
+	std::vector<unsigned> agents;
+	std::vector<unsigned> neighbors;
+	unsigned ticks;
+	unsigned warmup;
+	float dt;
+	unsigned seed;
+	unsigned budgetAgents;
+	float budgetTime;
+	unsigned paths;
+	float pathBuckets;
+	bool csv;
+	std::string output;
+};
+
+void printUsage()
+{
+	fprintf(stderr,
+			"Usage: DetourCrowdBench [--scene file] [--size meters] [--corridors n] [--agents n1,n2,...] [--neighbors k1,k2,...]\n"
+			"                        [--ticks n] [--warmup n] [--dt seconds] [--seed n] [--budget-agents n] [--budget-us microseconds]\n"
+			"                        [--paths n] [--path-buckets width] [--format json|csv] [--output file]\n");
+}
+
+/// Parses a comma separated list of positive numbers
+bool parseList(const char* value, std::vector<unsigned>& list)
+{
+	for (const char* s = value; *s; )
+	{
+		const int n = atoi(s);
+		if (n <= 0)
+			return false;
+
+		list.push_back((unsigned) n);
+
+		s = strchr(s, ',');
+		if (!s)
+			break;
+		++s;
+	}
+
+	return true;
+}
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+	options.size = 100.f;
+	options.corridors = 0;
+	options.ticks = 100;
+	options.warmup = 10;
+	options.dt = 0.1f;
+	options.seed = 1;
+	options.budgetAgents = 0;
+	options.budgetTime = 0.f;
+	options.paths = 0;
+	options.pathBuckets = 0.f;
+	options.csv = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+
+		if (i + 1 >= argc)
+			return false;
+
+		const char* value = argv[++i];
+
+		if (arg == "--scene")
+			options.scene = value;
+		else if (arg == "--size")
+			options.size = (float) atof(value);
+		else if (arg == "--corridors")
+			options.corridors = (unsigned) atoi(value);
+		else if (arg == "--ticks")
+			options.ticks = (unsigned) atoi(value);
+		else if (arg == "--warmup")
+			options.warmup = (unsigned) atoi(value);
+		else if (arg == "--dt")
+			options.dt = (float) atof(value);
+		else if (arg == "--seed")
+			options.seed = (unsigned) atoi(value);
+		else if (arg == "--budget-agents")
+			options.budgetAgents = (unsigned) atoi(value);
+		else if (arg == "--budget-us")
+			options.budgetTime = (float) atof(value);
+		else if (arg == "--paths")
+			options.paths = (unsigned) atoi(value);
+		else if (arg == "--path-buckets")
+			options.pathBuckets = (float) atof(value);
+		else if (arg == "--output")
+			options.output = value;
+		else if (arg == "--format")
+		{
+			if (strcmp(value, "csv") == 0)
+				options.csv = true;
+			else if (strcmp(value, "json") != 0)
+				return false;
+		}
+		else if (arg == "--agents")
+		{
+			if (!parseList(value, options.agents))
+				return false;
+		}
+		else if (arg == "--neighbors")
+		{
+			if (!parseList(value, options.neighbors))
+				return false;
+		}
+		else
+			return false;
+	}
+
+	if (options.agents.empty())
+	{
+		options.agents.push_back(100);
+		options.agents.push_back(1000);
+		options.agents.push_back(10000);
+	}
+
+	if (options.neighbors.empty())
+		options.neighbors.push_back(DT_CROWDAGENT_MAX_NEIGHBOURS);
+
+	return options.ticks > 0 && options.dt > 0.f && options.size > 0.f && options.pathBuckets >= 0.f;
+}
+
+// Results
+
+/// Summary of the values of a measure over the measured updates
+struct Summary
+{
+	double mean;
+	double p50;
+	double p95;
+	double p99;
+	double max;
+};
+
+Summary summarize(std::vector<double> values)
+{
+	Summary s;
+	memset(&s, 0, sizeof(s));
+
+	if (values.empty())
+		return s;
+
+	std::sort(values.begin(), values.end());
+
+	double sum = 0;
+	for (size_t i = 0; i < values.size(); ++i)
+		sum += values[i];
+
+	const size_t last = values.size() - 1;
+	s.mean = sum / values.size();
+	s.p50 = values[(size_t) (last * 0.50 + 0.5)];
+	s.p95 = values[(size_t) (last * 0.95 + 0.5)];
+	s.p99 = values[(size_t) (last * 0.99 + 0.5)];
+	s.max = values[last];
+
+	return s;
+}
+
+/// The phases measured, in milliseconds per update
+enum Phase
+{
+	PHASE_TOTAL,
+	PHASE_ENVIRONMENT,
+	PHASE_VELOCITY,
+	PHASE_POSITION,
+	PHASE_COUNT
+};
+
+const char* PHASE_NAMES[PHASE_COUNT] = {"total", "environment", "velocity", "position"};
+
+/// The counters of dtCrowdStats, averaged per update
+enum Counter
+{
+	COUNTER_NEAREST_POLY,
+	COUNTER_MOVE_ALONG_SURFACE,
+	COUNTER_BOUNDARY_UPDATES,
+	COUNTER_WALL_SEGMENT_QUERIES,
+	COUNTER_NEIGHBOR_CANDIDATES,
+	COUNTER_AVOIDANCE_SAMPLES,
+	COUNTER_PATH_QUEUE_ITERATIONS,
+	COUNTER_SKIPPED_AGENTS,
+	COUNTER_COUNT
+};
+
+const char* COUNTER_NAMES[COUNTER_COUNT] = {
+	"nearestPolyQueries", "moveAlongSurfaceQueries", "boundaryUpdates", "wallSegmentQueries",
+	"neighborCandidates", "avoidanceSamples", "pathQueueIterations", "skippedAgents"
+};
+
+struct RunResult
+{
+	unsigned nbAgents;			///< Agents requested
+	unsigned nbAgentsAdded;		///< Agents actually placed in the crowd
+	unsigned nbNeighbors;		///< Maximum number of neighbors of an agent
+	double setupMs;				///< Time spent creating the crowd and its agents
+	Summary phases[PHASE_COUNT];
+	double counters[COUNTER_COUNT];
+	size_t peakBytes;			///< Peak of the memory allocated through the Detour allocator during the run
+	long maxResidentKb;			///< Peak resident memory of the process at the end of the run
+};
+
+/// The path searches, in microseconds per search
+struct PathResult
+{
+	unsigned nbPaths;			///< Searches done
+	unsigned nbFound;			///< Searches which reached their destination
+	double meanNodes;			///< Mean number of nodes visited by a search
+	double meanLength;			///< Mean number of polygons of a path
+	Summary heap;				///< Searches with the heap as open list
+	Summary buckets;			///< Searches with the buckets as open list (if requested)
+};
+
+// Benchmark
+
+const float AGENT_RADIUS = 0.2f;
+
+/// Adds a horizontal rectangle to the mesh
+void addRectangle(float minX, float minZ, float maxX, float maxZ, std::vector<float>& verts, std::vector<int>& tris)
+{
+	const int first = (int) verts.size() / 3;
+	const float corners[] = {maxX, 0, maxZ, maxX, 0, minZ, minX, 0, minZ, minX, 0, maxZ};
+	const int indices[] = {0, 1, 2, 2, 3, 0};
+
+	verts.insert(verts.end(), corners, corners + 12);
+	for (int i = 0; i < 6; ++i)
+		tris.push_back(first + indices[i]);
+}
+
+/// Builds the floor of the square scene. With several corridors, the square is split into
+/// parallel corridors separated by gaps as wide as them, each one joined to the next one
+/// at alternate ends, so the paths across the square are long.
+void buildSquare(float size, unsigned nbCorridors, std::vector<float>& verts, std::vector<int>& tris)
+{
+	const float half = size * 0.5f;
+
+	if (nbCorridors <= 1)
+	{
+		addRectangle(-half, -half, half, half, verts, tris);
+		return;
+	}
+
+	const float pitch = size / nbCorridors;
+	const float width = pitch * 0.5f;
+
+	for (unsigned i = 0; i < nbCorridors; ++i)
+	{
+		const float minZ = -half + i * pitch;
+		addRectangle(-half, minZ, half, minZ + width, verts, tris);
+
+		// The junction with the next corridor
+		if (i + 1 < nbCorridors)
+		{
+			const float minX = (i % 2 == 0) ? half - width : -half;
+			addRectangle(minX, minZ + width, minX + width, minZ + pitch, verts, tris);
+		}
+	}
+}
+
+/// The maximum number of nodes of a path search
+const int PATH_MAX_NODES = 4096;
+
+/// The number of buckets of the open list of a path search, when buckets are used
+const int PATH_BUCKET_COUNT = 4096;
+
+/// The number of random destinations drawn for a path search, the farthest one is kept
+const int PATH_DESTINATION_CANDIDATES = 8;
+
+/// The ends of a path search
+struct PathRequest
+{
+	dtPolyRef startRef, endRef;
+	float startPos[3], endPos[3];
+};
+
+/// Does every search with the given open list, and returns the duration of the searches in microseconds.
+/// The searches are timed in nanoseconds, since the short ones take about a microsecond.
+std::vector<double> timePathSearches(dtNavMeshQuery& query, const std::vector<PathRequest>& requests, float bucketWidth, PathResult& result)
+{
+	std::vector<double> times;
+	if (dtStatusFailed(query.setOpenListBuckets(bucketWidth, PATH_BUCKET_COUNT)))
+		return times;
+
+	dtQueryFilter filter;
+	std::vector<dtPolyRef> path(PATH_MAX_NODES);
+	double nbNodes = 0, length = 0;
+	result.nbFound = 0;
+
+	for (size_t i = 0; i < requests.size(); ++i)
+	{
+		const PathRequest& req = requests[i];
+
+		int nbPolys = 0;
+		const TimeVal start = getPerfTime();
+		const dtStatus status = query.findPath(req.startRef, req.endRef, req.startPos, req.endPos, &filter, &path[0], &nbPolys, PATH_MAX_NODES);
+		times.push_back(getPerfDeltaTimeNsec(start, getPerfTime()) / 1000.0);
+
+		if (dtStatusSucceed(status) && !dtStatusDetail(status, DT_PARTIAL_RESULT))
+			++result.nbFound;
+		nbNodes += query.getNodePool()->getNodeCount();
+		length += nbPolys;
+	}
+
+	if (!requests.empty())
+	{
+		result.meanNodes = nbNodes / requests.size();
+		result.meanLength = length / requests.size();
+	}
+
+	return times;
+}
+
+bool runPathBenchmark(dtNavMesh& navMesh, const Options& options, PathResult& result)
+{
+	memset(&result, 0, sizeof(result));
+	g_seed = options.seed;
+
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	if (!query || dtStatusFailed(query->init(&navMesh, PATH_MAX_NODES)))
+	{
+		dtFreeNavMeshQuery(query);
+		return false;
+	}
+
+	// Long searches: the farthest of a few random destinations
+	dtQueryFilter filter;
+	std::vector<PathRequest> requests;
+
+	for (unsigned i = 0; i < options.paths; ++i)
+	{
+		PathRequest req;
+		req.endRef = 0;
+		if (dtStatusFailed(query->findRandomPoint(&filter, frand, &req.startRef, req.startPos)))
+			continue;
+
+		float bestDist = -1.f;
+		for (int j = 0; j < PATH_DESTINATION_CANDIDATES; ++j)
+		{
+			dtPolyRef ref;
+			float pos[3];
+			if (dtStatusFailed(query->findRandomPoint(&filter, frand, &ref, pos)))
+				continue;
+
+			const float dist = dtVdistSqr(req.startPos, pos);
+			if (dist > bestDist)
+			{
+				bestDist = dist;
+				req.endRef = ref;
+				dtVcopy(req.endPos, pos);
+			}
+		}
+
+		if (req.endRef)
+			requests.push_back(req);
+	}
+
+	result.nbPaths = (unsigned) requests.size();
+
+	// The searches with buckets are done first, so the statistics reported are the ones of the heap
+	bool ok = true;
+	if (options.pathBuckets > 0.f)
+	{
+		const std::vector<double> times = timePathSearches(*query, requests, options.pathBuckets, result);
+		ok = times.size() == requests.size();
+		result.buckets = summarize(times);
+	}
+
+	result.heap = summarize(timePathSearches(*query, requests, 0.f, result));
+
+	dtFreeNavMeshQuery(query);
+
+	return ok;
+}
+
+bool runBenchmark(dtNavMesh& navMesh, unsigned nbAgents, unsigned nbNeighbors, const Options& options, RunResult& result)
+{
+	memset(&result, 0, sizeof(result));
+	result.nbAgents = nbAgents;
+	result.nbNeighbors = nbNeighbors;
+
+	// Only the memory used by the crowd and its behaviors counts
+	g_peakBytes = g_allocatedBytes;
+	const size_t baseBytes = g_allocatedBytes;
+	g_seed = options.seed;
+
+	TimeVal start = getPerfTime();
+
+	dtCrowd* crowd = dtAllocCrowd();
+	dtPathFollowing* pathFollowing = dtPathFollowing::allocate(nbAgents);
+	dtCollisionAvoidance* avoidance = dtCollisionAvoidance::allocate(nbAgents);
+	dtPipelineBehavior* pipeline = dtPipelineBehavior::allocate();
+
+	bool ok = crowd && pathFollowing && avoidance && pipeline &&
+		crowd->init(nbAgents, AGENT_RADIUS, &navMesh, nbNeighbors) &&
+		pathFollowing->init(*crowd->getCrowdQuery(), 256, std::min(nbAgents, 1024u)) &&
+		avoidance->init();
+
+	if (ok)
+	{
+		dtBehavior* behaviors[] = {pathFollowing, avoidance};
+		ok = pipeline->setBehaviors(behaviors, 2);
+	}
+
+	if (ok)
+	{
+		const dtCrowdQuery* query = crowd->getCrowdQuery();
+		const dtNavMeshQuery* navQuery = query->getNavMeshQuery();
+
+		for (unsigned i = 0; i < nbAgents; ++i)
+		{
+			dtPolyRef startRef = 0, endRef = 0;
+			float startPos[3], endPos[3];
+
+			if (dtStatusFailed(navQuery->findRandomPoint(query->getQueryFilter(), frand, &startRef, startPos)) ||
+				dtStatusFailed(navQuery->findRandomPoint(query->getQueryFilter(), frand, &endRef, endPos)))
+				continue;
+
+			dtCrowdAgent ag;
+			if (!crowd->addAgent(ag, startPos))
+				continue;
+
+			ag.radius = AGENT_RADIUS;
+			ag.height = 1.7f;
+			ag.maxSpeed = 2.f;
+			ag.maxAcceleration = 10.f;
+			ag.perceptionDistance = 4.f;
+			ag.updateFlags = DT_CROWD_OBSTACLE_AVOIDANCE;
+			crowd->applyAgent(ag);
+			crowd->setAgentBehavior(ag.id, pipeline);
+
+			dtPathFollowingParams* pfParams = pathFollowing->getBehaviorParams(ag.id);
+			dtCollisionAvoidanceParams* caParams = avoidance->getBehaviorParams(ag.id);
+			if (!pfParams || !caParams)
+				continue;
+
+			pfParams->debugInfos = 0;
+			pfParams->debugIndex = ag.id;
+			pfParams->pathOptimizationRange = 6.f;
+			pathFollowing->requestMoveTarget(ag.id, endRef, endPos);
+
+			caParams->debug = 0;
+			caParams->velBias = 0.4f;
+			caParams->weightDesVel = 2.f;
+			caParams->weightCurVel = 0.75f;
+			caParams->weightSide = 0.75f;
+			caParams->weightToi = 2.5f;
+			caParams->horizTime = 2.5f;
+			caParams->gridSize = 33;
+			caParams->adaptiveDivs = 7;
+			caParams->adaptiveRings = 2;
+			caParams->adaptiveDepth = 5;
+
+			++result.nbAgentsAdded;
+		}
+	}
+
+	result.setupMs = getPerfDeltaTimeNsec(start, getPerfTime()) / 1000000.0;
+
+	if (ok)
+	{
+		crowd->setUpdateBudget(options.budgetAgents, options.budgetTime);
+
+		for (unsigned i = 0; i < options.warmup; ++i)
+			crowd->update(options.dt);
+
+		crowd->setStatsEnabled(true);
+
+		std::vector<double> phases[PHASE_COUNT];
+
+		for (unsigned i = 0; i < options.ticks; ++i)
+		{
+			start = getPerfTime();
+			crowd->update(options.dt);
+			const TimeVal elapsed = getPerfDeltaTimeNsec(start, getPerfTime());
+
+			const dtCrowdStats* stats = crowd->getStats();
+			phases[PHASE_TOTAL].push_back(elapsed / 1000000.0);
+			phases[PHASE_ENVIRONMENT].push_back(stats->environmentTime / 1000.0);
+			phases[PHASE_VELOCITY].push_back(stats->velocityTime / 1000.0);
+			phases[PHASE_POSITION].push_back(stats->positionTime / 1000.0);
+
+			result.counters[COUNTER_NEAREST_POLY] += stats->nearestPolyQueries;
+			result.counters[COUNTER_MOVE_ALONG_SURFACE] += stats->moveAlongSurfaceQueries;
+			result.counters[COUNTER_BOUNDARY_UPDATES] += stats->boundaryUpdates;
+			result.counters[COUNTER_WALL_SEGMENT_QUERIES] += stats->wallSegmentQueries;
+			result.counters[COUNTER_NEIGHBOR_CANDIDATES] += stats->neighborCandidates;
+			result.counters[COUNTER_AVOIDANCE_SAMPLES] += stats->avoidanceSamples;
+			result.counters[COUNTER_PATH_QUEUE_ITERATIONS] += stats->pathQueueIterations;
+			result.counters[COUNTER_SKIPPED_AGENTS] += stats->skippedAgents;
+		}
+
+		for (int i = 0; i < PHASE_COUNT; ++i)
+			result.phases[i] = summarize(phases[i]);
+
+		for (int i = 0; i < COUNTER_COUNT; ++i)
+			result.counters[i] /= options.ticks;
+	}
+
+	result.peakBytes = g_peakBytes - baseBytes;
+	result.maxResidentKb = getMaxResidentKb();
+
+	dtPipelineBehavior::free(pipeline);
+	dtCollisionAvoidance::free(avoidance);
+	dtPathFollowing::free(pathFollowing);
+	dtFreeCrowd(crowd);
+
+	return ok;
+}
+
+void writeJson(FILE* out, const Options& options, const PathResult& paths, const std::vector<RunResult>& results)
+{
+	fprintf(out, "{\n");
+	fprintf(out, "  \"scene\": \"%s\",\n", options.scene.empty() ? (options.corridors > 1 ? "corridors" : "square") : options.scene.c_str());
+	fprintf(out, "  \"corridors\": %u,\n", options.scene.empty() ? options.corridors : 0);
+	fprintf(out, "  \"ticks\": %u,\n", options.ticks);
+	fprintf(out, "  \"warmup\": %u,\n", options.warmup);
+	fprintf(out, "  \"dt\": %g,\n", options.dt);
+	fprintf(out, "  \"seed\": %u,\n", options.seed);
+	fprintf(out, "  \"budgetAgents\": %u,\n", options.budgetAgents);
+	fprintf(out, "  \"budgetUs\": %g,\n", options.budgetTime);
+
+	if (options.paths > 0)
+	{
+		const Summary* s[] = {&paths.heap, &paths.buckets};
+		const char* names[] = {"heap", "buckets"};
+		const int nbSummaries = options.pathBuckets > 0.f ? 2 : 1;
+
+		fprintf(out, "  \"paths\": {\n");
+		fprintf(out, "    \"searches\": %u,\n", paths.nbPaths);
+		fprintf(out, "    \"found\": %u,\n", paths.nbFound);
+		fprintf(out, "    \"meanNodes\": %.1f,\n", paths.meanNodes);
+		fprintf(out, "    \"meanLength\": %.1f,\n", paths.meanLength);
+		fprintf(out, "    \"bucketWidth\": %g,\n", options.pathBuckets);
+		fprintf(out, "    \"searchUs\": {\n");
+
+		for (int i = 0; i < nbSummaries; ++i)
+		{
+			fprintf(out, "      \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+					names[i], s[i]->mean, s[i]->p50, s[i]->p95, s[i]->p99, s[i]->max, i + 1 < nbSummaries ? "," : "");
+		}
+
+		fprintf(out, "    }\n");
+		fprintf(out, "  },\n");
+	}
+
+	fprintf(out, "  \"runs\": [\n");
+
+	for (size_t r = 0; r < results.size(); ++r)
+	{
+		const RunResult& res = results[r];
+
+		fprintf(out, "    {\n");
+		fprintf(out, "      \"agents\": %u,\n", res.nbAgents);
+		fprintf(out, "      \"agentsAdded\": %u,\n", res.nbAgentsAdded);
+		fprintf(out, "      \"neighbors\": %u,\n", res.nbNeighbors);
+		fprintf(out, "      \"setupMs\": %.3f,\n", res.setupMs);
+		fprintf(out, "      \"phasesMs\": {\n");
+
+		for (int i = 0; i < PHASE_COUNT; ++i)
+		{
+			const Summary& s = res.phases[i];
+			fprintf(out, "        \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+					PHASE_NAMES[i], s.mean, s.p50, s.p95, s.p99, s.max, i + 1 < PHASE_COUNT ? "," : "");
+		}
+
+		fprintf(out, "      },\n");
+		fprintf(out, "      \"countersPerTick\": {\n");
+
+		for (int i = 0; i < COUNTER_COUNT; ++i)
+			fprintf(out, "        \"%s\": %.1f%s\n", COUNTER_NAMES[i], res.counters[i], i + 1 < COUNTER_COUNT ? "," : "");
+
+		fprintf(out, "      },\n");
+		fprintf(out, "      \"peakBytes\": %lu,\n", (unsigned long) res.peakBytes);
+		fprintf(out, "      \"maxResidentKb\": %ld\n", res.maxResidentKb);
+		fprintf(out, "    }%s\n", r + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(out, "  ]\n");
+	fprintf(out, "}\n");
+}
+
+void writeCsv(FILE* out, const std::vector<RunResult>& results)
+{
+	fprintf(out, "agents,agentsAdded,neighbors,setupMs");
+
+	for (int i = 0; i < PHASE_COUNT; ++i)
+		fprintf(out, ",%s_mean,%s_p50,%s_p95,%s_p99,%s_max", PHASE_NAMES[i], PHASE_NAMES[i], PHASE_NAMES[i], PHASE_NAMES[i], PHASE_NAMES[i]);
+
+	for (int i = 0; i < COUNTER_COUNT; ++i)
+		fprintf(out, ",%s", COUNTER_NAMES[i]);
+
+	fprintf(out, ",peakBytes,maxResidentKb\n");
+
+	for (size_t r = 0; r < results.size(); ++r)
+	{
+		const RunResult& res = results[r];
+
+		fprintf(out, "%u,%u,%u,%.3f", res.nbAgents, res.nbAgentsAdded, res.nbNeighbors, res.setupMs);
+
+		for (int i = 0; i < PHASE_COUNT; ++i)
+		{
+			const Summary& s = res.phases[i];
+			fprintf(out, ",%.4f,%.4f,%.4f,%.4f,%.4f", s.mean, s.p50, s.p95, s.p99, s.max);
+		}
+
+		for (int i = 0; i < COUNTER_COUNT; ++i)
+			fprintf(out, ",%.1f", res.counters[i]);
+
+		fprintf(out, ",%lu,%ld\n", (unsigned long) res.peakBytes, res.maxResidentKb);
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage();
+		return 1;
+	}
+
+	dtAllocSetCustom(trackingAlloc, trackingFree);
+
+	BuildContext context;
+	CrowdSample sample;
+	InputGeom scene;
+	sample.m_context = &context;
+
+	if (!options.scene.empty())
+	{
+		if (!sample.loadFromFile(options.scene.c_str()))
+		{
+			fprintf(stderr, "Could not load the scene file '%s'.\n", options.scene.c_str());
+			return 1;
+		}
+
+		sample.getSceneFile();
+		sample.m_maxRadius = AGENT_RADIUS;
+
+		if (!sample.initializeScene(&scene))
+		{
+			fprintf(stderr, "Could not load the mesh '%s'.\n", sample.m_sceneFileName);
+			return 1;
+		}
+	}
+	else
+	{
+		std::vector<float> verts;
+		std::vector<int> tris;
+		buildSquare(options.size, options.corridors, verts, tris);
+
+		sample.m_maxRadius = AGENT_RADIUS;
+
+		if (!sample.initializeScene(&scene, &verts[0], (unsigned) verts.size() / 3, &tris[0], (unsigned) tris.size() / 3))
+		{
+			fprintf(stderr, "Could not create the square scene.\n");
+			return 1;
+		}
+	}
+
+	dtNavMesh navMesh;
+
+	if (!sample.initializeNavmesh(scene, &navMesh))
+	{
+		fprintf(stderr, "Could not build the navigation mesh.\n");
+		return 1;
+	}
+
+	PathResult paths;
+	memset(&paths, 0, sizeof(paths));
+
+	if (options.paths > 0)
+	{
+		if (!runPathBenchmark(navMesh, options, paths))
+		{
+			fprintf(stderr, "Could not run the path searches.\n");
+			return 1;
+		}
+
+		fprintf(stderr, "%u path searches (%.1f nodes): %.3f us per search with the heap", paths.nbPaths, paths.meanNodes, paths.heap.mean);
+		if (options.pathBuckets > 0.f)
+			fprintf(stderr, ", %.3f us with the buckets", paths.buckets.mean);
+		fprintf(stderr, "\n");
+	}
+
+	std::vector<RunResult> results;
+
+	for (size_t i = 0; i < options.agents.size(); ++i)
+	{
+		for (size_t k = 0; k < options.neighbors.size(); ++k)
+		{
+			RunResult result;
+
+			if (!runBenchmark(navMesh, options.agents[i], options.neighbors[k], options, result))
+			{
+				fprintf(stderr, "Could not run the benchmark with %u agents and %u neighbors.\n", options.agents[i], options.neighbors[k]);
+				return 1;
+			}
+
+			fprintf(stderr, "%u agents, %u neighbors: %.3f ms per update (environment %.3f ms)\n", result.nbAgentsAdded, result.nbNeighbors,
+					result.phases[PHASE_TOTAL].mean, result.phases[PHASE_ENVIRONMENT].mean);
+			results.push_back(result);
+		}
+	}
+
+	FILE* out = stdout;
+
+	if (!options.output.empty())
+	{
+		out = fopen(options.output.c_str(), "w");
+		if (!out)
+		{
+			fprintf(stderr, "Could not open '%s'.\n", options.output.c_str());
+			return 1;
+		}
+	}
+
+	if (options.csv)
+		writeCsv(out, results);
+	else
+		writeJson(out, options, paths, results);
+
+	if (out != stdout)
+		fclose(out);
+
+	return 0;
+}
@@ -20,6 +20,10 @@
 
 #include "DetourAlignmentBehavior.h"
 #include "DetourCohesionBehavior.h"
+#include "DetourCollisionAvoidance.h"
+#include "DetourCommon.h"
+#include "DetourFlockGroup.h"
+#include "DetourFlockingBehavior.h"
 #include "DetourGoToBehavior.h"
 #include "DetourPathFollowing.h"
 #include "DetourSeekBehavior.h"
@@ -36,7 +40,11 @@
 #pragma GCC diagnostic pop
 #endif
 
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
+#include <thread>
+#include <vector>
 
 TEST_CASE("DetourBehaviorsTests/CustomBehavior", "Test whether the custom behaviors behave correctly")
 {
@@ -450,3 +458,487 @@ TEST_CASE("DetourBehaviorsTests/CustomBehavior", "Test whether the custom behavi
 		dtArriveBehavior::free(go);
 	}
 }
+
+/// Places the agents on a circle, walking toward its center, and sets their collision avoidance parameters.
+static void setUpCollisionAvoidance(TestScene& ts, dtCrowd* crowd, dtCollisionAvoidance* ca, unsigned nbAgents)
+{
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		// The agents are close to each other and walk toward the center
+		float pos[] = {3.f * cosf(i * 0.4f), 0, 3.f * sinf(i * 0.4f)};
+		dtCrowdAgent ag;
+
+		REQUIRE(crowd->addAgent(ag, pos));
+		ts.defaultInitializeAgent(*crowd, ag.id);
+
+		crowd->fetchAgent(ag, ag.id);
+		dtVset(ag.desiredVelocity, -pos[0], 0, -pos[2]);
+		dtVnormalize(ag.desiredVelocity);
+		dtVcopy(ag.velocity, ag.desiredVelocity);
+		REQUIRE(crowd->applyAgent(ag));
+
+		dtCollisionAvoidanceParams* params = ca->getBehaviorParams(ag.id);
+		REQUIRE(params != 0);
+		params->debug = 0;
+		params->velBias = 0.5f;
+		params->weightDesVel = 2.f;
+		params->weightCurVel = 0.75f;
+		params->weightSide = 0.75f;
+		params->weightToi = 2.5f;
+		params->horizTime = 2.5f;
+		params->gridSize = 33;
+		params->adaptiveDivs = 7;
+		params->adaptiveRings = 2;
+		params->adaptiveDepth = 5;
+	}
+
+	crowd->updateEnvironment();
+}
+
+TEST_CASE("DetourBehaviorsTests/CollisionAvoidance", "A collision avoidance instance must be usable by several threads at once")
+{
+	const unsigned nbAgents = 16;
+	const unsigned nbThreads = 4;
+
+	TestScene ts;
+	dtCrowd* crowd = ts.createSquareScene(nbAgents, 0.5f);
+	REQUIRE(crowd != 0);
+
+	dtCollisionAvoidance* ca = dtCollisionAvoidance::allocate(nbAgents);
+	REQUIRE(ca != 0);
+
+	setUpCollisionAvoidance(ts, crowd, ca, nbAgents);
+	const dtCrowdQuery& query = *crowd->getCrowdQuery();
+
+	// Reference velocities, computed serially
+	std::vector<dtCrowdAgent> expected(nbAgents);
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		expected[i] = *crowd->getAgent(i);
+		ca->update(query, *crowd->getAgent(i), expected[i], 0.1f);
+	}
+
+	std::vector<unsigned> mismatches(nbThreads, 0);
+	std::vector<std::thread> threads;
+
+	for (unsigned t = 0; t < nbThreads; ++t)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			for (unsigned iter = 0; iter < 50; ++iter)
+			{
+				for (unsigned i = t; i < nbAgents; i += nbThreads)
+				{
+					dtCrowdAgent result = *crowd->getAgent(i);
+					ca->update(query, *crowd->getAgent(i), result, 0.1f);
+
+					if (!dtVequal(result.desiredVelocity, expected[i].desiredVelocity))
+						++mismatches[t];
+				}
+			}
+		}));
+	}
+
+	for (unsigned t = 0; t < nbThreads; ++t)
+		threads[t].join();
+
+	for (unsigned t = 0; t < nbThreads; ++t)
+		CHECK(mismatches[t] == 0);
+
+	// The neighbors were actually avoided
+	unsigned nbAvoiding = 0;
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		if (!dtVequal(expected[i].desiredVelocity, crowd->getAgent(i)->desiredVelocity))
+			++nbAvoiding;
+	}
+	CHECK(nbAvoiding > 0);
+
+	dtCollisionAvoidance::free(ca);
+}
+
+TEST_CASE("DetourBehaviorsTests/VectorizedCollisionAvoidance", "Scoring the velocity samples four at a time must give the same velocities")
+{
+	const unsigned nbAgents = 16;
+
+	TestScene ts;
+	dtCrowd* crowd = ts.createSquareScene(nbAgents, 0.5f);
+	REQUIRE(crowd != 0);
+
+	dtCollisionAvoidance* ca = dtCollisionAvoidance::allocate(nbAgents);
+	REQUIRE(ca != 0);
+	CHECK(ca->isVectorizedSampling());
+
+	setUpCollisionAvoidance(ts, crowd, ca, nbAgents);
+	const dtCrowdQuery& query = *crowd->getCrowdQuery();
+
+	unsigned nbAvoiding = 0;
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		dtCrowdAgent vectorized = *crowd->getAgent(i);
+		dtCrowdAgent scalar = *crowd->getAgent(i);
+
+		ca->setVectorizedSampling(true);
+		ca->update(query, *crowd->getAgent(i), vectorized, 0.1f);
+
+		ca->setVectorizedSampling(false);
+		ca->update(query, *crowd->getAgent(i), scalar, 0.1f);
+
+		CHECK(dtVdist(vectorized.desiredVelocity, scalar.desiredVelocity) < 1e-5f);
+
+		if (!dtVequal(scalar.desiredVelocity, crowd->getAgent(i)->desiredVelocity))
+			++nbAvoiding;
+	}
+
+	CHECK(nbAvoiding > 0);
+
+	dtCollisionAvoidance::free(ca);
+}
+
+TEST_CASE("DetourBehaviorsTests/CollisionAvoidanceLimits", "Rejected obstacle limits must leave the collision avoidance unchanged")
+{
+	const unsigned nbAgents = 16;
+
+	TestScene ts;
+	dtCrowd* crowd = ts.createSquareScene(nbAgents, 0.5f);
+	REQUIRE(crowd != 0);
+
+	dtCollisionAvoidance* ca = dtCollisionAvoidance::allocate(nbAgents);
+	REQUIRE(ca != 0);
+
+	setUpCollisionAvoidance(ts, crowd, ca, nbAgents);
+	const dtCrowdQuery& query = *crowd->getCrowdQuery();
+
+	std::vector<dtCrowdAgent> expected(nbAgents);
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		expected[i] = *crowd->getAgent(i);
+		ca->update(query, *crowd->getAgent(i), expected[i], 0.1f);
+	}
+
+	CHECK(!ca->init(DT_MAX_AVOIDANCE_CIRCLES + 1, 8));
+	CHECK(!ca->init(6, DT_MAX_AVOIDANCE_SEGMENTS + 1));
+
+	unsigned nbAvoiding = 0;
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		dtCrowdAgent result = *crowd->getAgent(i);
+		ca->update(query, *crowd->getAgent(i), result, 0.1f);
+
+		CHECK(dtVequal(result.desiredVelocity, expected[i].desiredVelocity));
+
+		if (!dtVequal(result.desiredVelocity, crowd->getAgent(i)->desiredVelocity))
+			++nbAvoiding;
+	}
+
+	CHECK(nbAvoiding > 0);
+	CHECK(ca->init(DT_MAX_AVOIDANCE_CIRCLES, DT_MAX_AVOIDANCE_SEGMENTS));
+
+	dtCollisionAvoidance::free(ca);
+}
+
+/// Worker pool running the shares of a task one after the other
+class SerialWorkerPool : public dtCrowdWorkerPool
+{
+public:
+	virtual void run(dtCrowdTask& task, unsigned nbWorkers)
+	{
+		for (unsigned i = 0; i < nbWorkers; ++i)
+			task.execute(i);
+	}
+};
+
+TEST_CASE("DetourBehaviorsTests/CrowdStats", "The statistics must measure the updates of the crowd, whatever the number of workers")
+{
+	const unsigned nbAgents = 16;
+
+	TestScene scenes[2];
+	dtCrowd* crowds[2];
+	dtCollisionAvoidance* ca = dtCollisionAvoidance::allocate(nbAgents);
+	SerialWorkerPool pool;
+
+	REQUIRE(ca != 0);
+	REQUIRE(ca->init());
+
+	for (int c = 0; c < 2; ++c)
+	{
+		crowds[c] = scenes[c].createSquareScene(nbAgents, 0.5f);
+		REQUIRE(crowds[c] != 0);
+
+		setUpCollisionAvoidance(scenes[c], crowds[c], ca, nbAgents);
+
+		for (unsigned i = 0; i < nbAgents; ++i)
+			crowds[c]->setAgentBehavior(i, ca);
+
+		// Disabled by default
+		CHECK(!crowds[c]->isStatsEnabled());
+		CHECK(crowds[c]->getStats() == 0);
+		CHECK(crowds[c]->getCrowdQuery()->getStats() == 0);
+	}
+
+	REQUIRE(crowds[1]->setWorkerPool(&pool, 3));
+
+	const float farPos[] = {15.f, 0, 15.f};
+
+	for (int c = 0; c < 2; ++c)
+	{
+		REQUIRE(crowds[c]->updateAgentPosition(0, farPos));
+		crowds[c]->setStatsEnabled(true);
+		REQUIRE(crowds[c]->getStats() != 0);
+		CHECK(crowds[c]->getCrowdQuery()->getStats() != 0);
+	}
+
+	for (unsigned frame = 0; frame < 10; ++frame)
+	{
+		crowds[0]->update(0.1f);
+		crowds[1]->update(0.1f);
+
+		const dtCrowdStats* serial = crowds[0]->getStats();
+		const dtCrowdStats* parallel = crowds[1]->getStats();
+
+		// The counters only cover the last update, and do not depend on the number of workers
+		CHECK(serial->nearestPolyQueries == parallel->nearestPolyQueries);
+		CHECK(serial->moveAlongSurfaceQueries == nbAgents);
+		CHECK(parallel->moveAlongSurfaceQueries == nbAgents);
+		CHECK(serial->boundaryUpdates == parallel->boundaryUpdates);
+		CHECK(serial->neighborCandidates == parallel->neighborCandidates);
+		CHECK(serial->neighborCandidates >= nbAgents);
+		CHECK(serial->avoidanceSamples == parallel->avoidanceSamples);
+		CHECK(serial->avoidanceSamples > 0);
+		CHECK(serial->pathQueueIterations == 0);
+
+		CHECK(serial->nearestPolyQueries >= serial->boundaryUpdates);
+
+		// The boundary of the teleported agent is rebuilt
+		if (frame == 0)
+			CHECK(serial->boundaryUpdates >= 1);
+
+		// Every agent uses the same behavior
+		for (int c = 0; c < 2; ++c)
+		{
+			const dtCrowdStats* stats = crowds[c]->getStats();
+
+			REQUIRE(stats->nbBehaviors == 1);
+			CHECK(stats->behaviors[0].behavior == ca);
+			CHECK(stats->behaviors[0].nbAgents == nbAgents);
+			CHECK(stats->behaviors[0].time >= 0.f);
+			CHECK(stats->behaviors[0].time <= stats->velocityTime);
+			CHECK(stats->environmentTime >= 0.f);
+			CHECK(stats->positionTime >= 0.f);
+		}
+	}
+
+	// The phases called separately accumulate
+	crowds[0]->resetStats();
+	crowds[0]->updatePosition(0.1f);
+	crowds[0]->updatePosition(0.1f);
+	CHECK(crowds[0]->getStats()->moveAlongSurfaceQueries == 2 * nbAgents);
+	CHECK(crowds[0]->getStats()->nbBehaviors == 0);
+
+	crowds[0]->setStatsEnabled(false);
+	CHECK(crowds[0]->getStats() == 0);
+	CHECK(crowds[0]->getCrowdQuery()->getStats() == 0);
+
+	dtCollisionAvoidance::free(ca);
+}
+
+TEST_CASE("DetourBehaviorsTests/FlockGroup", "The members of a flock group must behave as if they flocked with every other member")
+{
+	const unsigned nbAgents = 6;
+
+	TestScene ts;
+	dtCrowd* crowd = ts.createSquareScene(nbAgents, 0.5f);
+	REQUIRE(crowd != 0);
+
+	unsigned ids[nbAgents];
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		float pos[] = {-5.f + 2.f * i, 0, (i % 2) ? 1.f : -1.f};
+		dtCrowdAgent ag;
+
+		REQUIRE(crowd->addAgent(ag, pos));
+		ts.defaultInitializeAgent(*crowd, ag.id);
+
+		crowd->fetchAgent(ag, ag.id);
+		dtVset(ag.velocity, 0.1f * i, 0, 0.3f - 0.1f * i);
+		REQUIRE(crowd->applyAgent(ag));
+
+		ids[nbAgents - 1 - i] = ag.id;
+	}
+
+	// The last agent is not a member of the group
+	dtFlockGroup* group = dtFlockGroup::allocate();
+	REQUIRE(group != 0);
+	REQUIRE(group->setMembers(ids + 1, nbAgents - 1));
+
+	CHECK(group->getMemberCount() == nbAgents - 1);
+	CHECK(group->isMember(0));
+	CHECK(group->isMember(4));
+	CHECK_FALSE(group->isMember(5));
+
+	crowd->updateEnvironment();
+	const dtCrowdQuery& query = *crowd->getCrowdQuery();
+
+	dtCohesionBehavior* cohesion = dtCohesionBehavior::allocate(nbAgents);
+	dtAlignmentBehavior* alignment = dtAlignmentBehavior::allocate(nbAgents);
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		const dtCrowdAgent& ag = *crowd->getAgent(i);
+
+		// The targets are the other members of the group
+		std::vector<unsigned> others;
+		for (unsigned j = 0; j < nbAgents - 1; ++j)
+			if (j != i)
+				others.push_back(j);
+
+		dtCohesionBehaviorParams cohesionParams = {others.data(), (unsigned) others.size(), 0};
+		dtCohesionBehaviorParams groupCohesionParams = {0, 0, group};
+		float cohesionForce[] = {0, 0, 0};
+		float groupCohesionForce[] = {0, 0, 0};
+
+		cohesion->computeForce(query, ag, cohesionForce, cohesionParams, cohesionParams);
+		cohesion->computeForce(query, ag, groupCohesionForce, groupCohesionParams, groupCohesionParams);
+
+		CHECK(dtVdist(cohesionForce, groupCohesionForce) < 0.0001f);
+
+		dtAlignmentBehaviorParams alignmentParams = {others.data(), (unsigned) others.size(), 0};
+		dtAlignmentBehaviorParams groupAlignmentParams = {0, 0, group};
+		float alignmentForce[] = {0, 0, 0};
+		float groupAlignmentForce[] = {0, 0, 0};
+
+		alignment->computeForce(query, ag, alignmentForce, alignmentParams, alignmentParams);
+		alignment->computeForce(query, ag, groupAlignmentForce, groupAlignmentParams, groupAlignmentParams);
+
+		CHECK(dtVdist(alignmentForce, groupAlignmentForce) < 0.0001f);
+	}
+
+	SECTION("The aggregates follow the agents from one update to the next")
+	{
+		float center[3];
+		REQUIRE(group->getCenter(query, *crowd->getAgent(nbAgents - 1), center));
+		CHECK(fabsf(center[0] - (-1.f)) < 0.0001f);
+
+		float pos[] = {10.f, 0, 0};
+		REQUIRE(crowd->updateAgentPosition(0, pos));
+
+		// The aggregates are computed once per update of the crowd
+		crowd->updateVelocity(0.1f);
+
+		REQUIRE(group->getCenter(query, *crowd->getAgent(nbAgents - 1), center));
+		CHECK(fabsf(center[0] - 2.f) < 0.0001f);
+	}
+
+	SECTION("Agents of a flocking group stick together")
+	{
+		dtFlockingBehavior* flocking = dtFlockingBehavior::allocate(nbAgents, 1.f, 1.f, 1.f, 1.f);
+
+		for (unsigned i = 0; i < nbAgents - 1; ++i)
+		{
+			dtFlockingBehaviorParams* params = flocking->getBehaviorParams(i);
+			REQUIRE(params != 0);
+			params->group = group;
+			crowd->setAgentBehavior(i, flocking);
+		}
+
+		const float initialSpread = dtVdist2D(crowd->getAgent(0)->position, crowd->getAgent(nbAgents - 2)->position);
+
+		for (int frame = 0; frame < 20; ++frame)
+			crowd->update(0.1f);
+
+		const float spread = dtVdist2D(crowd->getAgent(0)->position, crowd->getAgent(nbAgents - 2)->position);
+		CHECK(spread < initialSpread);
+
+		// The members never overlap
+		for (unsigned i = 0; i < nbAgents - 1; ++i)
+			for (unsigned j = i + 1; j < nbAgents - 1; ++j)
+				CHECK(dtVdist2D(crowd->getAgent(i)->position, crowd->getAgent(j)->position) > 0.5f);
+
+		for (unsigned i = 0; i < nbAgents; ++i)
+			crowd->setAgentBehavior(i, 0);
+
+		dtFlockingBehavior::free(flocking);
+	}
+
+	dtCohesionBehavior::free(cohesion);
+	dtAlignmentBehavior::free(alignment);
+	dtFlockGroup::free(group);
+}
+
+static unsigned groupForceAllocations = 0;
+
+static void* countingGroupAlloc(int size, dtAllocHint)
+{
+	++groupForceAllocations;
+	return malloc(size);
+}
+
+TEST_CASE("DetourBehaviorsTests/FlockGroupNeighbors", "The separation of the members of a group must not allocate, whatever the number of neighbors")
+{
+	const unsigned nbAgents = 10;
+	const unsigned maxNeighbors = 16;
+
+	TestScene ts;
+	dtCrowd* crowd = ts.createSquareScene(nbAgents, 0.5f);
+	REQUIRE(crowd != 0);
+	REQUIRE(crowd->init(nbAgents, 0.5f, ts.getNavMesh(), maxNeighbors));
+
+	unsigned ids[nbAgents];
+
+	// The agents are close enough to be separated from every other one
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		float pos[] = {cosf(i * 0.628f), 0, sinf(i * 0.628f)};
+		dtCrowdAgent ag;
+
+		REQUIRE(crowd->addAgent(ag, pos));
+		ts.defaultInitializeAgent(*crowd, ag.id);
+
+		crowd->fetchAgent(ag, ag.id);
+		dtVset(ag.velocity, 0.1f * i, 0, 0.5f - 0.1f * i);
+		REQUIRE(crowd->applyAgent(ag));
+
+		ids[i] = ag.id;
+	}
+
+	crowd->updateEnvironment();
+	const dtCrowdQuery& query = *crowd->getCrowdQuery();
+
+	dtFlockGroup* group = dtFlockGroup::allocate();
+	REQUIRE(group != 0);
+	REQUIRE(group->setMembers(ids, nbAgents));
+
+	dtFlockingBehavior* flocking = dtFlockingBehavior::allocate(nbAgents, 1.f, 1.f, 1.f, 1.f);
+	REQUIRE(flocking != 0);
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		const dtCrowdAgent& ag = *crowd->getAgent(i);
+		REQUIRE(crowd->getAgentEnvironment(i)->nbNeighbors == nbAgents - 1);
+
+		std::vector<unsigned> others;
+		for (unsigned j = 0; j < nbAgents; ++j)
+			if (j != i)
+				others.push_back(j);
+
+		dtFlockingBehaviorParams params = {others.data(), (unsigned) others.size(), 0};
+		dtFlockingBehaviorParams groupParams = {0, 0, group};
+		float force[] = {0, 0, 0};
+		float groupForce[] = {0, 0, 0};
+
+		flocking->computeForce(query, ag, force, params, params);
+
+		groupForceAllocations = 0;
+		dtAllocSetCustom(countingGroupAlloc, 0);
+		flocking->computeForce(query, ag, groupForce, groupParams, groupParams);
+		dtAllocSetCustom(0, 0);
+
+		CHECK(groupForceAllocations == 0);
+		CHECK(dtVdist(force, groupForce) < 0.0001f);
+	}
+
+	dtFlockingBehavior::free(flocking);
+	dtFlockGroup::free(group);
+}
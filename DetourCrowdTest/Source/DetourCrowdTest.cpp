@@ -19,8 +19,21 @@
 #include "DetourCrowdTestUtils.h"
 
 #include "DetourAlignmentBehavior.h"
+#include "DetourGoToBehavior.h"
 #include "DetourPathFollowing.h"
+#include "DetourPipelineBehavior.h"
 #include "DetourSeekBehavior.h"
+#include "DetourAlloc.h"
+#include "DetourCommon.h"
+#include "DetourNavMeshBuilder.h"
+#include "DetourNode.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
 
 
 #define CATCH_CONFIG_MAIN // Generate automatically the main (one occurrence only)
@@ -415,6 +428,1894 @@ TEST_CASE("DetourCrowdTest/UpdateCrowd", "Test the different ways to update the
 	dtPathFollowing::free(pf1);
 }
 
+TEST_CASE("DetourCrowdTest/ProximityGrid", "The neighbors found through the proximity grid must be the same as the ones found by testing every agent")
+{
+	SECTION("Grid queries", "Items are found in the cells overlapping the query area")
+	{
+		dtProximityGrid grid;
+		REQUIRE(grid.init(10, 1.f));
+
+		CHECK(grid.addItem(0, 0.5f, 0.5f));
+		CHECK(grid.addItem(1, 0.7f, 0.2f));
+		CHECK(grid.addItem(2, -3.5f, 0.5f));
+		CHECK(grid.addItem(3, 10.5f, 10.5f));
+
+		CHECK(grid.getItemCount() == 4);
+		CHECK(grid.getItemCountAt(0.1f, 0.1f) == 2);
+		CHECK(grid.getItemCountAt(-3.1f, 0.9f) == 1);
+		CHECK(grid.getItemCountAt(5.f, 5.f) == 0);
+
+		unsigned ids[10];
+		CHECK(grid.queryItems(-0.5f, -0.5f, 0.5f, 0.5f, ids, 10) == 2);
+		CHECK(grid.queryItems(-4.f, -4.f, 4.f, 4.f, ids, 10) == 3);
+		CHECK(grid.queryItems(-100.f, -100.f, 100.f, 100.f, ids, 10) == 4);
+		CHECK(grid.queryItems(-100.f, -100.f, 100.f, 100.f, ids, 2) == 2);
+		CHECK(grid.queryItems(5.f, 5.f, 6.f, 6.f, ids, 10) == 0);
+
+		grid.clear();
+		CHECK(grid.getItemCount() == 0);
+		CHECK(grid.queryItems(-100.f, -100.f, 100.f, 100.f, ids, 10) == 0);
+	}
+
+	SECTION("Crowd neighbors", "Comparing the neighbors of the agents with a brute force search, whatever their maximum number")
+	{
+		const unsigned nbAgents = 100;
+		const unsigned maxNeighbors[] = {1, DT_CROWDAGENT_MAX_NEIGHBOURS, 32};
+
+		TestScene ts;
+		dtCrowd* crowd = ts.createSquareScene(nbAgents, 0.5f);
+
+		REQUIRE(crowd != 0);
+		REQUIRE(crowd->getCrowdQuery()->getProximityGrid() != 0);
+		CHECK(crowd->getMaxNeighbors() == (unsigned) DT_CROWDAGENT_MAX_NEIGHBOURS);
+		CHECK(!crowd->init(nbAgents, 0.5f, ts.getNavMesh(), 0));
+
+		for (unsigned k = 0; k < sizeof(maxNeighbors) / sizeof(maxNeighbors[0]); ++k)
+		{
+			REQUIRE(crowd->init(nbAgents, 0.5f, ts.getNavMesh(), maxNeighbors[k]));
+			CHECK(crowd->getMaxNeighbors() == maxNeighbors[k]);
+
+			unsigned seed = 42;
+			for (unsigned i = 0; i < nbAgents; ++i)
+			{
+				seed = seed * 1103515245 + 12345;
+				const float x = (float) ((seed >> 8) % 2000) / 100.f - 10.f;
+				seed = seed * 1103515245 + 12345;
+				const float z = (float) ((seed >> 8) % 2000) / 100.f - 10.f;
+
+				float pos[] = {x, 0, z};
+				dtCrowdAgent ag;
+				REQUIRE(crowd->addAgent(ag, pos));
+				ts.defaultInitializeAgent(*crowd, ag.id);
+			}
+
+			crowd->updateEnvironment();
+
+			CHECK(crowd->getCrowdQuery()->getProximityGrid()->getItemCount() == (int) nbAgents);
+
+			for (unsigned i = 0; i < nbAgents; ++i)
+			{
+				const dtCrowdAgent* ag = crowd->getAgent(i);
+				const dtCrowdAgentEnvironment* env = crowd->getAgentEnvironment(i);
+
+				// Brute force search, the closest agents are selected
+				std::vector<std::pair<float, unsigned> > expected;
+				for (unsigned j = 0; j < nbAgents; ++j)
+				{
+					const dtCrowdAgent* other = crowd->getAgent(j);
+					if (j == i)
+						continue;
+
+					const float dist = dtSqr(ag->position[0] - other->position[0]) + dtSqr(ag->position[2] - other->position[2]);
+					if (dist <= dtSqr(ag->perceptionDistance))
+						expected.push_back(std::make_pair(dist, j));
+				}
+
+				std::sort(expected.begin(), expected.end());
+
+				const unsigned nbExpected = dtMin((unsigned) expected.size(), maxNeighbors[k]);
+				REQUIRE(env->nbNeighbors == nbExpected);
+
+				for (unsigned j = 0; j < nbExpected; ++j)
+					CHECK(env->neighbors[j].idx == expected[j].second);
+			}
+		}
+	}
+}
+
+static unsigned countedAllocations = 0;
+
+static void* countingAlloc(int size, dtAllocHint)
+{
+	++countedAllocations;
+	return malloc(size);
+}
+
+/// Worker pool running the shares of a task in reverse order, 
+/// in order to check the results do not depend on the order of execution.
+class ReverseWorkerPool : public dtCrowdWorkerPool
+{
+public:
+	ReverseWorkerPool() : nbRuns(0) {}
+
+	virtual void run(dtCrowdTask& task, unsigned nbWorkers)
+	{
+		++nbRuns;
+
+		for (unsigned i = nbWorkers; i > 0; --i)
+			task.execute(i - 1);
+	}
+
+	unsigned nbRuns;
+};
+
+/// Worker pool running every share of a task on its own thread.
+class ThreadWorkerPool : public dtCrowdWorkerPool
+{
+public:
+	ThreadWorkerPool() : nbRuns(0) {}
+
+	virtual void run(dtCrowdTask& task, unsigned nbWorkers)
+	{
+		++nbRuns;
+
+		std::vector<std::thread> threads;
+		for (unsigned i = 1; i < nbWorkers; ++i)
+			threads.push_back(std::thread([&task, i]() { task.execute(i); }));
+
+		task.execute(0);
+
+		for (size_t i = 0; i < threads.size(); ++i)
+			threads[i].join();
+	}
+
+	unsigned nbRuns;
+};
+
+/// Checks a crowd updated by the given pool moves its agents like a crowd updated serially.
+static void checkParallelUpdate(dtCrowdWorkerPool& pool, const unsigned& nbRuns)
+{
+	const unsigned nbAgents = 30;
+
+	TestScene serialScene;
+	TestScene parallelScene;
+	dtCrowd* serialCrowd = serialScene.createSquareScene(nbAgents, 0.5f);
+	dtCrowd* parallelCrowd = parallelScene.createSquareScene(nbAgents, 0.5f);
+
+	REQUIRE(serialCrowd != 0);
+	REQUIRE(parallelCrowd != 0);
+
+	REQUIRE(parallelCrowd->setWorkerPool(&pool, 4));
+	CHECK(parallelCrowd->getWorkerCount() == 4);
+	CHECK(serialCrowd->getWorkerCount() == 1);
+
+	float target[] = {0, 0, 0};
+	dtArriveBehavior* arrive = dtArriveBehavior::allocate(nbAgents);
+
+	dtCrowd* crowds[] = {serialCrowd, parallelCrowd};
+	TestScene* scenes[] = {&serialScene, &parallelScene};
+
+	for (unsigned c = 0; c < 2; ++c)
+	{
+		for (unsigned i = 0; i < nbAgents; ++i)
+		{
+			// Agents are placed on a circle around the target, so they collide when reaching it
+			float pos[] = {10.f * cosf(i * 0.2f), 0, 10.f * sinf(i * 0.2f)};
+			dtCrowdAgent ag;
+
+			REQUIRE(crowds[c]->addAgent(ag, pos));
+			scenes[c]->defaultInitializeAgent(*crowds[c], ag.id);
+			crowds[c]->setAgentBehavior(ag.id, arrive);
+
+			dtArriveBehaviorParams* params = arrive->getBehaviorParams(ag.id);
+			params->target = target;
+			params->distance = 0.f;
+		}
+	}
+
+	for (unsigned frame = 0; frame < 100; ++frame)
+	{
+		serialCrowd->update(0.1f);
+		parallelCrowd->update(0.1f);
+	}
+
+	CHECK(nbRuns > 0);
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		CHECK(dtVequal(serialCrowd->getAgent(i)->position, parallelCrowd->getAgent(i)->position));
+		CHECK(dtVequal(serialCrowd->getAgent(i)->velocity, parallelCrowd->getAgent(i)->velocity));
+		CHECK(serialCrowd->getAgentEnvironment(i)->nbNeighbors == parallelCrowd->getAgentEnvironment(i)->nbNeighbors);
+	}
+
+	// Back to a serial update
+	REQUIRE(parallelCrowd->setWorkerPool(0, 4));
+	CHECK(parallelCrowd->getWorkerCount() == 1);
+
+	dtArriveBehavior::free(arrive);
+}
+
+TEST_CASE("DetourCrowdTest/ParallelUpdate", "The results of an update must not depend on the number of workers")
+{
+	SECTION("Order", "The shares of the steps may be executed in any order")
+	{
+		ReverseWorkerPool pool;
+		checkParallelUpdate(pool, pool.nbRuns);
+	}
+
+	SECTION("Threads", "The shares of the steps may be executed concurrently")
+	{
+		ThreadWorkerPool pool;
+		checkParallelUpdate(pool, pool.nbRuns);
+	}
+}
+
+static unsigned failingAllocationIndex = 0;
+
+/// Allocator failing only the allocation of index failingAllocationIndex.
+static void* failingAlloc(int size, dtAllocHint)
+{
+	if (countedAllocations++ == failingAllocationIndex)
+		return 0;
+
+	return malloc(size);
+}
+
+TEST_CASE("DetourCrowdTest/WorkerPoolFailure", "A crowd whose workers could not be allocated must fall back to a serial update")
+{
+	const unsigned nbAgents = 10;
+
+	ReverseWorkerPool pool;
+	bool succeeded = false;
+
+	for (failingAllocationIndex = 0; !succeeded; ++failingAllocationIndex)
+	{
+		TestScene scene;
+		dtCrowd* crowd = scene.createSquareScene(nbAgents, 0.5f);
+		REQUIRE(crowd != 0);
+		crowd->setStatsEnabled(true);
+
+		for (unsigned i = 0; i < nbAgents; ++i)
+		{
+			float pos[] = {(float) i - 5.f, 0, 0};
+			dtCrowdAgent ag;
+			REQUIRE(crowd->addAgent(ag, pos));
+			scene.defaultInitializeAgent(*crowd, ag.id);
+			ag.velocity[2] = 1.f;
+			ag.desiredVelocity[2] = 1.f;
+			crowd->applyAgent(ag);
+		}
+
+		countedAllocations = 0;
+		dtAllocSetCustom(failingAlloc, 0);
+		succeeded = crowd->setWorkerPool(&pool, 4);
+		dtAllocSetCustom(0, 0);
+
+		if (!succeeded)
+		{
+			CHECK(crowd->getWorkerCount() == 1);
+			CHECK(crowd->getStats() != 0);
+		}
+
+		// Whatever allocation failed, the crowd can still be updated
+		const float z = crowd->getAgent(0)->position[2];
+		for (unsigned frame = 0; frame < 5; ++frame)
+			crowd->update(0.1f);
+
+		CHECK(crowd->getAgent(0)->position[2] > z);
+	}
+
+	CHECK(failingAllocationIndex > 1);
+}
+
+TEST_CASE("DetourCrowdTest/Kinematics", "The structure of arrays update must give the same results as the update of the agents")
+{
+	// Not a multiple of 4, so the scalar code handling the remaining lanes is used too
+	const unsigned nbAgents = 31;
+
+	TestScene scenes[2];
+	dtCrowd* crowds[2];
+	dtArriveBehavior* arrive = dtArriveBehavior::allocate(nbAgents);
+	float target[] = {0, 0, 0};
+
+	for (unsigned c = 0; c < 2; ++c)
+	{
+		crowds[c] = scenes[c].createSquareScene(nbAgents, 0.5f);
+		REQUIRE(crowds[c] != 0);
+		CHECK(crowds[c]->isKinematicsEnabled());
+
+		for (unsigned i = 0; i < nbAgents; ++i)
+		{
+			// The first two agents are on top of each other
+			const float angle = (i < 2) ? 0.f : i * 0.2f;
+			float pos[] = {10.f * cosf(angle), 0, 10.f * sinf(angle)};
+			dtCrowdAgent ag;
+
+			REQUIRE(crowds[c]->addAgent(ag, pos));
+			scenes[c].defaultInitializeAgent(*crowds[c], ag.id);
+			crowds[c]->setAgentBehavior(ag.id, arrive);
+
+			dtArriveBehaviorParams* params = arrive->getBehaviorParams(ag.id);
+			params->target = target;
+			params->distance = 0.f;
+		}
+	}
+
+	crowds[1]->setKinematicsEnabled(false);
+	CHECK(!crowds[1]->isKinematicsEnabled());
+
+	// Only some of the agents are updated, the others are read from the crowd
+	unsigned someAgents[] = {0, 1, 5, 6, 7, 8, 9, 20, 30};
+	const unsigned nbSomeAgents = sizeof(someAgents) / sizeof(someAgents[0]);
+
+	for (unsigned frame = 0; frame < 100; ++frame)
+	{
+		for (unsigned c = 0; c < 2; ++c)
+		{
+			if (frame % 3 == 0)
+				crowds[c]->update(0.1f, someAgents, nbSomeAgents);
+			else
+				crowds[c]->update(0.1f);
+		}
+	}
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		const dtCrowdAgent* soa = crowds[0]->getAgent(i);
+		const dtCrowdAgent* aos = crowds[1]->getAgent(i);
+
+		CHECK(memcmp(soa->position, aos->position, sizeof(soa->position)) == 0);
+		CHECK(memcmp(soa->velocity, aos->velocity, sizeof(soa->velocity)) == 0);
+	}
+
+	// The agents must have moved toward the target and pushed each other
+	CHECK(dtVdist2D(crowds[0]->getAgent(0)->position, crowds[0]->getAgent(1)->position) > 0.5f);
+	CHECK(dtVdist2D(crowds[0]->getAgent(10)->position, target) < 5.f);
+
+	dtArriveBehavior::free(arrive);
+}
+
+/// Behavior copying the desired velocity of the next agent, then accelerating along the x axis.
+class FollowNextBehavior : public dtBehavior
+{
+public:
+	FollowNextBehavior(unsigned nbAgents) : m_nbAgents(nbAgents) {}
+
+	virtual void update(const dtCrowdQuery& query, const dtCrowdAgent& oldAgent, dtCrowdAgent& newAgent, float /*dt*/)
+	{
+		const dtCrowdAgent* next = query.getAgent((oldAgent.id + 1) % m_nbAgents);
+
+		dtVcopy(newAgent.desiredVelocity, next->desiredVelocity);
+		newAgent.desiredVelocity[0] += 0.1f * (oldAgent.id + 1);
+	}
+
+private:
+	unsigned m_nbAgents;
+};
+
+TEST_CASE("DetourCrowdTest/UpdateOrder", "The behaviors must not depend on the order in which the agents are updated")
+{
+	TestScene scenes[2];
+	dtCrowd* crowds[2];
+	unsigned forward[] = {0, 1, 2};
+	unsigned backward[] = {2, 1, 0};
+	unsigned* orders[] = {forward, backward};
+
+	FollowNextBehavior follow(3);
+
+	for (unsigned c = 0; c < 2; ++c)
+	{
+		crowds[c] = scenes[c].createSquareScene(3, 0.5f);
+		REQUIRE(crowds[c] != 0);
+
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			float pos[] = {(float) i * 2.f, 0, 0};
+			dtCrowdAgent ag;
+
+			REQUIRE(crowds[c]->addAgent(ag, pos));
+			scenes[c].defaultInitializeAgent(*crowds[c], ag.id);
+			crowds[c]->setAgentBehavior(ag.id, &follow);
+		}
+	}
+
+	for (unsigned frame = 0; frame < 5; ++frame)
+		for (unsigned c = 0; c < 2; ++c)
+			crowds[c]->updateVelocity(0.1f, orders[c], 3);
+
+	for (unsigned i = 0; i < 3; ++i)
+	{
+		CHECK(crowds[0]->getAgent(i)->desiredVelocity[0] == crowds[1]->getAgent(i)->desiredVelocity[0]);
+		CHECK(crowds[0]->getAgent(i)->velocity[0] == crowds[1]->getAgent(i)->velocity[0]);
+	}
+
+	// Every agent uses the desired velocity the next agent had before the update: 0.1, 0.3, 0.6, 0.7, 0.9
+	CHECK(fabsf(crowds[0]->getAgent(0)->desiredVelocity[0] - 0.9f) < 0.0001f);
+}
+
+/// Behavior recording the batches it is given
+class BatchRecordingBehavior : public dtBehavior
+{
+public:
+	virtual void update(const dtCrowdQuery&, const dtCrowdAgent&, dtCrowdAgent& newAgent, float)
+	{
+		newAgent.desiredVelocity[0] += 1.f;
+	}
+
+	virtual void updateBatch(const dtCrowdQuery& query, const dtCrowdAgent* oldAgents, dtCrowdAgent* newAgents, 
+							 const unsigned* ids, unsigned nbIds, float dt)
+	{
+		batches.push_back(std::vector<unsigned>(ids, ids + nbIds));
+		dtBehavior::updateBatch(query, oldAgents, newAgents, ids, nbIds, dt);
+	}
+
+	std::vector<std::vector<unsigned> > batches;
+};
+
+TEST_CASE("DetourCrowdTest/BehaviorBatches", "The crowd must update the agents of a behavior in a single batch")
+{
+	TestScene scene;
+	dtCrowd* crowd = scene.createSquareScene(8, 0.5f);
+	REQUIRE(crowd != 0);
+
+	BatchRecordingBehavior even, odd;
+
+	for (unsigned i = 0; i < 8; ++i)
+	{
+		float pos[] = {-7.f + 2.f * i, 0, 0};
+		dtCrowdAgent ag;
+
+		REQUIRE(crowd->addAgent(ag, pos));
+		scene.defaultInitializeAgent(*crowd, ag.id);
+		crowd->setAgentBehavior(ag.id, (i % 2) ? (dtBehavior*) &odd : (dtBehavior*) &even);
+	}
+
+	// Agent 5 has no behavior
+	crowd->setAgentBehavior(5, 0);
+
+	crowd->updateVelocity(0.1f);
+
+	REQUIRE(even.batches.size() == 1);
+	REQUIRE(odd.batches.size() == 1);
+
+	const unsigned evenIds[] = {0, 2, 4, 6};
+	const unsigned oddIds[] = {1, 3, 7};
+
+	CHECK(even.batches[0] == std::vector<unsigned>(evenIds, evenIds + 4));
+	CHECK(odd.batches[0] == std::vector<unsigned>(oddIds, oddIds + 3));
+
+	// Every agent was updated once
+	for (unsigned i = 0; i < 8; ++i)
+		CHECK(crowd->getAgent(i)->desiredVelocity[0] == (i == 5 ? 0.f : 1.f));
+
+	SECTION("The batches keep the order of the agents given to the update")
+	{
+		unsigned idx[] = {6, 3, 5, 0, 1};
+		crowd->updateVelocity(0.1f, idx, 5);
+
+		REQUIRE(even.batches.size() == 2);
+		REQUIRE(odd.batches.size() == 2);
+
+		const unsigned evenOrder[] = {6, 0};
+		const unsigned oddOrder[] = {3, 1};
+
+		CHECK(even.batches[1] == std::vector<unsigned>(evenOrder, evenOrder + 2));
+		CHECK(odd.batches[1] == std::vector<unsigned>(oddOrder, oddOrder + 2));
+	}
+
+	SECTION("A pipeline updates its stages batch by batch")
+	{
+		dtPipelineBehavior pipeline;
+		dtBehavior* stages[] = {&even, &odd};
+		REQUIRE(pipeline.setBehaviors(stages, 2));
+
+		for (unsigned i = 0; i < 8; ++i)
+			crowd->setAgentBehavior(i, &pipeline);
+
+		crowd->updateVelocity(0.1f);
+
+		REQUIRE(even.batches.size() == 2);
+		REQUIRE(odd.batches.size() == 2);
+		CHECK(even.batches[1].size() == 8);
+		CHECK(odd.batches[1].size() == 8);
+
+		// Both stages were applied to every agent
+		for (unsigned i = 0; i < 8; ++i)
+			CHECK(crowd->getAgent(i)->desiredVelocity[0] == (i == 5 ? 2.f : 3.f));
+	}
+}
+
+TEST_CASE("DetourCrowdTest/ActiveAgents", "The crowd must keep the list of its active agents")
+{
+	TestScene scene;
+	dtCrowd* crowd = scene.createSquareScene(100, 0.5f);
+	REQUIRE(crowd != 0);
+
+	const dtCrowdAgent* agents[100];
+	CHECK(crowd->getActiveAgents(agents, 100) == 0);
+
+	for (unsigned i = 0; i < 5; ++i)
+	{
+		float pos[] = {-10.f + 4.f * i, 0, 0};
+		dtCrowdAgent ag;
+
+		REQUIRE(crowd->addAgent(ag, pos));
+		CHECK(ag.id == i);
+		scene.defaultInitializeAgent(*crowd, ag.id);
+	}
+
+	crowd->removeAgent(1);
+	crowd->removeAgent(3);
+	crowd->removeAgent(3);
+
+	// The active agents are sorted by id
+	REQUIRE(crowd->getActiveAgents(agents, 100) == 3);
+	CHECK(agents[0]->id == 0);
+	CHECK(agents[1]->id == 2);
+	CHECK(agents[2]->id == 4);
+	CHECK(crowd->getActiveAgents(agents, 2) == 2);
+
+	// The slots of the removed agents are reused
+	float pos[] = {0, 0, 5.f};
+	dtCrowdAgent ag;
+	REQUIRE(crowd->addAgent(ag, pos));
+	CHECK((ag.id == 1 || ag.id == 3));
+	scene.defaultInitializeAgent(*crowd, ag.id);
+
+	REQUIRE(crowd->getActiveAgents(agents, 100) == 4);
+	for (unsigned i = 1; i < 4; ++i)
+		CHECK(agents[i - 1]->id < agents[i]->id);
+
+	// Applying an inactive agent does not activate it
+	dtCrowdAgent removed;
+	crowd->fetchAgent(removed, ag.id == 1 ? 3 : 1);
+	removed.active = 1;
+	CHECK(crowd->applyAgent(removed));
+	CHECK(!crowd->getAgent(removed.id)->active);
+	CHECK(crowd->getActiveAgents(agents, 100) == 4);
+
+	// Only the active agents are updated
+	float removedPos[3];
+	dtVcopy(removedPos, crowd->getAgent(removed.id)->position);
+
+	dtCrowdAgent moving;
+	crowd->fetchAgent(moving, 0);
+	dtVset(moving.velocity, 1.f, 0, 0);
+	dtVset(moving.desiredVelocity, 1.f, 0, 0);
+	CHECK(crowd->applyAgent(moving));
+
+	crowd->fetchAgent(removed, removed.id);
+	dtVset(removed.velocity, 1.f, 0, 0);
+	dtVset(removed.desiredVelocity, 1.f, 0, 0);
+	CHECK(crowd->applyAgent(removed));
+
+	crowd->updatePosition(0.5f);
+
+	CHECK(crowd->getAgent(0)->position[0] > -10.f);
+	CHECK(dtVequal(crowd->getAgent(removed.id)->position, removedPos));
+}
+
+TEST_CASE("DetourCrowdTest/PositionUpdate", "The position update must not allocate memory and keep the agents on the navigation mesh")
+{
+	const unsigned nbAgents = 20;
+
+	TestScene scene;
+	dtCrowd* crowd = scene.createSquareScene(nbAgents, 0.5f);
+	REQUIRE(crowd != 0);
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		float pos[] = {10.f * cosf(i * 0.3f), 0, 10.f * sinf(i * 0.3f)};
+		dtCrowdAgent ag;
+
+		REQUIRE(crowd->addAgent(ag, pos));
+		scene.defaultInitializeAgent(*crowd, ag.id);
+
+		crowd->fetchAgent(ag, ag.id);
+		dtVset(ag.velocity, -pos[0] * 0.2f, 0, -pos[2] * 0.2f);
+		dtVcopy(ag.desiredVelocity, ag.velocity);
+		REQUIRE(crowd->applyAgent(ag));
+	}
+
+	crowd->updateEnvironment();
+
+	countedAllocations = 0;
+	dtAllocSetCustom(countingAlloc, 0);
+
+	for (unsigned frame = 0; frame < 20; ++frame)
+		crowd->updatePosition(0.1f);
+
+	dtAllocSetCustom(0, 0);
+	CHECK(countedAllocations == 0);
+
+	// The agents moved and are still on the navigation mesh
+	const dtNavMeshQuery* navQuery = crowd->getCrowdQuery()->getNavMeshQuery();
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		const dtCrowdAgent* ag = crowd->getAgent(i);
+		dtPolyRef ref = 0;
+		float nearest[3];
+
+		CHECK(dtVlen(ag->position) < 9.f);
+		navQuery->findNearestPoly(ag->position, crowd->getCrowdQuery()->getQueryExtents(), 
+								  crowd->getCrowdQuery()->getQueryFilter(), &ref, nearest);
+		CHECK(ref != 0);
+		CHECK(dtVdist2D(nearest, ag->position) < 0.001f);
+	}
+}
+
+TEST_CASE("DetourCrowdTest/WallSegmentCache", "The local boundaries built from the cached wall segments must be the same as the ones built from the navigation mesh")
+{
+	const unsigned nbAgents = 20;
+
+	TestScene scene;
+	dtCrowd* crowd = scene.createSquareScene(nbAgents, 0.5f);
+	REQUIRE(crowd != 0);
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		float pos[] = {8.f * cosf(i * 0.3f), 0, 8.f * sinf(i * 0.3f)};
+		dtCrowdAgent ag;
+
+		REQUIRE(crowd->addAgent(ag, pos));
+		scene.defaultInitializeAgent(*crowd, ag.id);
+	}
+
+	dtNavMeshQuery* navQuery = crowd->getCrowdQuery()->getNavMeshQuery();
+	const dtQueryFilter* filter = crowd->getCrowdQuery()->getQueryFilter();
+
+	std::vector<dtPolyRef> polys(nbAgents);
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		float nearest[3];
+		navQuery->findNearestPoly(crowd->getAgent(i)->position, crowd->getCrowdQuery()->getQueryExtents(), filter, &polys[i], nearest);
+		REQUIRE(polys[i] != 0);
+	}
+
+	dtWallSegmentCache cache;
+	REQUIRE(cache.init(64, 256));
+	cache.validate(navQuery->getAttachedNavMesh(), filter);
+
+	SECTION("Same boundaries", "The cache does not change the segments of the boundaries")
+	{
+		for (unsigned i = 0; i < nbAgents; ++i)
+		{
+			const dtCrowdAgent* ag = crowd->getAgent(i);
+			dtLocalBoundary cached, uncached;
+
+			cached.update(polys[i], ag->position, ag->perceptionDistance, navQuery, filter, &cache);
+			uncached.update(polys[i], ag->position, ag->perceptionDistance, navQuery, filter);
+
+			REQUIRE(cached.getSegmentCount() == uncached.getSegmentCount());
+
+			for (int j = 0; j < cached.getSegmentCount(); ++j)
+				CHECK(memcmp(cached.getSegment(j), uncached.getSegment(j), sizeof(float) * 6) == 0);
+		}
+
+		// The agents share their polygons, so most of the segments are read from the cache
+		CHECK(cache.getMissCount() == cache.getPolyCount());
+		CHECK(cache.getHitCount() > cache.getMissCount());
+	}
+
+	SECTION("Invalidation", "Changing the navigation mesh or the filter empties the cache")
+	{
+		const dtPolyRef ref = polys[0];
+		const float* segs = 0;
+
+		cache.getWallSegments(ref, navQuery, filter, &segs);
+		CHECK(cache.getPolyCount() == 1);
+
+		cache.validate(navQuery->getAttachedNavMesh(), filter);
+		CHECK(cache.getPolyCount() == 1);
+
+		unsigned short flags = 0;
+		dtNavMesh* navMesh = scene.getNavMesh();
+		REQUIRE(dtStatusSucceed(navMesh->getPolyFlags(ref, &flags)));
+		REQUIRE(dtStatusSucceed(navMesh->setPolyFlags(ref, flags)));
+
+		cache.validate(navMesh, filter);
+		CHECK(cache.getPolyCount() == 0);
+
+		cache.getWallSegments(ref, navQuery, filter, &segs);
+		CHECK(cache.getPolyCount() == 1);
+
+		dtQueryFilter other(*filter);
+		other.setExcludeFlags(other.getExcludeFlags() | 0x8000);
+
+		cache.validate(navMesh, &other);
+		CHECK(cache.getPolyCount() == 0);
+	}
+
+	SECTION("Crowd statistics", "The crowd reads the wall segments of the shared polygons once")
+	{
+		crowd->setStatsEnabled(true);
+		crowd->updateEnvironment();
+
+		const dtCrowdStats* stats = crowd->getStats();
+		CHECK(stats->boundaryUpdates == nbAgents);
+		CHECK(stats->wallSegmentQueries > 0);
+		CHECK(stats->wallSegmentQueries < stats->boundaryUpdates);
+	}
+}
+
+TEST_CASE("DetourCrowdTest/NearestPolyBatch", "A batch of nearest polygon queries must give the same results as the queries done one by one")
+{
+	TestScene scene;
+	dtCrowd* crowd = scene.createSquareScene(1, 0.5f);
+	REQUIRE(crowd != 0);
+
+	const dtNavMeshQuery* navQuery = crowd->getCrowdQuery()->getNavMeshQuery();
+	const dtQueryFilter* filter = crowd->getCrowdQuery()->getQueryFilter();
+	const float* extents = crowd->getCrowdQuery()->getQueryExtents();
+
+	// More queries than a batch, some of them outside of the mesh
+	const int nbQueries = 200;
+	std::vector<float> centers(nbQueries * 3);
+
+	unsigned seed = 42;
+	for (int i = 0; i < nbQueries; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		centers[i * 3 + 0] = (float) ((seed >> 8) % 6000) / 100.f - 30.f;
+		seed = seed * 1103515245 + 12345;
+		centers[i * 3 + 1] = (float) ((seed >> 8) % 800) / 100.f - 4.f;
+		seed = seed * 1103515245 + 12345;
+		centers[i * 3 + 2] = (float) ((seed >> 8) % 6000) / 100.f - 30.f;
+	}
+
+	std::vector<dtPolyRef> refs(nbQueries), batchRefs(nbQueries);
+	std::vector<float> nearest(nbQueries * 3), batchNearest(nbQueries * 3);
+
+	int nbFound = 0;
+	for (int i = 0; i < nbQueries; ++i)
+	{
+		REQUIRE(dtStatusSucceed(navQuery->findNearestPoly(&centers[i * 3], extents, filter, &refs[i], &nearest[i * 3])));
+		if (refs[i])
+			++nbFound;
+	}
+
+	CHECK(nbFound > 0);
+	CHECK(nbFound < nbQueries);
+
+	SECTION("Same polygons", "The batch finds the same polygons and points")
+	{
+		REQUIRE(dtStatusSucceed(navQuery->findNearestPolyBatch(&centers[0], nbQueries, extents, filter, &batchRefs[0], &batchNearest[0])));
+
+		for (int i = 0; i < nbQueries; ++i)
+		{
+			CHECK(batchRefs[i] == refs[i]);
+
+			if (refs[i])
+			{
+				CHECK(dtVdistSqr(&batchNearest[i * 3], &nearest[i * 3]) < 1e-6f);
+			}
+		}
+	}
+
+	SECTION("No points", "The nearest points are optional")
+	{
+		REQUIRE(dtStatusSucceed(navQuery->findNearestPolyBatch(&centers[0], nbQueries, extents, filter, &batchRefs[0], 0)));
+
+		for (int i = 0; i < nbQueries; ++i)
+			CHECK(batchRefs[i] == refs[i]);
+	}
+
+	SECTION("Invalid parameters", "The batch fails without queries or results")
+	{
+		CHECK(dtStatusFailed(navQuery->findNearestPolyBatch(0, nbQueries, extents, filter, &batchRefs[0], 0)));
+		CHECK(dtStatusFailed(navQuery->findNearestPolyBatch(&centers[0], nbQueries, extents, filter, 0, 0)));
+		CHECK(dtStatusSucceed(navQuery->findNearestPolyBatch(&centers[0], 0, extents, filter, &batchRefs[0], 0)));
+	}
+}
+
+TEST_CASE("DetourCrowdTest/LocatePoint", "Locating a point from a close polygon must give the same polygon as the nearest polygon query")
+{
+	TestScene scene;
+	dtCrowd* crowd = scene.createSquareScene(1, 0.5f);
+	REQUIRE(crowd != 0);
+
+	const dtNavMeshQuery* navQuery = crowd->getCrowdQuery()->getNavMeshQuery();
+	const dtQueryFilter* filter = crowd->getCrowdQuery()->getQueryFilter();
+	const float* extents = crowd->getCrowdQuery()->getQueryExtents();
+
+	const int nbPoints = 100;
+	int nbFromHint = 0;
+	unsigned seed = 42;
+
+	for (int i = 0; i < nbPoints; ++i)
+	{
+		// A point of the mesh, and a hint a few meters away from it
+		seed = seed * 1103515245 + 12345;
+		const float x = (float) ((seed >> 8) % 3000) / 100.f - 15.f;
+		seed = seed * 1103515245 + 12345;
+		const float z = (float) ((seed >> 8) % 3000) / 100.f - 15.f;
+		seed = seed * 1103515245 + 12345;
+		const float offset = (float) ((seed >> 8) % 400) / 100.f - 2.f;
+
+		const float pos[] = {x, 0, z};
+		const float hintPos[] = {x + offset, 0, z - offset};
+
+		dtPolyRef expected = 0, hint = 0, ref = 0;
+		float expectedNearest[3], nearest[3];
+		navQuery->findNearestPoly(pos, extents, filter, &expected, expectedNearest);
+		navQuery->findNearestPoly(hintPos, extents, filter, &hint, nearest);
+		REQUIRE(expected != 0);
+		REQUIRE(hint != 0);
+
+		bool fromHint = false;
+		REQUIRE(dtStatusSucceed(navQuery->locatePoint(hint, pos, extents, filter, &ref, nearest, &fromHint)));
+
+		CHECK(ref == expected);
+		CHECK(dtVdistSqr(nearest, expectedNearest) < 1e-4f);
+
+		if (fromHint)
+			++nbFromHint;
+	}
+
+	// The hints are close enough to walk to the points most of the time
+	CHECK(nbFromHint > nbPoints / 2);
+
+	SECTION("Fallback", "Without a valid hint, or outside of the mesh, the nearest polygon query is used")
+	{
+		const float pos[] = {1.f, 0, 1.f};
+		const float outside[] = {100.f, 0, 100.f};
+		dtPolyRef expected = 0, ref = 0;
+		float nearest[3];
+		bool fromHint = true;
+
+		navQuery->findNearestPoly(pos, extents, filter, &expected, nearest);
+
+		CHECK(dtStatusSucceed(navQuery->locatePoint(0, pos, extents, filter, &ref, nearest, &fromHint)));
+		CHECK(ref == expected);
+		CHECK(!fromHint);
+
+		CHECK(dtStatusSucceed(navQuery->locatePoint(expected, outside, extents, filter, &ref, nearest, &fromHint)));
+		CHECK(ref == 0);
+		CHECK(!fromHint);
+
+		CHECK(dtStatusFailed(navQuery->locatePoint(expected, pos, extents, filter, 0, nearest)));
+	}
+}
+
+/// Builds a single tile navigation mesh made of a grid of square polygons of 1 meter.
+static dtNavMesh* createGridNavMesh(const int size, const bool buildBvTree, const bool buildWideBvTree, 
+									std::vector<unsigned char>* tileData = 0, const bool linked = false)
+{
+	const int nvp = 4;
+	const int nbPolys = size * size;
+	std::vector<unsigned short> verts;
+	std::vector<unsigned short> polys(nbPolys * nvp * 2, 0xffff);
+	std::vector<unsigned short> flags(nbPolys, 1);
+	std::vector<unsigned char> areas(nbPolys, 0);
+
+	// Vertices are on a 0.5 cells grid, slightly uneven to vary the bounds
+	for (int z = 0; z <= size; ++z)
+	{
+		for (int x = 0; x <= size; ++x)
+		{
+			verts.push_back((unsigned short) (x * 2));
+			verts.push_back((unsigned short) ((x * 7 + z * 3) % 4));
+			verts.push_back((unsigned short) (z * 2));
+		}
+	}
+
+	for (int z = 0; z < size; ++z)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			unsigned short* p = &polys[(z * size + x) * nvp * 2];
+			p[0] = (unsigned short) (z * (size + 1) + x);
+			p[1] = (unsigned short) ((z + 1) * (size + 1) + x);
+			p[2] = (unsigned short) ((z + 1) * (size + 1) + x + 1);
+			p[3] = (unsigned short) (z * (size + 1) + x + 1);
+
+			// Borders only unless the polygons are linked, the spatial queries do not need the links
+			for (int j = 0; j < nvp; ++j)
+				p[nvp + j] = 0x800f;
+
+			if (linked)
+			{
+				if (x > 0) p[nvp + 0] = (unsigned short) (z * size + x - 1);
+				if (z < size - 1) p[nvp + 1] = (unsigned short) ((z + 1) * size + x);
+				if (x < size - 1) p[nvp + 2] = (unsigned short) (z * size + x + 1);
+				if (z > 0) p[nvp + 3] = (unsigned short) ((z - 1) * size + x);
+			}
+		}
+	}
+
+	dtNavMeshCreateParams params;
+	memset(&params, 0, sizeof(params));
+	params.verts = &verts[0];
+	params.vertCount = (int) verts.size() / 3;
+	params.polys = &polys[0];
+	params.polyFlags = &flags[0];
+	params.polyAreas = &areas[0];
+	params.polyCount = nbPolys;
+	params.nvp = nvp;
+	params.walkableHeight = 2.f;
+	params.walkableRadius = 0.5f;
+	params.walkableClimb = 0.5f;
+	params.bmax[0] = (float) size;
+	params.bmax[1] = 2.f;
+	params.bmax[2] = (float) size;
+	params.cs = 0.5f;
+	params.ch = 0.5f;
+	params.buildBvTree = buildBvTree;
+	params.buildWideBvTree = buildWideBvTree;
+
+	unsigned char* data = 0;
+	int dataSize = 0;
+	if (!dtCreateNavMeshData(&params, &data, &dataSize))
+		return 0;
+
+	if (tileData)
+		tileData->assign(data, data + dataSize);
+
+	dtNavMesh* navMesh = dtAllocNavMesh();
+	if (!navMesh || dtStatusFailed(navMesh->init(data, dataSize, DT_TILE_FREE_DATA)))
+	{
+		dtFreeNavMesh(navMesh);
+		return 0;
+	}
+
+	return navMesh;
+}
+
+TEST_CASE("DetourCrowdTest/WideBVTree", "The 4-wide bounding volume trees must find the same polygons as the binary ones")
+{
+	const int size = 48;
+	std::vector<unsigned char> wideData;
+
+	dtNavMesh* linearMesh = createGridNavMesh(size, false, false);
+	dtNavMesh* binaryMesh = createGridNavMesh(size, true, false);
+	dtNavMesh* wideMesh = createGridNavMesh(size, true, true, &wideData);
+	REQUIRE(linearMesh != 0);
+	REQUIRE(binaryMesh != 0);
+	REQUIRE(wideMesh != 0);
+
+	const dtNavMesh* constWideMesh = wideMesh;
+	const dtMeshTile* wideTile = constWideMesh->getTile(0);
+	CHECK(wideTile->header->version == DT_NAVMESH_VERSION_WIDE_BVH);
+	CHECK(wideTile->bvTree == 0);
+	CHECK(wideTile->bvTree4 != 0);
+
+	dtNavMesh* meshes[] = {linearMesh, binaryMesh, wideMesh};
+	dtNavMeshQuery* queries[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		queries[i] = dtAllocNavMeshQuery();
+		REQUIRE(dtStatusSucceed(queries[i]->init(meshes[i], 64)));
+	}
+
+	dtQueryFilter filter;
+
+	SECTION("Same polygons", "Both trees find the same polygons in random boxes")
+	{
+		const int maxPolys = size * size;
+		std::vector<dtPolyRef> polys[3];
+		unsigned seed = 42;
+
+		for (int q = 0; q < 200; ++q)
+		{
+			float center[3], extents[3];
+			seed = seed * 1103515245 + 12345;
+			center[0] = (float) ((seed >> 8) % (size * 120)) / 100.f - size * 0.1f;
+			seed = seed * 1103515245 + 12345;
+			center[1] = (float) ((seed >> 8) % 300) / 100.f - 0.5f;
+			seed = seed * 1103515245 + 12345;
+			center[2] = (float) ((seed >> 8) % (size * 120)) / 100.f - size * 0.1f;
+			seed = seed * 1103515245 + 12345;
+			extents[0] = extents[2] = (float) ((seed >> 8) % 800) / 100.f;
+			extents[1] = (q % 4) ? 1.f : 0.1f;
+
+			for (int i = 0; i < 3; ++i)
+			{
+				polys[i].resize(maxPolys);
+				int nbPolys = 0;
+				REQUIRE(dtStatusSucceed(queries[i]->queryPolygons(center, extents, &filter, &polys[i][0], &nbPolys, maxPolys)));
+				polys[i].resize(nbPolys);
+				std::sort(polys[i].begin(), polys[i].end());
+
+				// The last node of a binary tree is unused, and seen as the first polygon
+				polys[i].erase(std::unique(polys[i].begin(), polys[i].end()), polys[i].end());
+			}
+
+			// The trees test quantized bounds, so they may find a few more polygons than the exact bounds
+			CHECK(std::includes(polys[1].begin(), polys[1].end(), polys[0].begin(), polys[0].end()));
+			CHECK(polys[2] == polys[1]);
+
+			// The nearest polygon is only searched among the first 128 polygons found
+			if (polys[1].size() >= 128)
+				continue;
+
+			dtPolyRef binaryRef = 0, wideRef = 0;
+			float binaryNearest[3], wideNearest[3];
+			queries[1]->findNearestPoly(center, extents, &filter, &binaryRef, binaryNearest);
+			queries[2]->findNearestPoly(center, extents, &filter, &wideRef, wideNearest);
+
+			if (binaryRef && wideRef)
+			{
+				CHECK(dtVdistSqr(center, binaryNearest) == dtVdistSqr(center, wideNearest));
+			}
+			else
+			{
+				CHECK(binaryRef == wideRef);
+			}
+		}
+	}
+
+	SECTION("Endianness", "Swapping the endianness of the wide tree twice gives the same data")
+	{
+		std::vector<unsigned char> data = wideData;
+
+		REQUIRE(dtNavMeshDataSwapEndian(&data[0], (int) data.size()));
+		REQUIRE(dtNavMeshHeaderSwapEndian(&data[0], (int) data.size()));
+		CHECK(data != wideData);
+
+		REQUIRE(dtNavMeshHeaderSwapEndian(&data[0], (int) data.size()));
+		REQUIRE(dtNavMeshDataSwapEndian(&data[0], (int) data.size()));
+		CHECK(data == wideData);
+	}
+
+	for (int i = 0; i < 3; ++i)
+	{
+		dtFreeNavMeshQuery(queries[i]);
+		dtFreeNavMesh(meshes[i]);
+	}
+}
+
+TEST_CASE("DetourCrowdTest/NodePool", "The nodes of a pool must be found until it is cleared, whatever the number of clears")
+{
+	const int maxNodes = 64;
+	dtNodePool pool(maxNodes, 128);
+
+	// Polygon references sharing their low bits, to collide in the hash table
+	std::vector<dtPolyRef> refs;
+	for (int i = 0; i < maxNodes; ++i)
+		refs.push_back((dtPolyRef) ((i + 1) << 16 | 1));
+
+	SECTION("Find", "The nodes are found once created, and are lost when the pool is cleared")
+	{
+		for (int i = 0; i < maxNodes; ++i)
+		{
+			CHECK(pool.findNode(refs[i]) == 0);
+			dtNode* node = pool.getNode(refs[i]);
+			REQUIRE(node != 0);
+			CHECK(node->id == refs[i]);
+			CHECK(pool.getNodeAtIdx(pool.getNodeIdx(node)) == node);
+		}
+
+		CHECK(pool.getNodeCount() == maxNodes);
+
+		for (int i = 0; i < maxNodes; ++i)
+		{
+			CHECK(pool.findNode(refs[i]) == pool.getNodeAtIdx(i + 1));
+			CHECK(pool.getNode(refs[i]) == pool.getNodeAtIdx(i + 1));
+		}
+
+		// The pool is full
+		CHECK(pool.getNode(12345) == 0);
+
+		pool.clear();
+		CHECK(pool.getNodeCount() == 0);
+
+		for (int i = 0; i < maxNodes; ++i)
+			CHECK(pool.findNode(refs[i]) == 0);
+	}
+
+	SECTION("Generations", "The nodes of the previous searches are never found, even when the generations wrap around")
+	{
+		for (int i = 0; i < 70000; ++i)
+		{
+			pool.clear();
+
+			const dtPolyRef ref = refs[i % maxNodes];
+			REQUIRE(pool.findNode(ref) == 0);
+			REQUIRE(pool.getNode(ref) == pool.getNodeAtIdx(1));
+			REQUIRE(pool.findNode(refs[(i + 1) % maxNodes]) == 0);
+		}
+	}
+}
+
+TEST_CASE("DetourCrowdTest/NodeQueue", "The open list must pop its nodes by increasing total cost, with the heap or with buckets")
+{
+	const int nbNodes = 256;
+	std::vector<dtNode> nodes(nbNodes);
+	dtNodeQueue queue(nbNodes);
+
+	srand(42);
+
+	SECTION("Heap", "The nodes are popped by increasing total cost, even when their cost decreased")
+	{
+		for (int i = 0; i < nbNodes; ++i)
+		{
+			nodes[i].total = (float) (rand() % 1000);
+			queue.push(&nodes[i]);
+		}
+
+		for (int i = 0; i < nbNodes; i += 3)
+		{
+			nodes[i].total *= 0.5f;
+			queue.modify(&nodes[i]);
+		}
+
+		std::vector<float> expected;
+		for (int i = 0; i < nbNodes; ++i)
+			expected.push_back(nodes[i].total);
+		std::sort(expected.begin(), expected.end());
+
+		for (int i = 0; i < nbNodes; ++i)
+		{
+			REQUIRE(!queue.empty());
+			CHECK(queue.top()->total == expected[i]);
+			CHECK(queue.pop()->total == expected[i]);
+		}
+
+		CHECK(queue.empty());
+	}
+
+	SECTION("Buckets", "The nodes are popped by increasing total cost when no node is cheaper than the last one popped")
+	{
+		CHECK(queue.initBuckets(1.f, 50));
+		CHECK(queue.getBucketCount() == 64);
+
+		// A search-like sequence: the nodes pushed or modified are never cheaper than the last one popped
+		nodes[0].total = 10.f;
+		queue.push(&nodes[0]);
+
+		int nbPushed = 1;
+		float last = 0.f;
+		std::vector<dtNode*> open;
+		while (!queue.empty())
+		{
+			dtNode* node = queue.pop();
+			CHECK(node->total >= last);
+			last = node->total;
+			open.erase(std::remove(open.begin(), open.end(), node), open.end());
+
+			for (int i = 0; i < 3 && nbPushed < nbNodes; ++i)
+			{
+				dtNode* next = &nodes[nbPushed++];
+				next->total = last + (float) (rand() % 100) * 0.25f;
+				queue.push(next);
+				open.push_back(next);
+			}
+
+			if (!open.empty())
+			{
+				dtNode* modified = open[rand() % open.size()];
+				modified->total = last + (modified->total - last) * 0.5f;
+				queue.modify(modified);
+			}
+		}
+
+		CHECK(nbPushed == nbNodes);
+
+		// The nodes beyond the last bucket are not popped before the cheaper ones pushed once the buckets moved forward
+		CHECK(queue.initBuckets(1.f, 4));
+		nodes[0].total = 0.f;
+		nodes[1].total = 100.f;
+		nodes[2].total = 2.5f;
+		nodes[3].total = 4.5f;
+		queue.push(&nodes[0]);
+		queue.push(&nodes[1]);
+		CHECK(queue.pop() == &nodes[0]);
+		queue.push(&nodes[2]);
+		CHECK(queue.pop() == &nodes[2]);
+		queue.push(&nodes[3]);
+		CHECK(queue.pop() == &nodes[3]);
+		CHECK(queue.pop() == &nodes[1]);
+		CHECK(queue.empty());
+
+		// Same with costs far beyond the buckets, some of them lowered while in the overflow list
+		last = 0.f;
+		nbPushed = 0;
+		nodes[nbPushed].total = 0.f;
+		queue.push(&nodes[nbPushed++]);
+		open.clear();
+		while (!queue.empty())
+		{
+			dtNode* node = queue.pop();
+			CHECK(node->total >= last);
+			last = node->total;
+			open.erase(std::remove(open.begin(), open.end(), node), open.end());
+
+			for (int i = 0; i < 2 && nbPushed < nbNodes; ++i)
+			{
+				dtNode* next = &nodes[nbPushed++];
+				next->total = last + (float) (rand() % 400) * 0.1f;
+				queue.push(next);
+				open.push_back(next);
+			}
+
+			if (!open.empty())
+			{
+				dtNode* modified = open[rand() % open.size()];
+				modified->total = last + (modified->total - last) * 0.5f;
+				queue.modify(modified);
+			}
+		}
+
+		CHECK(nbPushed == nbNodes);
+
+		// The queue is reusable once cleared, even when not empty
+		queue.push(&nodes[1]);
+		queue.clear();
+		CHECK(queue.empty());
+		nodes[2].total = 3.f;
+		queue.push(&nodes[2]);
+		CHECK(queue.pop() == &nodes[2]);
+
+		CHECK(queue.initBuckets(0.f, 0));
+		CHECK(queue.getBucketWidth() == 0.f);
+	}
+
+	SECTION("Search", "The buckets find paths as short as the heap")
+	{
+		const int size = 32;
+		dtNavMesh* navMesh = createGridNavMesh(size, true, false, 0, true);
+		REQUIRE(navMesh != 0);
+
+		dtNavMeshQuery* heapQuery = dtAllocNavMeshQuery();
+		dtNavMeshQuery* bucketQuery = dtAllocNavMeshQuery();
+		REQUIRE(dtStatusSucceed(heapQuery->init(navMesh, 2048)));
+		REQUIRE(dtStatusSucceed(bucketQuery->init(navMesh, 1024)));
+		CHECK(dtStatusFailed(bucketQuery->setOpenListBuckets(-1.f, 256)));
+		REQUIRE(dtStatusSucceed(bucketQuery->setOpenListBuckets(0.5f, 256)));
+
+		// The setting survives a reallocation of the open list
+		REQUIRE(dtStatusSucceed(bucketQuery->init(navMesh, 2048)));
+
+		dtQueryFilter filter;
+		const float ext[3] = {0.1f, 2.f, 0.1f};
+
+		for (int i = 0; i < 50; ++i)
+		{
+			float start[3] = {(rand() % size) + 0.5f, 1.f, (rand() % size) + 0.5f};
+			float end[3] = {(rand() % size) + 0.5f, 1.f, (rand() % size) + 0.5f};
+
+			dtPolyRef startRef, endRef;
+			float nearest[3];
+			REQUIRE(dtStatusSucceed(heapQuery->findNearestPoly(start, ext, &filter, &startRef, nearest)));
+			REQUIRE(dtStatusSucceed(heapQuery->findNearestPoly(end, ext, &filter, &endRef, nearest)));
+
+			dtPolyRef heapPath[256], bucketPath[256];
+			int nbHeap = 0, nbBucket = 0;
+			REQUIRE(dtStatusSucceed(heapQuery->findPath(startRef, endRef, start, end, &filter, heapPath, &nbHeap, 256)));
+			REQUIRE(dtStatusSucceed(bucketQuery->findPath(startRef, endRef, start, end, &filter, bucketPath, &nbBucket, 256)));
+
+			// Paths of equal cost may differ, but they cross as many cells of the grid
+			CHECK(nbBucket == nbHeap);
+			CHECK(heapPath[nbHeap - 1] == endRef);
+			CHECK(bucketPath[nbBucket - 1] == endRef);
+		}
+
+		dtFreeNavMeshQuery(bucketQuery);
+		dtFreeNavMeshQuery(heapQuery);
+		dtFreeNavMesh(navMesh);
+	}
+}
+
+/// Counts the calls to the hooks, and checks that every agent is updated between them
+class HookCountingBehavior : public dtBehavior
+{
+public:
+	HookCountingBehavior() : nbPreUpdates(0), nbUpdates(0), nbPostUpdates(0) {}
+
+	virtual void update(const dtCrowdQuery&, const dtCrowdAgent&, dtCrowdAgent&, float)
+	{
+		CHECK(nbPreUpdates == nbPostUpdates + 1);
+		++nbUpdates;
+	}
+
+	int nbPreUpdates;
+	int nbUpdates;
+	int nbPostUpdates;
+
+protected:
+	virtual void doPreUpdate(const dtCrowdQuery&, float) { ++nbPreUpdates; }
+	virtual void doPostUpdate(const dtCrowdQuery&, float) { ++nbPostUpdates; }
+};
+
+TEST_CASE("DetourCrowdTest/LodScheduler", "The agents must be updated at the rate of their level of detail tier, with the time elapsed since their last update")
+{
+	SECTION("Scheduling", "The agents of a tier are updated in turns")
+	{
+		const unsigned nbAgents = 8;
+		const float dt = 0.1f;
+
+		dtCrowdAgent agents[nbAgents];
+		unsigned ids[nbAgents];
+
+		for (unsigned i = 0; i < nbAgents; ++i)
+		{
+			memset(&agents[i], 0, sizeof(dtCrowdAgent));
+			agents[i].id = i;
+			agents[i].position[0] = 10.f * i;
+			ids[i] = i;
+		}
+
+		dtLodScheduler scheduler;
+		REQUIRE(scheduler.init(nbAgents));
+
+		dtLodTier tiers[] = {{15.f, 1}, {1000.f, 4}};
+		dtLodTier unsorted[] = {{15.f, 1}, {10.f, 4}};
+		dtLodTier nullPeriod[] = {{15.f, 0}};
+
+		CHECK(!scheduler.setTiers(unsorted, 2));
+		CHECK(!scheduler.setTiers(nullPeriod, 1));
+		REQUIRE(scheduler.setTiers(tiers, 2));
+
+		const float point[] = {0, 0, 0};
+		REQUIRE(scheduler.setPointsOfInterest(point, 1));
+
+		std::vector<unsigned> nbUpdates(nbAgents, 0);
+		std::vector<float> updatedTime(nbAgents, 0.f);
+
+		for (unsigned tick = 0; tick < 8; ++tick)
+		{
+			const unsigned nbGroups = scheduler.schedule(agents, ids, nbAgents, dt);
+			const unsigned* scheduled = scheduler.getScheduledIds();
+
+			// The close agents and one slice of the far ones (2 and 3 share the slices of 6 and 7)
+			CHECK(scheduler.getScheduledCount() == (tick % 4 < 2 ? 3u : 4u));
+
+			for (unsigned g = 0; g < nbGroups; ++g)
+			{
+				const dtLodScheduler::Group& group = scheduler.getGroup(g);
+
+				for (unsigned i = group.first; i < group.first + group.nbAgents; ++i)
+				{
+					if (i > group.first)
+						CHECK(scheduled[i - 1] < scheduled[i]);
+
+					++nbUpdates[scheduled[i]];
+					updatedTime[scheduled[i]] += group.dt;
+				}
+			}
+		}
+
+		CHECK(scheduler.getAgentTier(0) == 0);
+		CHECK(scheduler.getAgentTier(1) == 0);
+		CHECK(scheduler.getAgentTier(2) == 1);
+
+		for (unsigned i = 0; i < nbAgents; ++i)
+			CHECK(nbUpdates[i] == (i < 2 ? 8u : 2u));
+
+		// The first update of the slow agents catches up with the time elapsed since the scheduler started
+		CHECK(fabsf(updatedTime[0] - 0.8f) < 1e-5f);
+		CHECK(fabsf(updatedTime[2] - 0.7f) < 1e-5f);
+		CHECK(fabsf(updatedTime[4] - 0.5f) < 1e-5f);
+		CHECK(fabsf(updatedTime[7] - 0.8f) < 1e-5f);
+
+		// An explicit tier ignores the distance
+		REQUIRE(scheduler.setAgentTier(7, 0));
+		CHECK(!scheduler.setAgentTier(7, 2));
+		CHECK(!scheduler.setAgentTier(nbAgents, 0));
+
+		// The agents are grouped by time step: 0, 1 and 7 were updated at the last update, 4 was not
+		REQUIRE(scheduler.schedule(agents, ids, nbAgents, dt) == 2);
+		CHECK(scheduler.getAgentTier(7) == 0);
+		CHECK(scheduler.getGroup(0).nbAgents == 3);
+		CHECK(scheduler.getGroup(0).dt == dt);
+		CHECK(scheduler.getScheduledIds()[2] == 7);
+		CHECK(scheduler.getScheduledIds()[3] == 4);
+
+		// Without tiers, every agent is updated every time
+		REQUIRE(scheduler.setTiers(0, 0));
+		scheduler.schedule(agents, ids, nbAgents, dt);
+		CHECK(scheduler.getScheduledCount() == nbAgents);
+	}
+
+	SECTION("Crowd update", "The agents updated less often travel the same distance")
+	{
+		TestScene scene;
+		dtCrowd* crowd = scene.createSquareScene(2, 0.5f);
+		REQUIRE(crowd != 0);
+		REQUIRE(crowd->getLodScheduler() != 0);
+
+		const float positions[][3] = {{-5.f, 0, 0}, {5.f, 0, 0}};
+
+		for (unsigned i = 0; i < 2; ++i)
+		{
+			dtCrowdAgent ag;
+			REQUIRE(crowd->addAgent(ag, positions[i]));
+			scene.defaultInitializeAgent(*crowd, ag.id);
+
+			crowd->fetchAgent(ag, ag.id);
+			dtVset(ag.velocity, 0, 0, 1.f);
+			dtVcopy(ag.desiredVelocity, ag.velocity);
+			REQUIRE(crowd->applyAgent(ag));
+		}
+
+		dtLodTier tiers[] = {{0.f, 1}, {0.f, 4}};
+		dtLodScheduler* scheduler = crowd->getLodScheduler();
+		REQUIRE(scheduler->setTiers(tiers, 2));
+		REQUIRE(scheduler->setAgentTier(0, 0));
+		REQUIRE(scheduler->setAgentTier(1, 1));
+
+		// The slow agent (id 1) is only updated on the second update, then every four updates
+		crowd->updateScheduled(0.1f);
+		CHECK(fabsf(crowd->getAgent(0)->position[2] - 0.1f) < 1e-3f);
+		CHECK(fabsf(crowd->getAgent(1)->position[2]) < 1e-3f);
+
+		for (unsigned i = 0; i < 5; ++i)
+			crowd->updateScheduled(0.1f);
+
+		CHECK(fabsf(crowd->getAgent(0)->position[2] - 0.6f) < 1e-3f);
+		CHECK(fabsf(crowd->getAgent(1)->position[2] - 0.6f) < 1e-3f);
+
+		// Removing an agent forgets its tier
+		crowd->removeAgent(1);
+		CHECK(scheduler->getAgentTier(1) == 0);
+	}
+
+	SECTION("Collisions", "The collisions between the agents of different groups do not depend on the order of the groups")
+	{
+		TestScene scene;
+		dtCrowd* crowd = scene.createSquareScene(2, 0.5f);
+		REQUIRE(crowd != 0);
+
+		// Two overlapping agents, standing still
+		const float positions[][3] = {{-0.1f, 0, 0}, {0.1f, 0, 0}};
+
+		for (unsigned i = 0; i < 2; ++i)
+		{
+			dtCrowdAgent ag;
+			REQUIRE(crowd->addAgent(ag, positions[i]));
+			scene.defaultInitializeAgent(*crowd, ag.id);
+		}
+
+		dtLodTier tiers[] = {{0.f, 1}, {0.f, 2}};
+		dtLodScheduler* scheduler = crowd->getLodScheduler();
+		REQUIRE(scheduler->setTiers(tiers, 2));
+		REQUIRE(scheduler->setAgentTier(0, 0));
+		REQUIRE(scheduler->setAgentTier(1, 1));
+
+		// Wait for an update of both agents, each in its own group
+		float before[2][3];
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			dtVcopy(before[0], crowd->getAgent(0)->position);
+			dtVcopy(before[1], crowd->getAgent(1)->position);
+			crowd->updateScheduled(0.1f);
+
+			if (scheduler->getGroupCount() == 2)
+				break;
+		}
+
+		REQUIRE(scheduler->getGroupCount() == 2);
+
+		// The agents are pushed apart by the same distance, although the group of the first one is updated first
+		float disp[2][3];
+		dtVsub(disp[0], crowd->getAgent(0)->position, before[0]);
+		dtVsub(disp[1], crowd->getAgent(1)->position, before[1]);
+		CHECK(disp[0][0] < -1e-3f);
+		CHECK(fabsf(disp[0][0] + disp[1][0]) < 1e-5f);
+		CHECK(fabsf(disp[0][2] + disp[1][2]) < 1e-5f);
+	}
+
+	SECTION("Update hooks", "The path queue ticks once per update, however many groups are updated")
+	{
+		const unsigned nbAgents = 6;
+
+		TestScene scene;
+		dtCrowd* crowd = scene.createSquareScene(nbAgents, 0.5f);
+		REQUIRE(crowd != 0);
+
+		dtPathFollowing* pathFollowing = dtPathFollowing::allocate(nbAgents);
+		REQUIRE(pathFollowing != 0);
+		REQUIRE(pathFollowing->init(*crowd->getCrowdQuery()));
+
+		HookCountingBehavior counter;
+		dtBehavior* behaviors[] = {pathFollowing, &counter};
+		dtPipelineBehavior pipeline;
+		REQUIRE(pipeline.setBehaviors(behaviors, 2));
+
+		dtLodTier tiers[] = {{0.f, 1}, {0.f, 2}, {0.f, 3}};
+		dtLodScheduler* scheduler = crowd->getLodScheduler();
+		REQUIRE(scheduler->setTiers(tiers, 3));
+
+		for (unsigned i = 0; i < nbAgents; ++i)
+		{
+			float pos[] = {-5.f + 2.f * i, 0, 0};
+			dtCrowdAgent ag;
+
+			REQUIRE(crowd->addAgent(ag, pos));
+			scene.defaultInitializeAgent(*crowd, ag.id);
+			REQUIRE(scheduler->setAgentTier(ag.id, i % 3));
+			REQUIRE(crowd->setAgentBehavior(ag.id, &pipeline));
+
+			const float target[] = {pos[0], 0, 10.f};
+			dtPolyRef targetRef;
+			float nearest[3];
+			crowd->getCrowdQuery()->getNavMeshQuery()->findNearestPoly(target, crowd->getCrowdQuery()->getQueryExtents(), 
+																	   crowd->getCrowdQuery()->getQueryFilter(), &targetRef, nearest);
+			REQUIRE(pathFollowing->requestMoveTarget(ag.id, targetRef, nearest));
+		}
+
+		const unsigned frame = crowd->getCrowdQuery()->getFrame();
+		bool severalGroups = false;
+
+		for (int i = 1; i <= 12; ++i)
+		{
+			crowd->updateScheduled(0.1f);
+			severalGroups = severalGroups || scheduler->getGroupCount() > 1;
+
+			// The path queue is updated by the post update of the path following
+			CHECK(crowd->getCrowdQuery()->getFrame() == frame + i);
+			CHECK(counter.nbPreUpdates == i);
+			CHECK(counter.nbPostUpdates == i);
+		}
+
+		CHECK(severalGroups);
+
+		// The agents reached by the path requests are moving
+		for (unsigned i = 0; i < nbAgents; ++i)
+		{
+			CHECK(crowd->getAgent(i)->position[2] > 0.1f);
+			crowd->setAgentBehavior(i, 0);
+		}
+
+		dtPathFollowing::free(pathFollowing);
+	}
+}
+
+TEST_CASE("DetourCrowdTest/UpdateBudget", "A budgeted update must resume from the agents where the previous one stopped")
+{
+	const unsigned nbAgents = 10;
+
+	TestScene scene;
+	dtCrowd* crowd = scene.createSquareScene(nbAgents, 0.5f);
+	REQUIRE(crowd != 0);
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		float pos[] = {-9.f + 2.f * i, 0, 0};
+		dtCrowdAgent ag;
+
+		REQUIRE(crowd->addAgent(ag, pos));
+		scene.defaultInitializeAgent(*crowd, ag.id);
+
+		// The velocity only changes when the velocity of the agent is updated
+		crowd->fetchAgent(ag, ag.id);
+		dtVset(ag.desiredVelocity, 0, 0, 0.5f);
+		REQUIRE(crowd->applyAgent(ag));
+	}
+
+	crowd->setStatsEnabled(true);
+	crowd->setUpdateBudget(3, 0);
+	CHECK(crowd->getUpdateBudgetAgents() == 3);
+
+	SECTION("Agents budget", "The agents are updated in turns")
+	{
+		crowd->update(0.1f);
+
+		CHECK(crowd->getStats()->skippedAgents == nbAgents - 3);
+		CHECK(crowd->getStats()->boundaryUpdates == 3);
+
+		for (unsigned i = 0; i < nbAgents; ++i)
+			CHECK((crowd->getAgent(i)->velocity[2] > 0.f) == (i < 3));
+
+		crowd->update(0.1f);
+		crowd->update(0.1f);
+
+		CHECK(crowd->getAgent(8)->velocity[2] > 0.f);
+		CHECK(crowd->getAgent(9)->velocity[2] == 0.f);
+
+		// The agents which were updated keep moving, the last one is updated when the slices wrap around
+		const float z = crowd->getAgent(0)->position[2];
+		CHECK(z > 0.f);
+
+		crowd->update(0.1f);
+
+		CHECK(crowd->getAgent(9)->velocity[2] > 0.f);
+		CHECK(crowd->getAgent(0)->position[2] > z);
+		CHECK(crowd->getStats()->skippedAgents == nbAgents - 3);
+	}
+
+	SECTION("Time budget", "At least one slice of agents is updated")
+	{
+		crowd->setUpdateBudget(0, 0.001f);
+		crowd->update(0.1f);
+
+		CHECK(crowd->getStats()->skippedAgents == 0);
+
+		for (unsigned i = 0; i < nbAgents; ++i)
+			CHECK(crowd->getAgent(i)->velocity[2] > 0.f);
+	}
+
+	SECTION("Explicit agents", "The budget does not apply when the agents to update are given")
+	{
+		unsigned ids[nbAgents];
+		for (unsigned i = 0; i < nbAgents; ++i)
+			ids[i] = i;
+
+		crowd->update(0.1f, ids, nbAgents);
+
+		CHECK(crowd->getStats()->skippedAgents == 0);
+		CHECK(crowd->getAgent(nbAgents - 1)->velocity[2] > 0.f);
+	}
+}
+
+TEST_CASE("DetourCrowdTest/UpdateBudgetHooks", "The behaviors are prepared before the first slice of a budgeted update and finished after the last one")
+{
+	// More agents than a slice holds
+	const unsigned nbAgents = 300;
+
+	TestScene scene;
+	dtCrowd* crowd = scene.createSquareScene(nbAgents, 0.5f);
+	REQUIRE(crowd != 0);
+
+	HookCountingBehavior counter;
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		float pos[] = {-15.f + 1.5f * (i % 20), 0, -15.f + 2.f * (i / 20)};
+		dtCrowdAgent ag;
+
+		REQUIRE(crowd->addAgent(ag, pos));
+		scene.defaultInitializeAgent(*crowd, ag.id);
+		REQUIRE(crowd->setAgentBehavior(ag.id, &counter));
+	}
+
+	crowd->setUpdateBudget(nbAgents - 10, 0);
+	const unsigned frame = crowd->getCrowdQuery()->getFrame();
+
+	for (int i = 1; i <= 3; ++i)
+	{
+		crowd->update(0.1f);
+
+		CHECK(crowd->getCrowdQuery()->getFrame() == frame + i);
+		CHECK(counter.nbPreUpdates == i);
+		CHECK(counter.nbPostUpdates == i);
+		CHECK(counter.nbUpdates == i * (int) (nbAgents - 10));
+	}
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+		crowd->setAgentBehavior(i, 0);
+}
+
+TEST_CASE("DetourCrowdTest/BehaviorParams", "The parameters of a behavior must be stable, found without allocation and removable")
+{
+	const unsigned nbAgents = 500;
+
+	dtSeekBehavior* seek = dtSeekBehavior::allocate(10);
+	REQUIRE(seek != 0);
+
+	std::vector<dtSeekBehaviorParams*> params(nbAgents, 0);
+
+	// Creating more parameters than estimated, with sparse ids
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		params[i] = seek->getBehaviorParams(i * 3);
+		REQUIRE(params[i] != 0);
+		params[i]->targetID = i;
+	}
+
+	CHECK(seek->getBehaviorParamsCount() == nbAgents);
+
+	// The parameters did not move while the storage grew
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		CHECK(seek->getBehaviorParams(i * 3) == params[i]);
+		CHECK(params[i]->targetID == i);
+	}
+
+	SECTION("Looking up parameters does not allocate memory")
+	{
+		countedAllocations = 0;
+		dtAllocSetCustom(countingAlloc, 0);
+
+		for (unsigned i = 0; i < nbAgents * 3; ++i)
+		{
+			seek->findBehaviorParams(i);
+			seek->findBehaviorParams(i + 100000);
+		}
+
+		for (unsigned i = 0; i < nbAgents; ++i)
+			seek->getBehaviorParams(i * 3);
+
+		dtAllocSetCustom(0, 0);
+		CHECK(countedAllocations == 0);
+	}
+
+	SECTION("Finding parameters does not create them")
+	{
+		CHECK(seek->findBehaviorParams(1) == 0);
+		CHECK(seek->findBehaviorParams(nbAgents * 10) == 0);
+		CHECK(seek->findBehaviorParams(3) == params[1]);
+		CHECK(seek->getBehaviorParamsCount() == nbAgents);
+	}
+
+	SECTION("Removed parameters are not found anymore and their memory is reused")
+	{
+		CHECK(seek->removeBehaviorParams(3));
+		CHECK_FALSE(seek->removeBehaviorParams(3));
+		CHECK_FALSE(seek->removeBehaviorParams(1));
+		CHECK(seek->findBehaviorParams(3) == 0);
+		CHECK(seek->getBehaviorParamsCount() == nbAgents - 1);
+
+		countedAllocations = 0;
+		dtAllocSetCustom(countingAlloc, 0);
+
+		dtSeekBehaviorParams* reused = seek->getBehaviorParams(1);
+
+		dtAllocSetCustom(0, 0);
+		CHECK(countedAllocations == 0);
+		CHECK(reused == params[1]);
+		CHECK(seek->findBehaviorParams(1) == reused);
+		CHECK(seek->getBehaviorParamsCount() == nbAgents);
+
+		// The other parameters were not affected
+		for (unsigned i = 2; i < nbAgents; ++i)
+			CHECK(seek->findBehaviorParams(i * 3)->targetID == i);
+	}
+
+	dtSeekBehavior::free(seek);
+}
+
+TEST_CASE("DetourCrowdTest/PathQueue", "The path queue must serve its requests by priority and share its iterations between its searches")
+{
+	TestScene scene;
+	dtCrowd* crowd = scene.createSquareScene(1, 0.5f);
+	REQUIRE(crowd != 0);
+
+	const dtCrowdQuery* query = crowd->getCrowdQuery();
+	const float startPos[] = {-18.f, 0, -18.f};
+	const float endPos[] = {18.f, 0, 18.f};
+	dtPolyRef startRef = 0, endRef = 0;
+	float nearest[3];
+
+	query->getNavMeshQuery()->findNearestPoly(startPos, query->getQueryExtents(), query->getQueryFilter(), &startRef, nearest);
+	query->getNavMeshQuery()->findNearestPoly(endPos, query->getQueryExtents(), query->getQueryFilter(), &endRef, nearest);
+	REQUIRE(startRef != 0);
+	REQUIRE(endRef != 0);
+	REQUIRE(startRef != endRef);
+
+	dtPolyRef path[256];
+	int pathSize = 0;
+
+	SECTION("Capacity", "The queue accepts as many requests as its capacity")
+	{
+		dtPathQueue queue;
+		REQUIRE(queue.init(256, 512, scene.getNavMesh(), 100));
+		CHECK(queue.getMaxRequests() == 100);
+
+		std::vector<dtPathQueueRef> refs;
+
+		for (int i = 0; i < 100; ++i)
+		{
+			refs.push_back(queue.request(startRef, endRef, startPos, endPos, query->getQueryFilter()));
+			CHECK(refs.back() != DT_PATHQ_INVALID);
+		}
+
+		CHECK(queue.getPendingCount() == 100);
+		CHECK(queue.request(startRef, endRef, startPos, endPos, query->getQueryFilter()) == DT_PATHQ_INVALID);
+
+		// Every request is eventually computed
+		std::vector<bool> read(100, false);
+		int nbResults = 0;
+
+		for (int i = 0; i < 1000 && nbResults < 100; ++i)
+		{
+			queue.update(100);
+
+			for (int j = 0; j < 100; ++j)
+			{
+				if (read[j] || queue.getRequestStatus(refs[j]) == 0 || dtStatusInProgress(queue.getRequestStatus(refs[j])))
+					continue;
+
+				read[j] = true;
+
+				CHECK(dtStatusSucceed(queue.getRequestStatus(refs[j])));
+				CHECK(dtStatusSucceed(queue.getPathResult(refs[j], path, &pathSize, 256)));
+				CHECK(pathSize > 1);
+				CHECK(path[0] == startRef);
+				CHECK(path[pathSize - 1] == endRef);
+				++nbResults;
+			}
+		}
+
+		CHECK(nbResults == 100);
+
+		// The handles of the released requests are not valid anymore, even if their slots are reused
+		const dtPathQueueRef ref = queue.request(startRef, endRef, startPos, endPos, query->getQueryFilter());
+		CHECK(ref != DT_PATHQ_INVALID);
+		CHECK(std::find(refs.begin(), refs.end(), ref) == refs.end());
+
+		for (int i = 0; i < 100; ++i)
+		{
+			CHECK(queue.getRequestStatus(refs[i]) == DT_FAILURE);
+			CHECK(queue.getPathResult(refs[i], path, &pathSize, 256) == DT_FAILURE);
+		}
+	}
+
+	SECTION("Priorities", "The requests with the lowest priority are served first, then the oldest ones")
+	{
+		dtPathQueue queue;
+		REQUIRE(queue.init(256, 512, scene.getNavMesh(), 8));
+
+		const float priorities[] = {2.f, 0.f, 1.f, 0.f, -1.f};
+		const int expectedOrder[] = {4, 1, 3, 2, 0};
+		dtPathQueueRef refs[5];
+
+		for (int i = 0; i < 5; ++i)
+			refs[i] = queue.request(startRef, endRef, startPos, endPos, query->getQueryFilter(), priorities[i]);
+
+		// A single iteration is allowed per update, so the requests are computed one at a time
+		int next = 0;
+
+		for (int i = 0; i < 1000 && next < 5; ++i)
+		{
+			queue.update(1);
+
+			for (int j = next + 1; j < 5; ++j)
+				CHECK(queue.getRequestStatus(refs[expectedOrder[j]]) == 0);
+
+			if (dtStatusSucceed(queue.getRequestStatus(refs[expectedOrder[next]])))
+			{
+				CHECK(dtStatusSucceed(queue.getPathResult(refs[expectedOrder[next]], path, &pathSize, 256)));
+				++next;
+			}
+		}
+
+		CHECK(next == 5);
+	}
+
+	SECTION("Concurrent searches", "The iterations of an update are shared between the searches")
+	{
+		dtPathQueue queue;
+		REQUIRE(queue.init(256, 512, scene.getNavMesh(), 8, 2));
+
+		const dtPathQueueRef first = queue.request(startRef, endRef, startPos, endPos, query->getQueryFilter());
+		const dtPathQueueRef second = queue.request(endRef, startRef, endPos, startPos, query->getQueryFilter());
+		const dtPathQueueRef third = queue.request(startRef, endRef, startPos, endPos, query->getQueryFilter());
+
+		queue.update(2);
+
+		// Both searches started, the third request waits for one of them to be done
+		CHECK(queue.getPendingCount() == 1);
+		CHECK(queue.getRequestStatus(first) != 0);
+		CHECK(queue.getRequestStatus(second) != 0);
+		CHECK(queue.getRequestStatus(third) == 0);
+
+		// The first two searches progress at the same pace
+		while (dtStatusInProgress(queue.getRequestStatus(first)))
+		{
+			CHECK(dtStatusInProgress(queue.getRequestStatus(second)));
+			queue.update(2);
+		}
+
+		CHECK(dtStatusSucceed(queue.getPathResult(first, path, &pathSize, 256)));
+		CHECK(path[pathSize - 1] == endRef);
+		CHECK(dtStatusSucceed(queue.getPathResult(second, path, &pathSize, 256)));
+		CHECK(path[pathSize - 1] == startRef);
+
+		queue.update(1000);
+
+		CHECK(dtStatusSucceed(queue.getPathResult(third, path, &pathSize, 256)));
+		CHECK(path[pathSize - 1] == endRef);
+	}
+
+	SECTION("Unread results", "The results which are not read are eventually released")
+	{
+		dtPathQueue queue;
+		REQUIRE(queue.init(256, 512, scene.getNavMesh(), 1));
+
+		const dtPathQueueRef ref = queue.request(startRef, endRef, startPos, endPos, query->getQueryFilter());
+		CHECK(queue.request(startRef, endRef, startPos, endPos, query->getQueryFilter()) == DT_PATHQ_INVALID);
+
+		for (int i = 0; i < 100; ++i)
+			queue.update(100);
+
+		CHECK(queue.getRequestStatus(ref) == DT_FAILURE);
+		CHECK(queue.request(startRef, endRef, startPos, endPos, query->getQueryFilter()) != DT_PATHQ_INVALID);
+	}
+}
+
 TEST_CASE("DetourCrowdTest/InitCrowd", "Test whether the initialization of a crowd is successful")
 {
 	dtCrowd crowd;
@@ -152,3 +152,184 @@ TEST_CASE("DetourPipelineTest/Pipeline", "Tests about the pipeline behavior")
 	dtPathFollowing::free(pf);
 	dtPipelineBehavior::free(pipeline);
 }
+
+/// Behavior counting the calls made by the crowd
+class CountingBehavior : public dtBehavior
+{
+public:
+	CountingBehavior() : nbPreUpdates(0), nbUpdates(0), nbPostUpdates(0) {}
+
+	virtual void update(const dtCrowdQuery&, const dtCrowdAgent&, dtCrowdAgent&, float)
+	{
+		// The update of the agents happens between the hooks
+		CHECK(nbPreUpdates == nbPostUpdates + 1);
+		++nbUpdates;
+	}
+
+	int nbPreUpdates;
+	int nbUpdates;
+	int nbPostUpdates;
+
+protected:
+	virtual void doPreUpdate(const dtCrowdQuery&, float) { ++nbPreUpdates; }
+	virtual void doPostUpdate(const dtCrowdQuery&, float) { ++nbPostUpdates; }
+};
+
+TEST_CASE("DetourPipelineTest/UpdateHooks", "The behaviors are prepared and finished once per update of the crowd")
+{
+	TestScene ts;
+	dtCrowd* crowd = ts.createSquareScene(10, 0.5);
+
+	REQUIRE(crowd != 0);
+
+	CountingBehavior counter;
+	dtBehavior* behaviors[] = {&counter, &counter};
+
+	// Each agent has its own pipeline, and every pipeline contains the same behavior twice
+	dtPipelineBehavior pipelines[10];
+
+	for (int i = 0; i < 10; ++i)
+	{
+		float pos[] = {-9.f + 2.f * i, 0, 0};
+		dtCrowdAgent ag;
+
+		REQUIRE(crowd->addAgent(ag, pos));
+		ts.defaultInitializeAgent(*crowd, ag.id);
+		REQUIRE(pipelines[i].setBehaviors(behaviors, 2));
+		crowd->setAgentBehavior(ag.id, &pipelines[i]);
+	}
+
+	for (int frame = 1; frame <= 5; ++frame)
+	{
+		crowd->update(0.1f);
+
+		CHECK(counter.nbPreUpdates == frame);
+		CHECK(counter.nbUpdates == frame * 20);
+		CHECK(counter.nbPostUpdates == frame);
+	}
+
+	// Calling the hooks again during the same update has no effect
+	counter.preUpdate(*crowd->getCrowdQuery(), 0.1f);
+	counter.postUpdate(*crowd->getCrowdQuery(), 0.1f);
+
+	CHECK(counter.nbPreUpdates == 5);
+	CHECK(counter.nbPostUpdates == 5);
+
+	// Only the agents being updated count
+	unsigned idx = 3;
+	crowd->updateVelocity(0.1f, &idx, 1);
+
+	CHECK(counter.nbPreUpdates == 6);
+	CHECK(counter.nbUpdates == 102);
+	CHECK(counter.nbPostUpdates == 6);
+}
+
+TEST_CASE("DetourPipelineTest/StaticPipeline", "A static pipeline must give the same results as a pipeline built at runtime")
+{
+	const unsigned nbAgents = 6;
+
+	TestScene dynamicScene, staticScene;
+	dtCrowd* crowds[] = {dynamicScene.createSquareScene(nbAgents, 0.5f), staticScene.createSquareScene(nbAgents, 0.5f)};
+	TestScene* scenes[] = {&dynamicScene, &staticScene};
+
+	REQUIRE(crowds[0] != 0);
+	REQUIRE(crowds[1] != 0);
+
+	dtPathFollowing* pf[2];
+	dtCollisionAvoidance* ca[2];
+
+	for (int c = 0; c < 2; ++c)
+	{
+		pf[c] = dtPathFollowing::allocate(nbAgents);
+		ca[c] = dtCollisionAvoidance::allocate(nbAgents);
+
+		REQUIRE(pf[c]->init(*crowds[c]->getCrowdQuery()));
+		REQUIRE(ca[c]->init());
+
+		for (unsigned i = 0; i < nbAgents; ++i)
+		{
+			float pos[] = {-8.f + 3.f * i, 0, -5.f};
+			float dest[] = {8.f - 3.f * i, 0, 5.f};
+			dtCrowdAgent ag;
+
+			REQUIRE(crowds[c]->addAgent(ag, pos));
+			scenes[c]->defaultInitializeAgent(*crowds[c], ag.id);
+
+			dtPolyRef destRef;
+			float nearest[3];
+			crowds[c]->getCrowdQuery()->getNavMeshQuery()->findNearestPoly(dest, crowds[c]->getCrowdQuery()->getQueryExtents(), 
+																			crowds[c]->getCrowdQuery()->getQueryFilter(), &destRef, nearest);
+			REQUIRE(destRef != 0);
+			REQUIRE(pf[c]->requestMoveTarget(ag.id, destRef, nearest));
+
+			dtCollisionAvoidanceParams* params = ca[c]->getBehaviorParams(ag.id);
+			REQUIRE(params != 0);
+			params->velBias = 0.4f;
+			params->weightDesVel = 2.0f;
+			params->weightCurVel = 0.75f;
+			params->weightSide = 0.75f;
+			params->weightToi = 2.5f;
+			params->horizTime = 2.5f;
+			params->gridSize = 33;
+			params->adaptiveDivs = 7;
+			params->adaptiveRings = 2;
+			params->adaptiveDepth = 5;
+		}
+	}
+
+	dtPipelineBehavior* pipeline = dtPipelineBehavior::allocate();
+	dtBehavior* behaviors[] = {pf[0], ca[0]};
+	REQUIRE(pipeline->setBehaviors(behaviors, 2));
+
+	dtStaticPipeline<dtPathFollowing, dtCollisionAvoidance>* staticPipeline = 
+		dtStaticPipeline<dtPathFollowing, dtCollisionAvoidance>::allocate(pf[1], ca[1]);
+	REQUIRE(staticPipeline != 0);
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		crowds[0]->setAgentBehavior(crowds[0]->getAgent(i)->id, pipeline);
+		crowds[1]->setAgentBehavior(crowds[1]->getAgent(i)->id, staticPipeline);
+	}
+
+	for (int frame = 0; frame < 30; ++frame)
+	{
+		crowds[0]->update(0.1f);
+		crowds[1]->update(0.1f);
+	}
+
+	for (unsigned i = 0; i < nbAgents; ++i)
+	{
+		const dtCrowdAgent* dynamicAgent = crowds[0]->getAgent(i);
+		const dtCrowdAgent* staticAgent = crowds[1]->getAgent(i);
+
+		CHECK(dtVequal(dynamicAgent->position, staticAgent->position));
+		CHECK(dtVequal(dynamicAgent->velocity, staticAgent->velocity));
+	}
+
+	// The agents moved
+	CHECK(crowds[1]->getAgent(0)->position[2] > -4.f);
+
+	SECTION("The stages of a static pipeline are prepared and finished once per update")
+	{
+		CountingBehavior counter;
+		dtStaticPipeline<CountingBehavior, dtNullStage, CountingBehavior> countingPipeline(&counter, 0, &counter);
+
+		for (unsigned i = 0; i < nbAgents; ++i)
+			crowds[1]->setAgentBehavior(crowds[1]->getAgent(i)->id, &countingPipeline);
+
+		crowds[1]->update(0.1f);
+
+		CHECK(counter.nbPreUpdates == 1);
+		CHECK(counter.nbUpdates == (int) nbAgents * 2);
+		CHECK(counter.nbPostUpdates == 1);
+	}
+
+	dtStaticPipeline<dtPathFollowing, dtCollisionAvoidance>::free(staticPipeline);
+	dtPipelineBehavior::free(pipeline);
+
+	for (int c = 0; c < 2; ++c)
+	{
+		dtPathFollowing::free(pf[c]);
+		dtCollisionAvoidance::free(ca[c]);
+	}
+}
@@ -28,5 +28,6 @@ typedef __int64 TimeVal;
 
 TimeVal getPerfTime();
 int getPerfDeltaTimeUsec(const TimeVal start, const TimeVal end);
+TimeVal getPerfDeltaTimeNsec(const TimeVal start, const TimeVal end);
 
 #endif // PERFTIMER_H
\ No newline at end of file
@@ -88,7 +88,7 @@ void BuildContext::doStartTimer(const rcTimerLabel label)
 void BuildContext::doStopTimer(const rcTimerLabel label)
 {
 	const TimeVal endTime = getPerfTime();
-	const int deltaTime = (int)(endTime - m_startTime[label]);
+	const int deltaTime = getPerfDeltaTimeUsec(m_startTime[label], endTime);
 	if (m_accTime[label] == -1)
 		m_accTime[label] = deltaTime;
 	else
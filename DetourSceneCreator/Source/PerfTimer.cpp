@@ -39,22 +39,49 @@ int getPerfDeltaTimeUsec(const TimeVal start, const TimeVal end)
 	return (int)(elapsed*1000000 / freq);
 }
 
+TimeVal getPerfDeltaTimeNsec(const TimeVal start, const TimeVal end)
+{
+	static __int64 freq = 0;
+	if (freq == 0)
+		QueryPerformanceFrequency((LARGE_INTEGER*)&freq);
+	__int64 elapsed = end - start;
+	return (TimeVal)((double)elapsed*1000000000.0 / (double)freq);
+}
+
 #else
 
 // Linux, BSD, OSX
 
-#include <sys/time.h>
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
 
+// The time is counted in nanoseconds
 TimeVal getPerfTime()
 {
-	timeval now;
-	gettimeofday(&now, 0);
-	return (TimeVal)now.tv_sec*1000000L + (TimeVal)now.tv_usec;
+#if defined(__APPLE__)
+	static mach_timebase_info_data_t timebase = {0, 0};
+	if (!timebase.denom)
+		mach_timebase_info(&timebase);
+
+	return (TimeVal)(mach_absolute_time() * timebase.numer / timebase.denom);
+#else
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (TimeVal)now.tv_sec*1000000000L + (TimeVal)now.tv_nsec;
+#endif
 }
 
 int getPerfDeltaTimeUsec(const TimeVal start, const TimeVal end)
 {
-	return (int)(end - start);
+	return (int)((end - start) / 1000);
+}
+
+TimeVal getPerfDeltaTimeNsec(const TimeVal start, const TimeVal end)
+{
+	return end - start;
 }
 
 #endif
@@ -434,20 +434,17 @@ void CrowdToolState::handleRenderOverlay(double* proj, double* model, int* view)
 			if (pool)
 			{
 				const float off = 0.5f;
-				for (int i = 0; i < pool->getHashSize(); ++i)
+				for (int i = 1; i <= pool->getNodeCount(); ++i)
 				{
-					for (dtNodeIndex j = pool->getFirst(i); j != DT_NULL_IDX; j = pool->getNext(j))
+					const dtNode* node = pool->getNodeAtIdx(i);
+					if (!node) continue;
+
+					if (gluProject((GLdouble)node->pos[0],(GLdouble)node->pos[1]+off,(GLdouble)node->pos[2],
+								   model, proj, view, &x, &y, &z))
 					{
-						const dtNode* node = pool->getNodeAtIdx(j+1);
-						if (!node) continue;
-
-						if (gluProject((GLdouble)node->pos[0],(GLdouble)node->pos[1]+off,(GLdouble)node->pos[2],
-									   model, proj, view, &x, &y, &z))
-						{
-							const float heuristic = node->total;// - node->cost;
-							snprintf(label, 32, "%.2f", heuristic);
-							imguiDrawText((int)x, (int)y+15, IMGUI_ALIGN_CENTER, label, imguiRGBA(0,0,0,220));
-						}
+						const float heuristic = node->total;// - node->cost;
+						snprintf(label, 32, "%.2f", heuristic);
+						imguiDrawText((int)x, (int)y+15, IMGUI_ALIGN_CENTER, label, imguiRGBA(0,0,0,220));
 					}
 				}
 			}